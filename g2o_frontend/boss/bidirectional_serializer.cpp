@@ -21,8 +21,23 @@ namespace boss {
   }
   
   std::istream* BidirectionalSerializer::getBinaryInputStream(const std::string& fname){
+    //A BLOB written in background may not be on disk yet
+    Serializer::flush();
     return Deserializer::getBinaryInputStream(fname);
   }
 
+  bool BidirectionalSerializer::writePackedBLOB(BaseBLOBReference& instance, BLOB& blob, BLOBLocation& location){
+    return Serializer::writePackedBLOB(instance, blob, location);
+  }
+
+  std::istream* BidirectionalSerializer::getPackedBLOBInputStream(const BLOBLocation& location){
+    Serializer::flush();
+    return Deserializer::getPackedBLOBInputStream(location);
+  }
+
+  bool BidirectionalSerializer::writeBLOBAsync(BaseBLOBReference& instance, BLOB& blob, ObjectData& data, AsyncBLOBLocation*& location){
+    return Serializer::writeBLOBAsync(instance, blob, data, location);
+  }
+
   
 }
@@ -59,6 +59,9 @@ class ObjectWriter;
 
   virtual std::ostream* getBinaryOutputStream(const std::string& fname);
   virtual std::istream* getBinaryInputStream(const std::string& fname);
+  virtual bool writePackedBLOB(BaseBLOBReference& instance, BLOB& blob, BLOBLocation& location);
+  virtual std::istream* getPackedBLOBInputStream(const BLOBLocation& location);
+  virtual bool writeBLOBAsync(BaseBLOBReference& instance, BLOB& blob, ObjectData& data, AsyncBLOBLocation*& location);
 
 };
 
@@ -0,0 +1,440 @@
+/*
+    <one line to give the program's name and a brief idea of what it does.>
+    Copyright (C) 2013  <copyright holder> <email>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include "binary_format.h"
+#include "object_data.h"
+
+using namespace std;
+using namespace boss;
+
+static const double MAX_BINARY_INT=2147483647.0;
+//Integers up to 2^24 are represented exactly by a float
+static const double MAX_FLOAT_INT=16777216.0;
+
+bool boss::isBinaryFormat(istream& is) {
+  return is.peek()==BINARY_RECORD_SYNC;
+}
+
+static bool isInteger(double v) {
+  return floor(v)==v && fabs(v)<=MAX_BINARY_INT;
+}
+
+static BinaryValueTag numberTag(ValueData* val) {
+  double v=val->getDouble();
+  if (isInteger(v)) {
+    return BINARY_INT;
+  }
+  if (static_cast<NumberData*>(val)->precision()<=numeric_limits<float>::digits10) {
+    return BINARY_FLOAT;
+  }
+  return BINARY_DOUBLE;
+}
+
+//Numeric arrays are stored packed, with the narrowest representation that
+//keeps all the elements (and their precision when written back to JSON);
+//an array mixing float and double elements keeps the tag of each element
+static BinaryValueTag arrayTag(ArrayData* v_array) {
+  if (!v_array->size()) {
+    return BINARY_ARRAY;
+  }
+  bool allInt=true;
+  bool anyFloat=false;
+  bool anyDouble=false;
+  for (vector<ValueData*>::const_iterator v_it=v_array->begin();v_it!=v_array->end();v_it++) {
+    if ((*v_it)->type()!=NUMBER) {
+      return BINARY_ARRAY;
+    }
+    BinaryValueTag tag=numberTag(*v_it);
+    if (tag!=BINARY_INT) {
+      allInt=false;
+    } else if (fabs((*v_it)->getDouble())>MAX_FLOAT_INT) {
+      anyDouble=true;
+    }
+    if (tag==BINARY_FLOAT) {
+      anyFloat=true;
+    } else if (tag==BINARY_DOUBLE) {
+      anyDouble=true;
+    }
+  }
+  if (allInt) {
+    return BINARY_INT_ARRAY;
+  }
+  if (anyFloat && anyDouble) {
+    return BINARY_ARRAY;
+  }
+  return anyFloat?BINARY_FLOAT_ARRAY:BINARY_DOUBLE_ARRAY;
+}
+
+void BinaryEncoder::begin() {
+  _buffer.clear();
+  _names.clear();
+}
+
+void BinaryEncoder::writeRaw(const void* data, size_t size) {
+  _buffer.append(static_cast<const char*>(data),size);
+}
+
+void BinaryEncoder::writeVarint(uint64_t v) {
+  while (v>=0x80) {
+    _buffer.push_back(static_cast<char>((v&0x7f)|0x80));
+    v>>=7;
+  }
+  _buffer.push_back(static_cast<char>(v));
+}
+
+void BinaryEncoder::writeInt(int64_t v) {
+  //Zigzag encoding, small negative numbers take few bytes as well
+  writeVarint((static_cast<uint64_t>(v)<<1)^static_cast<uint64_t>(v>>63));
+}
+
+void BinaryEncoder::writeFloat(float v) {
+  writeRaw(&v,sizeof(v));
+}
+
+void BinaryEncoder::writeDouble(double v) {
+  writeRaw(&v,sizeof(v));
+}
+
+void BinaryEncoder::writeString(const string& str) {
+  writeVarint(str.size());
+  writeRaw(str.data(),str.size());
+}
+
+void BinaryEncoder::writeName(const string& name) {
+  map<string, uint64_t>::iterator it=_names.find(name);
+  if (it!=_names.end()) {
+    writeVarint(it->second+1);
+    return;
+  }
+  //First occurrence in this record: 0 followed by the name
+  writeVarint(0);
+  writeString(name);
+  uint64_t idx=_names.size();
+  _names.insert(make_pair(name,idx));
+}
+
+void BinaryEncoder::writeValue(ValueData* val) {
+  switch (val->type()) {
+  case BOOL:
+    _buffer.push_back(static_cast<char>(val->getBool()?BINARY_TRUE:BINARY_FALSE));
+    break;
+  case NUMBER: {
+    BinaryValueTag tag=numberTag(val);
+    _buffer.push_back(static_cast<char>(tag));
+    if (tag==BINARY_INT) {
+      writeInt(static_cast<int64_t>(val->getDouble()));
+    } else if (tag==BINARY_FLOAT) {
+      writeFloat(val->getFloat());
+    } else {
+      writeDouble(val->getDouble());
+    }
+    break;
+  }
+  case STRING:
+    _buffer.push_back(static_cast<char>(BINARY_STRING));
+    writeString(val->getString());
+    break;
+  case ARRAY: {
+    ArrayData* v_array=static_cast<ArrayData*>(val);
+    BinaryValueTag tag=arrayTag(v_array);
+    _buffer.push_back(static_cast<char>(tag));
+    writeVarint(v_array->size());
+    for (vector<ValueData*>::const_iterator v_it=v_array->begin();v_it!=v_array->end();v_it++) {
+      switch (tag) {
+      case BINARY_INT_ARRAY:
+        writeInt(static_cast<int64_t>((*v_it)->getDouble()));
+        break;
+      case BINARY_FLOAT_ARRAY:
+        writeFloat((*v_it)->getFloat());
+        break;
+      case BINARY_DOUBLE_ARRAY:
+        writeDouble((*v_it)->getDouble());
+        break;
+      default:
+        writeValue(*v_it);
+      }
+    }
+    break;
+  }
+  case NUMERIC_ARRAY: {
+    NumericArrayData& n_array=val->getNumericArray();
+    _buffer.push_back(static_cast<char>(n_array.isFloat()?BINARY_FLOAT_ARRAY:BINARY_DOUBLE_ARRAY));
+    writeVarint(n_array.size());
+    if (n_array.isFloat()) {
+      writeRaw(n_array.floats(),n_array.size()*sizeof(float));
+    } else {
+      writeRaw(n_array.doubles(),n_array.size()*sizeof(double));
+    }
+    break;
+  }
+  case OBJECT: {
+    ObjectData* o=static_cast<ObjectData*>(val);
+    //Pointers are written as { "#pointer" : id }, store them as a single tagged integer
+    if (o->numFields()==1 && o->fieldName(0)=="#pointer" && o->fieldValue(0)->type()==NUMBER) {
+      _buffer.push_back(static_cast<char>(BINARY_POINTER));
+      writeInt(o->fieldValue(0)->getInt());
+      break;
+    }
+    _buffer.push_back(static_cast<char>(BINARY_OBJECT));
+    writeVarint(o->numFields());
+    for (size_t i=0;i<o->numFields();i++) {
+      writeName(o->fieldName(i));
+      writeValue(o->fieldValue(i));
+    }
+    break;
+  }
+  case POINTER: {
+    Identifiable* pointer=val->getPointer();
+    _buffer.push_back(static_cast<char>(BINARY_POINTER));
+    writeInt(pointer?pointer->getId():-1);
+    break;
+  }
+  default:
+    throw logic_error("unexpected value type: "+val->typeName());
+  }
+}
+
+void BinaryEncoder::end(ostream& os, unsigned char kind) {
+  os.put(static_cast<char>(BINARY_RECORD_SYNC));
+  os.put(static_cast<char>(kind));
+  string payload;
+  payload.swap(_buffer);
+  writeVarint(payload.size());
+  os.write(_buffer.data(),_buffer.size());
+  os.write(payload.data(),payload.size());
+  _buffer.clear();
+  _names.clear();
+}
+
+bool BinaryDecoder::readRecord(istream& is, unsigned char& kind) {
+  int sync=is.get();
+  if (!is || sync!=BINARY_RECORD_SYNC) {
+    return false;
+  }
+  kind=static_cast<unsigned char>(is.get());
+  uint64_t size=0;
+  int shift=0;
+  while (true) {
+    int c=is.get();
+    if (!is || shift>=64) {
+      return false;
+    }
+    size|=static_cast<uint64_t>(c&0x7f)<<shift;
+    if (!(c&0x80)) {
+      break;
+    }
+    shift+=7;
+  }
+  if (size>BINARY_MAX_RECORD_SIZE) {
+    return false;
+  }
+  // the buffer grows with the data actually read, so a corrupt length
+  // cannot allocate more than what is left in the stream
+  const size_t chunk=1<<20;
+  size_t read=0;
+  _buffer.clear();
+  while (read<size) {
+    size_t n=std::min(static_cast<size_t>(size)-read,chunk);
+    _buffer.resize(read+n);
+    is.read(&_buffer[read],n);
+    if (static_cast<size_t>(is.gcount())!=n) {
+      return false;
+    }
+    read+=n;
+  }
+  setRecord(size?&_buffer[0]:0,size);
+  return true;
+}
+
+BinaryDecoder::BinaryDecoder(): _data(0), _size(0), _pos(0), _arena(0) {}
+
+void BinaryDecoder::setRecord(const char* data, size_t size) {
+  _data=data;
+  _size=size;
+  _pos=0;
+  _names.clear();
+}
+
+void BinaryDecoder::readRaw(void* data, size_t size) {
+  if (_pos+size>_size) {
+    throw runtime_error("truncated binary record");
+  }
+  memcpy(data,_data+_pos,size);
+  _pos+=size;
+}
+
+uint64_t BinaryDecoder::readVarint() {
+  uint64_t v=0;
+  int shift=0;
+  while (true) {
+    if (_pos>=_size || shift>=64) {
+      throw runtime_error("truncated binary record");
+    }
+    unsigned char c=static_cast<unsigned char>(_data[_pos++]);
+    v|=static_cast<uint64_t>(c&0x7f)<<shift;
+    if (!(c&0x80)) {
+      return v;
+    }
+    shift+=7;
+  }
+}
+
+int64_t BinaryDecoder::readInt() {
+  uint64_t v=readVarint();
+  return static_cast<int64_t>(v>>1)^-static_cast<int64_t>(v&1);
+}
+
+float BinaryDecoder::readFloat() {
+  float v;
+  readRaw(&v,sizeof(v));
+  return v;
+}
+
+double BinaryDecoder::readDouble() {
+  double v;
+  readRaw(&v,sizeof(v));
+  return v;
+}
+
+string BinaryDecoder::readString() {
+  uint64_t size=readVarint();
+  if (_pos+size>_size) {
+    throw runtime_error("truncated binary record");
+  }
+  string str(_data+_pos,size);
+  _pos+=size;
+  return str;
+}
+
+const string* BinaryDecoder::readName() {
+  uint64_t idx=readVarint();
+  if (!idx) {
+    _names.push_back(ObjectData::internName(readString()));
+    return _names.back();
+  }
+  if (idx>_names.size()) {
+    throw runtime_error("bad name reference in binary record");
+  }
+  return _names[idx-1];
+}
+
+ObjectData* BinaryDecoder::readObject() {
+  ValueArena* arena=new ValueArena();
+  _arena=arena;
+  ValueData* data=0;
+  try {
+    data=readValue();
+  } catch (...) {
+    _arena=0;
+    delete arena;
+    throw;
+  }
+  _arena=0;
+  if (data->type()!=OBJECT) {
+    delete data;
+    delete arena;
+    return 0;
+  }
+  return ObjectData::makeRoot(static_cast<ObjectData*>(data),arena);
+}
+
+ValueData* BinaryDecoder::readValue() {
+  if (_pos>=_size) {
+    throw runtime_error("truncated binary record");
+  }
+  BinaryValueTag tag=static_cast<BinaryValueTag>(_data[_pos++]);
+  switch (tag) {
+  case BINARY_FALSE:
+    return new (_arena) BoolData(false);
+  case BINARY_TRUE:
+    return new (_arena) BoolData(true);
+  case BINARY_INT:
+    return new (_arena) NumberData(static_cast<int>(readInt()));
+  case BINARY_FLOAT:
+    return new (_arena) NumberData(readFloat());
+  case BINARY_DOUBLE:
+    return new (_arena) NumberData(readDouble());
+  case BINARY_STRING:
+    return new (_arena) StringData(readString());
+  case BINARY_POINTER: {
+    ObjectData* pointerObject=new (_arena) ObjectData(_arena);
+    pointerObject->setInt("#pointer",static_cast<int>(readInt()));
+    return pointerObject;
+  }
+  case BINARY_FLOAT_ARRAY:
+  case BINARY_DOUBLE_ARRAY: {
+    //Read in place, as a single block
+    uint64_t size=readVarint();
+    size_t elementSize=(tag==BINARY_FLOAT_ARRAY)?sizeof(float):sizeof(double);
+    if (size>(_size-_pos)/elementSize) {
+      throw runtime_error("truncated binary record");
+    }
+    NumericArrayData* n_array=new (_arena) NumericArrayData(size,tag==BINARY_FLOAT_ARRAY,_arena);
+    if (tag==BINARY_FLOAT_ARRAY) {
+      readRaw(n_array->floats(),size*elementSize);
+    } else {
+      readRaw(n_array->doubles(),size*elementSize);
+    }
+    return n_array;
+  }
+  case BINARY_ARRAY:
+  case BINARY_INT_ARRAY: {
+    uint64_t size=readVarint();
+    if (size>_size-_pos) {
+      throw runtime_error("truncated binary record");
+    }
+    ArrayData* v_array=new (_arena) ArrayData(_arena);
+    v_array->reserve(size);
+    try {
+      for (uint64_t i=0;i<size;i++) {
+        if (tag==BINARY_INT_ARRAY) {
+          v_array->add(static_cast<int>(readInt()));
+        } else {
+          v_array->add(readValue());
+        }
+      }
+    } catch (...) {
+      delete v_array;
+      throw;
+    }
+    return v_array;
+  }
+  case BINARY_OBJECT: {
+    uint64_t size=readVarint();
+    ObjectData* o=new (_arena) ObjectData(_arena);
+    try {
+      for (uint64_t i=0;i<size;i++) {
+        const string* name=readName();
+        o->setField(name,readValue());
+      }
+    } catch (...) {
+      delete o;
+      throw;
+    }
+    return o;
+  }
+  default:
+    throw runtime_error("unknown value tag in binary record");
+  }
+}
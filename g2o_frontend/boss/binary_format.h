@@ -0,0 +1,128 @@
+/*
+    <one line to give the program's name and a brief idea of what it does.>
+    Copyright (C) 2013  <copyright holder> <email>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef BOSS_BINARY_FORMAT_H
+#define BOSS_BINARY_FORMAT_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+
+namespace boss {
+
+class ValueData;
+class ObjectData;
+class ValueArena;
+
+/*
+ * Binary log format.
+ * Each record is self contained: a sync byte, the record kind, the length of the payload
+ * as a varint, and the payload. Integers are zigzag varints, floating point numbers and
+ * numeric arrays are stored raw (little endian), field names are interned within the record.
+ * Since the records do not depend on each other, a reader can start at any record boundary.
+ */
+const unsigned char BINARY_RECORD_SYNC=0xb5;
+const unsigned char BINARY_MESSAGE_RECORD='M';
+const unsigned char BINARY_OBJECT_RECORD='O';
+/*
+ * Records longer than this are rejected as corrupt (BLOB payloads are not stored in records).
+ */
+const uint64_t BINARY_MAX_RECORD_SIZE=1<<28;
+
+enum BinaryValueTag {
+  BINARY_FALSE, BINARY_TRUE, BINARY_INT, BINARY_FLOAT, BINARY_DOUBLE, BINARY_STRING,
+  BINARY_ARRAY, BINARY_OBJECT, BINARY_POINTER, BINARY_INT_ARRAY, BINARY_FLOAT_ARRAY, BINARY_DOUBLE_ARRAY
+};
+
+/*
+ * Returns true if the stream starts with a binary record (the stream position is not changed).
+ */
+bool isBinaryFormat(std::istream& is);
+
+class BinaryEncoder {
+public:
+  /*
+   * Start a new record.
+   */
+  void begin();
+  void writeVarint(uint64_t v);
+  void writeInt(int64_t v);
+  void writeFloat(float v);
+  void writeDouble(double v);
+  void writeString(const std::string& str);
+  void writeName(const std::string& name);
+  void writeValue(ValueData* value);
+  /*
+   * Write the current record to the stream.
+   */
+  void end(std::ostream& os, unsigned char kind);
+
+protected:
+  void writeRaw(const void* data, size_t size);
+
+  std::string _buffer;
+  std::map<std::string, uint64_t> _names;
+};
+
+class BinaryDecoder {
+public:
+  BinaryDecoder();
+
+  /*
+   * Read a whole record from the stream.
+   * Return false on EOF or if the record is malformed.
+   */
+  bool readRecord(std::istream& is, unsigned char& kind);
+  /*
+   * Use a record already in memory, data must stay valid while decoding.
+   */
+  void setRecord(const char* data, size_t size);
+
+  //The following throw std::runtime_error if the record is truncated
+  uint64_t readVarint();
+  int64_t readInt();
+  float readFloat();
+  double readDouble();
+  std::string readString();
+  //Interned name (see ObjectData::internName())
+  const std::string* readName();
+  ValueData* readValue();
+  /*
+   * Read a value which must be an object, with the whole tree allocated in an arena
+   * owned by the returned object. Return null if the value is not an object.
+   */
+  ObjectData* readObject();
+
+protected:
+  void readRaw(void* data, size_t size);
+
+  std::vector<char> _buffer;
+  const char* _data;
+  size_t _size;
+  size_t _pos;
+  std::vector<const std::string*> _names;
+  //Arena of the values being read, if any
+  ValueArena* _arena;
+};
+
+}
+
+#endif // BOSS_BINARY_FORMAT_H
@@ -0,0 +1,47 @@
+/*
+    <one line to give the program's name and a brief idea of what it does.>
+    Copyright (C) 2013  <copyright holder> <email>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <memory>
+#include <stdexcept>
+
+#include "binary_message_parser.h"
+#include "message_data.h"
+#include "object_data.h"
+
+using namespace std;
+using namespace boss;
+
+MessageData* BinaryMessageParser::readMessage(istream& is) {
+  unsigned char kind;
+  if (!_decoder.readRecord(is,kind) || kind!=BINARY_MESSAGE_RECORD) {
+    return 0;
+  }
+  try {
+    double timestamp=_decoder.readDouble();
+    string type=_decoder.readString();
+    string source=_decoder.readString();
+    auto_ptr<ObjectData> data(_decoder.readObject());
+    if (!data.get()) {
+      return 0;
+    }
+    return new MessageData(timestamp,type,source,data.release());
+  } catch (runtime_error& e) {
+    //TODO Notify this occurrence
+    return 0;
+  }
+}
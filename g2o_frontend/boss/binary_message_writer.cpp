@@ -0,0 +1,33 @@
+/*
+    <one line to give the program's name and a brief idea of what it does.>
+    Copyright (C) 2013  <copyright holder> <email>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "binary_message_writer.h"
+#include "message_data.h"
+#include "object_data.h"
+
+using namespace std;
+using namespace boss;
+
+void BinaryMessageWriter::writeMessage(ostream& os, MessageData& message) {
+  _encoder.begin();
+  _encoder.writeDouble(message.getTimestamp());
+  _encoder.writeString(message.getType());
+  _encoder.writeString(message.getSource());
+  _encoder.writeValue(message.getData());
+  _encoder.end(os,BINARY_MESSAGE_RECORD);
+}
@@ -0,0 +1,30 @@
+/*
+    <one line to give the program's name and a brief idea of what it does.>
+    Copyright (C) 2013  <copyright holder> <email>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "binary_object_writer.h"
+#include "object_data.h"
+
+using namespace std;
+using namespace boss;
+
+void BinaryObjectWriter::writeObject(ostream& os, const string& type, ObjectData& object) {
+  _encoder.begin();
+  _encoder.writeString(type);
+  _encoder.writeValue(&object);
+  _encoder.end(os,BINARY_OBJECT_RECORD);
+}
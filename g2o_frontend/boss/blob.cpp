@@ -32,6 +32,10 @@ BLOB::~BLOB() {
   }
 }
 
+BLOB* BLOB::clone() const {
+  return 0;
+}
+
 static string DEFAULT_EXTENSION("dat");
 
 const string& BLOB::extension() {
@@ -49,7 +53,60 @@ void BaseBLOBReference::dataDestroyed() {
   _instance=0;
 }
 
+AsyncBLOBLocation::AsyncBLOBLocation(): _refs(1), _done(false) {
+  pthread_mutex_init(&_mutex,0);
+  pthread_cond_init(&_written,0);
+}
+
+AsyncBLOBLocation::~AsyncBLOBLocation() {
+  pthread_cond_destroy(&_written);
+  pthread_mutex_destroy(&_mutex);
+}
+
+void AsyncBLOBLocation::ref() {
+  pthread_mutex_lock(&_mutex);
+  _refs++;
+  pthread_mutex_unlock(&_mutex);
+}
+
+void AsyncBLOBLocation::unref() {
+  pthread_mutex_lock(&_mutex);
+  bool last=!--_refs;
+  pthread_mutex_unlock(&_mutex);
+  if (last) {
+    delete this;
+  }
+}
+
+void AsyncBLOBLocation::set(const BLOBLocation& location) {
+  pthread_mutex_lock(&_mutex);
+  _location=location;
+  _done=true;
+  pthread_cond_broadcast(&_written);
+  pthread_mutex_unlock(&_mutex);
+}
+
+bool AsyncBLOBLocation::get(BLOBLocation& location) {
+  pthread_mutex_lock(&_mutex);
+  bool done=_done;
+  if (done) {
+    location=_location;
+  }
+  pthread_mutex_unlock(&_mutex);
+  return done;
+}
+
+void AsyncBLOBLocation::wait(BLOBLocation& location) {
+  pthread_mutex_lock(&_mutex);
+  while (!_done) {
+    pthread_cond_wait(&_written,&_mutex);
+  }
+  location=_location;
+  pthread_mutex_unlock(&_mutex);
+}
+
 BaseBLOBReference::~BaseBLOBReference() {
+  clearAsyncLocation();
   if (_instance) {
     delete _instance;
   }
@@ -61,19 +118,43 @@ void BaseBLOBReference::serialize(ObjectData& data, IdContext& context) {
     //Check if binary file serialization is supported
     SerializationContext* fileContext=dynamic_cast<SerializationContext*>(&context);
     if (fileContext) {
-      _fileName=fileContext->createBinaryFilePath(*this);
-      auto_ptr<ostream> os(fileContext->getBinaryOutputStream(_fileName));
-      if (os.get()) {
-        _instance->write(*os);
+      _location=BLOBLocation();
+      clearAsyncLocation();
+      //Encoded in background if the context supports it, the context writes the fields
+      if (fileContext->writeBLOBAsync(*this,*_instance,data,_asyncLocation)) {
+        return;
+      }
+      //Packed in a segment if the context supports it, otherwise in its own file
+      if (fileContext->writePackedBLOB(*this,*_instance,_location)) {
+        _fileName.clear();
+      } else {
+        _fileName=fileContext->createBinaryFilePath(*this);
+        auto_ptr<ostream> os(fileContext->getBinaryOutputStream(_fileName));
+        if (os.get()) {
+          _instance->write(*os);
+        }
       }
     }
   }
-  data << field("pathName",_fileName);
+  if (_location.segment.empty()) {
+    data << field("pathName",_fileName);
+  } else {
+    data << field("segment",_location.segment);
+    data.setDouble("offset",_location.offset);
+    data.setDouble("size",_location.size);
+  }
 }
 
 void BaseBLOBReference::deserialize(ObjectData& data, IdContext& context) {
   Identifiable::deserialize(data, context);
   data >> field("pathName",_fileName);
+  _location=BLOBLocation();
+  clearAsyncLocation();
+  data >> field("segment",_location.segment);
+  if (!_location.segment.empty()) {
+    _location.offset=static_cast<uint64_t>(data.getDouble("offset"));
+    _location.size=static_cast<uint64_t>(data.getDouble("size"));
+  }
   _instance=0;
 }
 
@@ -81,7 +162,14 @@ bool BaseBLOBReference::load(BLOB& instance) {
   //Check if binary file serialization is supported
   SerializationContext* fileContext=dynamic_cast<SerializationContext*>(_context);
   if (fileContext) {
-    auto_ptr<istream> is(fileContext->getBinaryInputStream(_fileName));
+    if (_asyncLocation) {
+      //Released while written in background
+      _asyncLocation->wait(_location);
+      clearAsyncLocation();
+    }
+    auto_ptr<istream> is(_location.segment.empty()?
+                         fileContext->getBinaryInputStream(_fileName):
+                         fileContext->getPackedBLOBInputStream(_location));
     if (is.get()) {
       return instance.read(*is);
     }
@@ -89,6 +177,34 @@ bool BaseBLOBReference::load(BLOB& instance) {
   return false;
 }
 
+bool BaseBLOBReference::release() {
+  if (!_instance) {
+    return true;
+  }
+  updateLocation();
+  //A BLOB still queued for writing is kept by the writer until it is in its segment
+  if (!dynamic_cast<SerializationContext*>(_context) ||
+      (_fileName.empty() && _location.segment.empty() && !_asyncLocation)) {
+    return false;
+  }
+  delete _instance;
+  _instance=0;
+  return true;
+}
+
+void BaseBLOBReference::updateLocation() {
+  if (_asyncLocation && _asyncLocation->get(_location)) {
+    clearAsyncLocation();
+  }
+}
+
+void BaseBLOBReference::clearAsyncLocation() {
+  if (_asyncLocation) {
+    _asyncLocation->unref();
+    _asyncLocation=0;
+  }
+}
+
 void BaseBLOBReference::set(BLOB* instance) {
   if (_instance) {
     delete _instance;
@@ -24,6 +24,8 @@
 #include <iostream>
 #include <fstream>
 #include <memory>
+#include <stdint.h>
+#include <pthread.h>
 
 #include "identifiable.h"
 
@@ -33,6 +35,43 @@ class BaseBLOBReference;
 
 template <class T> class BLOBReference;
 
+/*
+ * Position of a BLOB packed in a segment file, the segment is an entry of the offset table
+ * of the log (see BLOBSegmentStore).
+ */
+struct BLOBLocation {
+  BLOBLocation(): offset(0), size(0) {}
+
+  std::string segment;
+  uint64_t offset;
+  uint64_t size;
+};
+
+/*
+ * Location of a packed BLOB written in background (see Serializer::setAsyncBLOBs()), shared
+ * by the reference and the writer thread, which sets it once the BLOB is in its segment.
+ * Reference counted, created with one reference.
+ */
+class AsyncBLOBLocation {
+public:
+  AsyncBLOBLocation();
+  void ref();
+  void unref();
+  //Called by the writer, an empty location if the BLOB could not be written
+  void set(const BLOBLocation& location);
+  //Return false if not written yet
+  bool get(BLOBLocation& location);
+  //Block until written
+  void wait(BLOBLocation& location);
+protected:
+  ~AsyncBLOBLocation();
+  pthread_mutex_t _mutex;
+  pthread_cond_t _written;
+  int _refs;
+  bool _done;
+  BLOBLocation _location;
+};
+
 class BLOB {
   template <class T>
   friend class BLOBReference;
@@ -40,6 +79,11 @@ public:
   BLOB(): _ref(0) {}
   virtual bool read(std::istream& is)=0;
   virtual void write(std::ostream& os)=0;
+  /*
+   * Deep copy of the data, used to encode it in background (see Serializer::setAsyncBLOBs()).
+   * Return null (default) if not supported.
+   */
+  virtual BLOB* clone() const;
   virtual ~BLOB();
   virtual const std::string& extension();
 protected:
@@ -49,12 +93,18 @@ protected:
 class BaseBLOBReference: public Identifiable {
 public:
   BaseBLOBReference(BLOB* instance, int id, IdContext* context):
-    Identifiable(id, context), _instance(instance) {}
+    Identifiable(id, context), _instance(instance), _asyncLocation(0) {}
 
   virtual void serialize(ObjectData& data, IdContext& context);
   virtual void deserialize(ObjectData& data, IdContext& context);
   virtual BLOB* get()=0;
   virtual void set(BLOB*);
+  /*
+   * Deletes the instance if it can be loaded again from the log it was read from or
+   * written to (also while it is being written in background), the next get() reloads it.
+   * Return true if the instance is not in memory.
+   */
+  bool release();
   void dataDestroyed();
   const std::string& extension();
 
@@ -65,15 +115,30 @@ public:
   const std::string& getFileName() {
     return _fileName;
   }
+
+  /*
+   * Location of the BLOB if packed in a segment file, the segment name is empty if
+   * the BLOB has its own file (or if it is still being written in background).
+   */
+  const BLOBLocation& getLocation() {
+    updateLocation();
+    return _location;
+  }
   
   virtual ~BaseBLOBReference();
 
   inline BLOB* instance() {return _instance;}
 protected:
   bool load(BLOB& instance);
+  //Take the location of a BLOB written in background, if written
+  void updateLocation();
+  void clearAsyncLocation();
   
   std::string _fileName;
+  BLOBLocation _location;
   BLOB* _instance;
+  //Set while the location of a BLOB written in background is not known
+  AsyncBLOBLocation* _asyncLocation;
 };
 
 template<typename T>
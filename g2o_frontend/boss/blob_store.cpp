@@ -0,0 +1,180 @@
+/*
+    <one line to give the program's name and a brief idea of what it does.>
+    Copyright (C) 2013  <copyright holder> <email>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <boost/filesystem.hpp>
+
+#include "blob_store.h"
+#include "memory_stream.h"
+
+using namespace std;
+using namespace boss;
+
+static const string DEFAULT_SEGMENT_FILE="binary/segment.<segment>.blob";
+static const uint64_t DEFAULT_MAX_SEGMENT_SIZE=1024*1024*1024;
+static const string SEGMENT_TAG="<segment>";
+
+BLOBSegmentStore::BLOBSegmentStore():
+  _baseDirectory("."), _segmentPath(DEFAULT_SEGMENT_FILE), _maxSegmentSize(DEFAULT_MAX_SEGMENT_SIZE),
+  _segmentCount(0), _segmentStream(0), _tableStream(0) {}
+
+void BLOBSegmentStore::setBaseDirectory(const string& dir) {
+  _baseDirectory=dir.empty()?".":dir;
+}
+
+void BLOBSegmentStore::setSegmentPath(const string& fpath) {
+  if (fpath.empty()) {
+    return;
+  }
+  _segmentPath=fpath;
+}
+
+void BLOBSegmentStore::setMaxSegmentSize(uint64_t size) {
+  _maxSegmentSize=size;
+}
+
+string BLOBSegmentStore::filePath(const string& segment) const {
+  if (!segment.empty() && segment[0]=='/') {
+    return segment;
+  }
+  return _baseDirectory+"/"+segment;
+}
+
+bool BLOBSegmentStore::openSegment(uint64_t size) {
+  if (_segmentStream) {
+    uint64_t current=_segmentStream->tellp();
+    //A BLOB larger than a segment gets a segment of its own
+    if (current==0 || current+size<=_maxSegmentSize) {
+      return !_segmentStream->fail();
+    }
+    closeSegment();
+  }
+  stringstream ss;
+  ss.width(4);
+  ss.fill('0');
+  ss << _segmentCount++;
+  _segment=_segmentPath;
+  size_t pos=_segment.find(SEGMENT_TAG);
+  if (pos!=string::npos) {
+    _segment.replace(pos,SEGMENT_TAG.length(),ss.str());
+  } else {
+    _segment+="."+ss.str();
+  }
+  string fpath=filePath(_segment);
+  boost::filesystem::create_directories(boost::filesystem::path(fpath).parent_path());
+  _segmentStream=new ofstream(fpath.c_str(), ios::out|ios::binary|ios::trunc);
+  _tableStream=new ofstream((fpath+".tbl").c_str(), ios::out|ios::trunc);
+  return !_segmentStream->fail();
+}
+
+bool BLOBSegmentStore::finishWrite(int id, const string& className, uint64_t offset, BLOBLocation& location) {
+  uint64_t end=_segmentStream->tellp();
+  if (_segmentStream->fail()) {
+    return false;
+  }
+  location.segment=_segment;
+  location.offset=offset;
+  location.size=end-offset;
+  *_tableStream << location.offset << " " << location.size << " " << id << " " << className << endl;
+  return true;
+}
+
+bool BLOBSegmentStore::write(BaseBLOBReference& instance, BLOB& blob, BLOBLocation& location) {
+  //The size is not known in advance, the BLOB goes to a new segment only if the current one is full
+  if (!openSegment(0)) {
+    return false;
+  }
+  uint64_t offset=_segmentStream->tellp();
+  blob.write(*_segmentStream);
+  return finishWrite(instance.getId(),instance.className(),offset,location);
+}
+
+bool BLOBSegmentStore::write(const char* data, uint64_t size, int id, const string& className, BLOBLocation& location) {
+  if (!openSegment(size)) {
+    return false;
+  }
+  uint64_t offset=_segmentStream->tellp();
+  _segmentStream->write(data,size);
+  return finishWrite(id,className,offset,location);
+}
+
+void BLOBSegmentStore::closeSegment() {
+  delete _segmentStream;
+  delete _tableStream;
+  _segmentStream=0;
+  _tableStream=0;
+}
+
+const BLOBSegmentStore::MappedSegment* BLOBSegmentStore::mapSegment(const string& segment, uint64_t minSize) {
+  MappedSegment& mapped=_mappedSegments[segment];
+  if (mapped.data && mapped.size>=minSize) {
+    return &mapped;
+  }
+  //Not mapped yet, or grown since (the segment being written)
+  if (segment==_segment && _segmentStream) {
+    _segmentStream->flush();
+  }
+  if (mapped.data) {
+    munmap(mapped.data,mapped.size);
+    mapped=MappedSegment();
+  }
+  int fd=open(filePath(segment).c_str(),O_RDONLY);
+  if (fd<0) {
+    return 0;
+  }
+  struct stat st;
+  if (fstat(fd,&st) || static_cast<uint64_t>(st.st_size)<minSize || st.st_size==0) {
+    close(fd);
+    return 0;
+  }
+  void* data=mmap(0,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+  close(fd);
+  if (data==MAP_FAILED) {
+    return 0;
+  }
+  mapped.data=static_cast<char*>(data);
+  mapped.size=st.st_size;
+  return &mapped;
+}
+
+istream* BLOBSegmentStore::read(const BLOBLocation& location) {
+  const MappedSegment* mapped=mapSegment(location.segment,location.offset+location.size);
+  if (!mapped) {
+    return 0;
+  }
+  const char* begin=mapped->data+location.offset;
+  return new MemoryInputStream(begin,begin+location.size);
+}
+
+void BLOBSegmentStore::unmapSegments() {
+  for (map<string,MappedSegment>::iterator it=_mappedSegments.begin();it!=_mappedSegments.end();it++) {
+    if (it->second.data) {
+      munmap(it->second.data,it->second.size);
+    }
+  }
+  _mappedSegments.clear();
+}
+
+BLOBSegmentStore::~BLOBSegmentStore() {
+  closeSegment();
+  unmapSegments();
+}
@@ -0,0 +1,122 @@
+/*
+    <one line to give the program's name and a brief idea of what it does.>
+    Copyright (C) 2013  <copyright holder> <email>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BOSS_BLOB_STORE_H
+#define BOSS_BLOB_STORE_H
+
+#include <map>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <stdint.h>
+
+#include "blob.h"
+
+namespace boss {
+
+/*
+ * Store packing the BLOBs of a log into large segment files, instead of one file per BLOB.
+ * BLOBs are appended to the current segment until it grows over the maximum segment size,
+ * then a new one is started. Each segment has an offset table (<segment>.tbl), a text file
+ * with one line per BLOB:
+ *   <offset> <size> <id> <class name>
+ * and each BaseBLOBReference keeps its own entry (BLOBLocation), so that no lookup is needed
+ * when reading. Segments are read through mmap.
+ * Segment names are relative to the base directory unless absolute.
+ */
+class BLOBSegmentStore {
+public:
+  BLOBSegmentStore();
+
+  /*
+   * Directory of the relative segment names, usually the one of the main data file.
+   */
+  void setBaseDirectory(const std::string& dir);
+
+  /*
+   * Pattern of the segment names, the tag <segment> is replaced with the segment number.
+   */
+  void setSegmentPath(const std::string& fpath);
+  const std::string& segmentPath() const {
+    return _segmentPath;
+  }
+
+  /*
+   * Size above which a new segment is started.
+   */
+  void setMaxSegmentSize(uint64_t size);
+  uint64_t maxSegmentSize() const {
+    return _maxSegmentSize;
+  }
+
+  /*
+   * Append a BLOB to the current segment.
+   * Return false if the segment cannot be written.
+   */
+  bool write(BaseBLOBReference& instance, BLOB& blob, BLOBLocation& location);
+
+  /*
+   * Append raw BLOB data to the current segment, used to pack existing BLOB files.
+   */
+  bool write(const char* data, uint64_t size, int id, const std::string& className, BLOBLocation& location);
+
+  /*
+   * Stream reading a BLOB, null if the segment cannot be mapped or the location is out of it.
+   * The stream must be deleted before the store.
+   */
+  std::istream* read(const BLOBLocation& location);
+
+  /*
+   * Close the current segment, the next write starts a new one.
+   */
+  void closeSegment();
+
+  /*
+   * Release the memory mapped segments.
+   */
+  void unmapSegments();
+
+  virtual ~BLOBSegmentStore();
+
+protected:
+  struct MappedSegment {
+    MappedSegment(): data(0), size(0) {}
+    char* data;
+    uint64_t size;
+  };
+
+  std::string filePath(const std::string& segment) const;
+  bool openSegment(uint64_t size);
+  bool finishWrite(int id, const std::string& className, uint64_t offset, BLOBLocation& location);
+  const MappedSegment* mapSegment(const std::string& segment, uint64_t minSize);
+
+  std::string _baseDirectory;
+  std::string _segmentPath;
+  uint64_t _maxSegmentSize;
+
+  int _segmentCount;
+  std::string _segment;
+  std::ofstream* _segmentStream;
+  std::ofstream* _tableStream;
+
+  std::map<std::string, MappedSegment> _mappedSegments;
+};
+
+}
+
+#endif // BOSS_BLOB_STORE_H
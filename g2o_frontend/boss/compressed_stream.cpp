@@ -0,0 +1,331 @@
+/*
+    <one line to give the program's name and a brief idea of what it does.>
+    Copyright (C) 2013  <copyright holder> <email>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cstring>
+
+#include "compressed_stream.h"
+
+using namespace boss;
+using namespace std;
+
+//Uncompressed data of a block, small enough for the block to stay under 64KB even if stored
+static const size_t BLOCK_DATA_SIZE=0xff00;
+static const size_t MAX_BLOCK_SIZE=0x10000;
+static const size_t HEADER_SIZE=18;
+static const size_t FOOTER_SIZE=8;
+
+//gzip member header with the "BC" extra field, holding the block size minus one
+static const unsigned char BLOCK_HEADER[HEADER_SIZE]={
+  31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 'B', 'C', 2, 0, 0, 0
+};
+
+static void writeUInt32(unsigned char* p, unsigned int v) {
+  p[0]=v;
+  p[1]=v>>8;
+  p[2]=v>>16;
+  p[3]=v>>24;
+}
+
+static unsigned int readUInt32(const unsigned char* p) {
+  return p[0]|(p[1]<<8)|(p[2]<<16)|(static_cast<unsigned int>(p[3])<<24);
+}
+
+bool boss::isCompressedLogPath(const string& path) {
+  return path.size()>3 && path.compare(path.size()-3,3,".gz")==0;
+}
+
+istream* boss::openLogInputStream(const string& path) {
+  if (isCompressedLogPath(path)) {
+    return new CompressedInputStream(path);
+  }
+  return new ifstream(path.c_str(), ios::in|ios::binary);
+}
+
+ostream* boss::openLogOutputStream(const string& path) {
+  if (isCompressedLogPath(path)) {
+    return new CompressedOutputStream(path);
+  }
+  return new ofstream(path.c_str(), ios::out|ios::binary);
+}
+
+CompressedOutputStreamBuf::CompressedOutputStreamBuf(int level): _zstreamReady(false), _buffer(BLOCK_DATA_SIZE), _block(MAX_BLOCK_SIZE), _offset(0) {
+  memset(&_zstream,0,sizeof(_zstream));
+  _zstreamReady=deflateInit2(&_zstream,level,Z_DEFLATED,-15,8,Z_DEFAULT_STRATEGY)==Z_OK;
+  setp(&_buffer[0],&_buffer[0]+_buffer.size());
+}
+
+bool CompressedOutputStreamBuf::open(const string& path) {
+  _offset=0;
+  setp(&_buffer[0],&_buffer[0]+_buffer.size());
+  return _zstreamReady && _file.open(path.c_str(),ios::out|ios::binary|ios::trunc);
+}
+
+bool CompressedOutputStreamBuf::writeBlock() {
+  size_t size=pptr()-pbase();
+  unsigned char* block=&_block[0];
+  size_t maxData=MAX_BLOCK_SIZE-HEADER_SIZE-FOOTER_SIZE;
+  deflateReset(&_zstream);
+  _zstream.next_in=reinterpret_cast<Bytef*>(pbase());
+  _zstream.avail_in=size;
+  _zstream.next_out=block+HEADER_SIZE;
+  _zstream.avail_out=maxData;
+  size_t dataSize;
+  if (deflate(&_zstream,Z_FINISH)==Z_STREAM_END) {
+    dataSize=maxData-_zstream.avail_out;
+  } else {
+    //Data that does not compress, written as a single stored deflate block
+    unsigned char* stored=block+HEADER_SIZE;
+    stored[0]=1;
+    stored[1]=size&0xff;
+    stored[2]=size>>8;
+    stored[3]=~stored[1];
+    stored[4]=~stored[2];
+    memcpy(stored+5,pbase(),size);
+    dataSize=size+5;
+  }
+  size_t blockSize=HEADER_SIZE+dataSize+FOOTER_SIZE;
+  memcpy(block,BLOCK_HEADER,HEADER_SIZE);
+  block[16]=(blockSize-1)&0xff;
+  block[17]=(blockSize-1)>>8;
+  writeUInt32(block+blockSize-8,crc32(crc32(0,Z_NULL,0),reinterpret_cast<Bytef*>(pbase()),size));
+  writeUInt32(block+blockSize-4,size);
+  if (_file.sputn(reinterpret_cast<char*>(block),blockSize)!=static_cast<streamsize>(blockSize)) {
+    return false;
+  }
+  _offset+=size;
+  setp(&_buffer[0],&_buffer[0]+_buffer.size());
+  return true;
+}
+
+CompressedOutputStreamBuf::int_type CompressedOutputStreamBuf::overflow(int_type c) {
+  if (!_file.is_open() || !writeBlock()) {
+    return traits_type::eof();
+  }
+  if (!traits_type::eq_int_type(c,traits_type::eof())) {
+    *pptr()=traits_type::to_char_type(c);
+    pbump(1);
+  }
+  return traits_type::not_eof(c);
+}
+
+int CompressedOutputStreamBuf::sync() {
+  //The partial block is kept, small blocks would not compress
+  return _file.pubsync();
+}
+
+CompressedOutputStreamBuf::pos_type CompressedOutputStreamBuf::seekoff(off_type off, ios_base::seekdir dir, ios_base::openmode which) {
+  //Only the current position can be queried
+  if (off!=0 || dir!=ios_base::cur || !(which&ios_base::out)) {
+    return pos_type(off_type(-1));
+  }
+  return pos_type(_offset+(pptr()-pbase()));
+}
+
+bool CompressedOutputStreamBuf::close() {
+  if (!_file.is_open()) {
+    return false;
+  }
+  bool ok=true;
+  if (pptr()>pbase()) {
+    ok=writeBlock();
+  }
+  //An empty block marks the end of the file
+  ok=writeBlock() && ok;
+  return _file.close() && ok;
+}
+
+CompressedOutputStreamBuf::~CompressedOutputStreamBuf() {
+  close();
+  if (_zstreamReady) {
+    deflateEnd(&_zstream);
+  }
+}
+
+CompressedInputStreamBuf::CompressedInputStreamBuf(): _zstreamReady(false), _buffer(MAX_BLOCK_SIZE), _block(MAX_BLOCK_SIZE),
+  _scannedOffset(0), _scannedFileOffset(0), _scannedAll(false), _current(0) {
+  memset(&_zstream,0,sizeof(_zstream));
+  _zstreamReady=inflateInit2(&_zstream,-15)==Z_OK;
+  setg(&_buffer[0],&_buffer[0],&_buffer[0]);
+}
+
+bool CompressedInputStreamBuf::open(const string& path) {
+  _blocks.clear();
+  _scannedOffset=0;
+  _scannedFileOffset=0;
+  _scannedAll=false;
+  _current=0;
+  setg(&_buffer[0],&_buffer[0],&_buffer[0]);
+  return _zstreamReady && _file.open(path.c_str(),ios::in|ios::binary);
+}
+
+bool CompressedInputStreamBuf::readHeader(streamoff fileOffset, size_t& blockSize) {
+  unsigned char* header=&_block[0];
+  if (_file.pubseekpos(fileOffset,ios_base::in)!=streampos(fileOffset) ||
+      _file.sgetn(reinterpret_cast<char*>(header),HEADER_SIZE)!=static_cast<streamsize>(HEADER_SIZE)) {
+    return false;
+  }
+  if (header[0]!=31 || header[1]!=139 || header[2]!=8 || !(header[3]&4) ||
+      header[10]!=6 || header[11]!=0 || header[12]!='B' || header[13]!='C') {
+    return false;
+  }
+  blockSize=(header[16]|(header[17]<<8))+1;
+  return blockSize>=HEADER_SIZE+FOOTER_SIZE;
+}
+
+bool CompressedInputStreamBuf::scanBlock() {
+  while (!_scannedAll) {
+    size_t blockSize;
+    unsigned char footer[FOOTER_SIZE];
+    if (!readHeader(_scannedFileOffset,blockSize) ||
+        _file.pubseekpos(_scannedFileOffset+blockSize-FOOTER_SIZE,ios_base::in)!=streampos(_scannedFileOffset+blockSize-FOOTER_SIZE) ||
+        _file.sgetn(reinterpret_cast<char*>(footer),FOOTER_SIZE)!=static_cast<streamsize>(FOOTER_SIZE)) {
+      _scannedAll=true;
+      return false;
+    }
+    size_t size=readUInt32(footer+4);
+    streamoff fileOffset=_scannedFileOffset;
+    _scannedFileOffset+=blockSize;
+    if (size) {
+      _blocks.push_back(Block(_scannedOffset,fileOffset));
+      _scannedOffset+=size;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool CompressedInputStreamBuf::loadBlock(size_t index) {
+  const Block& block=_blocks[index];
+  size_t blockSize;
+  if (!readHeader(block.fileOffset,blockSize)) {
+    return false;
+  }
+  unsigned char* data=&_block[0];
+  streamsize rest=blockSize-HEADER_SIZE;
+  if (_file.sgetn(reinterpret_cast<char*>(data+HEADER_SIZE),rest)!=rest) {
+    return false;
+  }
+  size_t size=readUInt32(data+blockSize-4);
+  if (size>_buffer.size()) {
+    return false;
+  }
+  inflateReset(&_zstream);
+  _zstream.next_in=data+HEADER_SIZE;
+  _zstream.avail_in=blockSize-HEADER_SIZE-FOOTER_SIZE;
+  _zstream.next_out=reinterpret_cast<Bytef*>(&_buffer[0]);
+  _zstream.avail_out=_buffer.size();
+  if (inflate(&_zstream,Z_FINISH)!=Z_STREAM_END || _zstream.total_out!=size ||
+      crc32(crc32(0,Z_NULL,0),reinterpret_cast<Bytef*>(&_buffer[0]),size)!=readUInt32(data+blockSize-8)) {
+    return false;
+  }
+  _current=index;
+  setg(&_buffer[0],&_buffer[0],&_buffer[0]+size);
+  return true;
+}
+
+CompressedInputStreamBuf::int_type CompressedInputStreamBuf::underflow() {
+  if (gptr()<egptr()) {
+    return traits_type::to_int_type(*gptr());
+  }
+  size_t next=(egptr()>eback())?_current+1:_current;
+  if (next>=_blocks.size() && !scanBlock()) {
+    _current=_blocks.size();
+    setg(&_buffer[0],&_buffer[0],&_buffer[0]);
+    return traits_type::eof();
+  }
+  if (!loadBlock(next)) {
+    return traits_type::eof();
+  }
+  return traits_type::to_int_type(*gptr());
+}
+
+CompressedInputStreamBuf::pos_type CompressedInputStreamBuf::seekoff(off_type off, ios_base::seekdir dir, ios_base::openmode which) {
+  if (!(which&ios_base::in)) {
+    return pos_type(off_type(-1));
+  }
+  streamoff base=(_current<_blocks.size())?_blocks[_current].offset:_scannedOffset;
+  streamoff current=base+(gptr()-eback());
+  if (dir==ios_base::cur) {
+    if (off==0) {
+      return pos_type(current);
+    }
+    return seekpos(pos_type(current+off),which);
+  }
+  if (dir==ios_base::end) {
+    while (scanBlock());
+    return seekpos(pos_type(_scannedOffset+off),which);
+  }
+  return seekpos(pos_type(off),which);
+}
+
+CompressedInputStreamBuf::pos_type CompressedInputStreamBuf::seekpos(pos_type pos, ios_base::openmode which) {
+  streamoff offset=pos;
+  if (!(which&ios_base::in) || offset<0) {
+    return pos_type(off_type(-1));
+  }
+  //Inside the loaded block
+  if (_current<_blocks.size() && offset>=_blocks[_current].offset && offset<_blocks[_current].offset+(egptr()-eback())) {
+    setg(eback(),eback()+(offset-_blocks[_current].offset),egptr());
+    return pos;
+  }
+  while (offset>=_scannedOffset && scanBlock());
+  if (offset>=_scannedOffset) {
+    if (offset>_scannedOffset) {
+      return pos_type(off_type(-1));
+    }
+    //At the end of the data
+    _current=_blocks.size();
+    setg(&_buffer[0],&_buffer[0],&_buffer[0]);
+    return pos;
+  }
+  size_t index=upper_bound(_blocks.begin(),_blocks.end(),Block(offset))-_blocks.begin()-1;
+  if (!loadBlock(index)) {
+    return pos_type(off_type(-1));
+  }
+  setg(eback(),eback()+(offset-_blocks[index].offset),egptr());
+  return pos;
+}
+
+CompressedInputStreamBuf::~CompressedInputStreamBuf() {
+  if (_zstreamReady) {
+    inflateEnd(&_zstream);
+  }
+}
+
+CompressedOutputStream::CompressedOutputStream(const string& path, int level):
+  ostream(0), _buf(level) {
+  rdbuf(&_buf);
+  if (!_buf.open(path)) {
+    setstate(ios_base::failbit);
+  }
+}
+
+void CompressedOutputStream::close() {
+  if (!_buf.close()) {
+    setstate(ios_base::failbit);
+  }
+}
+
+CompressedInputStream::CompressedInputStream(const string& path):
+  istream(0) {
+  rdbuf(&_buf);
+  if (!_buf.open(path)) {
+    setstate(ios_base::failbit);
+  }
+}
@@ -0,0 +1,144 @@
+/*
+    <one line to give the program's name and a brief idea of what it does.>
+    Copyright (C) 2013  <copyright holder> <email>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BOSS_COMPRESSED_STREAM_H
+#define BOSS_COMPRESSED_STREAM_H
+
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+namespace boss {
+
+/*
+ * Block compressed log files, chosen by the ".gz" extension of the data file.
+ * The data is split in blocks of at most 64KB, each compressed as a separate gzip member
+ * with its compressed size in the header (the BGZF layout), so the files can be read by
+ * the gzip tools and a block can be located without decompressing the ones before it.
+ * Stream positions are offsets in the uncompressed data: the offsets of the log index
+ * and the block reads of Deserializer::readAllObjects() are the same of a plain file.
+ */
+
+/*
+ * True if the file path selects a compressed log.
+ */
+bool isCompressedLogPath(const std::string& path);
+
+/*
+ * Open a data file for reading or writing, compressed if isCompressedLogPath().
+ * Check fail() on the returned stream, the caller takes ownership of it.
+ */
+std::istream* openLogInputStream(const std::string& path);
+std::ostream* openLogOutputStream(const std::string& path);
+
+/*
+ * Write side. The last block is written when the stream is closed or destroyed;
+ * flushing the stream (as std::endl does) writes only the complete blocks, so a
+ * crash loses at most the last block.
+ */
+class CompressedOutputStreamBuf: public std::streambuf {
+public:
+  CompressedOutputStreamBuf(int level=Z_DEFAULT_COMPRESSION);
+  bool open(const std::string& path);
+  bool close();
+  virtual ~CompressedOutputStreamBuf();
+
+protected:
+  virtual int_type overflow(int_type c);
+  virtual int sync();
+  virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which=std::ios_base::out);
+  bool writeBlock();
+
+  std::filebuf _file;
+  z_stream _zstream;
+  bool _zstreamReady;
+  std::vector<char> _buffer;
+  std::vector<unsigned char> _block;
+  //Uncompressed size of the blocks written so far
+  std::streamoff _offset;
+};
+
+/*
+ * Read side, seekable. The blocks found while reading or seeking are remembered,
+ * seeking to a block not seen yet reads only the headers of the blocks before it.
+ */
+class CompressedInputStreamBuf: public std::streambuf {
+public:
+  CompressedInputStreamBuf();
+  bool open(const std::string& path);
+  virtual ~CompressedInputStreamBuf();
+
+protected:
+  struct Block {
+    Block(std::streamoff offset_=0, std::streamoff fileOffset_=0): offset(offset_), fileOffset(fileOffset_) {}
+    bool operator<(const Block& other) const {
+      return offset<other.offset;
+    }
+    //Uncompressed offset and position in the file
+    std::streamoff offset;
+    std::streamoff fileOffset;
+  };
+
+  virtual int_type underflow();
+  virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which=std::ios_base::in);
+  virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which=std::ios_base::in);
+  //Read the header of the block at fileOffset, false at the end of the file
+  bool readHeader(std::streamoff fileOffset, size_t& blockSize);
+  //Find the next non empty block after the known ones, false at the end of the file
+  bool scanBlock();
+  bool loadBlock(size_t index);
+
+  std::filebuf _file;
+  z_stream _zstream;
+  bool _zstreamReady;
+  std::vector<char> _buffer;
+  std::vector<unsigned char> _block;
+  //Non empty blocks seen so far, in file order
+  std::vector<Block> _blocks;
+  //End of the known blocks, uncompressed and in the file
+  std::streamoff _scannedOffset;
+  std::streamoff _scannedFileOffset;
+  bool _scannedAll;
+  //Index of the loaded block in _blocks, or _blocks.size() at the end
+  size_t _current;
+};
+
+class CompressedOutputStream: public std::ostream {
+public:
+  CompressedOutputStream(const std::string& path, int level=Z_DEFAULT_COMPRESSION);
+  void close();
+
+protected:
+  CompressedOutputStreamBuf _buf;
+};
+
+class CompressedInputStream: public std::istream {
+public:
+  CompressedInputStream(const std::string& path);
+
+protected:
+  CompressedInputStreamBuf _buf;
+};
+
+}
+
+#endif // BOSS_COMPRESSED_STREAM_H
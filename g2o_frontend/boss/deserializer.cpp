@@ -16,11 +16,16 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <stdexcept>
 #include <memory>
 #include <fstream>
+#include <cstring>
+#include <pthread.h>
+#include <unistd.h>
 
 #include "deserializer.h"
+#include "memory_stream.h"
 
 #include "message_data.h"
 #include "object_data.h"
@@ -28,7 +33,12 @@
 #include "message.h"
 #include "json_message_parser.h"
 #include "json_object_parser.h"
+#include "binary_format.h"
+#include "binary_message_parser.h"
+#include "binary_object_parser.h"
 #include "id_placeholder.h"
+#include "log_index.h"
+#include "compressed_stream.h"
 
 using namespace std;
 using namespace boss;
@@ -50,19 +60,17 @@ static ValueData* processData(ValueData* vdata, IdContext& context, vector<int>&
           danglingRefs.push_back(id);
         }
       }
-      return new PointerReference(pointer);
+      return new (data->arena()) PointerReference(pointer);
     }
     ValueData* idfield=data->getField("#id");
     if (idfield) {
       declaredIDs.push_back(idfield->getInt());
     }
 
-    const vector<string>& fields=data->fields();
-    for (vector<string>::const_iterator f_it=fields.begin();f_it!=fields.end();f_it++) {
-      ValueData* fdata=data->getField(*f_it);
-      ValueData* replaceData=processData(fdata, context, danglingRefs, declaredIDs);
+    for (size_t i=0;i<data->numFields();i++) {
+      ValueData* replaceData=processData(data->fieldValue(i), context, danglingRefs, declaredIDs);
       if (replaceData) {
-        data->setField(*f_it,replaceData);
+        data->setFieldValue(i,replaceData);
       }
     }
     break;
@@ -85,7 +93,7 @@ static ValueData* processData(ValueData* vdata, IdContext& context, vector<int>&
 }
 
 static Serializable* createInstance(ObjectData* odata, const string& type, IdContext& context,
-    map<Serializable*,std::set<int> >& waitingInstances, map<int,std::set<Serializable*> >& danglingReferences) {
+    boost::unordered_map<Serializable*,int>& waitingInstances, boost::unordered_map<int,vector<Serializable*> >& danglingReferences) {
   ValueData* idValue=odata->getField("#id");
 
   //Identifiable objects are overwritten if another object
@@ -124,24 +132,27 @@ static Serializable* createInstance(ObjectData* odata, const string& type, IdCon
   processData(odata, context, danglingPointers,declaredIDs);
   instance->deserialize(*odata,context);
 
+  //Each missing id is counted once, even if pointed more than once
+  sort(danglingPointers.begin(),danglingPointers.end());
+  danglingPointers.erase(unique(danglingPointers.begin(),danglingPointers.end()),danglingPointers.end());
   for (vector<int>::iterator dp_it=danglingPointers.begin();dp_it!=danglingPointers.end();dp_it++) {
-    waitingInstances[instance].insert(*dp_it);
-    danglingReferences[*dp_it].insert(instance);
+    waitingInstances[instance]++;
+    danglingReferences[*dp_it].push_back(instance);
   }
   for (vector<int>::iterator id_it=declaredIDs.begin();id_it!=declaredIDs.end();id_it++) {
     //Further check, just in case the ID was a fake field
     if (context.getById(*id_it)) {
-      map<int,set<Serializable*> >::iterator entry=danglingReferences.find(*id_it);
+      boost::unordered_map<int,vector<Serializable*> >::iterator entry=danglingReferences.find(*id_it);
       if (entry!=danglingReferences.end()) {
-        set<Serializable*>& instSet=(*entry).second;
-        for (set<Serializable*>::iterator instance_it=instSet.begin();instance_it!=instSet.end();instance_it++) {
-          waitingInstances[*instance_it].erase(*id_it);
-          if (waitingInstances[*instance_it].empty()) {
-            waitingInstances.erase(*instance_it);
+        vector<Serializable*>& instances=(*entry).second;
+        for (vector<Serializable*>::iterator instance_it=instances.begin();instance_it!=instances.end();instance_it++) {
+          boost::unordered_map<Serializable*,int>::iterator waiting=waitingInstances.find(*instance_it);
+          if (waiting!=waitingInstances.end() && !--(*waiting).second) {
+            waitingInstances.erase(waiting);
             (*instance_it)->deserializeComplete();
           }
         }
-        danglingReferences.erase(*id_it);
+        danglingReferences.erase(entry);
       }
     }
   }
@@ -151,16 +162,43 @@ static Serializable* createInstance(ObjectData* odata, const string& type, IdCon
   return instance;
 }
 
-Deserializer::Deserializer(): _datastream(0) {
+Deserializer::Deserializer(): _format("JSON"), _datastream(0) {
   _parser=new JSONMessageParser();
   _objectParser=new JSONObjectParser();
 }
 
-Serializable* Deserializer::readObject() {
+bool Deserializer::setFormat(const string& format) {
+  MessageParser* parser=0;
+  ObjectParser* objectParser=0;
+  if (format=="JSON") {
+    parser=new JSONMessageParser();
+    objectParser=new JSONObjectParser();
+  } else if (format=="BINARY") {
+    parser=new BinaryMessageParser();
+    objectParser=new BinaryObjectParser();
+  } else {
+    return false;
+  }
+  delete _parser;
+  delete _objectParser;
+  _parser=parser;
+  _objectParser=objectParser;
+  _format=format;
+  return true;
+}
+
+bool Deserializer::openDataStream() {
   if (!_datastream) {
-    _datastream=new ifstream(_dataFileName.c_str());
+    _datastream=openLogInputStream(_dataFileName);
+    if (*_datastream && isBinaryFormat(*_datastream)) {
+      setFormat("BINARY");
+    }
   }
-  if (!(*_datastream)) {
+  return !_datastream->fail();
+}
+
+Serializable* Deserializer::readObject() {
+  if (!openDataStream()) {
     return 0;
   }
 
@@ -173,10 +211,7 @@ Serializable* Deserializer::readObject() {
 }
 
 Message* Deserializer::readMessage() {
-  if (!_datastream) {
-    _datastream=new ifstream(_dataFileName.c_str());
-  }
-  if (!(*_datastream)) {
+  if (!openDataStream()) {
     return 0;
   }
 
@@ -188,71 +223,454 @@ Message* Deserializer::readMessage() {
     return 0;
   }
 
-  //Check if this is an Identifiable object
-  ObjectData* odata=msgData->getData();
-  ValueData* idValue=odata->getField("#id");
+  Serializable* instance=createInstance(msgData->getData(), msgData->getType(), *this, _waitingInstances, _danglingReferences);
+  if (!instance) {
+    return 0;
+  }
+  return new Message(msgData->getTimestamp(),msgData->getSource(),instance);
+}
 
-  //Identifiable objects are overwritten if another message
-  //with the same ID is read, so first check if the ID is already in the context
-  Serializable* instance=0;
-  if (idValue) {
-    instance=getById(idValue->getInt());
-    if (instance) {
-      IdPlaceholder* placeHolder=dynamic_cast<IdPlaceholder*>(instance);
-      if (placeHolder) {
-        //Found instance is a placeholder, replace it
-        instance=0;
-      }
+static void collectPointers(ValueData* vdata, vector<int>& pointers) {
+  switch (vdata->type()) {
+  case OBJECT: {
+    ObjectData* data=static_cast<ObjectData*>(vdata);
+    ValueData* pfield=data->getField("#pointer");
+    if (pfield) {
+      pointers.push_back(pfield->getInt());
+      return;
     }
+    for (size_t i=0;i<data->numFields();i++) {
+      collectPointers(data->fieldValue(i),pointers);
+    }
+    break;
   }
+  case ARRAY: {
+    ArrayData* v_array=static_cast<ArrayData*>(vdata);
+    for (vector<ValueData*>::const_iterator v_it=v_array->begin();v_it!=v_array->end();v_it++) {
+      collectPointers(*v_it,pointers);
+    }
+    break;
+  }
+  default:
+    break;
+  }
+}
 
-  if (instance) {
-    //Just to ensure that the found instance has right type
-    if (instance->className()!=msgData->getType()) {
-      stringstream msg;
-      msg << "Trying to overwrite " << instance->className() << " (ID " << idValue->getInt() << ") with " << msgData->getType();
-      throw logic_error(msg.str()); 
+bool Deserializer::loadIndex() {
+  _index.clear();
+  _indexById.clear();
+  _indexByTime.clear();
+  ifstream is(logIndexPath(_dataFileName).c_str());
+  if (!is || !readLogIndex(is,_index)) {
+    _index.clear();
+    return false;
+  }
+  for (size_t i=0;i<_index.size();i++) {
+    const LogIndexEntry& entry=_index[i];
+    if (entry.id>=0) {
+      //The last declaration wins, as when reading sequentially
+      _indexById[entry.id]=i;
+    }
+    if (entry.timestamp>=0) {
+      _indexByTime.push_back(make_pair(entry.timestamp,i));
+    }
+  }
+  stable_sort(_indexByTime.begin(),_indexByTime.end());
+  return true;
+}
+
+bool Deserializer::seekTimestamp(double timestamp) {
+  if (!openDataStream() && !_datastream->eof()) {
+    return false;
+  }
+  vector<pair<double,size_t> >::iterator it=lower_bound(_indexByTime.begin(),_indexByTime.end(),make_pair(timestamp,(size_t)0));
+  if (it==_indexByTime.end()) {
+    return false;
+  }
+  _datastream->clear();
+  _datastream->seekg(_index[it->second].offset);
+  return !_datastream->fail();
+}
+
+Serializable* Deserializer::loadById(int id) {
+  Identifiable* existing=getById(id);
+  if (existing && !dynamic_cast<IdPlaceholder*>(existing)) {
+    return existing;
+  }
+  map<int,size_t>::iterator it=_indexById.find(id);
+  //Ids being loaded are in a pointer cycle, the placeholder is resolved when their record is read
+  if (it==_indexById.end() || _loadingIds.count(id)) {
+    return 0;
+  }
+  if (!openDataStream() && !_datastream->eof()) {
+    return 0;
+  }
+  const LogIndexEntry& entry=_index[it->second];
+  _datastream->clear();
+  streampos position=_datastream->tellg();
+  _datastream->seekg(entry.offset);
+  auto_ptr<MessageData> msgData;
+  auto_ptr<ObjectData> objData;
+  ObjectData* odata=0;
+  string type;
+  if (entry.kind=='M') {
+    msgData.reset(_parser->readMessage(*_datastream));
+    if (msgData.get()) {
+      odata=msgData->getData();
+      type=msgData->getType();
     }
   } else {
-    try {
-      instance=Serializable::createInstance(msgData->getType());
-    } catch (logic_error& e) {
-      //TODO Notify this occurrence
-      return 0;
+    objData.reset(_objectParser->readObject(*_datastream,type));
+    odata=objData.get();
+  }
+  _datastream->clear();
+  _datastream->seekg(position);
+  if (!odata) {
+    return 0;
+  }
+
+  //Load the pointed instances first, so that this one is complete when created
+  _loadingIds.insert(id);
+  vector<int> pointers;
+  collectPointers(odata,pointers);
+  for (vector<int>::iterator p_it=pointers.begin();p_it!=pointers.end();p_it++) {
+    if (*p_it>=0 && *p_it!=id) {
+      loadById(*p_it);
     }
   }
+  _loadingIds.erase(id);
+  return createInstance(odata, type, *this, _waitingInstances, _danglingReferences);
+}
 
-  vector<int> danglingPointers;
-  vector<int> declaredIDs;
+void Deserializer::resolveDanglingReferences() {
+  vector<int> ids;
+  for (boost::unordered_map<int,vector<Serializable*> >::iterator it=_danglingReferences.begin();it!=_danglingReferences.end();it++) {
+    ids.push_back(it->first);
+  }
+  //Same order of a sorted map
+  sort(ids.begin(),ids.end());
+  for (vector<int>::iterator id_it=ids.begin();id_it!=ids.end();id_it++) {
+    loadById(*id_it);
+  }
+}
 
-  processData(msgData->getData(), *this, danglingPointers,declaredIDs);
-  instance->deserialize(*odata,*this);
+//Size of the data parsed by each thread in a round of bulk loading,
+//small enough to have the parsed records still in cache when the instances are created
+static const size_t BULK_CHUNK_SIZE=16*1024;
 
-  for (vector<int>::iterator dp_it=danglingPointers.begin();dp_it!=danglingPointers.end();dp_it++) {
-    _waitingInstances[instance].insert(*dp_it);
-    _danglingReferences[*dp_it].insert(instance);
+namespace {
+
+struct BulkRecord {
+  BulkRecord(): message(0), object(0) {}
+  MessageData* message;
+  ObjectData* object;
+  string type;
+};
+
+//Range of records parsed by one thread, each thread has its own parsers since they keep state.
+//The parsed records are released by the same thread at the next round, so that its allocator
+//gets back the memory instead of growing
+struct BulkParseTask {
+  BulkParseTask(): begin(0), end(0), records(0), parser(0), objectParser(0) {}
+  ~BulkParseTask() {
+    clear();
+    delete parser;
+    delete objectParser;
   }
-  for (vector<int>::iterator id_it=declaredIDs.begin();id_it!=declaredIDs.end();id_it++) {
-    //Further check, just in case the ID was a fake field
-    if (getById(*id_it)) {
-      map<int,set<Serializable*> >::iterator entry=_danglingReferences.find(*id_it);
-      if (entry!=_danglingReferences.end()) {
-        set<Serializable*>& instSet=(*entry).second;
-        for (set<Serializable*>::iterator instance_it=instSet.begin();instance_it!=instSet.end();instance_it++) {
-          _waitingInstances[*instance_it].erase(*id_it);
-          if (_waitingInstances[*instance_it].empty()) {
-            _waitingInstances.erase(*instance_it);
-            (*instance_it)->deserializeComplete();
+  void clear() {
+    for (size_t i=0;i<results.size();i++) {
+      delete results[i].message;
+      delete results[i].object;
+    }
+    results.clear();
+  }
+  void run() {
+    clear();
+    results.resize(records);
+    MemoryInputStream is(begin,end);
+    for (size_t i=0;i<records;i++) {
+      BulkRecord& record=results[i];
+      if (parser) {
+        record.message=parser->readMessage(is);
+      } else {
+        record.object=objectParser->readObject(is,record.type);
+      }
+    }
+  }
+
+  const char* begin;
+  const char* end;
+  size_t records;
+  vector<BulkRecord> results;
+  MessageParser* parser;
+  ObjectParser* objectParser;
+};
+
+//Worker threads living for a whole bulk read, the calling thread runs the first task of each round
+struct BulkParsePool {
+  BulkParsePool(): round(0), pending(0), stop(false) {
+    pthread_mutex_init(&mutex,0);
+    pthread_cond_init(&start,0);
+    pthread_cond_init(&done,0);
+  }
+  ~BulkParsePool() {
+    pthread_mutex_lock(&mutex);
+    stop=true;
+    pthread_cond_broadcast(&start);
+    pthread_mutex_unlock(&mutex);
+    for (size_t t=0;t<workers.size();t++) {
+      pthread_join(workers[t],0);
+    }
+    pthread_cond_destroy(&done);
+    pthread_cond_destroy(&start);
+    pthread_mutex_destroy(&mutex);
+  }
+
+  //Run the first n tasks and wait for them to finish
+  void run(int n) {
+    pthread_mutex_lock(&mutex);
+    active=n;
+    pending=n-1;
+    round++;
+    pthread_cond_broadcast(&start);
+    pthread_mutex_unlock(&mutex);
+    tasks[0].run();
+    pthread_mutex_lock(&mutex);
+    while (pending) {
+      pthread_cond_wait(&done,&mutex);
+    }
+    pthread_mutex_unlock(&mutex);
+  }
+
+  struct Worker {
+    BulkParsePool* pool;
+    int task;
+  };
+
+  static void* work(void* arg) {
+    Worker* worker=static_cast<Worker*>(arg);
+    BulkParsePool* pool=worker->pool;
+    int lastRound=0;
+    for (;;) {
+      pthread_mutex_lock(&pool->mutex);
+      while (!pool->stop && pool->round==lastRound) {
+        pthread_cond_wait(&pool->start,&pool->mutex);
+      }
+      if (pool->stop) {
+        pthread_mutex_unlock(&pool->mutex);
+        return 0;
+      }
+      lastRound=pool->round;
+      bool active=worker->task<pool->active;
+      pthread_mutex_unlock(&pool->mutex);
+      if (!active) {
+        continue;
+      }
+      pool->tasks[worker->task].run();
+      pthread_mutex_lock(&pool->mutex);
+      if (!--pool->pending) {
+        pthread_cond_signal(&pool->done);
+      }
+      pthread_mutex_unlock(&pool->mutex);
+    }
+  }
+
+  void startWorkers() {
+    workerArgs.resize(tasks.size()-1);
+    workers.resize(tasks.size()-1);
+    for (size_t t=0;t<workers.size();t++) {
+      workerArgs[t].pool=this;
+      workerArgs[t].task=t+1;
+      if (pthread_create(&workers[t],0,work,&workerArgs[t])) {
+        workers.resize(t);
+        throw runtime_error("cannot start the bulk parsing threads");
+      }
+    }
+  }
+
+  vector<BulkParseTask> tasks;
+  vector<Worker> workerArgs;
+  vector<pthread_t> workers;
+  pthread_mutex_t mutex;
+  pthread_cond_t start;
+  pthread_cond_t done;
+  int round;
+  int active;
+  int pending;
+  bool stop;
+};
+
+}
+
+//Find the record boundaries in the buffer, return the size of the complete records
+static size_t splitRecords(const string& buffer, bool binary, vector<size_t>& ends) {
+  ends.clear();
+  size_t pos=0;
+  if (!binary) {
+    while (pos<buffer.size()) {
+      const char* nl=static_cast<const char*>(memchr(buffer.data()+pos,'\n',buffer.size()-pos));
+      if (!nl) {
+        break;
+      }
+      pos=nl-buffer.data()+1;
+      ends.push_back(pos);
+    }
+    return pos;
+  }
+  while (pos+2<buffer.size()) {
+    size_t p=pos+2;
+    uint64_t size=0;
+    int shift=0;
+    bool complete=false;
+    while (p<buffer.size() && shift<64) {
+      unsigned char c=static_cast<unsigned char>(buffer[p++]);
+      size|=static_cast<uint64_t>(c&0x7f)<<shift;
+      if (!(c&0x80)) {
+        complete=true;
+        break;
+      }
+      shift+=7;
+    }
+    if (!complete || size>buffer.size()-p) {
+      break;
+    }
+    pos=p+size;
+    ends.push_back(pos);
+  }
+  return pos;
+}
+
+size_t Deserializer::bulkRead(vector<Serializable*>* objects, vector<Message*>* messages, int threads) {
+  if (!openDataStream()) {
+    return 0;
+  }
+  if (threads<=0) {
+    threads=sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  size_t count=0;
+  if (threads<=1) {
+    //Nothing to overlap, the plain sequential read is faster
+    if (messages) {
+      Message* message;
+      while ((message=readMessage())) {
+        messages->push_back(message);
+        count++;
+      }
+    } else {
+      Serializable* object;
+      while ((object=readObject())) {
+        objects->push_back(object);
+        count++;
+      }
+    }
+    return count;
+  }
+
+  bool binary=(_format=="BINARY");
+  BulkParsePool pool;
+  pool.tasks.resize(threads);
+  for (int t=0;t<threads;t++) {
+    if (messages) {
+      pool.tasks[t].parser=binary?static_cast<MessageParser*>(new BinaryMessageParser()):new JSONMessageParser();
+    } else {
+      pool.tasks[t].objectParser=binary?static_cast<ObjectParser*>(new BinaryObjectParser()):new JSONObjectParser();
+    }
+  }
+  pool.startWorkers();
+
+  string buffer;
+  vector<size_t> ends;
+  bool done=false;
+  while (!done) {
+    //Phase 1: read a block of whole records and parse it in parallel
+    streamoff blockOffset=_datastream->tellg();
+    size_t blockSize=BULK_CHUNK_SIZE*threads;
+    size_t used=0;
+    buffer.clear();
+    while (!used) {
+      size_t oldSize=buffer.size();
+      buffer.resize(oldSize+blockSize);
+      _datastream->read(&buffer[oldSize],blockSize);
+      buffer.resize(oldSize+_datastream->gcount());
+      bool eof=!*_datastream;
+      if (eof && !binary && !buffer.empty() && buffer[buffer.size()-1]!='\n') {
+        //The last line may have no newline
+        buffer.push_back('\n');
+      }
+      used=splitRecords(buffer,binary,ends);
+      if (eof) {
+        done=true;
+        break;
+      }
+    }
+    if (ends.empty()) {
+      break;
+    }
+    //Give back the incomplete record at the end of the block
+    if (!done) {
+      _datastream->seekg(blockOffset+static_cast<streamoff>(used));
+    }
+
+    size_t first=0;
+    int nTasks=0;
+    for (int t=0;t<threads && first<ends.size();t++) {
+      //Split by size, so that the threads get roughly the same amount of data
+      size_t begin=first?ends[first-1]:0;
+      size_t target=begin+(used-begin)/(threads-t);
+      size_t last=lower_bound(ends.begin()+first,ends.end(),target)-ends.begin();
+      if (last>=ends.size()) {
+        last=ends.size()-1;
+      }
+      BulkParseTask& task=pool.tasks[nTasks++];
+      task.begin=buffer.data()+begin;
+      task.end=buffer.data()+ends[last];
+      task.records=last-first+1;
+      first=last+1;
+    }
+    pool.run(nTasks);
+
+    //Phase 2: create the instances in file order, as readObject()/readMessage() would
+    size_t failed=ends.size();
+    size_t r=0;
+    for (int t=0;t<nTasks && failed==ends.size();t++) {
+      vector<BulkRecord>& results=pool.tasks[t].results;
+      for (size_t i=0;i<results.size();i++,r++) {
+        BulkRecord& record=results[i];
+        Serializable* instance=0;
+        if (messages && record.message) {
+          instance=createInstance(record.message->getData(), record.message->getType(), *this, _waitingInstances, _danglingReferences);
+          if (instance) {
+            messages->push_back(new Message(record.message->getTimestamp(),record.message->getSource(),instance));
           }
+        } else if (objects && record.object) {
+          instance=createInstance(record.object, record.type, *this, _waitingInstances, _danglingReferences);
+          if (instance) {
+            objects->push_back(instance);
+          }
+        }
+        if (!instance) {
+          failed=r;
+          break;
         }
-        _danglingReferences.erase(*id_it);
+        count++;
       }
     }
+    if (failed<ends.size()) {
+      //Stop at the first failure, the next read starts after the failed record
+      _datastream->clear();
+      _datastream->seekg(blockOffset+static_cast<streamoff>(ends[failed]));
+      break;
+    }
   }
-  if (danglingPointers.empty()) {
-    instance->deserializeComplete();
-  }
-  return new Message(msgData->getTimestamp(),msgData->getSource(),instance);
+  return count;
+}
+
+size_t Deserializer::readAllObjects(vector<Serializable*>& objects, int threads) {
+  return bulkRead(&objects,0,threads);
+}
+
+size_t Deserializer::readAllMessages(vector<Message*>& messages, int threads) {
+  return bulkRead(0,&messages,threads);
 }
 
 static void adjustBinaryPath(string& fname, string& basename) {
@@ -283,11 +701,23 @@ istream* Deserializer::getBinaryInputStream(const string& fname) {
   return new ifstream(str.c_str());
 }
 
+istream* Deserializer::getPackedBLOBInputStream(const BLOBLocation& location) {
+  return _blobStore.read(location);
+}
+
 void Deserializer::setFilePath(const string& fpath) {
   if (fpath.length()==0) {
     return;
   }
   _dataFileName=fpath;
+  _index.clear();
+  _indexById.clear();
+  _indexByTime.clear();
+
+  //Packed BLOBs are relative to the data file directory, as the BLOB files
+  size_t pos=_dataFileName.rfind('/');
+  _blobStore.unmapSegments();
+  _blobStore.setBaseDirectory(pos==string::npos?string("."):_dataFileName.substr(0,pos));
 
   if (_datastream) {
     delete _datastream;
@@ -25,8 +25,11 @@
 #include <vector>
 #include <istream>
 #include <string>
+#include <boost/unordered_map.hpp>
 
 #include "serialization_context.h"
+#include "log_index.h"
+#include "blob_store.h"
 
 namespace boss {
   
@@ -44,11 +47,13 @@ public:
   /*
    * Set file path for main data file.
    * Binary files use this path as base directory.
+   * Paths ending with ".gz" are read as block compressed (see compressed_stream.h).
    */
   void setFilePath(const std::string& fpath);
   
   /*
-   * Set data file format (default is "JSON").
+   * Set data file format, "JSON" (default) or "BINARY".
+   * Binary files are also recognized when the data file is opened.
    */
   bool setFormat(const std::string& format);
 
@@ -70,21 +75,87 @@ public:
    */
   Serializable* readObject();
 
+  /*!
+   * \brief Read all the remaining objects of the file.
+   * \details The file is parsed in blocks, each split among parallel threads; then the instances are
+   * created and the pointers resolved in file order, with the same result of calling readObject()
+   * until it returns a null pointer. The caller takes ownership of the instances.
+   * \param threads number of parsing threads, if not positive the number of cores
+   * \return the number of objects read
+   */
+  size_t readAllObjects(std::vector<Serializable*>& objects, int threads=0);
+
+  /*!
+   * \brief Read all the remaining messages of the file, in parallel as readAllObjects().
+   * The caller takes ownership of the messages and their instances.
+   */
+  size_t readAllMessages(std::vector<Message*>& messages, int threads=0);
+
+  /*!
+   * \brief Load the sidecar index of the data file (written by Serializer::setIndexEnabled).
+   * \return false if the data file has no valid index
+   */
+  bool loadIndex();
+
+  const std::vector<LogIndexEntry>& index() const {
+    return _index;
+  }
+
+  /*!
+   * \brief True if the instance with the given id can be loaded with loadById().
+   */
+  bool isIndexed(int id) const {
+    return _indexById.count(id);
+  }
+
+  /*!
+   * \brief Move the read position to the message with the smallest timestamp not less than the given one.
+   * \details Requires the index. The following calls to readMessage()/readObject() continue from there;
+   * pointers to instances written before can be loaded with resolveDanglingReferences().
+   * \return false if there is no such message
+   */
+  bool seekTimestamp(double timestamp);
+
+  /*!
+   * \brief Load the instance with the given id, after the instances it points to (recursively).
+   * \details Requires the index, the read position is not changed. The loaded dependencies
+   * can be retrieved with getById().
+   * \return the instance, or a null pointer if the id is not in the index
+   */
+  Serializable* loadById(int id);
+
+  /*!
+   * \brief Load from the index all the instances pointed by the ones read so far but not read yet.
+   */
+  void resolveDanglingReferences();
+
   std::ostream* getBinaryOutputStream(const std::string& fname);
   std::istream* getBinaryInputStream(const std::string& fname);
+  virtual std::istream* getPackedBLOBInputStream(const BLOBLocation& location);
 
   virtual ~Deserializer();
 protected:
+  bool openDataStream();
+  size_t bulkRead(std::vector<Serializable*>* objects, std::vector<Message*>* messages, int threads);
+
   std::string _dataFileName;
+  std::string _format;
 
   MessageParser* _parser;
   ObjectParser* _objectParser;
   std::istream* _datastream;
+  BLOBSegmentStore _blobStore;
   
-  //Map with Identifiable objects that refers to unresolved pointers
-  std::map<Serializable*,std::set<int> > _waitingInstances;
-  //Reverse map
-  std::map<int,std::set<Serializable*> > _danglingReferences;
+  //Sidecar index, with the entries by id and by timestamp
+  std::vector<LogIndexEntry> _index;
+  std::map<int,size_t> _indexById;
+  std::vector<std::pair<double,size_t> > _indexByTime;
+  std::set<int> _loadingIds;
+
+  //Objects that refer to unresolved pointers, with the number of ids still missing
+  boost::unordered_map<Serializable*,int> _waitingInstances;
+  //Objects waiting for each missing id
+  boost::unordered_map<int,std::vector<Serializable*> > _danglingReferences;
 };
 
 }
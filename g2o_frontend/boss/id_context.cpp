@@ -17,6 +17,8 @@
 */
 
 
+#include <algorithm>
+
 #include "id_context.h"
 
 #include "identifiable.h"
@@ -27,17 +29,47 @@ using namespace std;
 using boost::mutex;
 using boost::lock_guard;
 
-IdContext::IdContext(): _lastGeneratedID(0) {}
+//The vector grows to include a new id only if it stays at least half full
+static const size_t MIN_DENSE_SIZE=1024;
+
+IdContext::IdContext(): _denseCount(0), _lastGeneratedID(0), _maxId(-1) {}
 
 bool IdContext::add(Identifiable* obj) {
   lock_guard<mutex> lock(_instances_lock);
   return addImpl(obj);
 }
 
+Identifiable** IdContext::slot(int id, bool create) {
+  if (id>=0 && static_cast<size_t>(id)<_denseInstances.size()) {
+    return &_denseInstances[id];
+  }
+  if (!create) {
+    boost::unordered_map<int, Identifiable*>::iterator instance_pair=_sparseInstances.find(id);
+    return instance_pair==_sparseInstances.end()?0:&(*instance_pair).second;
+  }
+  size_t instances=_denseCount+_sparseInstances.size()+1;
+  if (id>=0 && static_cast<size_t>(id)<max(2*instances,MIN_DENSE_SIZE)) {
+    //Grow the vector, moving there the instances now in its range
+    _denseInstances.resize(max(static_cast<size_t>(id)+1,2*_denseInstances.size()),0);
+    for (boost::unordered_map<int, Identifiable*>::iterator ipair=_sparseInstances.begin();ipair!=_sparseInstances.end();) {
+      if ((*ipair).first>=0 && static_cast<size_t>((*ipair).first)<_denseInstances.size()) {
+        _denseInstances[(*ipair).first]=(*ipair).second;
+        _denseCount++;
+        ipair=_sparseInstances.erase(ipair);
+      } else {
+        ipair++;
+      }
+    }
+    return &_denseInstances[id];
+  }
+  return &_sparseInstances[id];
+}
+
 bool IdContext::addImpl(Identifiable* obj) {
-  Identifiable*& instance=_instances[obj->getId()];
-  if (instance) {
-    IdPlaceholder* placeHolder=dynamic_cast<IdPlaceholder*>(instance);
+  int id=obj->getId();
+  Identifiable** instance=slot(id,true);
+  if (*instance) {
+    IdPlaceholder* placeHolder=dynamic_cast<IdPlaceholder*>(*instance);
     if (placeHolder) {
       placeHolder->resolve(obj);
       placeHolder->_context=0;
@@ -45,14 +77,35 @@ bool IdContext::addImpl(Identifiable* obj) {
     } else {
       return false;
     }
+  } else if (id>=0 && static_cast<size_t>(id)<_denseInstances.size()) {
+    _denseCount++;
+  }
+  *instance=obj;
+  if (id>_maxId) {
+    _maxId=id;
   }
-  instance=obj;
   return true;
 }
 
+void IdContext::eraseImpl(int id) {
+  if (id>=0 && static_cast<size_t>(id)<_denseInstances.size()) {
+    if (_denseInstances[id]) {
+      _denseInstances[id]=0;
+      _denseCount--;
+    }
+  } else {
+    _sparseInstances.erase(id);
+  }
+}
+
 bool IdContext::remove(Identifiable* obj) {
   lock_guard<mutex> lock(_instances_lock);
-  return _instances.erase(obj->getId())>0;
+  Identifiable** instance=slot(obj->getId(),false);
+  if (!instance || !*instance) {
+    return false;
+  }
+  eraseImpl(obj->getId());
+  return true;
 }
 
 bool IdContext::update(Identifiable* obj, int oldId) {
@@ -61,7 +114,7 @@ bool IdContext::update(Identifiable* obj, int oldId) {
   }
   lock_guard<mutex> lock(_instances_lock);
   if (addImpl(obj)) {
-    _instances.erase(oldId);
+    eraseImpl(oldId);
     return true;
   }
   return false;
@@ -69,21 +122,15 @@ bool IdContext::update(Identifiable* obj, int oldId) {
 
 Identifiable* IdContext::getById(int id) {
   lock_guard<mutex> lock(_instances_lock);
-  map<int, Identifiable*>::iterator instance_pair=_instances.find(id);
-  if (instance_pair==_instances.end()) {
-    return 0;
-  }
-  return (*instance_pair).second;
+  Identifiable** instance=slot(id,false);
+  return instance?*instance:0;
 }
 
 int IdContext::generateId() {
   lock_guard<mutex> lock(_instances_lock);
   int minId=_lastGeneratedID+1;
-  if (!_instances.empty()) {
-    int curId=(*_instances.rbegin()).first+1;
-    if (curId>minId) {
-      minId=curId;
-    }
+  if (_maxId+1>minId) {
+    minId=_maxId+1;
   }
   return _lastGeneratedID=minId;
 }
@@ -94,7 +141,14 @@ IdPlaceholder* IdContext::createPlaceHolder(int id) {
 
 IdContext::~IdContext() {
   lock_guard<mutex> lock(_instances_lock);
-  for (map<int, Identifiable*>::iterator ipair=_instances.begin();ipair!=_instances.end();ipair++) {
+  for (vector<Identifiable*>::iterator i_it=_denseInstances.begin();i_it!=_denseInstances.end();i_it++) {
+    if (dynamic_cast<IdPlaceholder*>(*i_it)) {
+      delete *i_it;
+    } else if (*i_it) {
+      (*i_it)->_context=0;
+    }
+  }
+  for (boost::unordered_map<int, Identifiable*>::iterator ipair=_sparseInstances.begin();ipair!=_sparseInstances.end();ipair++) {
     Identifiable* instance=(*ipair).second;
     if (dynamic_cast<IdPlaceholder*>(instance)) {
       delete instance;
@@ -102,6 +156,7 @@ IdContext::~IdContext() {
       instance->_context=0;
     }
   }
-  _instances.clear();
+  _denseInstances.clear();
+  _denseCount=0;
+  _sparseInstances.clear();
 }
-
@@ -20,7 +20,8 @@
 #ifndef BOSS_ID_CONTEXT_H
 #define BOSS_ID_CONTEXT_H
 
-#include <map>
+#include <vector>
+#include <boost/unordered_map.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/locks.hpp>
 
@@ -42,10 +43,22 @@ public:
   
 protected:
   virtual bool addImpl(Identifiable* obj);
+  //Slot of the instance with the given id, null if none and !create
+  Identifiable** slot(int id, bool create);
+  void eraseImpl(int id);
   
-  std::map<int, Identifiable*> _instances;
+  /*
+   * Ids are mostly sequential, so instances are indexed by id in a vector;
+   * ids that would make it too sparse (or negative) are kept in a hash map.
+   * Ids lower than the vector size are always in the vector.
+   */
+  std::vector<Identifiable*> _denseInstances;
+  size_t _denseCount;
+  boost::unordered_map<int, Identifiable*> _sparseInstances;
   boost::mutex _instances_lock;
   int _lastGeneratedID;
+  //Highest id added so far
+  int _maxId;
 };
 
 
@@ -35,6 +35,9 @@ public:
   bool setContext(IdContext* context);
   void ensureValidId(IdContext* context);
   int getId();
+  IdContext* getContext() {
+    return _context;
+  }
   
   virtual void serialize(ObjectData& data, IdContext& context);
   virtual void deserialize(ObjectData& data, IdContext& context);
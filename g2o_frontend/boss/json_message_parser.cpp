@@ -38,9 +38,30 @@ namespace ascii = boost::spirit::ascii;
 namespace phoenix = boost::phoenix;
 namespace fusion = boost::fusion;
 
-struct _json_parser_impl: qi::grammar<Iterator, MessageData*(), ascii::space_type> {
+//Values are allocated in the arena of the record being parsed
+static BoolData* newBool(ValueArena* arena, bool value) {
+  return new (arena) BoolData(value);
+}
+
+static NumberData* newNumber(ValueArena* arena, double value) {
+  return new (arena) NumberData(value);
+}
+
+static StringData* newString(ValueArena* arena, const std::string& value) {
+  return new (arena) StringData(value);
+}
+
+static ArrayData* newArray(ValueArena* arena) {
+  return new (arena) ArrayData(arena);
+}
+
+static ObjectData* newObject(ValueArena* arena) {
+  return new (arena) ObjectData(arena);
+}
+
+struct _json_parser_impl: qi::grammar<Iterator, fusion::vector<double, std::string, std::string, ObjectData*>(), ascii::space_type> {
   
-  _json_parser_impl(): _json_parser_impl::base_type(start) {
+  _json_parser_impl(): _json_parser_impl::base_type(message_struct), arena(0) {
     using qi::double_;
     using qi::char_;
     using qi::_val;
@@ -57,15 +78,13 @@ struct _json_parser_impl: qi::grammar<Iterator, MessageData*(), ascii::space_typ
     using phoenix::construct;
     using phoenix::val;
 
-    start=message_struct[_val=new_<MessageData>(at_c<0>(_1),at_c<1>(_1),at_c<2>(_1),at_c<3>(_1))];
-    
     message_struct = double_ >> string_content >> string_content >> object_;
     
     value_ = bool_ | number_ | string_ | array_ | object_;
     
-    bool_ = lit("true")[_val=new BoolData(true)] | lit("false")[_val=new BoolData(false)];
+    bool_ = lit("true")[_val=bind(&newBool,phoenix::ref(arena),true)] | lit("false")[_val=bind(&newBool,phoenix::ref(arena),false)];
     
-    number_ = double_[_val=new_<NumberData>(_1)];
+    number_ = double_[_val=bind(&newNumber,phoenix::ref(arena),_1)];
     
     string_content = lit('"') >> *(
       +(~char_("\n\\\""))[_val +=_1] |
@@ -79,21 +98,20 @@ struct _json_parser_impl: qi::grammar<Iterator, MessageData*(), ascii::space_typ
       lit("\\t")[_val += '\t']
       ) >> lit('"');
       
-    string_ = string_content[_val=new_<StringData>(_1)];
+    string_ = string_content[_val=bind(&newString,phoenix::ref(arena),_1)];
 
-    array_ = lit('[')[_val=new_<ArrayData>()] >>
+    array_ = lit('[')[_val=bind(&newArray,phoenix::ref(arena))] >>
       -(value_[bind(static_cast<void (ArrayData::*)(ValueData*)> (&ArrayData::add),_val,_1)] % lit(',')) >> lit(']');
     
 
     field_struct = string_content >> lit(':') >> value_;
     
-    object_ = lit('{')[_val=new_<ObjectData>()] >>
+    object_ = lit('{')[_val=bind(&newObject,phoenix::ref(arena))] >>
       -(field_struct[bind(static_cast<void (ObjectData::*)(const std::string&, ValueData*)> (&ObjectData::setField),_val,at_c<0>(_1),at_c<1>(_1))] % lit(',')) >>
       lit('}');
   }
   
   
-  qi::rule<Iterator, MessageData*(), ascii::space_type> start;
   qi::rule<Iterator, std::string(), ascii::space_type> message_type;
   qi::rule<Iterator, std::string(), ascii::space_type> message_source;
   qi::rule<Iterator, ValueData*(), ascii::space_type> value_;
@@ -105,6 +123,8 @@ struct _json_parser_impl: qi::grammar<Iterator, MessageData*(), ascii::space_typ
   qi::rule<Iterator, ObjectData*(), ascii::space_type> object_;
   qi::rule<Iterator, fusion::vector<std::string, ValueData*>(), ascii::space_type> field_struct;
   qi::rule<Iterator, fusion::vector<double, std::string, std::string, ObjectData*>(), ascii::space_type> message_struct;
+
+  ValueArena* arena;
   
 };
 
@@ -117,9 +137,16 @@ MessageData* JSONMessageParser::readMessage(istream& is) {
   if (!getline(is,line)) {
     return 0;
   }
-  MessageData* message=0;
-  qi::phrase_parse(line.begin(),line.end(),*_parser_impl, ascii::space, message);
-  return message;
+  fusion::vector<double, std::string, std::string, ObjectData*> v(0,std::string(),std::string(),0);
+  ValueArena* arena=new ValueArena();
+  _parser_impl->arena=arena;
+  bool ok=qi::phrase_parse(line.begin(),line.end(),*_parser_impl, ascii::space, v);
+  _parser_impl->arena=0;
+  if (!ok || !fusion::at_c<3>(v)) {
+    delete arena;
+    return 0;
+  }
+  return new MessageData(fusion::at_c<0>(v),fusion::at_c<1>(v),fusion::at_c<2>(v),ObjectData::makeRoot(fusion::at_c<3>(v),arena));
 }
 
 JSONMessageParser::~JSONMessageParser() {
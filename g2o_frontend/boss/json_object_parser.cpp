@@ -37,9 +37,30 @@ namespace ascii = boost::spirit::ascii;
 namespace phoenix = boost::phoenix;
 namespace fusion = boost::fusion;
 
+//Values are allocated in the arena of the record being parsed
+static BoolData* newBool(ValueArena* arena, bool value) {
+  return new (arena) BoolData(value);
+}
+
+static NumberData* newNumber(ValueArena* arena, double value) {
+  return new (arena) NumberData(value);
+}
+
+static StringData* newString(ValueArena* arena, const std::string& value) {
+  return new (arena) StringData(value);
+}
+
+static ArrayData* newArray(ValueArena* arena) {
+  return new (arena) ArrayData(arena);
+}
+
+static ObjectData* newObject(ValueArena* arena) {
+  return new (arena) ObjectData(arena);
+}
+
 struct _json_object_parser_impl: qi::grammar<Iterator, fusion::vector<std::string, ObjectData*>(), ascii::space_type> {
   
-  _json_object_parser_impl(): _json_object_parser_impl::base_type(message_struct) {
+  _json_object_parser_impl(): _json_object_parser_impl::base_type(message_struct), arena(0) {
     using qi::double_;
     using qi::char_;
     using qi::_val;
@@ -60,9 +81,9 @@ struct _json_object_parser_impl: qi::grammar<Iterator, fusion::vector<std::strin
     
     value_ = bool_ | number_ | string_ | array_ | object_;
     
-    bool_ = lit("true")[_val=new BoolData(true)] | lit("false")[_val=new BoolData(false)];
+    bool_ = lit("true")[_val=bind(&newBool,phoenix::ref(arena),true)] | lit("false")[_val=bind(&newBool,phoenix::ref(arena),false)];
     
-    number_ = double_[_val=new_<NumberData>(_1)];
+    number_ = double_[_val=bind(&newNumber,phoenix::ref(arena),_1)];
     
     string_content = lit('"') >> *(
       +(~char_("\n\\\""))[_val +=_1] |
@@ -76,15 +97,15 @@ struct _json_object_parser_impl: qi::grammar<Iterator, fusion::vector<std::strin
       lit("\\t")[_val += '\t']
       ) >> lit('"');
       
-    string_ = string_content[_val=new_<StringData>(_1)];
+    string_ = string_content[_val=bind(&newString,phoenix::ref(arena),_1)];
 
-    array_ = lit('[')[_val=new_<ArrayData>()] >>
+    array_ = lit('[')[_val=bind(&newArray,phoenix::ref(arena))] >>
       -(value_[bind(static_cast<void (ArrayData::*)(ValueData*)> (&ArrayData::add),_val,_1)] % lit(',')) >> lit(']');
     
 
     field_struct = string_content >> lit(':') >> value_;
     
-    object_ = lit('{')[_val=new_<ObjectData>()] >>
+    object_ = lit('{')[_val=bind(&newObject,phoenix::ref(arena))] >>
       -(field_struct[bind(static_cast<void (ObjectData::*)(const std::string&, ValueData*)> (&ObjectData::setField),_val,at_c<0>(_1),at_c<1>(_1))] % lit(',')) >>
       lit('}');
   }
@@ -101,6 +122,8 @@ struct _json_object_parser_impl: qi::grammar<Iterator, fusion::vector<std::strin
   qi::rule<Iterator, ArrayData*(), ascii::space_type> array_;
   qi::rule<Iterator, ObjectData*(), ascii::space_type> object_;
   qi::rule<Iterator, fusion::vector<std::string, ValueData*>(), ascii::space_type> field_struct;
+
+  ValueArena* arena;
 };
 
 JSONObjectParser::JSONObjectParser() {
@@ -112,10 +135,17 @@ ObjectData* JSONObjectParser::readObject(istream& is, string& type) {
   if (!getline(is,line)) {
     return 0;
   }
-  fusion::vector<std::string, ObjectData*> v;
-  qi::phrase_parse(line.begin(),line.end(),*_parser_impl, ascii::space, v);
+  fusion::vector<std::string, ObjectData*> v(std::string(),0);
+  ValueArena* arena=new ValueArena();
+  _parser_impl->arena=arena;
+  bool ok=qi::phrase_parse(line.begin(),line.end(),*_parser_impl, ascii::space, v);
+  _parser_impl->arena=0;
+  if (!ok || !fusion::at_c<1>(v)) {
+    delete arena;
+    return 0;
+  }
   type=fusion::at_c<0>(v);
-  return fusion::at_c<1>(v);
+  return ObjectData::makeRoot(fusion::at_c<1>(v),arena);
 }
 
 JSONObjectParser::~JSONObjectParser() {
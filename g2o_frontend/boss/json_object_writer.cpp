@@ -87,17 +87,28 @@ static void writeJSONData(ostream& os, ValueData* val) {
     os << " ]";
     break;
   }
+  case NUMERIC_ARRAY: {
+    os << "[ ";
+    NumericArrayData& n_array=val->getNumericArray();
+    os.precision(n_array.precision());
+    for (size_t i=0;i<n_array.size();i++) {
+      if (i) {
+        os << ", ";
+      }
+      os << n_array.get(i);
+    }
+    os << " ]";
+    break;
+  }
   case OBJECT: {
     os << "{ ";
     ObjectData* o=static_cast<ObjectData*>(val);
-    const vector<string>& fields=o->fields();
-    for (vector<string>::const_iterator f_it=fields.begin();f_it!=fields.end();f_it++) {
-      if (f_it!=fields.begin()) {
+    for (size_t i=0;i<o->numFields();i++) {
+      if (i) {
         os << ", ";
       }
-      ValueData* fdata=o->getField(*f_it);
-      os << '"' << escapeJSONString(*f_it) << "\" : ";
-      writeJSONData(os,fdata);
+      os << '"' << escapeJSONString(o->fieldName(i)) << "\" : ";
+      writeJSONData(os,o->fieldValue(i));
     }
     os << " }";
     break;
@@ -0,0 +1,84 @@
+/*
+    <one line to give the program's name and a brief idea of what it does.>
+    Copyright (C) 2013  <copyright holder> <email>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdlib>
+#include <limits>
+
+#include "log_index.h"
+#include "object_data.h"
+
+using namespace std;
+using namespace boss;
+
+LogIndexEntry::LogIndexEntry(streamoff offset_, char kind_, ObjectData& data, const string& className_, double timestamp_):
+  offset(offset_), kind(kind_), id(-1), timestamp(timestamp_), className(className_) {
+  ValueData* idValue=data.getField("#id");
+  if (idValue) {
+    id=idValue->getInt();
+  }
+  //Objects have no message timestamp, use the one of the instance if any (e.g. sensor data)
+  if (timestamp<0) {
+    ValueData* tsValue=data.getField("timestamp");
+    if (tsValue && tsValue->type()==NUMBER) {
+      timestamp=tsValue->getDouble();
+    }
+  }
+}
+
+string boss::logIndexPath(const string& dataFilePath) {
+  return dataFilePath+".idx";
+}
+
+void boss::writeLogIndexEntry(ostream& os, const LogIndexEntry& entry) {
+  int precision=os.precision();
+  os.precision(numeric_limits<double>::digits10);
+  os << entry.offset << ' ' << entry.kind << ' ' << entry.id << ' ' << entry.timestamp << ' ' << entry.className << '\n';
+  os.precision(precision);
+}
+
+bool boss::readLogIndex(istream& is, vector<LogIndexEntry>& entries) {
+  entries.clear();
+  string line;
+  //Indices of long logs have millions of lines, parse them by hand instead of with streams
+  while (getline(is,line)) {
+    if (line.empty()) {
+      continue;
+    }
+    const char* c=line.c_str();
+    char* end;
+    LogIndexEntry entry;
+    entry.offset=strtoll(c,&end,10);
+    if (end==c || end[0]!=' ' || !end[1]) {
+      return false;
+    }
+    entry.kind=end[1];
+    c=end+2;
+    entry.id=strtol(c,&end,10);
+    if (end==c) {
+      return false;
+    }
+    c=end;
+    entry.timestamp=strtod(c,&end);
+    if (end==c || *end!=' ') {
+      return false;
+    }
+    entry.className=end+1;
+    entries.push_back(entry);
+  }
+  return true;
+}
@@ -0,0 +1,64 @@
+/*
+    <one line to give the program's name and a brief idea of what it does.>
+    Copyright (C) 2013  <copyright holder> <email>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef BOSS_LOG_INDEX_H
+#define BOSS_LOG_INDEX_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace boss {
+
+class ObjectData;
+
+/*
+ * Entry of the sidecar index of a log, one per message or object.
+ * The index is a text file, one entry per line:
+ *   <offset> <kind> <id> <timestamp> <class name>
+ * where kind is M for messages and O for objects, id is -1 for non identifiable instances
+ * and timestamp is -1 if not known.
+ */
+struct LogIndexEntry {
+  LogIndexEntry(): offset(0), kind('M'), id(-1), timestamp(-1) {}
+  LogIndexEntry(std::streamoff offset_, char kind_, ObjectData& data, const std::string& className_, double timestamp_=-1);
+
+  std::streamoff offset;
+  char kind;
+  int id;
+  double timestamp;
+  std::string className;
+};
+
+/*
+ * Index file path for a data file.
+ */
+std::string logIndexPath(const std::string& dataFilePath);
+
+void writeLogIndexEntry(std::ostream& os, const LogIndexEntry& entry);
+
+/*
+ * Read all the entries of an index.
+ * Return false if the index is malformed.
+ */
+bool readLogIndex(std::istream& is, std::vector<LogIndexEntry>& entries);
+
+}
+
+#endif // BOSS_LOG_INDEX_H
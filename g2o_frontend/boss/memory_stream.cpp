@@ -0,0 +1,43 @@
+/*
+    <one line to give the program's name and a brief idea of what it does.>
+    Copyright (C) 2013  <copyright holder> <email>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "memory_stream.h"
+
+using namespace boss;
+using namespace std;
+
+streambuf::pos_type MemoryStreamBuf::seekoff(off_type off, ios_base::seekdir dir, ios_base::openmode which) {
+  if (!(which&ios_base::in)) {
+    return pos_type(off_type(-1));
+  }
+  off_type pos=off;
+  if (dir==ios_base::cur) {
+    pos+=gptr()-eback();
+  } else if (dir==ios_base::end) {
+    pos+=egptr()-eback();
+  }
+  if (pos<0 || pos>egptr()-eback()) {
+    return pos_type(off_type(-1));
+  }
+  setg(eback(),eback()+pos,egptr());
+  return pos_type(pos);
+}
+
+streambuf::pos_type MemoryStreamBuf::seekpos(pos_type pos, ios_base::openmode which) {
+  return seekoff(off_type(pos),ios_base::beg,which);
+}
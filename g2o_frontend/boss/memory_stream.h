@@ -0,0 +1,68 @@
+/*
+    <one line to give the program's name and a brief idea of what it does.>
+    Copyright (C) 2013  <copyright holder> <email>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BOSS_MEMORY_STREAM_H
+#define BOSS_MEMORY_STREAM_H
+
+#include <istream>
+#include <streambuf>
+
+namespace boss {
+
+/*
+ * Read-only stream buffer over a range of memory, the memory is not copied.
+ */
+class MemoryStreamBuf: public std::streambuf {
+public:
+  MemoryStreamBuf(const char* begin, const char* end) {
+    char* b=const_cast<char*>(begin);
+    setg(b,b,b+(end-begin));
+  }
+
+  /*
+   * Range of memory not read yet, to access the data without copying.
+   */
+  const char* current() const {
+    return gptr();
+  }
+  const char* end() const {
+    return egptr();
+  }
+
+protected:
+  virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which=std::ios_base::in);
+  virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which=std::ios_base::in);
+};
+
+/*
+ * Input stream reading a range of memory, which must outlive the stream.
+ */
+class MemoryInputStream: public std::istream {
+public:
+  MemoryInputStream(const char* begin, const char* end):
+    std::istream(0), _buf(begin,end) {
+    rdbuf(&_buf);
+  }
+
+protected:
+  MemoryStreamBuf _buf;
+};
+
+}
+
+#endif // BOSS_MEMORY_STREAM_H
@@ -18,6 +18,10 @@
 
 #include <stdexcept>
 #include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <pthread.h>
 
 #include "object_data.h"
 #include "id_placeholder.h"
@@ -58,12 +62,48 @@ ArrayData& ValueData::getArray() {
   throw logic_error("getArray not allowed for type "+typeName());
 }
 
+NumericArrayData& ValueData::getNumericArray() {
+  throw logic_error("getNumericArray not allowed for type "+typeName());
+}
+
 ObjectData& ValueData::getObject() {
   throw logic_error("getObject not allowed for type "+typeName());
 }
 
 ValueData::~ValueData() {}
 
+//Each allocation is preceded by the arena it comes from, null for the heap
+static const size_t ALLOCATION_HEADER=16;
+
+void* ValueData::operator new(size_t size) {
+  char* p=static_cast<char*>(::operator new(size+ALLOCATION_HEADER));
+  *reinterpret_cast<ValueArena**>(p)=0;
+  return p+ALLOCATION_HEADER;
+}
+
+void* ValueData::operator new(size_t size, ValueArena* arena) {
+  if (!arena) {
+    return operator new(size);
+  }
+  char* p=static_cast<char*>(arena->allocate(size+ALLOCATION_HEADER));
+  *reinterpret_cast<ValueArena**>(p)=arena;
+  return p+ALLOCATION_HEADER;
+}
+
+void ValueData::operator delete(void* ptr) {
+  if (!ptr) {
+    return;
+  }
+  char* p=static_cast<char*>(ptr)-ALLOCATION_HEADER;
+  if (!*reinterpret_cast<ValueArena**>(p)) {
+    ::operator delete(p);
+  }
+}
+
+void ValueData::operator delete(void* ptr, ValueArena* /*arena*/) {
+  operator delete(ptr);
+}
+
 const string& ValueData::typeName() {
   static string boolTypeName="BoolData";
   static string numberTypeName="NumberData";
@@ -72,6 +112,7 @@ const string& ValueData::typeName() {
   static string objectTypeName="ObjectData";
   static string pointerTypeName="PointerData";
   static string pointerRefTypeName="PointerReference";
+  static string numericArrayTypeName="NumericArrayData";
   static string unknown="unknown";
   switch (type()) {
     case BOOL:
@@ -88,6 +129,8 @@ const string& ValueData::typeName() {
       return pointerTypeName;
     case POINTER_REF:
       return pointerRefTypeName;
+    case NUMERIC_ARRAY:
+      return numericArrayTypeName;
     default:
       return unknown;
   }
@@ -155,27 +198,27 @@ void ArrayData::add(ValueData* value) {
 }
 
 void ArrayData::add(double value) {
-  _value.push_back(new NumberData(value));
+  _value.push_back(new (_arena) NumberData(value));
 }
 
 void ArrayData::add(float value) {
-  _value.push_back(new NumberData(value));
+  _value.push_back(new (_arena) NumberData(value));
 }
 
 void ArrayData::add(int value) {
-  _value.push_back(new NumberData(value));
+  _value.push_back(new (_arena) NumberData(value));
 }
 
 void ArrayData::add(bool value) {
-  _value.push_back(new BoolData(value));
+  _value.push_back(new (_arena) BoolData(value));
 }
 
 void ArrayData::add(const string& value) {
-  _value.push_back(new StringData(value));
+  _value.push_back(new (_arena) StringData(value));
 }
 
 void ArrayData::add(const char* value) {
-  _value.push_back(new StringData(value));
+  _value.push_back(new (_arena) StringData(value));
 }
 
 void ArrayData::set(size_t idx, ValueData* value) {
@@ -186,27 +229,80 @@ void ArrayData::set(size_t idx, ValueData* value) {
 }
 
 void ArrayData::set(size_t idx, double value) {
-  set(idx, new NumberData(value));
+  set(idx, new (_arena) NumberData(value));
 }
 
 void ArrayData::set(size_t idx, float value) {
-  set(idx, new NumberData(value));
+  set(idx, new (_arena) NumberData(value));
 }
 
 void ArrayData::set(size_t idx, int value) {
-  set(idx, new NumberData(value));
+  set(idx, new (_arena) NumberData(value));
 }
 
 void ArrayData::set(size_t idx, bool value) {
-  set(idx, new BoolData(value));
+  set(idx, new (_arena) BoolData(value));
 }
 
 void ArrayData::set(size_t idx, const string& value) {
-  set(idx, new StringData(value));
+  set(idx, new (_arena) StringData(value));
 }
 
 void ArrayData::set(size_t idx, const char* value) {
-  set(idx, new StringData(value));
+  set(idx, new (_arena) StringData(value));
+}
+
+//NumericArrayData
+NumericArrayData::NumericArrayData(const float* values, size_t size, ValueArena* arena):
+  _size(size), _isFloat(true), _arena(arena), _array(0) {
+  allocate();
+  memcpy(_values,values,size*sizeof(float));
+}
+
+NumericArrayData::NumericArrayData(const double* values, size_t size, ValueArena* arena):
+  _size(size), _isFloat(false), _arena(arena), _array(0) {
+  allocate();
+  memcpy(_values,values,size*sizeof(double));
+}
+
+NumericArrayData::NumericArrayData(size_t size, bool isFloat, ValueArena* arena):
+  _size(size), _isFloat(isFloat), _arena(arena), _array(0) {
+  allocate();
+}
+
+void NumericArrayData::allocate() {
+  size_t bytes=_size*(_isFloat?sizeof(float):sizeof(double));
+  _values=_arena?_arena->allocate(bytes):new char[bytes];
+}
+
+ValueType NumericArrayData::type() {
+  return NUMERIC_ARRAY;
+}
+
+ArrayData& NumericArrayData::getArray() {
+  if (!_array) {
+    _array=new (_arena) ArrayData(_arena);
+    _array->reserve(_size);
+    for (size_t i=0;i<_size;i++) {
+      if (_isFloat) {
+        _array->add(static_cast<float*>(_values)[i]);
+      } else {
+        _array->add(static_cast<double*>(_values)[i]);
+      }
+    }
+  }
+  return *_array;
+}
+
+NumericArrayData& NumericArrayData::getNumericArray() {
+  return *this;
+}
+
+NumericArrayData::~NumericArrayData() {
+  delete _array;
+  if (!_arena) {
+    delete[] static_cast<char*>(_values);
+  }
 }
 
 
@@ -220,53 +316,142 @@ ObjectData& ObjectData::getObject() {
 }
 
 ObjectData::~ObjectData() {
-  for (map<string, ValueData*>::iterator v_it=_value.begin();v_it!=_value.end();delete (*(v_it++)).second);
+  for (vector<Field>::iterator f_it=_fields.begin();f_it!=_fields.end();f_it++) {
+    delete f_it->value;
+  }
+  if (_ownsArena) {
+    delete _arena;
+  }
 }
 
 ValueData* ObjectData::getField(const string& name) {
-  map<string,ValueData*>::iterator field=_value.find(name);
-  if (field!=_value.end()) {
-    return (*field).second;
+  //Objects have few fields, a linear search is faster than a lookup
+  for (vector<Field>::iterator f_it=_fields.begin();f_it!=_fields.end();f_it++) {
+    if (*f_it->name==name) {
+      return f_it->value;
+    }
   }
   return 0;
 }
 
 void ObjectData::setField(const string& name, ValueData* value) {
-  ValueData*& field=_value[name];
-  if (field) {
-    delete field;
-  } else {
-    _fields.push_back(name);
+  for (vector<Field>::iterator f_it=_fields.begin();f_it!=_fields.end();f_it++) {
+    if (*f_it->name==name) {
+      delete f_it->value;
+      f_it->value=value;
+      return;
+    }
+  }
+  _fields.push_back(Field(internName(name),value));
+}
+
+void ObjectData::setField(const string* name, ValueData* value) {
+  for (vector<Field>::iterator f_it=_fields.begin();f_it!=_fields.end();f_it++) {
+    if (f_it->name==name) {
+      delete f_it->value;
+      f_it->value=value;
+      return;
+    }
+  }
+  _fields.push_back(Field(name,value));
+}
+
+void ObjectData::setFieldValue(size_t idx, ValueData* value) {
+  Field& field=_fields.at(idx);
+  delete field.value;
+  field.value=value;
+}
+
+bool ObjectData::removeField(const string& name) {
+  for (vector<Field>::iterator f_it=_fields.begin();f_it!=_fields.end();f_it++) {
+    if (*f_it->name==name) {
+      delete f_it->value;
+      _fields.erase(f_it);
+      return true;
+    }
+  }
+  return false;
+}
+
+void ObjectData::takeFields(ObjectData& other) {
+  _fields.insert(_fields.end(),other._fields.begin(),other._fields.end());
+  other._fields.clear();
+}
+
+ObjectData* ObjectData::makeRoot(ObjectData* data, ValueArena* arena) {
+  ObjectData* root=new ObjectData(arena,true);
+  root->takeFields(*data);
+  delete data;
+  return root;
+}
+
+static pthread_mutex_t internMutex=PTHREAD_MUTEX_INITIALIZER;
+
+//Names already interned by the calling thread, looked up without the lock
+struct InternedNameLess {
+  bool operator()(const string* a, const string* b) const {
+    return *a<*b;
+  }
+};
+typedef set<const string*, InternedNameLess> InternedNameCache;
+
+static pthread_key_t internCacheKey;
+static pthread_once_t internCacheOnce=PTHREAD_ONCE_INIT;
+
+static void deleteInternCache(void* cache) {
+  delete static_cast<InternedNameCache*>(cache);
+}
+
+static void createInternCacheKey() {
+  pthread_key_create(&internCacheKey,deleteInternCache);
+}
+
+const string* ObjectData::internName(const string& name) {
+  pthread_once(&internCacheOnce,createInternCacheKey);
+  InternedNameCache* cache=static_cast<InternedNameCache*>(pthread_getspecific(internCacheKey));
+  if (!cache) {
+    cache=new InternedNameCache();
+    pthread_setspecific(internCacheKey,cache);
+  }
+  InternedNameCache::const_iterator it=cache->find(&name);
+  if (it!=cache->end()) {
+    return *it;
   }
-  field=value;
+  //Never deleted, objects may be destroyed after static destruction
+  static set<string>* names=new set<string>();
+  pthread_mutex_lock(&internMutex);
+  const string* interned=&*names->insert(name).first;
+  pthread_mutex_unlock(&internMutex);
+  cache->insert(interned);
+  return interned;
 }
 
 void ObjectData::setInt(const string& name, int value) {
-  setField(name, new NumberData(value));
+  setField(name, new (_arena) NumberData(value));
 }
 
 void ObjectData::setDouble(const string& name, double value) {
-  setField(name, new NumberData(value));
+  setField(name, new (_arena) NumberData(value));
 }
 
 void ObjectData::setFloat(const string& name, float value) {
-  setField(name, new NumberData(value));
+  setField(name, new (_arena) NumberData(value));
 }
 
 void ObjectData::setBool(const string& name, bool value) {
-  setField(name, new BoolData(value));
+  setField(name, new (_arena) BoolData(value));
 }
 
 void ObjectData::setString(const string& name, const string& value) {
-  setField(name, new StringData(value));
+  setField(name, new (_arena) StringData(value));
 }
 
 void ObjectData::setString(const string& name, const char* value) {
-  setField(name, new StringData(value));
+  setField(name, new (_arena) StringData(value));
 }
 
 void ObjectData::setPointer(const string& name, Identifiable* ptr) {
-  setField(name, new PointerData(ptr));
+  setField(name, new (_arena) PointerData(ptr));
 }
 
 //PointerData
@@ -27,14 +27,16 @@
 #include <stdexcept>
 
 #include "id_placeholder.h"
+#include "value_arena.h"
 
 namespace boss {
 
 enum ValueType {
-  BOOL, NUMBER, STRING, ARRAY, OBJECT, POINTER, POINTER_REF
+  BOOL, NUMBER, STRING, ARRAY, OBJECT, POINTER, POINTER_REF, NUMERIC_ARRAY
 };
 
 class ArrayData;
+class NumericArrayData;
 class ObjectData;
 class PointerReference;
 
@@ -49,6 +51,7 @@ public:
   virtual PointerReference& getReference();
 
   virtual ArrayData& getArray();
+  virtual NumericArrayData& getNumericArray();
   virtual ObjectData& getObject();
 
   virtual ValueType type()=0;
@@ -70,6 +73,16 @@ public:
   }
 
   virtual ~ValueData();
+
+  /*
+   * Values are allocated on the heap, or in an arena (new (arena) NumberData(...)).
+   * Both are released with delete, which frees only the heap ones: the memory of an
+   * arena is released with the arena.
+   */
+  static void* operator new(size_t size);
+  static void* operator new(size_t size, ValueArena* arena);
+  static void operator delete(void* ptr);
+  static void operator delete(void* ptr, ValueArena* arena);
 };
 
 
@@ -121,6 +134,10 @@ protected:
 
 class ArrayData: public ValueData {
 public:
+  /*
+   * The values created by add() and set() are allocated in arena, if given.
+   */
+  ArrayData(ValueArena* arena=0): _arena(arena) {}
   virtual ValueType type();
   virtual ArrayData& getArray();
   virtual ~ArrayData();
@@ -165,16 +182,83 @@ public:
     _value.push_back(value);
   }
 
+  ValueArena* arena() {
+    return _arena;
+  }
+
 protected:
   std::vector<ValueData*> _value;
+  ValueArena* _arena;
+};
+
+/*
+ * Array of numbers stored contiguously as floats or doubles, e.g. the coefficients of a matrix.
+ * It is written as a plain array of numbers. getArray() returns a copy with a NumberData
+ * per element, for the readers of generic arrays; changes to the copy are not written.
+ */
+class NumericArrayData: public ValueData {
+public:
+  NumericArrayData(const float* values, size_t size, ValueArena* arena=0);
+  NumericArrayData(const double* values, size_t size, ValueArena* arena=0);
+  /*
+   * Uninitialized array, to be filled through floats() or doubles().
+   */
+  NumericArrayData(size_t size, bool isFloat, ValueArena* arena=0);
+
+  virtual ValueType type();
+  virtual ArrayData& getArray();
+  virtual NumericArrayData& getNumericArray();
+
+  size_t size() const {
+    return _size;
+  }
+  bool isFloat() const {
+    return _isFloat;
+  }
+  //Null if the elements are not floats
+  float* floats() {
+    return _isFloat?static_cast<float*>(_values):0;
+  }
+  //Null if the elements are not doubles
+  double* doubles() {
+    return _isFloat?0:static_cast<double*>(_values);
+  }
+  double get(size_t idx) const {
+    return _isFloat?static_cast<const float*>(_values)[idx]:static_cast<const double*>(_values)[idx];
+  }
+  int precision() const {
+    return _isFloat?std::numeric_limits<float>::digits10:std::numeric_limits<double>::digits10;
+  }
+
+  virtual ~NumericArrayData();
+
+protected:
+  void allocate();
+
+  size_t _size;
+  bool _isFloat;
+  void* _values;
+  ValueArena* _arena;
+  ArrayData* _array;
 };
 
 class ObjectData: public ValueData {
 public:
+  /*
+   * The values created by the set methods are allocated in arena, if given.
+   * With ownsArena the arena is deleted with the object, which must be the root of the tree
+   * and allocated on the heap.
+   */
+  ObjectData(ValueArena* arena=0, bool ownsArena=false): _arena(arena), _ownsArena(ownsArena) {}
+
   virtual ValueType type();
   virtual ObjectData& getObject();
 
   void setField(const std::string& name, ValueData* value);
+  /*
+   * Same as above, name must come from internName().
+   */
+  void setField(const std::string* name, ValueData* value);
   void setInt(const std::string& name, int value);
   void setDouble(const std::string& name, double value);
   void setFloat(const std::string& name, float value);
@@ -182,6 +266,7 @@ public:
   void setString(const std::string& name, const char* value);
   void setBool(const std::string& name, bool value);
   void setPointer(const std::string&name, Identifiable* ptr);
+  bool removeField(const std::string& name);
   
   int getInt(const std::string& name) {
     return getField(name)->getInt();
@@ -203,10 +288,26 @@ public:
     return getField(name)->getBool();
   }
   
-  const std::vector<std::string>& fields() {
-    return _fields;
+  /*
+   * Fields in insertion order.
+   */
+  size_t numFields() {
+    return _fields.size();
   }
 
+  const std::string& fieldName(size_t idx) {
+    return *_fields[idx].name;
+  }
+
+  ValueData* fieldValue(size_t idx) {
+    return _fields[idx].value;
+  }
+
+  /*
+   * Replace the value of a field, the old one is deleted.
+   */
+  void setFieldValue(size_t idx, ValueData* value);
+
   PointerReference& getReference(const std::string&name) {
     return getField(name)->getReference();
   }
@@ -216,12 +317,41 @@ public:
   }
   
   ValueData* getField(const std::string& name);
+
+  ValueArena* arena() {
+    return _arena;
+  }
+
+  /*
+   * Move the fields of other at the end of this object, other is left empty.
+   */
+  void takeFields(ObjectData& other);
+
+  /*
+   * Heap allocated root owning arena, with the fields of data (a tree allocated in arena,
+   * which is deleted). Used by the parsers, which build the whole tree in the arena.
+   */
+  static ObjectData* makeRoot(ObjectData* data, ValueArena* arena);
+
+  /*
+   * Shared copy of a field name, names are stored once for all the objects.
+   * Each thread caches the names it has seen, so the parsers take the shared lock
+   * only for the names new to them.
+   */
+  static const std::string* internName(const std::string& name);
   
   virtual ~ObjectData();
 
 protected:
-  std::map<std::string, ValueData*> _value;
-  std::vector<std::string> _fields;
+  struct Field {
+    Field(const std::string* name_, ValueData* value_): name(name_), value(value_) {}
+    const std::string* name;
+    ValueData* value;
+  };
+
+  std::vector<Field> _fields;
+  ValueArena* _arena;
+  bool _ownsArena;
 };
 
 class PointerData: public ValueData {
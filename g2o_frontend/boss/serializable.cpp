@@ -59,7 +59,7 @@ const string& Serializable::className() {
 }
 
 ObjectData* Serializable::getSerializedData(IdContext& context) {
-  ObjectData* o=new ObjectData();
+  ObjectData* o=new ObjectData(new ValueArena(),true);
   serialize(*o,context);
   return o;
 }
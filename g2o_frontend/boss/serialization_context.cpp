@@ -26,3 +26,15 @@ using namespace std;
 string SerializationContext::createBinaryFilePath(BaseBLOBReference& /*instance*/) {
   return "";
 }
+
+bool SerializationContext::writePackedBLOB(BaseBLOBReference& /*instance*/, BLOB& /*blob*/, BLOBLocation& /*location*/) {
+  return false;
+}
+
+istream* SerializationContext::getPackedBLOBInputStream(const BLOBLocation& /*location*/) {
+  return 0;
+}
+
+bool SerializationContext::writeBLOBAsync(BaseBLOBReference& /*instance*/, BLOB& /*blob*/, ObjectData& /*data*/, AsyncBLOBLocation*& /*location*/) {
+  return false;
+}
@@ -29,12 +29,32 @@
 namespace boss {
 
 class Serializer;
+class ObjectData;
 
 class SerializationContext: public IdContext {
 public:
   virtual std::string createBinaryFilePath(BaseBLOBReference& instance);
   virtual std::ostream* getBinaryOutputStream(const std::string& fname)=0;
   virtual std::istream* getBinaryInputStream(const std::string& fname)=0;
+
+  /*
+   * Append a BLOB to the packed segment files, filling its location.
+   * Return false if the context writes each BLOB to its own file (the default).
+   */
+  virtual bool writePackedBLOB(BaseBLOBReference& instance, BLOB& blob, BLOBLocation& location);
+
+  /*
+   * Stream reading a BLOB packed in a segment file, null if not available.
+   */
+  virtual std::istream* getPackedBLOBInputStream(const BLOBLocation& location);
+
+  /*
+   * Take a copy of a BLOB to encode and write in background; the context also writes the
+   * file name or the location in the data of the reference. When packed, location is set to
+   * a handle (owned by the caller) filled with the location once written.
+   * Return false if the BLOB has to be written synchronously (the default).
+   */
+  virtual bool writeBLOBAsync(BaseBLOBReference& instance, BLOB& blob, ObjectData& data, AsyncBLOBLocation*& location);
 };
 
 }
@@ -17,13 +17,20 @@
 */
 
 #include <ctime>
+#include <deque>
 #include <sstream>
+#include <pthread.h>
 #include <boost/filesystem.hpp>
 
 #include "serializer.h"
 #include "json_message_writer.h"
 #include "json_object_writer.h"
+#include "binary_message_writer.h"
+#include "binary_object_writer.h"
 #include "object_data.h"
+#include "message_data.h"
+#include "log_index.h"
+#include "compressed_stream.h"
 
 using namespace std;
 using namespace boss;
@@ -73,12 +80,10 @@ static ValueData* processDataForWrite(ValueData* vdata, SerializationContext& co
   switch (vdata->type()) {
     case OBJECT: {
       ObjectData* o=static_cast<ObjectData*>(vdata);
-      const vector<string>& fields=o->fields();
-      for (vector<string>::const_iterator f_it=fields.begin();f_it!=fields.end();f_it++) {
-        ValueData* fdata=o->getField(*f_it);
-        ValueData* replaceData=processDataForWrite(fdata, context);
+      for (size_t i=0;i<o->numFields();i++) {
+        ValueData* replaceData=processDataForWrite(o->fieldValue(i), context);
         if (replaceData) {
-          o->setField(*f_it,replaceData);
+          o->setFieldValue(i,replaceData);
         }
       }
       break;
@@ -109,7 +114,75 @@ static ValueData* processDataForWrite(ValueData* vdata, SerializationContext& co
   return 0;
 }
 
-Serializer::Serializer(): _datastream(0) {
+//A BLOB copied to be encoded in background
+struct Serializer::AsyncBLOB {
+  AsyncBLOB(AsyncRecord* record_, BLOB* blob_, ObjectData* data_, int id_, const string& className_):
+    record(record_), blob(blob_), data(data_), location(0), id(id_), className(className_) {}
+  ~AsyncBLOB() {
+    if (location) {
+      location->unref();
+    }
+  }
+  AsyncRecord* record;
+  BLOB* blob;
+  //Fields of the reference, the location is written here when packed
+  ObjectData* data;
+  //Location shared with the reference, when packed
+  AsyncBLOBLocation* location;
+  int id;
+  string className;
+  //Full path of the BLOB file, empty when packed
+  string path;
+  string directory;
+  string buffer;
+};
+
+//A message or object waiting for its BLOBs
+struct Serializer::AsyncRecord {
+  AsyncRecord(char kind_): kind(kind_), timestamp(0), data(0), pending(0) {}
+  char kind;
+  double timestamp;
+  string className;
+  string source;
+  ObjectData* data;
+  vector<AsyncBLOB*> blobs;
+  int pending;
+};
+
+struct Serializer::AsyncState {
+  AsyncState(): current(0), writing(0), stop(false) {
+    pthread_mutex_init(&mutex,0);
+    pthread_cond_init(&encodeReady,0);
+    pthread_cond_init(&writeReady,0);
+    pthread_cond_init(&spaceReady,0);
+  }
+  ~AsyncState() {
+    pthread_cond_destroy(&spaceReady);
+    pthread_cond_destroy(&writeReady);
+    pthread_cond_destroy(&encodeReady);
+    pthread_mutex_destroy(&mutex);
+  }
+  pthread_mutex_t mutex;
+  //Signaled when a BLOB is queued for encoding
+  pthread_cond_t encodeReady;
+  //Signaled when a record may be ready for writing
+  pthread_cond_t writeReady;
+  //Signaled when a record has been written
+  pthread_cond_t spaceReady;
+  //Records in write order, the writer takes the front one when all its BLOBs are encoded
+  deque<AsyncRecord*> records;
+  deque<AsyncBLOB*> encodeQueue;
+  vector<pthread_t> threads;
+  //Record being serialized by the caller of write()
+  AsyncRecord* current;
+  //Records taken by the writer and not yet written
+  int writing;
+  bool stop;
+};
+
+Serializer::Serializer(): _datastream(0), _indexEnabled(false), _indexstream(0), _blobStore(0), _blobSegmentSize(0),
+                          _asyncEncoders(0), _maxQueueSize(0), _async(0), _maxQueueDepth(0), _blockedWrites(0),
+                          _encodedBLOBs(0), _totalEncodeTime(0), _maxEncodeTime(0) {
   setFilePath(DEFAULT_DATA_FILE);
   setBinaryPath(DEFAULT_BLOB_FILE);
   _writer=new JSONMessageWriter();
@@ -120,6 +193,7 @@ void Serializer::setFilePath(const string& fpath) {
   if (fpath.length()==0) {
     return;
   }
+  flush();
   _dataFileName=fpath;
   loadCurrentTime(_envMap);
 
@@ -135,6 +209,15 @@ void Serializer::setFilePath(const string& fpath) {
     delete _datastream;
     _datastream=0;
   }
+  if (_indexstream) {
+    delete _indexstream;
+    _indexstream=0;
+  }
+  //The segment names are relative to the datadir, the next write opens a new segment there
+  if (_blobStore) {
+    _blobStore->closeSegment();
+    _blobStore->unmapSegments();
+  }
 }
 
 void Serializer::setBinaryPath(const string& fpath) {
@@ -144,6 +227,30 @@ void Serializer::setBinaryPath(const string& fpath) {
   _blobFileName=fpath;
 }
 
+void Serializer::setBLOBSegmentPath(const string& fpath) {
+  flush();
+  if (fpath.empty()) {
+    delete _blobStore;
+    _blobStore=0;
+    return;
+  }
+  if (!_blobStore) {
+    _blobStore=new BLOBSegmentStore();
+    if (_blobSegmentSize) {
+      _blobStore->setMaxSegmentSize(_blobSegmentSize);
+    }
+  }
+  _blobStore->setSegmentPath(fpath);
+}
+
+void Serializer::setBLOBSegmentSize(uint64_t size) {
+  flush();
+  _blobSegmentSize=size;
+  if (_blobStore) {
+    _blobStore->setMaxSegmentSize(size);
+  }
+}
+
 string Serializer::createBinaryFilePath(BaseBLOBReference& instance) {
   _envMap["classname"]=instance.className();
   _envMap["id"]=toString(instance.getId(),7,'0');
@@ -154,9 +261,110 @@ string Serializer::createBinaryFilePath(BaseBLOBReference& instance) {
   return str;
 }
 
+bool Serializer::setAsyncBLOBs(int encoders, int maxQueueSize) {
+  stopAsync();
+  _asyncEncoders=encoders>0?encoders:0;
+  _maxQueueSize=maxQueueSize>0?maxQueueSize:1;
+  if (!_asyncEncoders) {
+    return true;
+  }
+  _async=new AsyncState();
+  pthread_t thread;
+  if (pthread_create(&thread,0,runWriter,this)) {
+    delete _async;
+    _async=0;
+    _asyncEncoders=0;
+    return false;
+  }
+  _async->threads.push_back(thread);
+  int started=0;
+  for (int i=0;i<_asyncEncoders;i++) {
+    if (!pthread_create(&thread,0,runEncoder,this)) {
+      _async->threads.push_back(thread);
+      started++;
+    }
+  }
+  //Fewer encoders still work, none means writing synchronously
+  _asyncEncoders=started;
+  if (!started) {
+    stopAsync();
+    return false;
+  }
+  return true;
+}
+
+void Serializer::flush() {
+  if (!_async) {
+    return;
+  }
+  pthread_mutex_lock(&_async->mutex);
+  while (!_async->records.empty()||_async->writing) {
+    pthread_cond_wait(&_async->spaceReady,&_async->mutex);
+  }
+  pthread_mutex_unlock(&_async->mutex);
+}
+
+int Serializer::queueDepth() {
+  if (!_async) {
+    return 0;
+  }
+  pthread_mutex_lock(&_async->mutex);
+  int depth=_async->records.size()+_async->writing;
+  pthread_mutex_unlock(&_async->mutex);
+  return depth;
+}
+
+void Serializer::stopAsync() {
+  if (!_async) {
+    return;
+  }
+  flush();
+  pthread_mutex_lock(&_async->mutex);
+  _async->stop=true;
+  pthread_cond_broadcast(&_async->encodeReady);
+  pthread_cond_broadcast(&_async->writeReady);
+  pthread_mutex_unlock(&_async->mutex);
+  for (size_t i=0;i<_async->threads.size();i++) {
+    pthread_join(_async->threads[i],0);
+  }
+  delete _async;
+  _async=0;
+}
+
 bool Serializer::setFormat(const string& format) {
-  //TODO Implementation
-  return format=="JSON";
+  MessageWriter* writer=0;
+  ObjectWriter* objectWriter=0;
+  if (format=="JSON") {
+    writer=new JSONMessageWriter();
+    objectWriter=new JSONObjectWriter();
+  } else if (format=="BINARY") {
+    writer=new BinaryMessageWriter();
+    objectWriter=new BinaryObjectWriter();
+  } else {
+    return false;
+  }
+  delete _writer;
+  delete _objectWriter;
+  _writer=writer;
+  _objectWriter=objectWriter;
+  return true;
+}
+
+void Serializer::setIndexEnabled(bool enabled) {
+  _indexEnabled=enabled;
+}
+
+bool Serializer::openDataStream() {
+  if (!_datastream) {
+    string str=_dataFileName;
+    replaceEnvTags(str,_envMap);
+    create_directories(path(str).parent_path());
+    _datastream=openLogOutputStream(str);
+    if (_indexEnabled) {
+      _indexstream=new ofstream(logIndexPath(str).c_str());
+    }
+  }
+  return !_datastream->fail();
 }
 
 bool Serializer::write(const string& source, Serializable& instance) {
@@ -168,45 +376,183 @@ bool Serializer::write(Message& message) {
 }
 
 bool Serializer::write(double timestamp, const string& source, Serializable& instance) {
-  ObjectData* data=new ObjectData();
+  ObjectData* data=new ObjectData(new ValueArena(),true);
+  AsyncRecord* record=0;
+  if (_async) {
+    record=new AsyncRecord('M');
+    _async->current=record;
+  }
   instance.serialize(*data,*this);
   
   processDataForWrite(data,*this);
 
-  MessageData msgData(timestamp, instance.className(), source, data);
-  if (!_datastream) {
-    string str=_dataFileName;
-    replaceEnvTags(str,_envMap);
-    create_directories(path(str).parent_path());
-    _datastream=new ofstream(str.c_str());
+  if (record) {
+    _async->current=0;
+    record->timestamp=timestamp;
+    record->className=instance.className();
+    record->source=source;
+    record->data=data;
+    return enqueue(record);
   }
-  if (*_datastream) {
-    _writer->writeMessage(*_datastream,msgData);
-    //TODO Change writer to get status flag
-    return true;
-  }
-  return false;
+  return writeRecord('M',timestamp,instance.className(),source,data);
 }
 
 bool Serializer::writeObject(Serializable& instance) {
-  ObjectData* data=new ObjectData();
+  ObjectData* data=new ObjectData(new ValueArena(),true);
+  AsyncRecord* record=0;
+  if (_async) {
+    record=new AsyncRecord('O');
+    _async->current=record;
+  }
   instance.serialize(*data,*this);
 
   processDataForWrite(data,*this);
 
-  if (!_datastream) {
-    string str=_dataFileName;
-    replaceEnvTags(str,_envMap);
-    create_directories(path(str).parent_path());
-    _datastream=new ofstream(str.c_str());
+  if (record) {
+    _async->current=0;
+    record->className=instance.className();
+    record->data=data;
+    return enqueue(record);
   }
-  if (*_datastream) {
-    _objectWriter->writeObject(*_datastream,instance.className(),*data);
-    //TODO Change writer to get status flag
-    return true;
+  return writeRecord('O',0,instance.className(),"",data);
+}
+
+bool Serializer::writeRecord(char kind, double timestamp, const string& className, const string& source, ObjectData* data) {
+  if (!openDataStream()) {
+    delete data;
+    return false;
+  }
+  streamoff offset=_datastream->tellp();
+  if (kind=='M') {
+    //Takes ownership of data
+    MessageData msgData(timestamp, className, source, data);
+    _writer->writeMessage(*_datastream,msgData);
+    if (_indexstream) {
+      writeLogIndexEntry(*_indexstream,LogIndexEntry(offset,kind,*data,className,timestamp));
+    }
+  } else {
+    _objectWriter->writeObject(*_datastream,className,*data);
+    if (_indexstream) {
+      writeLogIndexEntry(*_indexstream,LogIndexEntry(offset,kind,*data,className));
+    }
+    delete data;
   }
-  return false;
+  //TODO Change writer to get status flag
+  return true;
+}
 
+bool Serializer::enqueue(AsyncRecord* record) {
+  //Open the data file here, the writer thread must not touch the environment
+  bool ok=openDataStream();
+  pthread_mutex_lock(&_async->mutex);
+  if (_async->records.size()>=(size_t)_maxQueueSize) {
+    _blockedWrites++;
+    while (_async->records.size()>=(size_t)_maxQueueSize) {
+      pthread_cond_wait(&_async->spaceReady,&_async->mutex);
+    }
+  }
+  _async->records.push_back(record);
+  int depth=_async->records.size()+_async->writing;
+  if (depth>_maxQueueDepth) {
+    _maxQueueDepth=depth;
+  }
+  record->pending=record->blobs.size();
+  if (record->blobs.empty()) {
+    pthread_cond_signal(&_async->writeReady);
+  } else {
+    _async->encodeQueue.insert(_async->encodeQueue.end(),record->blobs.begin(),record->blobs.end());
+    pthread_cond_broadcast(&_async->encodeReady);
+  }
+  pthread_mutex_unlock(&_async->mutex);
+  return ok;
+}
+
+void Serializer::encode(AsyncBLOB* blob) {
+  double start=Message::getCurrentTime();
+  ostringstream os;
+  blob->blob->write(os);
+  blob->buffer=os.str();
+  delete blob->blob;
+  blob->blob=0;
+  double elapsed=Message::getCurrentTime()-start;
+
+  pthread_mutex_lock(&_async->mutex);
+  _encodedBLOBs++;
+  _totalEncodeTime+=elapsed;
+  if (elapsed>_maxEncodeTime) {
+    _maxEncodeTime=elapsed;
+  }
+  if (!--blob->record->pending) {
+    pthread_cond_signal(&_async->writeReady);
+  }
+  pthread_mutex_unlock(&_async->mutex);
+}
+
+void Serializer::writeAsyncRecord(AsyncRecord* record) {
+  for (size_t i=0;i<record->blobs.size();i++) {
+    AsyncBLOB* blob=record->blobs[i];
+    if (blob->path.empty()) {
+      BLOBLocation location;
+      _blobStore->setBaseDirectory(blob->directory);
+      _blobStore->write(blob->buffer.data(),blob->buffer.size(),blob->id,blob->className,location);
+      blob->data->setString("segment",location.segment);
+      blob->data->setDouble("offset",location.offset);
+      blob->data->setDouble("size",location.size);
+      blob->location->set(location);
+    } else {
+      create_directories(path(blob->path).parent_path());
+      std::ofstream os(blob->path.c_str(), ios::out|ios::binary);
+      os.write(blob->buffer.data(),blob->buffer.size());
+    }
+    delete blob;
+  }
+  writeRecord(record->kind,record->timestamp,record->className,record->source,record->data);
+  delete record;
+}
+
+void* Serializer::runWriter(void* serializer) {
+  Serializer* s=static_cast<Serializer*>(serializer);
+  AsyncState* async=s->_async;
+  pthread_mutex_lock(&async->mutex);
+  for (;;) {
+    while (!async->stop&&(async->records.empty()||async->records.front()->pending)) {
+      pthread_cond_wait(&async->writeReady,&async->mutex);
+    }
+    if (async->records.empty()) {
+      break;
+    }
+    AsyncRecord* record=async->records.front();
+    async->records.pop_front();
+    async->writing++;
+    pthread_mutex_unlock(&async->mutex);
+    s->writeAsyncRecord(record);
+    pthread_mutex_lock(&async->mutex);
+    async->writing--;
+    pthread_cond_broadcast(&async->spaceReady);
+  }
+  pthread_mutex_unlock(&async->mutex);
+  return 0;
+}
+
+void* Serializer::runEncoder(void* serializer) {
+  Serializer* s=static_cast<Serializer*>(serializer);
+  AsyncState* async=s->_async;
+  pthread_mutex_lock(&async->mutex);
+  for (;;) {
+    while (!async->stop&&async->encodeQueue.empty()) {
+      pthread_cond_wait(&async->encodeReady,&async->mutex);
+    }
+    if (async->encodeQueue.empty()) {
+      break;
+    }
+    AsyncBLOB* blob=async->encodeQueue.front();
+    async->encodeQueue.pop_front();
+    pthread_mutex_unlock(&async->mutex);
+    s->encode(blob);
+    pthread_mutex_lock(&async->mutex);
+  }
+  pthread_mutex_unlock(&async->mutex);
+  return 0;
 }
 
 static void adjustBinaryPath(string& fname, map<string,string>& envMap) {
@@ -231,16 +577,70 @@ istream* Serializer::getBinaryInputStream(const string& fname) {
   if (fname.empty()) {
     return 0;
   }
+  //A BLOB written in background may not be on disk yet
+  flush();
   string str=fname;
   adjustBinaryPath(str,_envMap);
   return new ifstream(str.c_str());
 }
 
+bool Serializer::writePackedBLOB(BaseBLOBReference& instance, BLOB& blob, BLOBLocation& location) {
+  if (!_blobStore) {
+    return false;
+  }
+  //The segment is shared with the writer thread
+  flush();
+  _blobStore->setBaseDirectory(_envMap["datadir"]);
+  return _blobStore->write(instance,blob,location);
+}
+
+istream* Serializer::getPackedBLOBInputStream(const BLOBLocation& location) {
+  if (!_blobStore) {
+    return 0;
+  }
+  flush();
+  return _blobStore->read(location);
+}
+
+bool Serializer::writeBLOBAsync(BaseBLOBReference& instance, BLOB& blob, ObjectData& data, AsyncBLOBLocation*& location) {
+  if (!_async||!_async->current) {
+    return false;
+  }
+  BLOB* copy=blob.clone();
+  if (!copy) {
+    return false;
+  }
+  AsyncBLOB* asyncBlob=new AsyncBLOB(_async->current,copy,&data,instance.getId(),instance.className());
+  if (_blobStore) {
+    //The location is known only when written, the fields keep their position
+    asyncBlob->directory=_envMap["datadir"];
+    asyncBlob->location=new AsyncBLOBLocation();
+    asyncBlob->location->ref();
+    location=asyncBlob->location;
+    data.setString("segment","");
+    data.setDouble("offset",0);
+    data.setDouble("size",0);
+  } else {
+    string fname=createBinaryFilePath(instance);
+    instance.setFileName(fname);
+    asyncBlob->path=fname;
+    adjustBinaryPath(asyncBlob->path,_envMap);
+    data.setString("pathName",fname);
+  }
+  _async->current->blobs.push_back(asyncBlob);
+  return true;
+}
+
 Serializer::~Serializer() {
+  stopAsync();
   delete _writer;
   delete _objectWriter;
   if (_datastream) {
     delete _datastream;
   }
+  if (_indexstream) {
+    delete _indexstream;
+  }
+  delete _blobStore;
 }
 
@@ -25,6 +25,7 @@
 #include "serialization_context.h"
 #include "message.h"
 #include "blob.h"
+#include "blob_store.h"
 
 namespace boss {
 
@@ -37,6 +38,7 @@ public:
   
   /*
    * Set file path for main data file.
+   * Paths ending with ".gz" are written block compressed (see compressed_stream.h).
    */
   void setFilePath(const std::string& fpath);
   
@@ -46,12 +48,77 @@ public:
    * to the directory name, if any.
    */
   void setBinaryPath(const std::string& fpath);
+
+  /*
+   * Pack the BLOBs into segment files instead of writing one file per BLOB (see BLOBSegmentStore).
+   * The tag <segment> in the path is replaced with the segment number; unless an absolute path
+   * is specified the path is relative to the main data file directory.
+   * An empty path (default) writes one file per BLOB, following setBinaryPath().
+   */
+  void setBLOBSegmentPath(const std::string& fpath);
+
+  /*
+   * Size above which a new BLOB segment is started (default 1GB).
+   */
+  void setBLOBSegmentSize(uint64_t size);
   
   /*
-   * Set data file format (default is "JSON").
+   * Set data file format, "JSON" (default) or "BINARY".
+   * Must be called before writing the first message.
    */
   bool setFormat(const std::string& format);
 
+  /*
+   * Write a sidecar index (<data file>.idx) with offset, id, class name and timestamp
+   * of each message, used by Deserializer for random access.
+   * Must be called before writing the first message.
+   */
+  void setIndexEnabled(bool enabled);
+  bool indexEnabled() const {
+    return _indexEnabled;
+  }
+
+  /*
+   * Encode the BLOBs in background with a pool of encoder threads, so that write() does not wait
+   * for the encoding (e.g. the image compression). Messages and objects are queued and written in
+   * order by a writer thread once their BLOBs are encoded; write() blocks only when maxQueueSize
+   * records are pending. BLOBs that do not support BLOB::clone() are encoded synchronously.
+   * With packed BLOBs the location is known only when written, getLocation() of the
+   * references is empty until then.
+   * encoders=0 (default) writes everything synchronously.
+   * Must be called before writing the first message.
+   * Return false if the threads could not be started, everything is then written synchronously.
+   */
+  bool setAsyncBLOBs(int encoders, int maxQueueSize=64);
+
+  /*
+   * Wait until all the queued messages and objects are written.
+   * Called when the file is changed or the serializer destroyed.
+   */
+  void flush();
+
+  /*
+   * Counters of the async BLOB encoding.
+   */
+  int queueDepth();
+  int maxQueueDepth() const {
+    return _maxQueueDepth;
+  }
+  //Number of times write() had to wait for a free slot in the queue
+  int blockedWrites() const {
+    return _blockedWrites;
+  }
+  int encodedBLOBs() const {
+    return _encodedBLOBs;
+  }
+  //Encoding time of a BLOB (seconds)
+  double meanEncodeTime() const {
+    return _encodedBLOBs?_totalEncodeTime/_encodedBLOBs:0;
+  }
+  double maxEncodeTime() const {
+    return _maxEncodeTime;
+  }
+
   /* Write a message.
    * Return false if an error occurred during serialization.
    */
@@ -67,10 +134,27 @@ public:
   virtual std::string createBinaryFilePath(BaseBLOBReference& instance);
   virtual std::ostream* getBinaryOutputStream(const std::string& fname);
   virtual std::istream* getBinaryInputStream(const std::string& fname);
+  virtual bool writePackedBLOB(BaseBLOBReference& instance, BLOB& blob, BLOBLocation& location);
+  virtual std::istream* getPackedBLOBInputStream(const BLOBLocation& location);
+  virtual bool writeBLOBAsync(BaseBLOBReference& instance, BLOB& blob, ObjectData& data, AsyncBLOBLocation*& location);
 
   virtual ~Serializer();
   
 protected:
+  struct AsyncState;
+  struct AsyncRecord;
+  struct AsyncBLOB;
+
+  bool openDataStream();
+  bool writeRecord(char kind, double timestamp, const std::string& className, const std::string& source, ObjectData* data);
+  bool enqueue(AsyncRecord* record);
+  void writeAsyncRecord(AsyncRecord* record);
+  void encode(AsyncBLOB* blob);
+  void stopAsync();
+  static void* runWriter(void* serializer);
+  static void* runEncoder(void* serializer);
+
+
   std::string _dataFileName;
   std::string _blobFileName;
   std::map<std::string, std::string> _envMap;
@@ -78,6 +162,19 @@ protected:
   MessageWriter* _writer;
   ObjectWriter* _objectWriter;
   std::ostream* _datastream;
+  bool _indexEnabled;
+  std::ostream* _indexstream;
+  BLOBSegmentStore* _blobStore;
+  uint64_t _blobSegmentSize;
+
+  int _asyncEncoders;
+  int _maxQueueSize;
+  AsyncState* _async;
+  int _maxQueueDepth;
+  int _blockedWrites;
+  int _encodedBLOBs;
+  double _totalEncodeTime;
+  double _maxEncodeTime;
 };
 
 }
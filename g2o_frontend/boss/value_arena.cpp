@@ -0,0 +1,57 @@
+/*
+    <one line to give the program's name and a brief idea of what it does.>
+    Copyright (C) 2013  <copyright holder> <email>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "value_arena.h"
+
+using namespace std;
+using namespace boss;
+
+static const size_t ARENA_ALIGNMENT=16;
+static const size_t MAX_BLOCK_SIZE=64*1024;
+
+ValueArena::ValueArena(size_t blockSize): _current(0), _left(0), _blockSize(blockSize), _allocated(0) {}
+
+void* ValueArena::allocate(size_t size) {
+  size=(size+ARENA_ALIGNMENT-1)&~(ARENA_ALIGNMENT-1);
+  _allocated+=size;
+  if (size>_left) {
+    //Large values get a block of their own, the current one is kept
+    if (size>_blockSize/2) {
+      char* block=new char[size];
+      _blocks.push_back(block);
+      return block;
+    }
+    _current=new char[_blockSize];
+    _blocks.push_back(_current);
+    _left=_blockSize;
+    //Trees with many values use larger blocks
+    if (_blockSize<MAX_BLOCK_SIZE) {
+      _blockSize*=2;
+    }
+  }
+  void* p=_current;
+  _current+=size;
+  _left-=size;
+  return p;
+}
+
+ValueArena::~ValueArena() {
+  for (vector<char*>::iterator b_it=_blocks.begin();b_it!=_blocks.end();b_it++) {
+    delete[] *b_it;
+  }
+}
@@ -0,0 +1,64 @@
+/*
+    <one line to give the program's name and a brief idea of what it does.>
+    Copyright (C) 2013  <copyright holder> <email>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef BOSS_VALUE_ARENA_H
+#define BOSS_VALUE_ARENA_H
+
+#include <cstddef>
+#include <vector>
+
+namespace boss {
+
+/*
+ * Memory for the values of a data tree (a message or an object), allocated in blocks and
+ * released all together when the arena is deleted.
+ * Not thread safe, each tree is built by a single thread.
+ */
+class ValueArena {
+public:
+  ValueArena(size_t blockSize=4096);
+
+  /*
+   * Memory aligned for any value type.
+   */
+  void* allocate(size_t size);
+
+  /*
+   * Bytes allocated so far.
+   */
+  size_t allocated() const {
+    return _allocated;
+  }
+
+  ~ValueArena();
+
+protected:
+  ValueArena(const ValueArena&);
+  ValueArena& operator=(const ValueArena&);
+
+  std::vector<char*> _blocks;
+  char* _current;
+  size_t _left;
+  size_t _blockSize;
+  size_t _allocated;
+};
+
+}
+
+#endif // BOSS_VALUE_ARENA_H
@@ -0,0 +1,212 @@
+/*
+ * boss_blob_packer.cpp
+ *
+ * Migrates a boss log written with one file per BLOB to packed BLOB segments.
+ * Every BLOB reference in the log (an object with "#id" and "pathName") gets its file
+ * appended to a segment, and its "pathName" replaced by the segment location.
+ * Works on the raw message data, so the classes in the log need not be linked.
+ * The BLOB files of the input log are left untouched.
+ */
+
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+
+#include "g2o_frontend/boss/binary_format.h"
+#include "g2o_frontend/boss/binary_message_parser.h"
+#include "g2o_frontend/boss/binary_message_writer.h"
+#include "g2o_frontend/boss/binary_object_parser.h"
+#include "g2o_frontend/boss/binary_object_writer.h"
+#include "g2o_frontend/boss/compressed_stream.h"
+#include "g2o_frontend/boss/json_message_parser.h"
+#include "g2o_frontend/boss/json_message_writer.h"
+#include "g2o_frontend/boss/json_object_parser.h"
+#include "g2o_frontend/boss/json_object_writer.h"
+#include "g2o_frontend/boss/message_data.h"
+#include "g2o_frontend/boss/object_data.h"
+#include "g2o_frontend/boss/blob_store.h"
+
+using namespace std;
+using namespace boss;
+
+const char* banner[] = {
+  "boss_blob_packer: packs the BLOB files of a boss log into segment files",
+  "usage: boss_blob_packer [-segmentPath <path>] [-segmentSize <MB>] <input log> <output log>",
+  "  -segmentPath: segment files, relative to the output log directory, default binary/segment.<segment>.blob",
+  "  -segmentSize: size above which a new segment is started, default 1024 MB",
+  0
+};
+
+void printBanner() {
+  const char** b = banner;
+  while (*b) {
+    cerr << *b << endl;
+    b++;
+  }
+}
+
+static string directory(const string& fname) {
+  size_t pos = fname.rfind('/');
+  if (pos == string::npos)
+    return ".";
+  return fname.substr(0, pos);
+}
+
+struct PackStats {
+  PackStats(): blobs(0), missing(0), bytes(0) {}
+  int blobs;
+  int missing;
+  uint64_t bytes;
+};
+
+static void packBLOBs(ValueData* vdata, const string& inputDir, BLOBSegmentStore& store, PackStats& stats) {
+  if (vdata->type() == ARRAY) {
+    ArrayData& array = vdata->getArray();
+    for (size_t i=0; i<array.size(); i++)
+      packBLOBs(&array[i], inputDir, store, stats);
+    return;
+  }
+  if (vdata->type() != OBJECT)
+    return;
+  ObjectData* odata = static_cast<ObjectData*>(vdata);
+  ValueData* path = odata->getField("pathName");
+  ValueData* id = odata->getField("#id");
+  if (path && id && path->type() == STRING) {
+    string fname = path->getString();
+    if (fname.empty())
+      return;
+    if (fname[0] != '/')
+      fname = inputDir + "/" + fname;
+    ifstream is(fname.c_str(), ios::in|ios::binary);
+    if (! is) {
+      cerr << "missing BLOB file " << fname << endl;
+      stats.missing++;
+      return;
+    }
+    vector<char> buffer((istreambuf_iterator<char>(is)), istreambuf_iterator<char>());
+    BLOBLocation location;
+    if (! store.write(buffer.empty() ? 0 : &buffer[0], buffer.size(), id->getInt(), path->getString(), location)) {
+      cerr << "cannot write the BLOB segment " << location.segment << endl;
+      exit(1);
+    }
+    odata->removeField("pathName");
+    odata->setString("segment", location.segment);
+    odata->setDouble("offset", location.offset);
+    odata->setDouble("size", location.size);
+    stats.blobs++;
+    stats.bytes += location.size;
+    return;
+  }
+  for (size_t i=0; i<odata->numFields(); i++)
+    packBLOBs(odata->fieldValue(i), inputDir, store, stats);
+}
+
+// JSON messages start with the timestamp, JSON objects with the quoted class name
+static bool nextIsObject(istream& is, bool binary) {
+  if (binary) {
+    // peek past the sync byte to the record kind
+    istream::pos_type pos = is.tellg();
+    is.get();
+    int kind = is.get();
+    is.clear();
+    is.seekg(pos);
+    return kind == BINARY_OBJECT_RECORD;
+  }
+  while (is.peek()==' ' || is.peek()=='\t')
+    is.get();
+  return is.peek()=='"';
+}
+
+int main(int argc, char** argv) {
+  string segmentPath;
+  uint64_t segmentSize = 0;
+  int c = 1;
+  while (c<argc && argv[c][0]=='-') {
+    if (! strcmp(argv[c], "-segmentPath") && c+1<argc) {
+      c++;
+      segmentPath = argv[c];
+    } else if (! strcmp(argv[c], "-segmentSize") && c+1<argc) {
+      c++;
+      segmentSize = static_cast<uint64_t>(atof(argv[c])*1024*1024);
+    } else {
+      printBanner();
+      return 1;
+    }
+    c++;
+  }
+  if (argc-c != 2) {
+    printBanner();
+    return 1;
+  }
+  string inputFile = argv[c];
+  string outputFile = argv[c+1];
+
+  auto_ptr<istream> input(openLogInputStream(inputFile));
+  istream& is = *input;
+  if (! is) {
+    cerr << "cannot open " << inputFile << endl;
+    return 1;
+  }
+  bool binary = isBinaryFormat(is);
+
+  auto_ptr<MessageParser> messageParser;
+  auto_ptr<ObjectParser> objectParser;
+  auto_ptr<MessageWriter> messageWriter;
+  auto_ptr<ObjectWriter> objectWriter;
+  if (binary) {
+    messageParser.reset(new BinaryMessageParser);
+    objectParser.reset(new BinaryObjectParser);
+    messageWriter.reset(new BinaryMessageWriter);
+    objectWriter.reset(new BinaryObjectWriter);
+  } else {
+    messageParser.reset(new JSONMessageParser);
+    objectParser.reset(new JSONObjectParser);
+    messageWriter.reset(new JSONMessageWriter);
+    objectWriter.reset(new JSONObjectWriter);
+  }
+
+  BLOBSegmentStore store;
+  store.setBaseDirectory(directory(outputFile));
+  if (! segmentPath.empty())
+    store.setSegmentPath(segmentPath);
+  if (segmentSize)
+    store.setMaxSegmentSize(segmentSize);
+
+  auto_ptr<ostream> output(openLogOutputStream(outputFile));
+  ostream& os = *output;
+  if (! os) {
+    cerr << "cannot open " << outputFile << endl;
+    return 1;
+  }
+  string inputDir = directory(inputFile);
+  PackStats stats;
+  int records = 0;
+  while (is && is.peek()!=EOF) {
+    if (nextIsObject(is, binary)) {
+      string type;
+      auto_ptr<ObjectData> odata(objectParser->readObject(is, type));
+      if (! odata.get())
+	break;
+      packBLOBs(odata.get(), inputDir, store, stats);
+      objectWriter->writeObject(os, type, *odata);
+    } else {
+      auto_ptr<MessageData> mdata(messageParser->readMessage(is));
+      if (! mdata.get())
+	break;
+      packBLOBs(mdata->getData(), inputDir, store, stats);
+      messageWriter->writeMessage(os, *mdata);
+    }
+    records++;
+  }
+  if (is && is.peek()!=EOF)
+    cerr << "parse error after " << records << " records" << endl;
+  cerr << "packed " << stats.blobs << " BLOBs (" << stats.bytes/(1024*1024) << " MB) from " << records << " records";
+  if (stats.missing)
+    cerr << ", " << stats.missing << " BLOB files missing";
+  cerr << endl;
+  return stats.missing ? 2 : 0;
+}
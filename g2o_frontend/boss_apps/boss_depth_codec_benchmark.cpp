@@ -0,0 +1,154 @@
+/*
+ * boss_depth_codec_benchmark.cpp
+ *
+ * Compares size and speed of the formats of the 16 bit depth images of ImageBLOB:
+ * PGM, PNG and the d16 lossless codec. The images are taken from the ImageData of a
+ * boss log, or from PGM files; each one is written and read back through ImageBLOB
+ * and checked to be identical to the original.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "g2o_frontend/boss/deserializer.h"
+#include "g2o_frontend/boss/memory_stream.h"
+#include "g2o_frontend/boss/message.h"
+#include "g2o_frontend/boss_map/image_sensor.h"
+
+using namespace std;
+using namespace boss;
+using namespace boss_map;
+
+const char* banner[] = {
+  "boss_depth_codec_benchmark: size and speed of the depth image formats of ImageBLOB",
+  "usage: boss_depth_codec_benchmark [-n <images>] [-repeat <times>] <boss log> | <pgm files>",
+  "  -n: maximum number of depth images taken from the log (default 100)",
+  "  -repeat: number of times each image is encoded and decoded (default 3)",
+  0
+};
+
+void printBanner() {
+  const char** b = banner;
+  while (*b) {
+    cerr << *b << endl;
+    b++;
+  }
+}
+
+static bool endsWith(const string& s, const string& suffix) {
+  return s.size()>=suffix.size() && s.compare(s.size()-suffix.size(), suffix.size(), suffix)==0;
+}
+
+static void readLogImages(vector<cv::Mat>& images, const string& filename, size_t maxImages) {
+  Deserializer des;
+  des.setFilePath(filename);
+  Serializable* o;
+  while (images.size()<maxImages && (o=des.readObject())) {
+    ImageData* imageData = dynamic_cast<ImageData*>(o);
+    if (! imageData)
+      continue;
+    ImageBLOB* blob = imageData->imageBlob().get();
+    if (blob && blob->cvImage().type()==CV_16UC1)
+      images.push_back(blob->cvImage().clone());
+    imageData->imageBlob().set(0);
+  }
+}
+
+struct CodecResult {
+  CodecResult(): bytes(0), encodeTime(0), decodeTime(0), errors(0) {}
+  double bytes;
+  double encodeTime;
+  double decodeTime;
+  int errors;
+};
+
+static void benchmark(CodecResult& result, const string& extension, const cv::Mat& image, int repeat) {
+  ImageBLOB blob;
+  blob.cvImage() = image;
+  blob.adjustFormat();
+  blob.setExtension(extension);
+  string data;
+  double t0 = Message::getCurrentTime();
+  for (int r=0; r<repeat; r++) {
+    ostringstream os;
+    blob.write(os);
+    data = os.str();
+  }
+  result.encodeTime += (Message::getCurrentTime()-t0)/repeat;
+  result.bytes += data.size();
+
+  ImageBLOB decoded;
+  t0 = Message::getCurrentTime();
+  for (int r=0; r<repeat; r++) {
+    MemoryInputStream is(data.data(), data.data()+data.size());
+    decoded.read(is);
+  }
+  result.decodeTime += (Message::getCurrentTime()-t0)/repeat;
+  const cv::Mat& d = decoded.cvImage();
+  if (d.rows!=image.rows || d.cols!=image.cols || d.type()!=image.type() || cv::countNonZero(d!=image))
+    result.errors++;
+}
+
+int main(int argc, char** argv) {
+  size_t maxImages = 100;
+  int repeat = 3;
+  int c = 1;
+  while (c<argc && argv[c][0]=='-') {
+    if (! strcmp(argv[c], "-n") && c+1<argc) {
+      c++;
+      maxImages = atoi(argv[c]);
+    } else if (! strcmp(argv[c], "-repeat") && c+1<argc) {
+      c++;
+      repeat = atoi(argv[c]);
+    } else {
+      printBanner();
+      return 1;
+    }
+    c++;
+  }
+  if (c>=argc || repeat<1) {
+    printBanner();
+    return 1;
+  }
+
+  vector<cv::Mat> images;
+  for (; c<argc; c++) {
+    if (endsWith(argv[c], ".pgm")) {
+      cv::Mat image = cv::imread(argv[c], -1);
+      if (image.type()==CV_16UC1)
+	images.push_back(image);
+      else
+	cerr << argv[c] << " is not a 16 bit image" << endl;
+    } else
+      readLogImages(images, argv[c], maxImages);
+  }
+  if (images.empty()) {
+    cerr << "no depth images" << endl;
+    return 1;
+  }
+
+  const char* formats[] = {"pgm", "png", "d16", 0};
+  double pixels = 0;
+  for (size_t i=0; i<images.size(); i++)
+    pixels += images[i].rows*images[i].cols;
+  cout << "images: " << images.size() << endl;
+  for (int f=0; formats[f]; f++) {
+    CodecResult result;
+    for (size_t i=0; i<images.size(); i++)
+      benchmark(result, formats[f], images[i], repeat);
+    cout << formats[f] << ": " << result.bytes/images.size()/1024 << " KB/image, "
+	 << result.bytes*8/pixels << " bits/pixel, encode " << result.encodeTime/images.size()*1e3
+	 << " ms/image, decode " << result.decodeTime/images.size()*1e3 << " ms/image";
+    if (result.errors)
+      cout << ", " << result.errors << " images NOT identical";
+    cout << endl;
+  }
+  return 0;
+}
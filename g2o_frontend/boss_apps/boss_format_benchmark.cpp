@@ -0,0 +1,160 @@
+/*
+ * boss_format_benchmark.cpp
+ *
+ * Measures the parsing throughput of the JSON and of the binary boss formats.
+ * The messages are taken from a log, or generated if no log is given,
+ * and written in memory in both formats before timing the parsers.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <memory>
+#include <vector>
+
+#include "g2o_frontend/boss/binary_format.h"
+#include "g2o_frontend/boss/binary_message_parser.h"
+#include "g2o_frontend/boss/binary_message_writer.h"
+#include "g2o_frontend/boss/json_message_parser.h"
+#include "g2o_frontend/boss/json_message_writer.h"
+#include "g2o_frontend/boss/message.h"
+#include "g2o_frontend/boss/message_data.h"
+#include "g2o_frontend/boss/object_data.h"
+
+using namespace std;
+using namespace boss;
+
+const char* banner[] = {
+  "boss_format_benchmark: parsing throughput of the JSON and binary boss formats",
+  "usage: boss_format_benchmark [-n <messages>] [-repeat <times>] [<message log>]",
+  "  -n: number of generated messages, if no log is given (default 100000)",
+  "  -repeat: number of times each stream is parsed (default 3)",
+  0
+};
+
+void printBanner() {
+  const char** b = banner;
+  while (*b) {
+    cerr << *b << endl;
+    b++;
+  }
+}
+
+// a message that resembles the sensor data in the logs: an id, some pointers,
+// a transform, a camera matrix and a few scalars
+MessageData* makeMessage(int i) {
+  ObjectData* o = new ObjectData;
+  o->setInt("#id", i);
+  o->setString("topic", "/camera/depth_registered/image_rect_raw");
+  o->setDouble("timestamp", 1381848243.123456 + i*0.033);
+  ObjectData* frame = new ObjectData;
+  frame->setInt("#pointer", i+1000000);
+  o->setField("robotReferenceFrame", frame);
+  ObjectData* sensor = new ObjectData;
+  sensor->setInt("#pointer", 7);
+  o->setField("sensor", sensor);
+  ArrayData* transform = new ArrayData;
+  for (int k=0; k<6; k++)
+    transform->add((float) (0.001f*i*(k+1)));
+  ObjectData* t = new ObjectData;
+  t->setField("values", transform);
+  o->setField("transform", t);
+  ArrayData* cameraMatrix = new ArrayData;
+  float K[] = {525, 0, 319.5, 0, 525, 239.5, 0, 0, 1};
+  for (int k=0; k<9; k++)
+    cameraMatrix->add(K[k]);
+  ObjectData* cm = new ObjectData;
+  cm->setField("values", cameraMatrix);
+  o->setField("cameraMatrix", cm);
+  ObjectData* blob = new ObjectData;
+  blob->setString("pathName", "binary/PinholeImageData.0012345.pgm");
+  o->setField("imageBlob", blob);
+  return new MessageData(1381848243.123456 + i*0.033, "PinholeImageData", "", o);
+}
+
+double parse(MessageParser& parser, const string& data, int repeat, int& count) {
+  double t0 = Message::getCurrentTime();
+  for (int r=0; r<repeat; r++) {
+    istringstream is(data);
+    count = 0;
+    while (1) {
+      auto_ptr<MessageData> m(parser.readMessage(is));
+      if (! m.get())
+	break;
+      count++;
+    }
+  }
+  return (Message::getCurrentTime() - t0)/repeat;
+}
+
+int main(int argc, char** argv) {
+  int n = 100000;
+  int repeat = 3;
+  const char* filename = 0;
+  int c = 1;
+  while (c<argc) {
+    if (! strcmp(argv[c], "-n") && c+1<argc) {
+      n = atoi(argv[++c]);
+    } else if (! strcmp(argv[c], "-repeat") && c+1<argc) {
+      repeat = atoi(argv[++c]);
+    } else if (argv[c][0] == '-') {
+      printBanner();
+      return 1;
+    } else {
+      filename = argv[c];
+    }
+    c++;
+  }
+
+  // collect the messages
+  vector<MessageData*> messages;
+  if (filename) {
+    ifstream is(filename, ios::in|ios::binary);
+    auto_ptr<MessageParser> parser;
+    if (isBinaryFormat(is))
+      parser.reset(new BinaryMessageParser);
+    else
+      parser.reset(new JSONMessageParser);
+    MessageData* m;
+    while ((m = parser->readMessage(is)))
+      messages.push_back(m);
+  } else {
+    for (int i=0; i<n; i++)
+      messages.push_back(makeMessage(i));
+  }
+  if (messages.empty()) {
+    cerr << "no messages" << endl;
+    return 1;
+  }
+
+  // write them in both formats
+  ostringstream jsonStream, binaryStream;
+  JSONMessageWriter jsonWriter;
+  BinaryMessageWriter binaryWriter;
+  for (size_t i=0; i<messages.size(); i++) {
+    jsonWriter.writeMessage(jsonStream, *messages[i]);
+    binaryWriter.writeMessage(binaryStream, *messages[i]);
+    delete messages[i];
+  }
+  string jsonData = jsonStream.str();
+  string binaryData = binaryStream.str();
+
+  JSONMessageParser jsonParser;
+  BinaryMessageParser binaryParser;
+  int jsonCount, binaryCount;
+  double jsonTime = parse(jsonParser, jsonData, repeat, jsonCount);
+  double binaryTime = parse(binaryParser, binaryData, repeat, binaryCount);
+
+  double mb = 1024.0*1024.0;
+  cout << "messages: " << messages.size() << endl;
+  cout << "JSON:   " << jsonData.size()/mb << " MB, " << jsonCount << " messages parsed in " 
+       << jsonTime << " s, " << jsonData.size()/mb/jsonTime << " MB/s, " 
+       << jsonCount/jsonTime << " messages/s" << endl;
+  cout << "BINARY: " << binaryData.size()/mb << " MB, " << binaryCount << " messages parsed in " 
+       << binaryTime << " s, " << binaryData.size()/mb/binaryTime << " MB/s, " 
+       << binaryCount/binaryTime << " messages/s" << endl;
+  cout << "speedup (messages/s): " << jsonTime/binaryTime << endl;
+  return 0;
+}
@@ -0,0 +1,168 @@
+/*
+ * boss_id_context_benchmark.cpp
+ *
+ * Measures the loading of a log with many identifiables, dominated by the id lookups
+ * and by the tracking of the pointers to instances not read yet.
+ * A synthetic log of nodes is written, each pointing to the previous and to the next
+ * one (a forward reference); then it is loaded with the Deserializer and every
+ * instance is looked up by id.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "g2o_frontend/boss/binary_object_writer.h"
+#include "g2o_frontend/boss/deserializer.h"
+#include "g2o_frontend/boss/identifiable.h"
+#include "g2o_frontend/boss/json_object_writer.h"
+#include "g2o_frontend/boss/message.h"
+#include "g2o_frontend/boss/object_data.h"
+
+using namespace std;
+using namespace boss;
+
+const char* banner[] = {
+  "boss_id_context_benchmark: loading time of a log with many identifiables",
+  "usage: boss_id_context_benchmark [-n <nodes>] [-sparse <fraction>] [-json] <log file>",
+  "  -n: number of nodes written in the log (default 10000000)",
+  "  -sparse: fraction of the nodes with an id far from the others (default 0.01)",
+  "  -json: write the log in JSON instead of binary",
+  "  the log file is overwritten",
+  0
+};
+
+void printBanner() {
+  const char** b = banner;
+  while (*b) {
+    cerr << *b << endl;
+    b++;
+  }
+}
+
+class BenchmarkNode: public Identifiable {
+public:
+  BenchmarkNode(int id=-1, IdContext* context=0): Identifiable(id, context), previous(0), next(0) {}
+
+  virtual void serialize(ObjectData& data, IdContext& context) {
+    Identifiable::serialize(data, context);
+    data.setPointer("previous", previous);
+    data.setPointer("next", next);
+  }
+
+  virtual void deserialize(ObjectData& data, IdContext& context) {
+    Identifiable::deserialize(data, context);
+    data.getReference("previous").bind(previous);
+    data.getReference("next").bind(next);
+  }
+
+  virtual void deserializeComplete() {
+    completed++;
+  }
+
+  BenchmarkNode* previous;
+  BenchmarkNode* next;
+  static size_t completed;
+};
+
+size_t BenchmarkNode::completed = 0;
+
+BOSS_REGISTER_CLASS(BenchmarkNode)
+
+// every 1/sparse nodes, one gets an id far above the sequential ones
+static int nodeId(int i, double sparse) {
+  int period = sparse>0 ? (int) (1/sparse) : 0;
+  if (period && i%period == period-1)
+    return 1000000000 + i;
+  return i;
+}
+
+static void setPointer(ObjectData& data, const string& name, int id) {
+  ObjectData* pointer = new (data.arena()) ObjectData(data.arena());
+  pointer->setInt("#pointer", id);
+  data.setField(name, pointer);
+}
+
+int main(int argc, char** argv) {
+  int n = 10000000;
+  double sparse = 0.01;
+  bool json = false;
+  int c = 1;
+  while (c<argc && argv[c][0]=='-') {
+    if (! strcmp(argv[c], "-n") && c+1<argc) {
+      c++;
+      n = atoi(argv[c]);
+    } else if (! strcmp(argv[c], "-sparse") && c+1<argc) {
+      c++;
+      sparse = atof(argv[c]);
+    } else if (! strcmp(argv[c], "-json")) {
+      json = true;
+    } else {
+      printBanner();
+      return 1;
+    }
+    c++;
+  }
+  if (argc-c != 1 || n<1) {
+    printBanner();
+    return 1;
+  }
+  string filename = argv[c];
+
+  double t0 = Message::getCurrentTime();
+  {
+    ofstream os(filename.c_str(), ios::out|ios::binary);
+    if (! os) {
+      cerr << "cannot open " << filename << endl;
+      return 1;
+    }
+    auto_ptr<ObjectWriter> writer;
+    if (json)
+      writer.reset(new JSONObjectWriter);
+    else
+      writer.reset(new BinaryObjectWriter);
+    for (int i=0; i<n; i++) {
+      ObjectData data(new ValueArena(), true);
+      data.setInt("#id", nodeId(i, sparse));
+      setPointer(data, "previous", i ? nodeId(i-1, sparse) : -1);
+      setPointer(data, "next", i+1<n ? nodeId(i+1, sparse) : -1);
+      writer->writeObject(os, "BenchmarkNode", data);
+    }
+  }
+  double t1 = Message::getCurrentTime();
+  cout << "nodes: " << n << ", written in " << t1-t0 << " s" << endl;
+
+  vector<Serializable*> nodes;
+  nodes.reserve(n);
+  {
+    Deserializer des;
+    des.setFilePath(filename);
+    t0 = Message::getCurrentTime();
+    Serializable* o;
+    while ((o=des.readObject()))
+      nodes.push_back(o);
+    t1 = Message::getCurrentTime();
+    cout << "loaded " << nodes.size() << " nodes in " << t1-t0 << " s ("
+	 << nodes.size()/(t1-t0) << " nodes/s), completed " << BenchmarkNode::completed << endl;
+
+    t0 = Message::getCurrentTime();
+    int errors = 0;
+    for (int i=0; i<n; i++) {
+      BenchmarkNode* node = static_cast<BenchmarkNode*>(des.getById(nodeId(i, sparse)));
+      if (! node || (i+1<n && (! node->next || node->next->getId()!=nodeId(i+1, sparse))))
+	errors++;
+    }
+    t1 = Message::getCurrentTime();
+    cout << "looked up " << n << " ids in " << t1-t0 << " s (" << n/(t1-t0) << " lookups/s)";
+    if (errors)
+      cout << ", " << errors << " ERRORS";
+    cout << endl;
+  }
+  for (size_t i=0; i<nodes.size(); i++)
+    delete nodes[i];
+  return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * boss_log_converter.cpp
+ *
+ * Converts a boss log between the JSON and the binary formats.
+ * Logs ending with ".gz" are read and written block compressed.
+ * Works on the raw message data, so the classes in the log need not be linked.
+ */
+
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <cstring>
+
+#include "g2o_frontend/boss/binary_format.h"
+#include "g2o_frontend/boss/binary_message_parser.h"
+#include "g2o_frontend/boss/binary_message_writer.h"
+#include "g2o_frontend/boss/binary_object_parser.h"
+#include "g2o_frontend/boss/binary_object_writer.h"
+#include "g2o_frontend/boss/compressed_stream.h"
+#include "g2o_frontend/boss/json_message_parser.h"
+#include "g2o_frontend/boss/json_message_writer.h"
+#include "g2o_frontend/boss/json_object_parser.h"
+#include "g2o_frontend/boss/json_object_writer.h"
+#include "g2o_frontend/boss/message_data.h"
+#include "g2o_frontend/boss/object_data.h"
+
+using namespace std;
+using namespace boss;
+
+const char* banner[] = {
+  "boss_log_converter: converts a boss log between the JSON and the binary format",
+  "usage: boss_log_converter [-format JSON|BINARY] <input log> <output log>",
+  "  -format: format of the output, by default the opposite of the input one",
+  "  logs ending with .gz are compressed",
+  0
+};
+
+void printBanner() {
+  const char** b = banner;
+  while (*b) {
+    cerr << *b << endl;
+    b++;
+  }
+}
+
+// JSON messages start with the timestamp, JSON objects with the quoted class name
+static bool nextIsObject(istream& is, bool binary) {
+  if (binary) {
+    // peek past the sync byte to the record kind
+    istream::pos_type pos = is.tellg();
+    is.get();
+    int kind = is.get();
+    is.clear();
+    is.seekg(pos);
+    return kind == BINARY_OBJECT_RECORD;
+  }
+  while (is.peek()==' ' || is.peek()=='\t')
+    is.get();
+  return is.peek()=='"';
+}
+
+int main(int argc, char** argv) {
+  string format;
+  int c = 1;
+  while (c<argc && argv[c][0]=='-') {
+    if (! strcmp(argv[c], "-format") && c+1<argc) {
+      c++;
+      format = argv[c];
+    } else {
+      printBanner();
+      return 1;
+    }
+    c++;
+  }
+  if (argc-c != 2) {
+    printBanner();
+    return 1;
+  }
+
+  auto_ptr<istream> input(openLogInputStream(argv[c]));
+  istream& is = *input;
+  if (! is) {
+    cerr << "cannot open " << argv[c] << endl;
+    return 1;
+  }
+  bool inputBinary = isBinaryFormat(is);
+  if (format.empty())
+    format = inputBinary ? "JSON" : "BINARY";
+  bool outputBinary = (format == "BINARY");
+  if (! outputBinary && format != "JSON") {
+    printBanner();
+    return 1;
+  }
+
+  auto_ptr<MessageParser> messageParser;
+  auto_ptr<ObjectParser> objectParser;
+  if (inputBinary) {
+    messageParser.reset(new BinaryMessageParser);
+    objectParser.reset(new BinaryObjectParser);
+  } else {
+    messageParser.reset(new JSONMessageParser);
+    objectParser.reset(new JSONObjectParser);
+  }
+  auto_ptr<MessageWriter> messageWriter;
+  auto_ptr<ObjectWriter> objectWriter;
+  if (outputBinary) {
+    messageWriter.reset(new BinaryMessageWriter);
+    objectWriter.reset(new BinaryObjectWriter);
+  } else {
+    messageWriter.reset(new JSONMessageWriter);
+    objectWriter.reset(new JSONObjectWriter);
+  }
+
+  auto_ptr<ostream> output(openLogOutputStream(argv[c+1]));
+  ostream& os = *output;
+  if (! os) {
+    cerr << "cannot open " << argv[c+1] << endl;
+    return 1;
+  }
+  int messages = 0, objects = 0;
+  while (is && is.peek()!=EOF) {
+    if (nextIsObject(is, inputBinary)) {
+      string type;
+      auto_ptr<ObjectData> odata(objectParser->readObject(is, type));
+      if (! odata.get())
+	break;
+      objectWriter->writeObject(os, type, *odata);
+      objects++;
+    } else {
+      auto_ptr<MessageData> mdata(messageParser->readMessage(is));
+      if (! mdata.get())
+	break;
+      messageWriter->writeMessage(os, *mdata);
+      messages++;
+    }
+  }
+  if (is && is.peek()!=EOF)
+    cerr << "parse error after " << messages+objects << " records" << endl;
+  cerr << "converted " << messages << " messages and " << objects << " objects to " << format << endl;
+  return 0;
+}
@@ -33,11 +33,11 @@ void processSequentialData(SensingFrameNode* previous, SensingFrameNode* current
     }
   }
 
-  std::set<MapNodeRelation*>& pRelations = previous->manager()->nodeRelations(previous);
-  std::set<MapNodeRelation*>& cRelations = current->manager()->nodeRelations(current);
+  MapNodeRelationView pRelations = previous->manager()->nodeRelations(previous);
+  MapNodeRelationView cRelations = current->manager()->nodeRelations(current);
   MapNodeBinaryRelation* odometry = 0;
   MapNodeUnaryRelation* imu1 = 0, *imu2 = 0;
-  for (std::set<MapNodeRelation*>::iterator it=pRelations.begin(); it!=pRelations.end(); it++){
+  for (MapNodeRelationView::iterator it=pRelations.begin(); it!=pRelations.end(); it++){
     MapNodeRelation* rel=*it;
     MapNodeUnaryRelation* unary=dynamic_cast<MapNodeUnaryRelation*>(rel);
     MapNodeBinaryRelation* binary=dynamic_cast<MapNodeBinaryRelation*>(rel);
@@ -47,7 +47,7 @@ void processSequentialData(SensingFrameNode* previous, SensingFrameNode* current
       odometry = binary;
   }
 
-  for (std::set<MapNodeRelation*>::iterator it=cRelations.begin(); it!=cRelations.end(); it++){
+  for (MapNodeRelationView::iterator it=cRelations.begin(); it!=cRelations.end(); it++){
     MapNodeRelation* rel=*it;
     MapNodeUnaryRelation* unary=dynamic_cast<MapNodeUnaryRelation*>(rel);
     MapNodeBinaryRelation* binary=dynamic_cast<MapNodeBinaryRelation*>(rel);
@@ -0,0 +1,358 @@
+/*
+ * boss_serialization_benchmark.cpp
+ *
+ * Serialization throughput of boss on synthetic workloads, for each log format:
+ * - identifiables: many small Identifiables, each pointing to the previous one
+ * - matrices: large Eigen matrices
+ * - images: 16 bit depth images in ImageBLOBs
+ * Each workload is written with the Serializer and read back with the Deserializer
+ * in a separate process, so that the peak RSS is its own. The results are printed
+ * one line per workload and format, as comma separated values.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+
+#include "g2o_frontend/boss/deserializer.h"
+#include "g2o_frontend/boss/identifiable.h"
+#include "g2o_frontend/boss/message.h"
+#include "g2o_frontend/boss/serializer.h"
+#include "g2o_frontend/boss_map/eigen_boss_plugin.h"
+#include "g2o_frontend/boss_map/image_sensor.h"
+
+using namespace std;
+using namespace boss;
+using namespace boss_map;
+
+// allocations of the process, counted by the global operator new
+static size_t allocations = 0;
+static size_t allocatedBytes = 0;
+
+void* operator new(size_t size) {
+  allocations++;
+  allocatedBytes += size;
+  void* p = malloc(size ? size : 1);
+  if (! p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* p) throw() {
+  free(p);
+}
+
+void operator delete[](void* p) throw() {
+  free(p);
+}
+
+#if __cplusplus >= 201402L
+void operator delete(void* p, size_t) throw() {
+  free(p);
+}
+
+void operator delete[](void* p, size_t) throw() {
+  free(p);
+}
+#endif
+
+const char* banner[] = {
+  "boss_serialization_benchmark: serialization throughput of boss on synthetic workloads",
+  "usage: boss_serialization_benchmark [options] <work directory>",
+  "  -workload <name>: identifiables, matrices or images (default all)",
+  "  -format <name>: JSON, BINARY, JSON.gz or BINARY.gz (default all)",
+  "  -scale <factor>: multiplies the size of the workloads (default 1)",
+  "  the logs are written in the work directory, which is removed at the end",
+  "output columns:",
+  "  workload,format,records,file_bytes,write_s,write_records_per_s,read_s,read_records_per_s,",
+  "  write_allocs,write_alloc_bytes,read_allocs,read_alloc_bytes,peak_rss_kb",
+  0
+};
+
+void printBanner() {
+  const char** b = banner;
+  while (*b) {
+    cerr << *b << endl;
+    b++;
+  }
+}
+
+class BenchmarkNode: public Identifiable {
+public:
+  BenchmarkNode(int id=-1, IdContext* context=0): Identifiable(id, context), previous(0), timestamp(0), value(0) {}
+
+  virtual void serialize(ObjectData& data, IdContext& context) {
+    Identifiable::serialize(data, context);
+    data.setPointer("previous", previous);
+    data.setDouble("timestamp", timestamp);
+    data.setFloat("value", value);
+    data.setString("frame", "base_link");
+  }
+
+  virtual void deserialize(ObjectData& data, IdContext& context) {
+    Identifiable::deserialize(data, context);
+    data.getReference("previous").bind(previous);
+    timestamp = data.getDouble("timestamp");
+    value = data.getFloat("value");
+  }
+
+  BenchmarkNode* previous;
+  double timestamp;
+  float value;
+};
+
+BOSS_REGISTER_CLASS(BenchmarkNode)
+
+class BenchmarkMatrix: public Identifiable {
+public:
+  BenchmarkMatrix(int id=-1, IdContext* context=0): Identifiable(id, context) {}
+
+  virtual void serialize(ObjectData& data, IdContext& context) {
+    Identifiable::serialize(data, context);
+    matrix.toBOSS(data, "matrix");
+  }
+
+  virtual void deserialize(ObjectData& data, IdContext& context) {
+    Identifiable::deserialize(data, context);
+    matrix.fromBOSS(data, "matrix");
+  }
+
+  Eigen::MatrixXf matrix;
+};
+
+BOSS_REGISTER_CLASS(BenchmarkMatrix)
+
+class BenchmarkImage: public Identifiable {
+public:
+  BenchmarkImage(int id=-1, IdContext* context=0): Identifiable(id, context) {}
+
+  virtual void serialize(ObjectData& data, IdContext& context) {
+    Identifiable::serialize(data, context);
+    ObjectData* blobData = new ObjectData;
+    data.setField("image", blobData);
+    image.serialize(*blobData, context);
+  }
+
+  virtual void deserialize(ObjectData& data, IdContext& context) {
+    Identifiable::deserialize(data, context);
+    image.deserialize(data.getField("image")->getObject(), context);
+  }
+
+  ImageBLOBReference image;
+};
+
+BOSS_REGISTER_CLASS(BenchmarkImage)
+
+struct BenchmarkResult {
+  BenchmarkResult(): records(0), fileBytes(0), writeTime(0), readTime(0),
+		     writeAllocations(0), writeBytes(0), readAllocations(0), readBytes(0) {}
+  size_t records;
+  double fileBytes;
+  double writeTime;
+  double readTime;
+  size_t writeAllocations;
+  size_t writeBytes;
+  size_t readAllocations;
+  size_t readBytes;
+};
+
+static double directorySize(const string& dirname) {
+  using namespace boost::filesystem;
+  double size = 0;
+  for (recursive_directory_iterator it(dirname), end; it!=end; ++it)
+    if (is_regular_file(it->status()))
+      size += file_size(it->path());
+  return size;
+}
+
+static Identifiable* makeRecord(const string& workload, int i, Identifiable* previous) {
+  if (workload == "identifiables") {
+    BenchmarkNode* node = new BenchmarkNode;
+    node->previous = static_cast<BenchmarkNode*>(previous);
+    node->timestamp = 1381848243.123456 + i*0.01;
+    node->value = i*0.25f;
+    return node;
+  }
+  if (workload == "matrices") {
+    BenchmarkMatrix* m = new BenchmarkMatrix;
+    m->matrix.resize(200, 200);
+    for (int r=0; r<m->matrix.rows(); r++)
+      for (int c=0; c<m->matrix.cols(); c++)
+	m->matrix(r, c) = 0.001f*(r*m->matrix.cols()+c)+i;
+    return m;
+  }
+  BenchmarkImage* image = new BenchmarkImage;
+  ImageBLOB* blob = new ImageBLOB;
+  cv::Mat& depth = blob->cvImage();
+  depth.create(480, 640, CV_16UC1);
+  // a slanted plane with some noise and an invalid border, as from a depth camera
+  for (int r=0; r<depth.rows; r++)
+    for (int c=0; c<depth.cols; c++)
+      depth.at<unsigned short>(r, c) = (c<16 || r<8) ? 0 : 1000+r*3+c+i+(rand()%8);
+  blob->adjustFormat();
+  image->image.set(blob);
+  return image;
+}
+
+static int workloadSize(const string& workload, double scale) {
+  if (workload == "identifiables")
+    return (int) (200000*scale);
+  if (workload == "matrices")
+    return (int) (200*scale);
+  return (int) (100*scale);
+}
+
+static void runBenchmark(BenchmarkResult& result, const string& workload, const string& format,
+			 const string& directory, double scale) {
+  bool binary = format.compare(0, 6, "BINARY") == 0;
+  bool compressed = format.size()>3 && format.compare(format.size()-3, 3, ".gz") == 0;
+  string filename = directory + "/data.log" + (compressed ? ".gz" : "");
+  int n = workloadSize(workload, scale);
+
+  // the records are created before timing, and kept alive since they point to each other
+  vector<Identifiable*> records;
+  Identifiable* previous = 0;
+  for (int i=0; i<n; i++) {
+    previous = makeRecord(workload, i, previous);
+    records.push_back(previous);
+  }
+
+  size_t allocations0 = allocations, bytes0 = allocatedBytes;
+  double t0 = Message::getCurrentTime();
+  {
+    Serializer ser;
+    ser.setFilePath(filename);
+    if (binary)
+      ser.setFormat("BINARY");
+    for (int i=0; i<n; i++)
+      ser.writeObject(*records[i]);
+  }
+  result.writeTime = Message::getCurrentTime()-t0;
+  result.writeAllocations = allocations-allocations0;
+  result.writeBytes = allocatedBytes-bytes0;
+  result.fileBytes = directorySize(directory);
+  for (int i=n-1; i>=0; i--)
+    delete records[i];
+  records.clear();
+
+  allocations0 = allocations;
+  bytes0 = allocatedBytes;
+  t0 = Message::getCurrentTime();
+  {
+    Deserializer des;
+    des.setFilePath(filename);
+    Serializable* o;
+    while ((o=des.readObject())) {
+      BenchmarkImage* image = dynamic_cast<BenchmarkImage*>(o);
+      // the BLOBs are loaded on access
+      if (image && ! image->image.get())
+	cerr << "cannot read the BLOB of image " << image->getId() << endl;
+      records.push_back(static_cast<Identifiable*>(o));
+    }
+    result.records = records.size();
+    for (size_t i=0; i<records.size(); i++)
+      delete records[i];
+  }
+  result.readTime = Message::getCurrentTime()-t0;
+  result.readAllocations = allocations-allocations0;
+  result.readBytes = allocatedBytes-bytes0;
+}
+
+int main(int argc, char** argv) {
+  vector<string> workloads;
+  vector<string> formats;
+  double scale = 1;
+  int c = 1;
+  while (c<argc && argv[c][0]=='-') {
+    if (! strcmp(argv[c], "-workload") && c+1<argc) {
+      c++;
+      workloads.push_back(argv[c]);
+    } else if (! strcmp(argv[c], "-format") && c+1<argc) {
+      c++;
+      formats.push_back(argv[c]);
+    } else if (! strcmp(argv[c], "-scale") && c+1<argc) {
+      c++;
+      scale = atof(argv[c]);
+    } else {
+      printBanner();
+      return 1;
+    }
+    c++;
+  }
+  if (argc-c != 1 || scale<=0) {
+    printBanner();
+    return 1;
+  }
+  string directory = argv[c];
+  for (size_t w=0; w<workloads.size(); w++) {
+    if (workloads[w]!="identifiables" && workloads[w]!="matrices" && workloads[w]!="images") {
+      printBanner();
+      return 1;
+    }
+  }
+  for (size_t f=0; f<formats.size(); f++) {
+    if (formats[f]!="JSON" && formats[f]!="BINARY" && formats[f]!="JSON.gz" && formats[f]!="BINARY.gz") {
+      printBanner();
+      return 1;
+    }
+  }
+  if (workloads.empty()) {
+    workloads.push_back("identifiables");
+    workloads.push_back("matrices");
+    workloads.push_back("images");
+  }
+  if (formats.empty()) {
+    formats.push_back("JSON");
+    formats.push_back("BINARY");
+    formats.push_back("JSON.gz");
+    formats.push_back("BINARY.gz");
+  }
+
+  printf("workload,format,records,file_bytes,write_s,write_records_per_s,read_s,read_records_per_s,"
+	 "write_allocs,write_alloc_bytes,read_allocs,read_alloc_bytes,peak_rss_kb\n");
+  fflush(stdout);
+  int failures = 0;
+  for (size_t w=0; w<workloads.size(); w++) {
+    for (size_t f=0; f<formats.size(); f++) {
+      boost::filesystem::remove_all(directory);
+      boost::filesystem::create_directories(directory);
+      // each run in its own process, for the peak RSS
+      pid_t pid = fork();
+      if (pid == 0) {
+	BenchmarkResult result;
+	runBenchmark(result, workloads[w], formats[f], directory, scale);
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	printf("%s,%s,%zu,%.0f,%.6f,%.1f,%.6f,%.1f,%zu,%zu,%zu,%zu,%ld\n",
+	       workloads[w].c_str(), formats[f].c_str(), result.records, result.fileBytes,
+	       result.writeTime, result.records/result.writeTime, result.readTime, result.records/result.readTime,
+	       result.writeAllocations, result.writeBytes, result.readAllocations, result.readBytes,
+	       usage.ru_maxrss);
+	fflush(stdout);
+	_exit(result.records == (size_t) workloadSize(workloads[w], scale) ? 0 : 2);
+      }
+      int status = 0;
+      if (pid<0 || waitpid(pid, &status, 0)<0 || ! WIFEXITED(status) || WEXITSTATUS(status)) {
+	cerr << workloads[w] << " " << formats[f] << " failed" << endl;
+	failures++;
+      }
+    }
+  }
+  boost::filesystem::remove_all(directory);
+  return failures ? 2 : 0;
+}
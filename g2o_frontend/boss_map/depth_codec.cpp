@@ -0,0 +1,296 @@
+#include "depth_codec.h"
+#include <cstring>
+
+namespace boss_map {
+  using namespace std;
+
+  static const unsigned char DEPTH_CODEC_MAGIC[] = {'D', '1', '6', 1};
+
+  // residuals whose Rice quotient reaches this are written verbatim after the escape
+  static const int ESCAPE_LIMIT = 16;
+  static const int NUM_CONTEXTS = 12;
+  // contexts of the run lengths and of the pixels ending a run
+  static const int RUN_CONTEXT = NUM_CONTEXTS;
+  static const int RUN_END_CONTEXT = NUM_CONTEXTS+1;
+  // the statistics of a context are halved after this many pixels, to follow the image
+  static const unsigned int RESET_COUNT = 64;
+
+  struct RiceContext {
+    RiceContext(): sum(16), count(1) {}
+    // smallest k with count*2^k >= sum
+    inline int parameter() const {
+      if (sum <= count)
+	return 0;
+      int k = __builtin_clz(count)-__builtin_clz(sum);
+      if ((count<<k) < sum)
+	k++;
+      return k < 16 ? k : 16;
+    }
+    inline void update(unsigned int u) {
+      sum += (u+1)>>1;
+      count++;
+      if (count == RESET_COUNT) {
+	sum >>= 1;
+	count >>= 1;
+      }
+    }
+    unsigned int sum;
+    unsigned int count;
+  };
+
+  static inline int absDiff(int a, int b) {
+    return a>b ? a-b : b-a;
+  }
+
+  // median edge detector of LOCO-I
+  static inline int predict(int a, int b, int c) {
+    int mn = a<b ? a : b;
+    int mx = a<b ? b : a;
+    if (c >= mx)
+      return mn;
+    if (c <= mn)
+      return mx;
+    return a+b-c;
+  }
+
+  static inline int context(int a, int b, int c) {
+    unsigned int g = absDiff(a, c) + absDiff(b, c);
+    if (! g)
+      return 0;
+    int bits = 32-__builtin_clz(g);
+    return bits < NUM_CONTEXTS ? bits : NUM_CONTEXTS-1;
+  }
+
+  // neighbors of pixel x of the current row; the first row and column use the available ones
+  static inline void neighbors(int& a, int& b, int& c, const unsigned short* prev, const unsigned short* cur, int x) {
+    if (! prev) {
+      a = x ? cur[x-1] : 0;
+      b = c = a;
+    } else if (! x) {
+      a = b = c = prev[0];
+    } else {
+      a = cur[x-1];
+      b = prev[x];
+      c = prev[x-1];
+    }
+  }
+
+  static inline void writeUInt32(unsigned char* p, unsigned int v) {
+    p[0] = v; p[1] = v>>8; p[2] = v>>16; p[3] = v>>24;
+  }
+
+  static inline unsigned int readUInt32(const unsigned char* p) {
+    return p[0] | (p[1]<<8) | (p[2]<<16) | ((unsigned int)p[3]<<24);
+  }
+
+  class BitWriter {
+  public:
+    BitWriter(unsigned char* out): _out(out), _acc(0), _bits(0) {}
+    inline void put(unsigned long long value, int bits) {
+      _acc = (_acc<<bits) | value;
+      _bits += bits;
+      while (_bits >= 8) {
+	_bits -= 8;
+	*_out++ = (unsigned char)(_acc>>_bits);
+      }
+    }
+    unsigned char* finish() {
+      if (_bits)
+	*_out++ = (unsigned char)(_acc<<(8-_bits));
+      _bits = 0;
+      return _out;
+    }
+  protected:
+    unsigned char* _out;
+    unsigned long long _acc;
+    int _bits;
+  };
+
+  // bits are kept left aligned in the accumulator, zeros are read past the end
+  class BitReader {
+  public:
+    BitReader(const unsigned char* begin, const unsigned char* end):
+      _p(begin), _end(end), _acc(0), _bits(0), _overrun(0) {}
+    inline void refill() {
+      if (_bits <= 56 && _p+8 <= _end) {
+	// the bits of a partial byte are loaded again, unchanged, by the next refill
+	unsigned long long v = 0;
+	for (int i=0; i<8; i++)
+	  v = (v<<8) | _p[i];
+	_acc |= v>>_bits;
+	int bytes = (63-_bits)>>3;
+	_p += bytes;
+	_bits += bytes*8;
+	return;
+      }
+      while (_bits <= 56) {
+	unsigned long long b = 0;
+	if (_p < _end)
+	  b = *_p++;
+	else
+	  _overrun++;
+	_acc |= b<<(56-_bits);
+	_bits += 8;
+      }
+    }
+    inline int leadingOnes() const {
+      unsigned long long inv = ~_acc;
+      return inv ? __builtin_clzll(inv) : 64;
+    }
+    inline void skip(int bits) {
+      _acc <<= bits;
+      _bits -= bits;
+    }
+    inline unsigned int get(int bits) {
+      if (! bits)
+	return 0;
+      unsigned int v = (unsigned int)(_acc>>(64-bits));
+      skip(bits);
+      return v;
+    }
+    // true if no bit past the end of the data has been consumed
+    bool valid() const {
+      return _overrun*8 <= _bits;
+    }
+  protected:
+    const unsigned char* _p;
+    const unsigned char* _end;
+    unsigned long long _acc;
+    int _bits;
+    int _overrun;
+  };
+
+  static inline void writeCode(BitWriter& writer, unsigned int u, int k, int rawBits) {
+    unsigned int q = u>>k;
+    if (q < (unsigned int)ESCAPE_LIMIT)
+      writer.put(((((1ULL<<q)-1)<<1)<<k) | (u & ((1u<<k)-1)), q+1+k);
+    else
+      writer.put((((1ULL<<ESCAPE_LIMIT)-1)<<rawBits) | u, ESCAPE_LIMIT+rawBits);
+  }
+
+  static inline unsigned int readCode(BitReader& reader, int k, int rawBits) {
+    reader.refill();
+    int q = reader.leadingOnes();
+    if (q < ESCAPE_LIMIT) {
+      reader.skip(q+1);
+      return ((unsigned int)q<<k) | reader.get(k);
+    }
+    reader.skip(ESCAPE_LIMIT);
+    return reader.get(rawBits);
+  }
+
+  // residual modulo 2^16, zigzag mapped
+  static inline unsigned int mapResidual(int value, int prediction) {
+    int r = (short)(unsigned short)(value-prediction);
+    return r >= 0 ? 2*r : -2*r-1;
+  }
+
+  static inline unsigned short unmapResidual(unsigned int u, int prediction) {
+    int r = (u&1) ? -(int)((u+1)>>1) : (int)(u>>1);
+    return (unsigned short)(prediction+r);
+  }
+
+  bool isDepthCodecData(const unsigned char* data, size_t size) {
+    return size >= DEPTH_CODEC_HEADER_SIZE && ! memcmp(data, DEPTH_CODEC_MAGIC, sizeof(DEPTH_CODEC_MAGIC));
+  }
+
+  bool depthCodecImageSize(int& rows, int& cols, const unsigned char* data, size_t size) {
+    if (! isDepthCodecData(data, size))
+      return false;
+    rows = readUInt32(data+4);
+    cols = readUInt32(data+8);
+    return rows >= 0 && cols >= 0;
+  }
+
+  void encodeDepth(std::vector<unsigned char>& buffer, const unsigned short* image,
+		   int rows, int cols, size_t stride) {
+    size_t start = buffer.size();
+    // at most 32 bits per pixel (escape)
+    buffer.resize(start + DEPTH_CODEC_HEADER_SIZE + (size_t)rows*cols*4 + 8);
+    unsigned char* header = &buffer[start];
+    memcpy(header, DEPTH_CODEC_MAGIC, sizeof(DEPTH_CODEC_MAGIC));
+    writeUInt32(header+4, rows);
+    writeUInt32(header+8, cols);
+
+    BitWriter writer(header+DEPTH_CODEC_HEADER_SIZE);
+    RiceContext contexts[NUM_CONTEXTS+2];
+    const unsigned short* prev = 0;
+    for (int y=0; y<rows; y++) {
+      const unsigned short* cur = image+y*stride;
+      int x = 0;
+      while (x<cols) {
+	int a, b, c;
+	neighbors(a, b, c, prev, cur, x);
+	int ctxIndex = context(a, b, c);
+	if (! ctxIndex) {
+	  // flat neighborhood: length of the run of pixels equal to a, then the pixel ending it
+	  int end = x;
+	  while (end<cols && cur[end]==a)
+	    end++;
+	  RiceContext& runCtx = contexts[RUN_CONTEXT];
+	  writeCode(writer, end-x, runCtx.parameter(), 32);
+	  runCtx.update(end-x);
+	  x = end;
+	  if (x == cols)
+	    break;
+	  // differs from the prediction a, so u>0
+	  RiceContext& endCtx = contexts[RUN_END_CONTEXT];
+	  unsigned int u = mapResidual(cur[x], a)-1;
+	  writeCode(writer, u, endCtx.parameter(), 16);
+	  endCtx.update(u);
+	  x++;
+	  continue;
+	}
+	RiceContext& ctx = contexts[ctxIndex];
+	unsigned int u = mapResidual(cur[x], predict(a, b, c));
+	writeCode(writer, u, ctx.parameter(), 16);
+	ctx.update(u);
+	x++;
+      }
+      prev = cur;
+    }
+    buffer.resize(writer.finish()-&buffer[0]);
+  }
+
+  bool decodeDepth(unsigned short* image, size_t stride, const unsigned char* data, size_t size) {
+    int rows, cols;
+    if (! depthCodecImageSize(rows, cols, data, size))
+      return false;
+    BitReader reader(data+DEPTH_CODEC_HEADER_SIZE, data+size);
+    RiceContext contexts[NUM_CONTEXTS+2];
+    const unsigned short* prev = 0;
+    for (int y=0; y<rows; y++) {
+      unsigned short* cur = image+y*stride;
+      int x = 0;
+      while (x<cols) {
+	int a, b, c;
+	neighbors(a, b, c, prev, cur, x);
+	int ctxIndex = context(a, b, c);
+	if (! ctxIndex) {
+	  RiceContext& runCtx = contexts[RUN_CONTEXT];
+	  unsigned int run = readCode(reader, runCtx.parameter(), 32);
+	  runCtx.update(run);
+	  if (run > (unsigned int)(cols-x))
+	    return false;
+	  unsigned short value = a;
+	  for (unsigned int i=0; i<run; i++)
+	    cur[x++] = value;
+	  if (x == cols)
+	    break;
+	  RiceContext& endCtx = contexts[RUN_END_CONTEXT];
+	  unsigned int u = readCode(reader, endCtx.parameter(), 16);
+	  endCtx.update(u);
+	  cur[x++] = unmapResidual(u+1, a);
+	  continue;
+	}
+	RiceContext& ctx = contexts[ctxIndex];
+	unsigned int u = readCode(reader, ctx.parameter(), 16);
+	ctx.update(u);
+	cur[x++] = unmapResidual(u, predict(a, b, c));
+      }
+      prev = cur;
+    }
+    return reader.valid();
+  }
+
+}
@@ -0,0 +1,39 @@
+#ifndef _BOSS_DEPTH_CODEC_H_
+#define _BOSS_DEPTH_CODEC_H_
+
+#include <cstddef>
+#include <vector>
+
+namespace boss_map {
+
+  /*
+   * Lossless codec for 16 bit depth images, used by ImageBLOB for the "d16" extension.
+   * Each pixel is predicted from its left, upper and upper-left neighbors (median edge
+   * detector), and the residual is written with an adaptive Rice code, whose parameter
+   * is estimated separately for each class of local gradient. Where the neighbors are
+   * all equal, as in the invalid (zero) regions, the length of the run of equal pixels is
+   * written instead.
+   *
+   * Layout: magic "D16", version byte, rows and cols (32 bit little endian), bit stream.
+   */
+
+  //! size of the header preceding the bit stream
+  static const size_t DEPTH_CODEC_HEADER_SIZE = 12;
+
+  //! true if the buffer starts with the codec header
+  bool isDepthCodecData(const unsigned char* data, size_t size);
+
+  //! reads the image size from the header, false if the buffer is not in codec format
+  bool depthCodecImageSize(int& rows, int& cols, const unsigned char* data, size_t size);
+
+  //! appends the encoded image to buffer; stride is the distance between rows, in pixels
+  void encodeDepth(std::vector<unsigned char>& buffer, const unsigned short* image,
+		   int rows, int cols, size_t stride);
+
+  //! decodes into image, which must hold the rows and cols of the header;
+  //! false if the data is truncated or not in codec format
+  bool decodeDepth(unsigned short* image, size_t stride, const unsigned char* data, size_t size);
+
+}
+
+#endif
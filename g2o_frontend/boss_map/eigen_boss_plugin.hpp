@@ -1,15 +1,16 @@
 
 inline void toBOSS(boss::ObjectData& data, const std::string name) const {
-  boss::ObjectData* matrixData = new boss::ObjectData;
+  boss::ObjectData* matrixData = new (data.arena()) boss::ObjectData(data.arena());
   if (SizeAtCompileTime == Eigen::Dynamic) {
     matrixData->setInt("rows", rows());
     matrixData->setInt("cols", cols());
   }
-  boss::ArrayData * adata =  new boss::ArrayData();
-  adata->reserve(rows()*cols());
+  // written as a single block of floats, row major
+  boss::NumericArrayData * adata = new (data.arena()) boss::NumericArrayData(rows()*cols(), true, data.arena());
+  float* values = adata->floats();
   for (int r=0; r<rows(); r++)
     for (int c=0; c<cols(); c++)
-      adata->push_back(new boss::NumberData((float)this->operator()(r,c)));
+      *values++ = (float)this->operator()(r,c);
   matrixData->setField("values",adata);
   data.setField(name, matrixData);
 }
@@ -24,7 +25,17 @@ inline void fromBOSS(boss::ObjectData& data, const std::string name){
     else 
       *this=Matrix<Scalar, RowsAtCompileTime, ColsAtCompileTime>();
   }
-  boss::ArrayData& adata = matrixData.getField("values")->getArray();
+  boss::ValueData* values = matrixData.getField("values");
+  if (values->type() == boss::NUMERIC_ARRAY) {
+    boss::NumericArrayData& ndata = values->getNumericArray();
+    assert((int)ndata.size()==rows()*cols());
+    int k=0;
+    for (int r=0; r<rows(); r++)
+      for (int c=0; c<cols(); c++, k++)
+        this->operator()(r,c) = ndata.get(k);
+    return;
+  }
+  boss::ArrayData& adata = values->getArray();
   assert((int)adata.size()==rows()*cols());
   int k=0;
   for (int r=0; r<rows(); r++)
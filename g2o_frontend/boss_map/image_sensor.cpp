@@ -1,6 +1,8 @@
 #include "image_sensor.h"
+#include "depth_codec.h"
 #include "opencv2/core/core.hpp"
 #include "g2o_frontend/boss/object_data.h"
+#include "g2o_frontend/boss/memory_stream.h"
 #include <stdexcept>
 
 #define BUF_BLOCK (4096*4)
@@ -23,7 +25,7 @@ namespace boss_map {
        break;
     case mono16: 
       _image = cv::Mat(width, height, CV_16UC1);
-      _extension = "pgm";
+      _extension = "d16";
        break;
     case rgb8:   
       _image = cv::Mat(width, height, CV_8UC3); 
@@ -45,7 +47,7 @@ namespace boss_map {
        break;
     case mono16: 
       _image = cv::Mat(width, height, CV_16UC1);
-      _extension = "pgm";
+      _extension = "d16";
        break;
     case rgb8:   
       _image = cv::Mat(width, height, CV_8UC3); 
@@ -67,7 +69,7 @@ namespace boss_map {
       break;
     case CV_16UC1: 
       _format = mono16;
-      _extension = "pgm";
+      _extension = "d16";
       break;
     case CV_8UC3:
       _format = rgb8;
@@ -81,21 +83,64 @@ namespace boss_map {
   }
 
 
-  bool ImageBLOB::read(std::istream& is) {
-    std::vector<uchar> buffer;
-    int count=0;
+  // reads the rest of the stream in buffer, with a single read if its size is known
+  static void readAll(std::vector<uchar>& buffer, std::istream& is) {
+    std::istream::pos_type start = is.tellg();
+    if (start != std::istream::pos_type(-1) && is.seekg(0, std::ios::end)) {
+      std::istream::pos_type end = is.tellg();
+      is.seekg(start);
+      buffer.resize(end-start);
+      if (! buffer.empty())
+	is.read((char*)&buffer[0], buffer.size());
+      buffer.resize(is.gcount());
+      return;
+    }
+    is.clear();
+    size_t count=0;
     while (is.good()){
-      buffer.resize(buffer.size()+BUF_BLOCK);
-      is.read((char*)&(buffer[count]),BUF_BLOCK);
+      buffer.resize(count ? 2*count : BUF_BLOCK);
+      is.read((char*)&(buffer[count]),buffer.size()-count);
       count+=is.gcount();
     }
     buffer.resize(count);
-    _image = cv::imdecode(buffer, -1);
+  }
+
+  bool ImageBLOB::read(std::istream& is) {
+    std::vector<uchar> buffer;
+    const uchar* data;
+    size_t size;
+    // packed BLOBs are read in place from the mapped segment
+    MemoryStreamBuf* memory = dynamic_cast<MemoryStreamBuf*>(is.rdbuf());
+    if (memory) {
+      data = (const uchar*)memory->current();
+      size = memory->end()-memory->current();
+    } else {
+      readAll(buffer, is);
+      data = buffer.empty() ? 0 : &buffer[0];
+      size = buffer.size();
+    }
+    int rows, cols;
+    if (depthCodecImageSize(rows, cols, data, size)) {
+      _image.create(rows, cols, CV_16UC1);
+      _format = mono16;
+      _extension = "d16";
+      return decodeDepth(_image.ptr<unsigned short>(), _image.step1(), data, size);
+    }
+    if (! size)
+      return false;
+    _image = cv::imdecode(cv::Mat(1, size, CV_8UC1, (void*)data), -1);
     return true;
   }
 
   void ImageBLOB::write(std::ostream& os) {
     std::vector<uchar> buffer;
+    if (_extension == "d16") {
+      if (_image.type() != CV_16UC1)
+	throw std::runtime_error("d16 format requires a 16 bit single channel image");
+      encodeDepth(buffer, _image.ptr<unsigned short>(), _image.rows, _image.cols, _image.step1());
+      os.write((char*)(&buffer[0]),buffer.size());
+      return;
+    }
     std::string _extension_=std::string(".")+_extension;
     bool result = cv::imencode(_extension_.c_str(), _image, buffer);
     os.write((char*)(&buffer[0]),buffer.size());
@@ -103,6 +148,14 @@ namespace boss_map {
       throw std::runtime_error("cv imwrite error");
   }
 
+  BLOB* ImageBLOB::clone() const {
+    ImageBLOB* copy = new ImageBLOB;
+    copy->_extension = _extension;
+    copy->_image = _image.clone();
+    copy->_format = _format;
+    return copy;
+  }
+
   ImageData::ImageData(int id, IdContext* context):
     BaseSensorData(id, context) {
   }
@@ -110,6 +163,10 @@ namespace boss_map {
   ImageData::~ImageData(){
   }
 
+  void ImageData::blobReferences(std::vector<BaseBLOBReference*>& references){
+    references.push_back(&_imageBlob);
+  }
+
   void ImageData::serialize(ObjectData& data, IdContext& context) {
     BaseSensorData::serialize(data,context);
     // alternative 1, creating an own field
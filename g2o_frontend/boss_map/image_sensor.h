@@ -21,6 +21,7 @@ namespace boss_map {
     void adjustFormat();
     virtual bool read(std::istream& is);
     virtual void write(std::ostream& os);
+    virtual BLOB* clone() const;
     inline cv::Mat& cvImage() {return _image;}
     const cv::Mat& cvImage() const {return _image;}
   protected:
@@ -39,6 +40,7 @@ namespace boss_map {
     virtual void deserialize(ObjectData& data, IdContext& context);
     inline ImageBLOBReference& imageBlob() { return _imageBlob; }
     inline const ImageBLOBReference& imageBlob() const { return _imageBlob; }
+    virtual void blobReferences(std::vector<BaseBLOBReference*>& references);
   protected:
     ImageBLOBReference _imageBlob;
   };
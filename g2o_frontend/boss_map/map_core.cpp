@@ -9,6 +9,7 @@ namespace boss_map {
 
   MapItem::MapItem(MapManager* manager_, int id, IdContext* context): Identifiable(id, context){
     _manager = manager_;
+    _managerIndex = -1;
   }
   
 
@@ -53,6 +54,13 @@ namespace boss_map {
       _manager->addNode(this);
   }
 
+  void MapNode::setTransform(const Eigen::Isometry3d& transform_){
+    MapManager::ScopedLock lock(manager());
+    _transform = transform_;
+    if (manager())
+      manager()->nodeMoved(this);
+  }
+
   //! called when all links are resolved, adjusts the bookkeeping of the parents
   void MapNode::deserializeComplete(){
     //assert(_manager);
@@ -79,8 +87,8 @@ namespace boss_map {
   
   std::vector<MapNodeRelation*> MapNode::parentRelations(){
     std::vector<MapNodeRelation*> ret;
-    std::set<MapNodeRelation*>& rel=_manager->nodeRelations(this);
-    for(std::set<MapNodeRelation*>::iterator it = rel.begin(); it!=rel.end(); it++){
+    MapNodeRelationView rel=_manager->nodeRelations(this);
+    for(MapNodeRelationView::iterator it = rel.begin(); it!=rel.end(); it++){
       MapNodeRelation* r = *it;
       if (r->owner() && r->owner()->level()>level())
 	ret.push_back(r);
@@ -107,8 +115,8 @@ namespace boss_map {
   
   std::vector<MapNodeRelation*> MapNode::childrenRelations(){
     std::vector<MapNodeRelation*> ret;
-    std::set<MapNodeRelation*>& rel=_manager->ownedRelations(this);
-    for(std::set<MapNodeRelation*>::iterator it = rel.begin(); it!=rel.end(); it++){
+    MapNodeRelationView rel=_manager->ownedRelations(this);
+    for(MapNodeRelationView::iterator it = rel.begin(); it!=rel.end(); it++){
       MapNodeRelation* r = *it;
       ret.push_back(r);
     }
@@ -14,15 +14,19 @@ namespace boss_map {
   /**An item of the map (can be either a relation or a node)*/
   class MapItem: public Identifiable {
   public:
+    friend class MapManager;
     MapItem (MapManager* manager=0, int id=-1, IdContext* context = 0);
     //! returns the manager object
     inline MapManager* manager() const {return _manager;}
+    //! slot of the item in the manager holding it, stable while it is there; -1 if none
+    inline int managerIndex() const {return _managerIndex;}
     //! boss serialization
     virtual void serialize(ObjectData& data, IdContext& context);
     //! boss deserialization
     virtual void deserialize(ObjectData& data, IdContext& context);
   protected:
     MapManager * _manager;
+    int _managerIndex;
   };
 
   /***************************************** MapNode *****************************************/  
@@ -43,8 +47,8 @@ namespace boss_map {
     virtual void deserializeComplete();
     //! isometry to which the map node is referred to
     virtual const Eigen::Isometry3d& transform() const {return _transform;}
-    //! sets the isometry
-    virtual void setTransform(const Eigen::Isometry3d& transform_) {_transform = transform_;}
+    //! sets the isometry, and tells the manager that the node moved
+    virtual void setTransform(const Eigen::Isometry3d& transform_);
 
     //! a useful sequence number
     inline int seq() const { return _seq; };
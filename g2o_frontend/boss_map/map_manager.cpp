@@ -1,13 +1,24 @@
 #include "map_manager.h"
 #include <stdexcept>
 #include <iostream>
+#include <algorithm>
 
 namespace boss_map {
   using namespace boss;
   using namespace std;
 
   /***************************************** MapManager********************************/
-  MapManager::MapManager(int id, IdContext* context) :Identifiable(id,context){}
+  MapManager::MapManager(int id, IdContext* context) :Identifiable(id,context){
+    pthread_mutexattr_t attributes;
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&_mutex, &attributes);
+    pthread_mutexattr_destroy(&attributes);
+  }
+
+  MapManager::~MapManager(){
+    pthread_mutex_destroy(&_mutex);
+  }
 
   //! boss serialization
   void MapManager::serialize(ObjectData& data, IdContext& context){
@@ -20,14 +31,34 @@ namespace boss_map {
     Identifiable::deserialize(data, context);
   }
 
+  // removes r from the array, not preserving the order
+  static void eraseRelation(std::vector<MapNodeRelation*>& relations, MapNodeRelation* r){
+    std::vector<MapNodeRelation*>::iterator it=std::find(relations.begin(), relations.end(), r);
+    if (it==relations.end())
+      return;
+    *it = relations.back();
+    relations.pop_back();
+  }
+
   bool MapManager::addNode(MapNode* n){
-    std::set<MapNode*>::iterator it=_nodes.find(n);
-    if (it!=_nodes.end())
+    ScopedLock lock(this);
+    if (contains(n))
       return false;
     //cerr << "inserting node " << n << endl;
-    _nodes.insert(n);
-    NodeInfo nInfo;
-    _nodeInfos.insert(std::make_pair(n, nInfo));
+    int index;
+    if (_freeNodeSlots.empty()) {
+      index = _nodeInfos.size();
+      _nodeInfos.push_back(NodeInfo());
+    } else {
+      index = _freeNodeSlots.back();
+      _freeNodeSlots.pop_back();
+    }
+    NodeInfo& nInfo = _nodeInfos[index];
+    nInfo.node = n;
+    nInfo.position = _nodes.size();
+    n->_managerIndex = index;
+    _nodes.push_back(n);
+    _nodeIndex.insert(n);
     for (size_t i = 0; i<_actionHandlers.size(); i++){
       MapManagerActionHandler* handler = _actionHandlers[i];
       handler->nodeAdded(n);
@@ -35,33 +66,64 @@ namespace boss_map {
     return true;
   }
 
+  bool MapManager::removeNode(MapNode* n){
+    ScopedLock lock(this);
+    if (! contains(n))
+      return false;
+    // the relations involving the node go with it
+    while (! _nodeInfos[n->_managerIndex].relations.empty())
+      removeRelation(_nodeInfos[n->_managerIndex].relations.back());
+    while (! _nodeInfos[n->_managerIndex].ownerRelations.empty())
+      removeRelation(_nodeInfos[n->_managerIndex].ownerRelations.back());
+    NodeInfo& nInfo = _nodeInfos[n->_managerIndex];
+    MapNode* last = _nodes.back();
+    _nodes[nInfo.position] = last;
+    _nodeInfos[last->_managerIndex].position = nInfo.position;
+    _nodes.pop_back();
+    nInfo.node = 0;
+    nInfo.position = -1;
+    // releases the memory of the arrays
+    std::vector<MapNodeRelation*>().swap(nInfo.relations);
+    std::vector<MapNodeRelation*>().swap(nInfo.ownerRelations);
+    _freeNodeSlots.push_back(n->_managerIndex);
+    n->_managerIndex = -1;
+    _nodeIndex.remove(n);
+    for (size_t i = 0; i<_actionHandlers.size(); i++){
+      MapManagerActionHandler* handler = _actionHandlers[i];
+      handler->nodeRemoved(n);
+    }
+    return true;
+  }
+
+  void MapManager::nodeMoved(MapNode* n){
+    ScopedLock lock(this);
+    _nodeIndex.update(n);
+  }
 
   bool MapManager::addRelation(MapNodeRelation* relation) {
-    std::set<MapNodeRelation*>::iterator it=_relations.find(relation);
+    ScopedLock lock(this);
     bool added = true;
-    if (it == _relations.end()) {
-      _relations.insert(relation);
-    } else {
+    if (contains(relation)) {
       removeRelation(relation);
-      _relations.insert(relation);
       added = false;
     }
     //cerr << "inserting relation " << relation << endl;
     for(size_t i=0; i<relation->nodes().size(); i++){
-      MapNode* n = relation->nodes()[i];
-      std::map<MapNode*, NodeInfo>::iterator it=_nodeInfos.find(n);
-      if (it == _nodeInfos.end()) {
+      if (! contains(relation->nodes()[i]))
 	throw std::runtime_error("no node for relation");
-      }
-      it->second.relations.insert(relation);
     }
-    if (relation->owner()){
-      MapNode* n = relation->owner();
-      std::map<MapNode*, NodeInfo>::iterator it=_nodeInfos.find(n);
-      if (it == _nodeInfos.end())
-	throw std::runtime_error("no owner for relation");
-      it->second.ownerRelations.insert(relation);
+    if (relation->owner() && ! contains(relation->owner()))
+      throw std::runtime_error("no owner for relation");
+    relation->_managerIndex = _relations.size();
+    _relations.push_back(relation);
+    for(size_t i=0; i<relation->nodes().size(); i++){
+      std::vector<MapNodeRelation*>& relations = _nodeInfos[relation->nodes()[i]->_managerIndex].relations;
+      // a relation may list a node twice, it is kept once as the set did
+      if (std::find(relations.begin(), relations.end(), relation)==relations.end())
+	relations.push_back(relation);
     }
+    if (relation->owner())
+      _nodeInfos[relation->owner()->_managerIndex].ownerRelations.push_back(relation);
     
     if (added) {
       for (size_t i = 0; i<_actionHandlers.size(); i++){
@@ -73,26 +135,28 @@ namespace boss_map {
   }
 
   bool MapManager::removeRelation(MapNodeRelation* relation){
-    std::set<MapNodeRelation*>::iterator it=_relations.find(relation);
-    if (it == _relations.end())
+    ScopedLock lock(this);
+    if (! contains(relation))
       return false;
     for(size_t i=0; i<relation->nodes().size(); i++){
       MapNode* n = relation->nodes()[i];
-      std::map<MapNode*, NodeInfo>::iterator it=_nodeInfos.find(n);
-      if (it == _nodeInfos.end()) {
+      if (! contains(n)) {
 	cerr << "node: " << n << endl;
 	throw std::runtime_error("no node for relation");
       }
-      it->second.relations.erase(relation);
+      eraseRelation(_nodeInfos[n->_managerIndex].relations, relation);
     }
     if (relation->owner()){
       MapNode* n = relation->owner();
-      std::map<MapNode*, NodeInfo>::iterator it=_nodeInfos.find(n);
-      if (it == _nodeInfos.end())
+      if (! contains(n))
 	throw std::runtime_error("no owner for relation");
-      it->second.ownerRelations.erase(relation);
+      eraseRelation(_nodeInfos[n->_managerIndex].ownerRelations, relation);
     }
-    _relations.erase(it);
+    MapNodeRelation* last = _relations.back();
+    _relations[relation->_managerIndex] = last;
+    last->_managerIndex = relation->_managerIndex;
+    _relations.pop_back();
+    relation->_managerIndex = -1;
     for (size_t i = 0; i<_actionHandlers.size(); i++){
       MapManagerActionHandler* handler = _actionHandlers[i];
       handler->relationRemoved(relation);
@@ -135,6 +199,8 @@ namespace boss_map {
 
 
   MapManagerActionHandler::~MapManagerActionHandler(){
+    if (! _manager)
+      return;
     size_t i;
     for (i = 0;  i<_manager->actionHandlers().size() && _manager->actionHandlers()[i]!=this;  i++);
     if (i<_manager->actionHandlers().size())
@@ -2,6 +2,9 @@
 #define _BOSS_MAP_MANAGER_H_
 
 #include "map_core.h"
+#include "map_node_index.h"
+#include <algorithm>
+#include <pthread.h>
 
 namespace boss_map {
   using namespace boss;
@@ -22,15 +25,77 @@ namespace boss_map {
     MapManager* _manager;
   };
 
+  /**
+     Read only view of a contiguous array of map items, as returned by the MapManager.
+     It is invalidated by the next change of the manager.
+   */
+  template <typename T>
+  class MapItemArrayView {
+  public:
+    typedef T* const* iterator;
+    typedef iterator const_iterator;
+    MapItemArrayView(): _begin(0), _end(0) {}
+    MapItemArrayView(const std::vector<T*>& v): _begin(v.empty() ? 0 : &v[0]), _end(_begin+v.size()) {}
+    inline iterator begin() const {return _begin;}
+    inline iterator end() const {return _end;}
+    inline size_t size() const {return _end-_begin;}
+    inline bool empty() const {return _begin==_end;}
+    inline T* operator[](size_t i) const {return _begin[i];}
+    //! linear search
+    inline iterator find(T* t) const {return std::find(_begin, _end, t);}
+    inline size_t count(T* t) const {return find(t)!=_end;}
+  protected:
+    iterator _begin, _end;
+  };
+
+  typedef MapItemArrayView<MapNode> MapNodeView;
+  typedef MapItemArrayView<MapNodeRelation> MapNodeRelationView;
+
   /***************************************** MapManager********************************/
+  /**
+     Bookkeeping of the nodes and of the relations among them.
+     Each node gets a slot, its managerIndex(), that does not change until the node is removed;
+     the slot holds the relations of the node in contiguous arrays.
+     A relation's managerIndex() is its position in relations(), that changes when others are removed.
+     The map has a recursive lock. The changes of the manager and the moves of the nodes take it,
+     so that they are atomic with the calls of the action handlers. Processors running in
+     different threads hold it while they read the map or the transforms of the nodes (the views
+     are invalidated by the changes of the other thread), but never while they put objects to an
+     asynchronous handler: the consumer would wait for the lock, and the producer for the queue.
+   */
   class MapManager: public Identifiable {
   protected:
     struct NodeInfo{
-      std::set<MapNodeRelation*> relations;
-      std::set<MapNodeRelation*> ownerRelations;
+      NodeInfo(): node(0), position(-1) {}
+      //! 0 if the slot is free
+      MapNode* node;
+      //! position of the node in _nodes
+      int position;
+      std::vector<MapNodeRelation*> relations;
+      std::vector<MapNodeRelation*> ownerRelations;
      };
   public:
+    //! holds the lock of the manager in its scope, a null manager is not locked
+    class ScopedLock {
+    public:
+      ScopedLock(MapManager* manager_): _manager(manager_) {if (_manager) _manager->lock();}
+      ~ScopedLock() {if (_manager) _manager->unlock();}
+    protected:
+      MapManager* _manager;
+    };
+
+    //! releases the lock of the manager in its scope, for a long computation that does not use the map;
+    //! a lock taken more than once by the thread stays held
+    class ScopedUnlock {
+    public:
+      ScopedUnlock(MapManager* manager_): _manager(manager_) {if (_manager) _manager->unlock();}
+      ~ScopedUnlock() {if (_manager) _manager->lock();}
+    protected:
+      MapManager* _manager;
+    };
+
     MapManager(int id=-1, IdContext* context = 0);
+    virtual ~MapManager();
     //! boss serialization
     virtual void serialize(ObjectData& data, IdContext& context);
     //! boss deserialization
@@ -40,20 +105,53 @@ namespace boss_map {
     bool removeNode(MapNode* n);
     bool addRelation(MapNodeRelation* relation);
     bool removeRelation(MapNodeRelation* relation);
+    //! called by the node when its transform changes, keeps the spatial index up to date
+    void nodeMoved(MapNode* n);
+
+    inline void lock() {pthread_mutex_lock(&_mutex);}
+    inline void unlock() {pthread_mutex_unlock(&_mutex);}
+
+    inline bool contains(const MapNode* n) const {
+      return n->_managerIndex>=0 && n->_managerIndex<(int)_nodeInfos.size() && _nodeInfos[n->_managerIndex].node==n;
+    }
+    inline bool contains(const MapNodeRelation* r) const {
+      return r->_managerIndex>=0 && r->_managerIndex<(int)_relations.size() && _relations[r->_managerIndex]==r;
+    }
 
-    inline std::set<MapNode*>& nodes() {return _nodes;}
-    inline std::set<MapNodeRelation*>& relations() {return _relations;}
+    //! the nodes, in no particular order
+    inline MapNodeView nodes() const {return MapNodeView(_nodes);}
+    //! the relations, in no particular order
+    inline MapNodeRelationView relations() const {return MapNodeRelationView(_relations);}
     
-    inline std::set<MapNodeRelation*>& nodeRelations(MapNode* n) {return _nodeInfos[n].relations;}
-    inline std::set<MapNodeRelation*>& ownedRelations(MapNode* n) {return _nodeInfos[n].ownerRelations;}
+    //! the relations involving n
+    inline MapNodeRelationView nodeRelations(const MapNode* n) const {
+      return contains(n) ? MapNodeRelationView(_nodeInfos[n->_managerIndex].relations) : MapNodeRelationView();
+    }
+    //! the relations owned by n
+    inline MapNodeRelationView ownedRelations(const MapNode* n) const {
+      return contains(n) ? MapNodeRelationView(_nodeInfos[n->_managerIndex].ownerRelations) : MapNodeRelationView();
+    }
+
+    //! number of node slots, the bound of the managerIndex() of the nodes
+    inline size_t nodeSlots() const {return _nodeInfos.size();}
+    //! node in the slot, 0 if the slot is free
+    inline MapNode* nodeInSlot(int index) const {return _nodeInfos[index].node;}
 
     inline std::vector<MapManagerActionHandler*>& actionHandlers() { return _actionHandlers; }
 
+    //! spatial index of the nodes, for the neighborhood queries
+    inline const MapNodeIndex& nodeIndex() const {return _nodeIndex;}
+    inline void setNodeIndexCellSize(double cellSize) {_nodeIndex.setCellSize(cellSize);}
+
   protected:
     std::vector<MapManagerActionHandler*> _actionHandlers;
-    std::set<MapNode*> _nodes;
-    std::set<MapNodeRelation*> _relations;
-    std::map<MapNode*, NodeInfo> _nodeInfos;
+    std::vector<MapNode*> _nodes;
+    std::vector<MapNodeRelation*> _relations;
+    //! indexed by the managerIndex() of the nodes
+    std::vector<NodeInfo> _nodeInfos;
+    std::vector<int> _freeNodeSlots;
+    MapNodeIndex _nodeIndex;
+    pthread_mutex_t _mutex;
   };
 
 }
@@ -0,0 +1,188 @@
+#include "map_node_index.h"
+#include "map_core.h"
+#include <algorithm>
+#include <cmath>
+#include <climits>
+#include <limits>
+#include <stdexcept>
+
+namespace boss_map {
+  using namespace std;
+
+  // cell coordinates are clamped to this, so that far or infinite bounds do not overflow
+  static const double MAX_CELL = 1<<30;
+
+  MapNodeIndex::MapNodeIndex(double cellSize_){
+    _cellSize = 0;
+    _invCellSize = 0;
+    clear();
+    setCellSize(cellSize_);
+  }
+
+  void MapNodeIndex::setCellSize(double cellSize_){
+    if (cellSize_<=0)
+      throw std::runtime_error("the cell size of the node index must be positive");
+    if (cellSize_==_cellSize)
+      return;
+    std::vector<MapNode*> nodes;
+    for (NodeCellMap::iterator it=_nodeCells.begin(); it!=_nodeCells.end(); it++)
+      nodes.push_back(it->first);
+    std::vector<MapNode*> unindexed = _unindexed;
+    clear();
+    _cellSize = cellSize_;
+    _invCellSize = 1./cellSize_;
+    for (size_t i=0; i<nodes.size(); i++)
+      insert(nodes[i]);
+    _unindexed = unindexed;
+  }
+
+  void MapNodeIndex::clear(){
+    _cells.clear();
+    _nodeCells.clear();
+    _unindexed.clear();
+    _lowerCell = Cell(INT_MAX, INT_MAX, INT_MAX);
+    _upperCell = Cell(INT_MIN, INT_MIN, INT_MIN);
+  }
+
+  MapNodeIndex::Cell MapNodeIndex::cell(const Eigen::Vector3d& p) const {
+    int c[3];
+    for (int i=0; i<3; i++){
+      double v = std::floor(p[i]*_invCellSize);
+      // also maps NaN to the upper bound
+      c[i] = (int) (v<MAX_CELL ? (v>-MAX_CELL ? v : -MAX_CELL) : MAX_CELL);
+    }
+    return Cell(c[0], c[1], c[2]);
+  }
+
+  void MapNodeIndex::addToCell(MapNode* n, const Cell& c){
+    _cells[c].push_back(n);
+    _nodeCells[n] = c;
+    _lowerCell = Cell(std::min(_lowerCell.x, c.x), std::min(_lowerCell.y, c.y), std::min(_lowerCell.z, c.z));
+    _upperCell = Cell(std::max(_upperCell.x, c.x), std::max(_upperCell.y, c.y), std::max(_upperCell.z, c.z));
+  }
+
+  void MapNodeIndex::removeFromCell(MapNode* n, const Cell& c){
+    CellMap::iterator it = _cells.find(c);
+    if (it==_cells.end())
+      return;
+    std::vector<MapNode*>& cellNodes = it->second;
+    std::vector<MapNode*>::iterator nt = std::find(cellNodes.begin(), cellNodes.end(), n);
+    if (nt!=cellNodes.end()){
+      *nt = cellNodes.back();
+      cellNodes.pop_back();
+    }
+    if (cellNodes.empty())
+      _cells.erase(it);
+  }
+
+  void MapNodeIndex::insert(MapNode* n){
+    // an alias takes the transform of the original node, and is not told when it changes
+    if (dynamic_cast<MapNodeAlias*>(n)){
+      if (std::find(_unindexed.begin(), _unindexed.end(), n)==_unindexed.end())
+	_unindexed.push_back(n);
+      return;
+    }
+    if (_nodeCells.count(n)){
+      update(n);
+      return;
+    }
+    addToCell(n, cell(n->transform().translation()));
+  }
+
+  void MapNodeIndex::update(MapNode* n){
+    NodeCellMap::iterator it = _nodeCells.find(n);
+    if (it==_nodeCells.end())
+      return;
+    Cell c = cell(n->transform().translation());
+    if (c==it->second)
+      return;
+    removeFromCell(n, it->second);
+    addToCell(n, c);
+  }
+
+  void MapNodeIndex::remove(MapNode* n){
+    NodeCellMap::iterator it = _nodeCells.find(n);
+    if (it!=_nodeCells.end()){
+      removeFromCell(n, it->second);
+      _nodeCells.erase(it);
+      return;
+    }
+    std::vector<MapNode*>::iterator ut = std::find(_unindexed.begin(), _unindexed.end(), n);
+    if (ut!=_unindexed.end())
+      _unindexed.erase(ut);
+  }
+
+  void MapNodeIndex::queryBox(std::vector<MapNode*>& nodes, const Eigen::Vector3d& lower, const Eigen::Vector3d& upper) const {
+    nodes.insert(nodes.end(), _unindexed.begin(), _unindexed.end());
+    Cell l = cell(lower), u = cell(upper);
+    l = Cell(std::max(l.x, _lowerCell.x), std::max(l.y, _lowerCell.y), std::max(l.z, _lowerCell.z));
+    u = Cell(std::min(u.x, _upperCell.x), std::min(u.y, _upperCell.y), std::min(u.z, _upperCell.z));
+    if (l.x>u.x || l.y>u.y || l.z>u.z)
+      return;
+    double numCells = (u.x-l.x+1.)*(u.y-l.y+1.)*(u.z-l.z+1.);
+    if (numCells>_cells.size()){
+      // a large box, cheaper to visit the occupied cells
+      for (CellMap::const_iterator it=_cells.begin(); it!=_cells.end(); it++){
+	const Cell& c = it->first;
+	if (c.x>=l.x && c.x<=u.x && c.y>=l.y && c.y<=u.y && c.z>=l.z && c.z<=u.z)
+	  nodes.insert(nodes.end(), it->second.begin(), it->second.end());
+      }
+      return;
+    }
+    for (int x=l.x; x<=u.x; x++)
+      for (int y=l.y; y<=u.y; y++)
+	for (int z=l.z; z<=u.z; z++){
+	  CellMap::const_iterator it = _cells.find(Cell(x, y, z));
+	  if (it!=_cells.end())
+	    nodes.insert(nodes.end(), it->second.begin(), it->second.end());
+	}
+  }
+
+  void MapNodeIndex::queryBall(std::vector<MapNode*>& nodes, const Eigen::Vector3d& center, double radius) const {
+    Eigen::Vector3d r(radius, radius, radius);
+    queryBox(nodes, center-r, center+r);
+  }
+
+  void MapNodeIndex::queryCylinder(std::vector<MapNode*>& nodes, const Eigen::Vector3d& center,
+				   const Eigen::Vector3d& axis, double radius) const {
+    if (_cells.empty()){
+      nodes.insert(nodes.end(), _unindexed.begin(), _unindexed.end());
+      return;
+    }
+    // the cylinder is unbounded, clip its axis to the occupied cells grown by the radius:
+    // a point of the cylinder within them has its projection on the axis within radius from them
+    Eigen::Vector3d lower(_lowerCell.x, _lowerCell.y, _lowerCell.z);
+    Eigen::Vector3d upper(_upperCell.x+1, _upperCell.y+1, _upperCell.z+1);
+    lower = lower*_cellSize-Eigen::Vector3d(radius, radius, radius);
+    upper = upper*_cellSize+Eigen::Vector3d(radius, radius, radius);
+    double t0 = -std::numeric_limits<double>::infinity();
+    double t1 = std::numeric_limits<double>::infinity();
+    for (int i=0; i<3; i++){
+      if (axis[i]==0){
+	if (center[i]<lower[i] || center[i]>upper[i]){
+	  nodes.insert(nodes.end(), _unindexed.begin(), _unindexed.end());
+	  return;
+	}
+	continue;
+      }
+      double ta = (lower[i]-center[i])/axis[i];
+      double tb = (upper[i]-center[i])/axis[i];
+      t0 = std::max(t0, std::min(ta, tb));
+      t1 = std::min(t1, std::max(ta, tb));
+    }
+    if (t0>t1){
+      nodes.insert(nodes.end(), _unindexed.begin(), _unindexed.end());
+      return;
+    }
+    Eigen::Vector3d p0 = center+axis*t0, p1 = center+axis*t1;
+    Eigen::Vector3d r(radius, radius, radius);
+    queryBox(nodes, p0.cwiseMin(p1)-r, p0.cwiseMax(p1)+r);
+  }
+
+  void MapNodeIndex::queryAll(std::vector<MapNode*>& nodes) const {
+    nodes.insert(nodes.end(), _unindexed.begin(), _unindexed.end());
+    for (NodeCellMap::const_iterator it=_nodeCells.begin(); it!=_nodeCells.end(); it++)
+      nodes.push_back(it->first);
+  }
+
+}
@@ -0,0 +1,73 @@
+#ifndef _BOSS_MAP_NODE_INDEX_H_
+#define _BOSS_MAP_NODE_INDEX_H_
+
+#include <vector>
+#include <boost/unordered_map.hpp>
+#include <Eigen/Core>
+
+namespace boss_map {
+  class MapNode;
+
+  /**
+     Spatial index of the map nodes, a hash of 3D grid cells keyed on the translation of the nodes.
+     It is kept up to date by the MapManager, that moves a node to its new cell whenever
+     its transform is set.
+     The queries return the nodes of the cells overlapping a region, a superset of the nodes
+     in the region that has to be refined with an exact test.
+   */
+  class MapNodeIndex {
+  public:
+    MapNodeIndex(double cellSize=1.0);
+
+    //! edge of the cells, in meters
+    inline double cellSize() const {return _cellSize;}
+    //! changes the edge of the cells, and rebuilds the index
+    void setCellSize(double cellSize_);
+
+    //! adds a node, at the position of its current transform
+    void insert(MapNode* n);
+    //! moves the node to the cell of its current transform
+    void update(MapNode* n);
+    void remove(MapNode* n);
+    void clear();
+    inline size_t size() const {return _nodeCells.size()+_unindexed.size();}
+
+    //! appends the nodes that may be inside the axis aligned box from lower to upper
+    void queryBox(std::vector<MapNode*>& nodes, const Eigen::Vector3d& lower, const Eigen::Vector3d& upper) const;
+    //! appends the nodes that may be within radius from center
+    void queryBall(std::vector<MapNode*>& nodes, const Eigen::Vector3d& center, double radius) const;
+    //! appends the nodes that may be within radius from the line through center along axis (a unit vector)
+    void queryCylinder(std::vector<MapNode*>& nodes, const Eigen::Vector3d& center,
+		       const Eigen::Vector3d& axis, double radius) const;
+    //! appends all the nodes
+    void queryAll(std::vector<MapNode*>& nodes) const;
+
+  protected:
+    struct Cell {
+      Cell(int x_=0, int y_=0, int z_=0): x(x_), y(y_), z(z_) {}
+      inline bool operator==(const Cell& c) const {return x==c.x && y==c.y && z==c.z;}
+      friend inline size_t hash_value(const Cell& c) {
+	return (size_t)c.x*73856093u ^ (size_t)c.y*19349663u ^ (size_t)c.z*83492791u;
+      }
+      int x, y, z;
+    };
+    typedef boost::unordered_map<Cell, std::vector<MapNode*> > CellMap;
+    typedef boost::unordered_map<MapNode*, Cell> NodeCellMap;
+
+    Cell cell(const Eigen::Vector3d& p) const;
+    void addToCell(MapNode* n, const Cell& c);
+    void removeFromCell(MapNode* n, const Cell& c);
+
+    double _cellSize;
+    double _invCellSize;
+    CellMap _cells;
+    NodeCellMap _nodeCells;
+    //! nodes whose position is not owned by them (aliases), returned by every query
+    std::vector<MapNode*> _unindexed;
+    //! range of the cells ever occupied, the queries are clamped to it
+    Cell _lowerCell, _upperCell;
+  };
+
+}
+
+#endif
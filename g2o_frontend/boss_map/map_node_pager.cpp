@@ -0,0 +1,164 @@
+#include "map_node_pager.h"
+#include "sensor_data_node.h"
+
+namespace boss_map {
+  using namespace std;
+
+  MapNodePager::MapNodePager(MapManager* manager, int capacity_, int id, IdContext* context):
+    MapManagerActionHandler(manager, id, context){
+    _capacity = capacity_;
+    _pageInCount = 0;
+    _pageOutCount = 0;
+  }
+
+  void MapNodePager::serialize(ObjectData& data, IdContext& context){
+    MapManagerActionHandler::serialize(data, context);
+    data.setInt("capacity", _capacity);
+  }
+
+  void MapNodePager::deserialize(ObjectData& data, IdContext& context){
+    MapManagerActionHandler::deserialize(data, context);
+    _capacity = data.getInt("capacity");
+  }
+
+  void MapNodePager::setCapacity(int capacity_){
+    _capacity = capacity_;
+    evict();
+  }
+
+  void MapNodePager::pageIn(MapNode* n){
+    NodeListMap::iterator it = _resident.find(n);
+    if (it!=_resident.end()) {
+      _lru.splice(_lru.begin(), _lru, it->second);
+    } else {
+      _lru.push_front(n);
+      _resident.insert(make_pair(n, _lru.begin()));
+    }
+    BaseSensorDataNode* sn = dynamic_cast<BaseSensorDataNode*>(n);
+    if (sn) {
+      bool loaded = loadSensorData(sn);
+      std::vector<BaseBLOBReference*> references;
+      sn->blobReferences(references);
+      for (size_t i=0; i<references.size(); i++){
+	if (! references[i]->instance() && references[i]->get())
+	  loaded = true;
+      }
+      if (loaded)
+	_pageInCount++;
+    }
+    evict();
+  }
+
+  bool MapNodePager::release(MapNode* n){
+    BaseSensorDataNode* sn = dynamic_cast<BaseSensorDataNode*>(n);
+    if (! sn)
+      return false;
+    std::vector<BaseBLOBReference*> references;
+    sn->blobReferences(references);
+    bool released = false;
+    for (size_t i=0; i<references.size(); i++){
+      if (references[i]->instance() && references[i]->release())
+	released = true;
+    }
+    if (releaseSensorData(sn))
+      released = true;
+    if (released)
+      _pageOutCount++;
+    return released;
+  }
+
+  bool MapNodePager::releaseSensorData(BaseSensorDataNode* n){
+    BaseSensorData* data = n->baseSensorData();
+    if (! data)
+      return false;
+    // only a sensor data read from an indexed log can be read again
+    Deserializer* source = dynamic_cast<Deserializer*>(data->getContext());
+    if (! source || ! source->isIndexed(data->getId()))
+      return false;
+    // the synchronized data are read again with it, so they have to come from the same log
+    SynchronizedSensorData* sync = dynamic_cast<SynchronizedSensorData*>(data);
+    if (sync) {
+      for (size_t i=0; i<sync->sensorDatas.size(); i++){
+	BaseSensorData* s = sync->sensorDatas[i];
+	if (s && (s->getContext()!=source || ! source->isIndexed(s->getId())))
+	  return false;
+      }
+      for (size_t i=0; i<sync->sensorDatas.size(); i++)
+	delete sync->sensorDatas[i];
+    }
+    PagedData paged;
+    paged.source = source;
+    paged.id = data->getId();
+    delete data;
+    n->setBaseSensorData(0);
+    _pagedData.insert(make_pair(n, paged));
+    return true;
+  }
+
+  bool MapNodePager::loadSensorData(BaseSensorDataNode* n){
+    PagedDataMap::iterator it = _pagedData.find(n);
+    if (it==_pagedData.end())
+      return false;
+    BaseSensorData* data = dynamic_cast<BaseSensorData*>(it->second.source->loadById(it->second.id));
+    n->setBaseSensorData(data);
+    _pagedData.erase(it);
+    return data;
+  }
+
+  void MapNodePager::pageOut(MapNode* n){
+    NodeListMap::iterator it = _resident.find(n);
+    if (it!=_resident.end()) {
+      _lru.erase(it->second);
+      _resident.erase(it);
+    }
+    release(n);
+  }
+
+  void MapNodePager::pageOutExcept(const std::set<MapNode*>& active){
+    NodeList::iterator it = _lru.begin();
+    while (it!=_lru.end()){
+      MapNode* n = *it;
+      if (active.count(n)) {
+	it++;
+	continue;
+      }
+      it = _lru.erase(it);
+      _resident.erase(n);
+      release(n);
+    }
+  }
+
+  void MapNodePager::pageOutAll(){
+    _lru.clear();
+    _resident.clear();
+    for (MapNodeView::iterator it=_manager->nodes().begin(); it!=_manager->nodes().end(); it++)
+      release(*it);
+  }
+
+  void MapNodePager::evict(){
+    while ((int)_lru.size()>_capacity){
+      MapNode* n = _lru.back();
+      _lru.pop_back();
+      _resident.erase(n);
+      release(n);
+    }
+  }
+
+  void MapNodePager::nodeAdded(MapNode* ) {}
+
+  void MapNodePager::nodeRemoved(MapNode* n) {
+    NodeListMap::iterator it = _resident.find(n);
+    if (it!=_resident.end()) {
+      _lru.erase(it->second);
+      _resident.erase(it);
+    }
+    _pagedData.erase(n);
+  }
+
+  void MapNodePager::relationAdded(MapNodeRelation* ) {}
+
+  void MapNodePager::relationRemoved(MapNodeRelation* ) {}
+
+  BOSS_REGISTER_CLASS(MapNodePager);
+
+}
@@ -0,0 +1,86 @@
+#ifndef _BOSS_MAP_NODE_PAGER_H_
+#define _BOSS_MAP_NODE_PAGER_H_
+
+#include <list>
+#include <set>
+#include <vector>
+#include <boost/unordered_map.hpp>
+#include "g2o_frontend/boss/deserializer.h"
+#include "map_manager.h"
+
+namespace boss_map {
+  using namespace boss;
+
+  struct BaseSensorDataNode;
+
+  /**
+     Keeps in memory the sensor payloads of a bounded number of nodes: the BLOBs of the sensor data
+     and, when they were read from an indexed log, the sensor data objects themselves.
+     The nodes and the relations stay in the manager; the payload of a node is loaded when
+     the node is paged in, and released when it is the least recently used node beyond the capacity.
+     Only the BLOBs that can be reloaded from the log they were read from are released.
+     A released sensor data is deleted, together with the data it synchronizes, and read again
+     by id (see Deserializer::loadById()), so it must not be referenced outside its node.
+     The payloads obtained from a node are valid until the node is paged out, so the
+     nodes used together should be paged in together, within the capacity.
+   */
+  class MapNodePager: public MapManagerActionHandler {
+  public:
+    MapNodePager(MapManager* manager=0, int capacity=1000, int id=-1, IdContext* context=0);
+    virtual void serialize(ObjectData& data, IdContext& context);
+    virtual void deserialize(ObjectData& data, IdContext& context);
+
+    //! maximum number of nodes whose payload is kept in memory
+    inline int capacity() const {return _capacity;}
+    void setCapacity(int capacity_);
+
+    //! loads the payload of the node, if needed, and makes it the most recently used
+    void pageIn(MapNode* n);
+    //! releases the payload of the node
+    void pageOut(MapNode* n);
+    //! releases the payloads of the resident nodes not in the active region
+    void pageOutExcept(const std::set<MapNode*>& active);
+    //! releases the payloads of all the nodes of the manager, also the ones loaded without the pager
+    void pageOutAll();
+
+    inline bool isResident(MapNode* n) const {return _resident.count(n);}
+    inline int residentCount() const {return _resident.size();}
+    //! nodes whose sensor data is not in memory
+    inline int pagedOutDataCount() const {return _pagedData.size();}
+    //! nodes whose payload was loaded from the log
+    inline int pageInCount() const {return _pageInCount;}
+    //! nodes whose payload was released
+    inline int pageOutCount() const {return _pageOutCount;}
+
+    virtual void nodeAdded(MapNode* n);
+    virtual void nodeRemoved(MapNode* n);
+    virtual void relationAdded(MapNodeRelation* r);
+    virtual void relationRemoved(MapNodeRelation* r);
+
+  protected:
+    typedef std::list<MapNode*> NodeList;
+    typedef boost::unordered_map<MapNode*, NodeList::iterator> NodeListMap;
+    //! where the released sensor data of a node is read again from
+    struct PagedData {
+      Deserializer* source;
+      int id;
+    };
+    typedef boost::unordered_map<MapNode*, PagedData> PagedDataMap;
+
+    bool release(MapNode* n);
+    bool releaseSensorData(BaseSensorDataNode* n);
+    bool loadSensorData(BaseSensorDataNode* n);
+    void evict();
+
+    //! resident nodes, the most recently used first
+    NodeList _lru;
+    NodeListMap _resident;
+    PagedDataMap _pagedData;
+    int _capacity;
+    int _pageInCount;
+    int _pageOutCount;
+  };
+
+}
+
+#endif
@@ -17,8 +17,8 @@ namespace boss_map {
     T* extractRelation(std::vector<MapNode*> nodes){
       if (nodes.size()==0)
 	return 0;
-      std::set<MapNodeRelation*>& relations = _manager->nodeRelations(nodes[0]);
-      for (std::set<MapNodeRelation*>::iterator it=relations.begin(); it!=relations.end(); it++){
+      MapNodeRelationView relations = _manager->nodeRelations(nodes[0]);
+      for (MapNodeRelationView::iterator it=relations.begin(); it!=relations.end(); it++){
 	MapNodeRelation* _rel=*it;
 	T* rel = dynamic_cast<T*>(_rel);
 	if (!rel)
@@ -1,5 +1,5 @@
 #include "map_utils.h"
-#include <queue>
+#include <algorithm>
 
 namespace boss_map {
   using namespace boss;
@@ -11,6 +11,10 @@ namespace boss_map {
 
   NodeAcceptanceCriterion::~NodeAcceptanceCriterion(){}
 
+  bool NodeAcceptanceCriterion::queryCandidates(std::vector<MapNode*>&, const MapNodeIndex&){
+    return false;
+  }
+
   void NodeAcceptanceCriterion::serialize(boss::ObjectData& data, boss::IdContext& context){
     Identifiable::serialize(data,context);
     data.setPointer("manager",_manager);
@@ -47,6 +51,13 @@ namespace boss_map {
 	return true;
   }
 
+  bool GazePointAcceptanceCriterion::queryCandidates(std::vector<MapNode*>& candidates, const MapNodeIndex& index){
+    // the nodes around the gaze point, and the ones on the reference pose
+    index.queryBall(candidates, _pose2.translation(), _translationalDistance);
+    index.queryBall(candidates, _pose.translation(), 0);
+    return true;
+  }
+
   void GazePointAcceptanceCriterion::serialize(boss::ObjectData& data, boss::IdContext& context){
     PoseAcceptanceCriterion::serialize(data,context);
     data.setFloat("translationalDistance", _translationalDistance);
@@ -81,6 +92,13 @@ namespace boss_map {
     return true;
   }
 
+  bool DistancePoseAcceptanceCriterion::queryCandidates(std::vector<MapNode*>& candidates, const MapNodeIndex& index){
+    // the distance is measured on the xy plane of the reference pose
+    Eigen::Vector3d axis = _pose.linear().col(2);
+    index.queryCylinder(candidates, _pose.translation(), axis, _translationalDistance);
+    return true;
+  }
+
   void DistancePoseAcceptanceCriterion::serialize(boss::ObjectData& data, boss::IdContext& context){
     PoseAcceptanceCriterion::serialize(data,context);
     data.setFloat("translationalDistance", _translationalDistance);
@@ -118,7 +136,16 @@ namespace boss_map {
 
   void selectNodes(std::set<MapNode*>& nodes, NodeAcceptanceCriterion* criterion){
     MapManager* manager = criterion->manager();
-    for (std::set<MapNode*>::iterator it=manager->nodes().begin(); it!=manager->nodes().end(); it++){
+    std::vector<MapNode*> candidates;
+    if (criterion->queryCandidates(candidates, manager->nodeIndex())){
+      for (size_t i=0; i<candidates.size(); i++){
+	MapNode* n = candidates[i];
+	if (criterion->accept(n))
+	  nodes.insert(n);
+      }
+      return;
+    }
+    for (MapNodeView::iterator it=manager->nodes().begin(); it!=manager->nodes().end(); it++){
       MapNode* n = *it;
       if (criterion->accept(n))
 	nodes.insert(*it);
@@ -128,10 +155,11 @@ namespace boss_map {
   void extractInternalRelations(std::set<MapNodeRelation*>& internalRelations, 
 				std::set<MapNode*>& nodes, 
 				MapManager* manager){
-    for (std::set<MapNode*>::iterator it=manager->nodes().begin(); it!=manager->nodes().end(); it++){
+    // a relation among the nodes is found from any of them
+    for (std::set<MapNode*>::iterator it=nodes.begin(); it!=nodes.end(); it++){
       MapNode* n = *it;
-      std::set<MapNodeRelation*>& relations = manager->nodeRelations(n);
-      for (std::set<MapNodeRelation*>::iterator rt=relations.begin(); rt!=relations.end(); rt++){
+      MapNodeRelationView relations = manager->nodeRelations(n);
+      for (MapNodeRelationView::iterator rt=relations.begin(); rt!=relations.end(); rt++){
 	bool add = true;
 	MapNodeRelation* rel=*rt;
 	for (size_t i = 0; i<rel->nodes().size(); i++){
@@ -164,37 +192,108 @@ namespace boss_map {
   }
 
 
-  void makePartitions(std::vector<std::set<MapNode*> >& partitions,
+  bool MapNodePartitions::contains(size_t i, MapNode* n) const {
+    return std::binary_search(partitionBegin(i), partitionEnd(i), n);
+  }
+
+  int MapNodePartitions::partitionOf(MapNode* n) const {
+    for (size_t i=0; i<size(); i++)
+      if (contains(i, n))
+	return i;
+    return -1;
+  }
+
+  void MapNodePartitions::addPartition(MapNode* const* begin, MapNode* const* end){
+    size_t first = nodes.size();
+    nodes.insert(nodes.end(), begin, end);
+    std::sort(nodes.begin()+first, nodes.end());
+    offsets.push_back(nodes.size());
+  }
+
+  // union-find over the local indices of the nodes, with path halving and union by size
+  static int findRoot(std::vector<int>& parent, int i){
+    while (parent[i]!=i){
+      parent[i] = parent[parent[i]];
+      i = parent[i];
+    }
+    return i;
+  }
+
+  static void unite(std::vector<int>& parent, std::vector<int>& size, int i, int j){
+    i = findRoot(parent, i);
+    j = findRoot(parent, j);
+    if (i==j)
+      return;
+    if (size[i]<size[j])
+      std::swap(i, j);
+    parent[j] = i;
+    size[i] += size[j];
+  }
+
+  void makePartitions(MapNodePartitions& partitions,
 		      std::set<MapNode*>& nodes, MapRelationSelector* relationSelector){
-    std::set<MapNode*> openNodes = nodes;
-    while(! openNodes.empty()){
-      std::queue<MapNode*> queue;
-      std::set<MapNode*> currentPartition;
-      MapNode* first=*openNodes.begin();
-      currentPartition.insert(first);
-      queue.push(first);
-      openNodes.erase(first);
-      while(! queue.empty()){
-	MapNode* n=queue.front();
-	queue.pop();
-	std::set<MapNodeRelation*>& relations=n->manager()->nodeRelations(n);
-	for(std::set<MapNodeRelation*>::iterator it=relations.begin(); it!=relations.end(); it++){
-	  MapNodeRelation* rel=*it;
-	  if (relationSelector && !relationSelector->accept(rel))
+    partitions.clear();
+    if (nodes.empty())
+      return;
+    // the set is ordered, so the local index of a node is found by binary search
+    std::vector<MapNode*> local(nodes.begin(), nodes.end());
+    int n = local.size();
+    std::vector<int> parent(n), size(n, 1);
+    for (int i=0; i<n; i++)
+      parent[i] = i;
+    std::vector<int> members;
+    for (int i=0; i<n; i++){
+      MapNode* node = local[i];
+      MapNodeRelationView relations=node->manager()->nodeRelations(node);
+      for(MapNodeRelationView::iterator it=relations.begin(); it!=relations.end(); it++){
+	MapNodeRelation* rel=*it;
+	// the relation is handled once, by its first node in the set
+	members.clear();
+	bool first = true;
+	for (size_t k=0; k<rel->nodes().size() && first; k++){
+	  std::vector<MapNode*>::iterator lt = std::lower_bound(local.begin(), local.end(), rel->nodes()[k]);
+	  if (lt==local.end() || *lt!=rel->nodes()[k])
 	    continue;
-	  for (size_t i=0; i<rel->nodes().size(); i++){
-	    MapNode* nOther = rel->nodes()[i];
-	    // if the node has already been visited or is not in the set, skip)
-	    if (!openNodes.count(nOther))
-	      continue;
-	    queue.push(nOther);
-	    openNodes.erase(nOther);
-	    currentPartition.insert(nOther);
-	  }
+	  int j = lt-local.begin();
+	  first = j>=i;
+	  members.push_back(j);
 	}
+	if (! first || members.size()<2)
+	  continue;
+	if (relationSelector && !relationSelector->accept(rel))
+	  continue;
+	for (size_t k=0; k<members.size(); k++)
+	  unite(parent, size, i, members[k]);
       }
-      partitions.push_back(currentPartition);
     }
+
+    // counting sort of the nodes by partition, numbered in order of their first node
+    std::vector<int> partitionIndex(n, -1), rootPartition(n, -1);
+    std::vector<int> counts;
+    for (int i=0; i<n; i++){
+      int r = findRoot(parent, i);
+      if (rootPartition[r]<0){
+	rootPartition[r] = counts.size();
+	counts.push_back(0);
+      }
+      partitionIndex[i] = rootPartition[r];
+      counts[partitionIndex[i]]++;
+    }
+    partitions.offsets.resize(counts.size()+1);
+    for (size_t p=0; p<counts.size(); p++)
+      partitions.offsets[p+1] = partitions.offsets[p]+counts[p];
+    partitions.nodes.resize(n);
+    std::vector<int> next(partitions.offsets.begin(), partitions.offsets.end()-1);
+    for (int i=0; i<n; i++)
+      partitions.nodes[next[partitionIndex[i]]++] = local[i];
+  }
+
+  void makePartitions(std::vector<std::set<MapNode*> >& partitions,
+		      std::set<MapNode*>& nodes, MapRelationSelector* relationSelector){
+    MapNodePartitions flat;
+    makePartitions(flat, nodes, relationSelector);
+    for (size_t i=0; i<flat.size(); i++)
+      partitions.push_back(std::set<MapNode*>(flat.partitionBegin(i), flat.partitionEnd(i)));
   }
 
   BOSS_REGISTER_CLASS(GazePointAcceptanceCriterion);
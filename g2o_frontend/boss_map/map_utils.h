@@ -11,6 +11,9 @@ namespace boss_map {
   public:
     NodeAcceptanceCriterion(MapManager* manager_=0, int id = -1, boss::IdContext* context = 0);
     virtual bool accept(MapNode* n) = 0;
+    //! appends to candidates the nodes of the index that may be accepted, so that only those are tested;
+    //! returns false if the criterion does not bound the region of the accepted nodes
+    virtual bool queryCandidates(std::vector<MapNode*>& candidates, const MapNodeIndex& index);
     virtual ~NodeAcceptanceCriterion();
     virtual void serialize(boss::ObjectData& data, boss::IdContext& context);
     virtual void deserialize(boss::ObjectData& data, boss::IdContext& context);
@@ -45,6 +48,7 @@ namespace boss_map {
     virtual void serialize(boss::ObjectData& data, boss::IdContext& context);
     virtual void deserialize(boss::ObjectData& data, boss::IdContext& context);
     virtual bool accept(MapNode* n);
+    virtual bool queryCandidates(std::vector<MapNode*>& candidates, const MapNodeIndex& index);
     inline const Eigen::Isometry3d gazePointPose() const { return _pose2;}
     inline double translationalDistance() const { return _translationalDistance;}
     inline void setTranslationalDistance(double td)  { _translationalDistance = td; _td2=td*td;}
@@ -66,6 +70,7 @@ namespace boss_map {
     virtual void serialize(boss::ObjectData& data, boss::IdContext& context);
     virtual void deserialize(boss::ObjectData& data, boss::IdContext& context);
     virtual bool accept(MapNode* n);
+    virtual bool queryCandidates(std::vector<MapNode*>& candidates, const MapNodeIndex& index);
     inline double translationalDistance() const { return _translationalDistance;}
     inline void setTranslationalDistance(double td)  { _translationalDistance = td; _td2=td*td;}
     inline double rotationalDistance() const { return _rotationalDistance;}
@@ -106,10 +111,35 @@ namespace boss_map {
   };
 
 
+  /**
+     Partitions of a set of nodes, stored flat: partition i is made of the nodes
+     from nodes[offsets[i]] to nodes[offsets[i+1]-1], sorted by address.
+   */
+  struct MapNodePartitions {
+    MapNodePartitions() {clear();}
+    inline void clear() {nodes.clear(); offsets.assign(1, 0);}
+    inline size_t size() const {return offsets.size()-1;}
+    inline size_t partitionSize(size_t i) const {return offsets[i+1]-offsets[i];}
+    inline MapNode* const* partitionBegin(size_t i) const {return nodes.empty() ? 0 : &nodes[0]+offsets[i];}
+    inline MapNode* const* partitionEnd(size_t i) const {return nodes.empty() ? 0 : &nodes[0]+offsets[i+1];}
+    //! true if partition i contains n (binary search)
+    bool contains(size_t i, MapNode* n) const;
+    //! index of the partition containing n, -1 if none
+    int partitionOf(MapNode* n) const;
+    //! appends a partition made of the nodes from begin to end
+    void addPartition(MapNode* const* begin, MapNode* const* end);
+    std::vector<MapNode*> nodes;
+    std::vector<int> offsets;
+  };
+
   void selectNodes(std::set<MapNode*>& nodes, NodeAcceptanceCriterion* criterion);
   void extractInternalRelations(std::set<MapNodeRelation*>& internalRelations, 
 				std::set<MapNode*>& nodes, 
 				MapManager* manager);
+  //! splits the nodes in the components connected by the relations accepted by the selector,
+  //! considering only the relations among the nodes; the partitions are ordered by their first node
+  void makePartitions(MapNodePartitions& partitions,
+		      std::set<MapNode*>& nodes, MapRelationSelector* relationSelector=0);
   void makePartitions(std::vector<std::set<MapNode*> >& partitions,
 		      std::set<MapNode*>& nodes, MapRelationSelector* relationSelector=0);
 }
@@ -4,8 +4,10 @@
 #include "reference_frame.h"
 #include "g2o_frontend/boss/identifiable.h"
 #include "g2o_frontend/boss/serializable.h"
+#include "g2o_frontend/boss/blob.h"
 #include <string>
 #include <deque>
+#include <vector>
 
 namespace boss_map {
   using namespace boss;
@@ -51,6 +53,8 @@ namespace boss_map {
     virtual void setSensor(BaseSensor *sensor_) { _sensor = sensor_; }
     virtual BaseSensor* baseSensor() { return _sensor; }
     virtual const BaseSensor* baseSensor() const { return _sensor; }
+    //! appends the references to the BLOBs holding the payload of the data
+    virtual void blobReferences(std::vector<BaseBLOBReference*>& /*references*/) {}
   protected:
     std::string _topic;
     double _timestamp;
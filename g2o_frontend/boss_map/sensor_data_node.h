@@ -34,6 +34,17 @@ namespace boss_map {
     //! odometry setter
     inline void setOdometry(MapNodeBinaryRelation* odometry_)  { _odometry = odometry_;}
 
+    //! the sensor data of the node, whatever its type
+    inline BaseSensorData* baseSensorData() const {return _sensorData;}
+    //! sets the sensor data, whatever its type; the node does not own it
+    inline void setBaseSensorData(BaseSensorData* data_) {_sensorData = data_;}
+
+    //! appends the references to the BLOBs of the sensor data, the payload of the node
+    inline void blobReferences(std::vector<BaseBLOBReference*>& references) {
+      if (_sensorData)
+	_sensorData->blobReferences(references);
+    }
+
 
   protected:
     BaseSensorData* _sensorData;
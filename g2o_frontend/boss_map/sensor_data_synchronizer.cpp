@@ -1,4 +1,6 @@
 #include "sensor_data_synchronizer.h"
+#include <algorithm>
+#include <cmath>
 #include <stdexcept>
 
 namespace boss_map {  
@@ -28,6 +30,13 @@ namespace boss_map {
     }
   }
 
+  void SynchronizedSensorData::blobReferences(std::vector<BaseBLOBReference*>& references){
+    for (size_t i =0; i<sensorDatas.size(); i++){
+      if (sensorDatas[i])
+	sensorDatas[i]->blobReferences(references);
+    }
+  }
+
 
   SyncCondition::SyncCondition(SyncTopicInstance* m1, SyncTopicInstance*m2){
     this->m1  = m1;
@@ -42,6 +51,10 @@ namespace boss_map {
 
   SyncTopicInstance::SyncTopicInstance(std::string topic){
     this->topic = topic;    sensorData = 0;
+    group = 0;
+    receivedCount = 0;
+    matchedCount = 0;
+    droppedCount = 0;
   }
 
 
@@ -60,6 +73,15 @@ namespace boss_map {
   }
 
   SensorDataSynchronizer::SensorDataSynchronizer(){
+    _bufferSize = 10;
+    _synchronizedCount = 0;
+  }
+
+  int SensorDataSynchronizer::droppedCount() const {
+    int dropped = 0;
+    for (std::map<std::string, SyncTopicInstance*>::const_iterator it = syncTopics.begin(); it!=syncTopics.end(); it++)
+      dropped += it->second->droppedCount;
+    return dropped;
   }
   
   SyncTopicInstance*  SensorDataSynchronizer::syncTopic(std::string topic) {
@@ -74,6 +96,7 @@ namespace boss_map {
     if (! previous){
       syncTopics.insert(make_pair(st->topic, st));
       //cerr << "added sync topic" << st->topic << endl;
+      computeGroups();
       return true;
     }
     return false;
@@ -91,6 +114,7 @@ namespace boss_map {
     syncConditions.insert(cond);
     cond->m1->syncConditions.insert(cond);
     cond->m2->syncConditions.insert(cond);
+    computeGroups();
     return true;
   }
   
@@ -100,37 +124,70 @@ namespace boss_map {
       return true;
     }
 
-    st->sensorData = data;
+    st->receivedCount++;
+    st->buffer.push_back(data);
+    if ((int)st->buffer.size() > std::max(_bufferSize, 1)) {
+      st->buffer.pop_front();
+      st->droppedCount++;
+    }
 
-    // check if the dependancies are satisfied
+    // for each other topic of the group, select the buffered data closest in time to the new one
+    SyncGroup* group = st->group;
+    std::vector<size_t> selected(group->topics.size());
+    double t = data->timestamp();
     bool canEval = true;
-    bool allSatisfied = true;
-    std::set<SyncCondition*> conditions;
-    std::set<SyncTopicInstance*> dependancies;
-    computeDependancies(conditions, dependancies, st);
-    for (std::set<SyncCondition*>::iterator it = conditions.begin(); it!=conditions.end(); it++){
-      SyncCondition* cond = *it;
-      canEval &= cond->canEval();
-      if(cond->canEval())
-	allSatisfied &= cond->eval();
+    for (size_t i=0; i<group->topics.size(); i++){
+      SyncTopicInstance* topic = group->topics[i];
+      if (topic == st) {
+	selected[i] = topic->buffer.size()-1;
+      } else if (topic->buffer.empty()) {
+	canEval = false;
+	break;
+      } else {
+	size_t best = 0;
+	double bestDt = fabs(topic->buffer[0]->timestamp()-t);
+	for (size_t j=1; j<topic->buffer.size(); j++){
+	  double dt = fabs(topic->buffer[j]->timestamp()-t);
+	  if (dt<bestDt) {
+	    best = j;
+	    bestDt = dt;
+	  }
+	}
+	selected[i] = best;
+      }
+      topic->sensorData = topic->buffer[selected[i]];
     }
     if (! canEval){
+      for (size_t i=0; i<group->topics.size(); i++)
+	group->topics[i]->sensorData = 0;
       cerr << 'x';
       return false;
     }
+
+    bool allSatisfied = true;
+    for (size_t i=0; i<group->conditions.size() && allSatisfied; i++)
+      allSatisfied &= group->conditions[i]->eval();
     if (allSatisfied) {
       cerr << 'F';
       SynchronizedSensorData* ssd = new SynchronizedSensorData();
       ssd->setTopic(_topic);
-      for (std::set<SyncTopicInstance*>::iterator it = dependancies.begin(); it!=dependancies.end(); it++) {
-	ssd->sensorDatas.push_back((*it)->sensorData);
-	(*it)->sensorData = 0;
+      // the matched data are consumed, the older ones can only match worse
+      for (size_t i=0; i<group->topics.size(); i++) {
+	SyncTopicInstance* topic = group->topics[i];
+	ssd->sensorDatas.push_back(topic->sensorData);
+	topic->sensorData = 0;
+	topic->matchedCount++;
+	topic->droppedCount += selected[i];
+	topic->buffer.erase(topic->buffer.begin(), topic->buffer.begin()+selected[i]+1);
       }
       ssd->setRobotReferenceFrame(data->robotReferenceFrame());
       ssd->setTimestamp(data->timestamp());
+      _synchronizedCount++;
       put(ssd);
       return true;
     }
+    for (size_t i=0; i<group->topics.size(); i++)
+      group->topics[i]->sensorData = 0;
     return false;
   }
 
@@ -142,6 +199,7 @@ namespace boss_map {
     SyncTopicInstance* instance = new SyncTopicInstance(topic);
     syncTopics.insert(make_pair(topic,instance));
     //cerr << "added sync topic" << topic << endl;
+    computeGroups();
     return instance;
   }
 
@@ -160,6 +218,31 @@ namespace boss_map {
       addSensorData(sdata);
   }
 
+  void SensorDataSynchronizer::computeGroups(){
+    for (size_t i=0; i<syncGroups.size(); i++)
+      delete syncGroups[i];
+    syncGroups.clear();
+    for (std::map<std::string, SyncTopicInstance*>::iterator it = syncTopics.begin(); it!=syncTopics.end(); it++)
+      it->second->group = 0;
+    for (std::map<std::string, SyncTopicInstance*>::iterator it = syncTopics.begin(); it!=syncTopics.end(); it++){
+      if (it->second->group)
+	continue;
+      std::set<SyncCondition*> conditions;
+      std::set<SyncTopicInstance*> dependancies;
+      computeDependancies(conditions, dependancies, it->second);
+      SyncGroup* group = new SyncGroup;
+      // the topics in name order, as in the map
+      for (std::map<std::string, SyncTopicInstance*>::iterator jt = it; jt!=syncTopics.end(); jt++){
+	if (dependancies.count(jt->second)) {
+	  group->topics.push_back(jt->second);
+	  jt->second->group = group;
+	}
+      }
+      group->conditions.assign(conditions.begin(), conditions.end());
+      syncGroups.push_back(group);
+    }
+  }
+
   void SensorDataSynchronizer::computeDependancies(std::set<SyncCondition*> & conditions, 
 					 std::set<SyncTopicInstance*>& dependancies,
 					 SyncTopicInstance* instance){
@@ -198,12 +281,15 @@ namespace boss_map {
     for (std::set<SyncCondition*>::iterator it=syncConditions.begin(); it!=syncConditions.end(); it++){
       delete *it;
     }
+    for (size_t i=0; i<syncGroups.size(); i++)
+      delete syncGroups[i];
 
   }
 
   void SensorDataSynchronizer::serialize(ObjectData& data, IdContext& context) {
     StreamProcessor::serialize(data,context);
     data.setString("topic", _topic);
+    data.setInt("bufferSize", _bufferSize);
     ArrayData* topicsArray = new ArrayData();
     for  ( std::map<std::string, SyncTopicInstance*>::const_iterator it=syncTopics.begin(); it!=syncTopics.end(); it++) {
       topicsArray->add(new StringData(it->first));
@@ -227,6 +313,7 @@ namespace boss_map {
   void SensorDataSynchronizer::deserialize(ObjectData& data, IdContext& context){
     StreamProcessor::deserialize(data,context);
     _topic = data.getString("topic");
+    data >> field("bufferSize", _bufferSize);
     ArrayData& topicsArray = data.getField("syncTopics")->getArray();
     for (size_t i =0; i<topicsArray.size(); i++){
       std::string top = topicsArray[i].getString();
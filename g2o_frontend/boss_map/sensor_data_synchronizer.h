@@ -3,6 +3,7 @@
 
 #include <set>
 #include <list>
+#include <deque>
 #include "g2o_frontend/boss/serializer.h"
 #include "g2o_frontend/boss/deserializer.h"
 #include "reference_frame.h"
@@ -14,6 +15,7 @@ namespace boss_map {
   using namespace boss;
 
   struct SyncTopicInstance;
+  struct SyncGroup;
 
   struct SyncCondition {
     SyncCondition(SyncTopicInstance* m1, SyncTopicInstance*m2);
@@ -25,8 +27,22 @@ namespace boss_map {
   struct SyncTopicInstance {
     SyncTopicInstance(std::string topic);
     std::string topic;
+    //! the data being matched, on which the conditions are evaluated
     BaseSensorData* sensorData;
     std::set<SyncCondition*> syncConditions;
+    //! the data not matched yet, oldest first
+    std::deque<BaseSensorData*> buffer;
+    //! the topics connected to this one by the conditions
+    SyncGroup* group;
+    //! data received, sent in a synchronized data, and discarded
+    //! (pushed out of the buffer, or older than a matched one)
+    int receivedCount, matchedCount, droppedCount;
+  };
+
+  //! topics connected by conditions, that are synchronized together
+  struct SyncGroup {
+    std::vector<SyncTopicInstance*> topics;
+    std::vector<SyncCondition*> conditions;
   };
 
   struct SyncTimeCondition : public SyncCondition{
@@ -40,6 +56,8 @@ namespace boss_map {
     SynchronizedSensorData(int id=-1, IdContext* context = 0);
     virtual void serialize(ObjectData& data, IdContext& context);
     virtual void deserialize(ObjectData& data, IdContext& context);
+    //! the BLOBs of all the synchronized data
+    virtual void blobReferences(std::vector<BaseBLOBReference*>& references);
 
     template <class SensorDataType> 
     SensorDataType* sensorData(const std::string& topic_){
@@ -67,12 +85,22 @@ namespace boss_map {
     ~SensorDataSynchronizer();
     inline const std::string& topic() const {return _topic;}
     inline void setTopic (const std::string& topic_) {_topic = topic_;}
+    //! data kept for each topic while waiting for a match
+    inline int bufferSize() const {return _bufferSize;}
+    inline void setBufferSize(int bufferSize_) {_bufferSize = bufferSize_;}
+    //! synchronized data sent so far
+    inline int synchronizedCount() const {return _synchronizedCount;}
+    //! data discarded so far, on all the topics
+    int droppedCount() const;
 
     virtual void serialize(ObjectData& data, IdContext& context);
     virtual void deserialize(ObjectData& data, IdContext& context);
     
   protected:
     std::string _topic;
+    int _bufferSize;
+    int _synchronizedCount;
+    void computeGroups();
     void computeDependancies(std::set<SyncCondition*> & conditions, 
 			     std::set<SyncTopicInstance*>& dependancies,
 			     SyncTopicInstance* instance);
@@ -83,6 +111,7 @@ namespace boss_map {
 
     std::map<std::string, SyncTopicInstance*> syncTopics;
     std::set<SyncCondition*> syncConditions;
+    std::vector<SyncGroup*> syncGroups;
   };
   
 }
@@ -2,6 +2,7 @@
 #include <stdexcept>
 #include <iostream>
 #include "g2o_frontend/boss/object_data.h"
+#include "g2o_frontend/boss/message.h"
 
 namespace boss_map{
   using namespace boss;
@@ -91,6 +92,181 @@ namespace boss_map{
     _destinationProcessor->process(s);
   }
 
+  StreamProcessor::AsyncPropagatorOutputHandler::AsyncPropagatorOutputHandler(StreamProcessor* processor_, 
+									      StreamProcessor* destinationProcessor_, 
+									      int maxQueueSize_, 
+									      int id, boss::IdContext* context): 
+    StreamProcessor::PropagatorOutputHandler(processor_, destinationProcessor_, id, context){
+    _maxQueueSize = maxQueueSize_;
+    _blockedPuts = 0;
+    _dequeuedCount = 0;
+    _totalQueueLatency = 0;
+    _maxQueueLatency = 0;
+    _running = false;
+    _busy = false;
+    _stop = false;
+    _failed = false;
+    pthread_mutex_init(&_mutex, 0);
+    pthread_cond_init(&_notEmpty, 0);
+    pthread_cond_init(&_notFull, 0);
+    pthread_cond_init(&_idle, 0);
+  }
+
+  StreamProcessor::AsyncPropagatorOutputHandler::~AsyncPropagatorOutputHandler(){
+    try {
+      stop();
+    } catch (const std::exception& e) {
+      cerr << "async output handler: " << e.what() << endl;
+    }
+    pthread_cond_destroy(&_idle);
+    pthread_cond_destroy(&_notFull);
+    pthread_cond_destroy(&_notEmpty);
+    pthread_mutex_destroy(&_mutex);
+  }
+
+  void StreamProcessor::AsyncPropagatorOutputHandler::serialize(ObjectData& data, IdContext& context){
+    StreamProcessor::PropagatorOutputHandler::serialize(data, context);
+    data.setInt("maxQueueSize", _maxQueueSize);
+  }
+  
+  void StreamProcessor::AsyncPropagatorOutputHandler::deserialize(ObjectData& data, IdContext& context){
+    StreamProcessor::PropagatorOutputHandler::deserialize(data, context);
+    data >> field("maxQueueSize", _maxQueueSize);
+  }
+
+  void StreamProcessor::AsyncPropagatorOutputHandler::throwFailure(){
+    if (! _failed) {
+      pthread_mutex_unlock(&_mutex);
+      return;
+    }
+    std::string error = _error;
+    pthread_mutex_unlock(&_mutex);
+    throw std::runtime_error("the processor of the async output handler failed: "+error);
+  }
+
+  StreamProcessor::AsyncPropagatorOutputHandler::QueueStats StreamProcessor::AsyncPropagatorOutputHandler::queueStats(){
+    QueueStats stats;
+    pthread_mutex_lock(&_mutex);
+    stats.queueSize = _queue.size();
+    stats.blockedPuts = _blockedPuts;
+    stats.dequeuedCount = _dequeuedCount;
+    stats.totalQueueLatency = _totalQueueLatency;
+    stats.maxQueueLatency = _maxQueueLatency;
+    pthread_mutex_unlock(&_mutex);
+    return stats;
+  }
+
+  bool StreamProcessor::AsyncPropagatorOutputHandler::failed(){
+    pthread_mutex_lock(&_mutex);
+    bool f = _failed;
+    pthread_mutex_unlock(&_mutex);
+    return f;
+  }
+
+  void StreamProcessor::AsyncPropagatorOutputHandler::put(boss::Serializable* s){
+    pthread_mutex_lock(&_mutex);
+    if (_failed) {
+      delete s;
+      throwFailure();
+      return;
+    }
+    if (! _running) {
+      _stop = false;
+      if (pthread_create(&_thread, 0, run, this)) {
+	pthread_mutex_unlock(&_mutex);
+	throw std::runtime_error("cannot start the thread of the async output handler");
+      }
+      _running = true;
+    }
+    if (_maxQueueSize>0 && (int)_queue.size()>=_maxQueueSize) {
+      _blockedPuts++;
+      while ((int)_queue.size()>=_maxQueueSize)
+	pthread_cond_wait(&_notFull, &_mutex);
+    }
+    _queue.push_back(s);
+    _enqueueTimes.push_back(Message::getCurrentTime());
+    pthread_cond_signal(&_notEmpty);
+    pthread_mutex_unlock(&_mutex);
+  }
+
+  bool StreamProcessor::AsyncPropagatorOutputHandler::flush(){
+    pthread_mutex_lock(&_mutex);
+    bool pending = _busy || ! _queue.empty();
+    while (_busy || ! _queue.empty())
+      pthread_cond_wait(&_idle, &_mutex);
+    throwFailure();
+    return pending;
+  }
+
+  void StreamProcessor::AsyncPropagatorOutputHandler::stop(){
+    pthread_mutex_lock(&_mutex);
+    if (! _running) {
+      pthread_mutex_unlock(&_mutex);
+      return;
+    }
+    _stop = true;
+    pthread_cond_signal(&_notEmpty);
+    pthread_mutex_unlock(&_mutex);
+    pthread_join(_thread, 0);
+    pthread_mutex_lock(&_mutex);
+    _running = false;
+    throwFailure();
+  }
+
+  void* StreamProcessor::AsyncPropagatorOutputHandler::run(void* handler){
+    static_cast<AsyncPropagatorOutputHandler*>(handler)->processQueue();
+    return 0;
+  }
+
+  void StreamProcessor::AsyncPropagatorOutputHandler::processQueue(){
+    pthread_mutex_lock(&_mutex);
+    while (true) {
+      while (_queue.empty() && ! _stop)
+	pthread_cond_wait(&_notEmpty, &_mutex);
+      if (_queue.empty())
+	break;
+      Serializable* s = _queue.front();
+      _queue.pop_front();
+      double latency = Message::getCurrentTime()-_enqueueTimes.front();
+      _enqueueTimes.pop_front();
+      _dequeuedCount++;
+      _totalQueueLatency += latency;
+      if (latency>_maxQueueLatency)
+	_maxQueueLatency = latency;
+      _busy = true;
+      bool failed = _failed;
+      pthread_cond_signal(&_notFull);
+      pthread_mutex_unlock(&_mutex);
+
+      // an exception cannot leave the thread, it is kept for the producer
+      std::string error;
+      if (! failed) {
+	try {
+	  _destinationProcessor->process(s);
+	} catch (const std::exception& e) {
+	  failed = true;
+	  error = e.what();
+	} catch (...) {
+	  failed = true;
+	  error = "unknown exception";
+	}
+      } else {
+	// discarded after a failure of the destination
+	delete s;
+      }
+
+      pthread_mutex_lock(&_mutex);
+      if (failed && ! _failed) {
+	_failed = true;
+	_error = error;
+      }
+      _busy = false;
+      if (_queue.empty())
+	pthread_cond_broadcast(&_idle);
+    }
+    pthread_mutex_unlock(&_mutex);
+  }
+
   void StreamProcessor::put(boss::Serializable* s){
     for(std::list<OutputHandler*>::iterator it = _handlers.begin(); it!=_handlers.end(); it++){
       OutputHandler* handler = *it;
@@ -216,6 +392,20 @@ namespace boss_map{
     return 0;
   }
 
+  void StreamProcessorGroup::flush() {
+    // a flushed handler may fill the queue of a downstream one, so repeat until nothing is pending
+    bool pending = true;
+    while (pending) {
+      pending = false;
+      for (size_t i =0; i<objects.size(); i++){
+	StreamProcessor::AsyncPropagatorOutputHandler* handler = 
+	  dynamic_cast<StreamProcessor::AsyncPropagatorOutputHandler*>(objects[i]);
+	if (handler && handler->flush())
+	  pending = true;
+      }
+    }
+  }
+
   StreamProcessor* loadProcessor(const std::string& name, boss::Deserializer& des, std::list<Serializable*>& objects){
     Serializable* o;
     while( (o = des.readObject()) ) {
@@ -230,10 +420,12 @@ namespace boss_map{
   typedef StreamProcessor::EnqueuerOutputHandler StreamProcessor_EnqueuerOutputHandler;
   typedef StreamProcessor::WriterOutputHandler StreamProcessor_WriterOutputHandler;
   typedef StreamProcessor::PropagatorOutputHandler StreamProcessor_PropagatorOutputHandler;
+  typedef StreamProcessor::AsyncPropagatorOutputHandler StreamProcessor_AsyncPropagatorOutputHandler;
 
   BOSS_REGISTER_CLASS(StreamProcessor_EnqueuerOutputHandler);
   BOSS_REGISTER_CLASS(StreamProcessor_WriterOutputHandler);
   BOSS_REGISTER_CLASS(StreamProcessor_PropagatorOutputHandler);
+  BOSS_REGISTER_CLASS(StreamProcessor_AsyncPropagatorOutputHandler);
   BOSS_REGISTER_CLASS(StreamProcessorGroup);
 
 }
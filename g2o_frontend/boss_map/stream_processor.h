@@ -1,5 +1,6 @@
 #pragma once
 #include <list>
+#include <pthread.h>
 #include "g2o_frontend/boss/serializer.h"
 #include "g2o_frontend/boss/identifiable.h"
 #include "robot_configuration.h"
@@ -60,6 +61,75 @@ namespace boss_map {
       StreamProcessor* _destinationProcessor;
     };
 
+    /**
+       Propagates the objects to the destination processor, that runs in a separate thread.
+       The objects are passed through a bounded queue: put() blocks when the queue is full, 
+       so that a slow consumer throttles the producer. The order of the objects is preserved.
+       The thread is started at the first put. Processors on the two sides of the handler
+       run concurrently, and should not share unprotected state: the map is protected by the
+       lock of its MapManager, the other objects (caches, matchers) have to be distinct.
+       If the destination processor throws, the objects still queued and the ones put later
+       are discarded and deleted, and the error is thrown again by the next put(), flush() or stop().
+     */
+    class AsyncPropagatorOutputHandler: public PropagatorOutputHandler {
+    public:
+      //! counters of the queue, taken together
+      struct QueueStats {
+	//! objects in the queue
+	size_t queueSize;
+	//! number of times put had to wait for the consumer
+	int blockedPuts;
+	//! number of objects taken from the queue by the consumer
+	int dequeuedCount;
+	//! seconds the dequeued objects waited in the queue, in total and at most
+	double totalQueueLatency;
+	double maxQueueLatency;
+      };
+
+      AsyncPropagatorOutputHandler(StreamProcessor* processor_=0, StreamProcessor* destinationProcessor_=0, int maxQueueSize_=16, int id=-1, boss::IdContext* context = 0);
+      virtual ~AsyncPropagatorOutputHandler();
+      virtual void serialize(boss::ObjectData& data, boss::IdContext& context);
+      virtual void deserialize(boss::ObjectData& data, boss::IdContext& context);
+      virtual void put(boss::Serializable* s);
+
+      inline int maxQueueSize() const {return _maxQueueSize;}
+      inline void setMaxQueueSize(int maxQueueSize_) {_maxQueueSize = maxQueueSize_;}
+      //! the counters of the queue, consistent with each other also while the consumer runs
+      QueueStats queueStats();
+
+      //! waits until all the queued objects have been processed, returns false if the queue was already empty
+      bool flush();
+      //! processes the objects left in the queue and terminates the thread
+      void stop();
+      //! true if the destination processor has thrown
+      bool failed();
+
+    protected:
+      static void* run(void* handler);
+      void processQueue();
+      //! throws the error of the destination processor, if any; to be called with the lock held, that is released
+      void throwFailure();
+
+      int _maxQueueSize;
+      int _blockedPuts;
+      int _dequeuedCount;
+      double _totalQueueLatency;
+      double _maxQueueLatency;
+      SerializableList _queue;
+      //! time each object of the queue was put
+      std::list<double> _enqueueTimes;
+      bool _running;
+      bool _busy;
+      bool _stop;
+      bool _failed;
+      std::string _error;
+      pthread_t _thread;
+      pthread_mutex_t _mutex;
+      pthread_cond_t _notEmpty;
+      pthread_cond_t _notFull;
+      pthread_cond_t _idle;
+    };
+
     friend class OutputHandler;
 
     StreamProcessor(int id=-1, boss::IdContext* context = 0);
@@ -100,6 +170,9 @@ namespace boss_map {
 
     StreamProcessor* byName(const std::string& n);
 
+    //! waits until all the asynchronous handlers in the group are idle
+    void flush();
+
     template <typename T>
     T* byType(size_t& pos, size_t startPos = 0) {
       for (pos = startPos; pos<objects.size(); pos++){
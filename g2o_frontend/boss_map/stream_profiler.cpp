@@ -0,0 +1,327 @@
+#include "stream_profiler.h"
+#include "map_manager.h"
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <typeinfo>
+#include <unistd.h>
+#include "g2o_frontend/boss/object_data.h"
+#include "g2o_frontend/boss/message.h"
+
+namespace boss_map {
+  using namespace boss;
+  using namespace std;
+
+  // the profiled call running in this thread, the nested ones add their time to it
+  struct ProfiledCall {
+    double nestedTime;
+  };
+  static __thread ProfiledCall* currentCall = 0;
+
+  static string jsonEscape(const string& s) {
+    string escaped;
+    for (size_t i=0; i<s.size(); i++){
+      if (s[i]=='"' || s[i]=='\\')
+	escaped += '\\';
+      escaped += s[i];
+    }
+    return escaped;
+  }
+
+  StreamProfiler::ProcessorStats::ProcessorStats(){
+    calls = 0;
+    outputs = 0;
+    totalTime = 0;
+    selfTime = 0;
+    maxTime = 0;
+    memoryGrowth = 0;
+  }
+
+  StreamProfiler::StreamProfiler(int id, boss::IdContext* context):
+    Identifiable(id, context){
+    _summaryPeriod = 10;
+    _maxTraceEvents = 1000000;
+    _measureMemory = false;
+    _pipeline = 0;
+    _manager = 0;
+    _startTime = Message::getCurrentTime();
+    _lastSummaryTime = _startTime;
+    _startMemory = residentMemory();
+    _mapNodes = -1;
+    _mapRelations = -1;
+    _traceOpen = false;
+    _traceEvents = 0;
+    pthread_mutex_init(&_mutex, 0);
+  }
+
+  StreamProfiler::~StreamProfiler(){
+    if (_trace.is_open())
+      _trace << "]" << endl;
+    pthread_mutex_destroy(&_mutex);
+  }
+
+  void StreamProfiler::serialize(ObjectData& data, IdContext& context){
+    Identifiable::serialize(data, context);
+    data.setFloat("summaryPeriod", _summaryPeriod);
+    data.setString("traceFilename", _traceFilename);
+    data.setInt("maxTraceEvents", _maxTraceEvents);
+    data.setBool("measureMemory", _measureMemory);
+    data.setPointer("pipeline", _pipeline);
+    data.setPointer("manager", _manager);
+  }
+
+  void StreamProfiler::deserialize(ObjectData& data, IdContext& context){
+    Identifiable::deserialize(data, context);
+    data >> field("summaryPeriod", _summaryPeriod);
+    data >> field("traceFilename", _traceFilename);
+    data >> field("maxTraceEvents", _maxTraceEvents);
+    data >> field("measureMemory", _measureMemory);
+    if (data.getField("pipeline"))
+      data.getReference("pipeline").bind(_pipeline);
+    if (data.getField("manager"))
+      data.getReference("manager").bind(_manager);
+  }
+
+  long StreamProfiler::residentMemory(){
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (! f)
+      return 0;
+    long size = 0, resident = 0;
+    if (fscanf(f, "%ld %ld", &size, &resident)!=2)
+      resident = 0;
+    fclose(f);
+    return resident*sysconf(_SC_PAGESIZE);
+  }
+
+  StreamProfiler::ProcessorStats& StreamProfiler::stats(ProfilingProcessor* processor){
+    std::map<ProfilingProcessor*, ProcessorStats>::iterator it = _stats.find(processor);
+    if (it!=_stats.end())
+      return it->second;
+    _processors.push_back(processor);
+    ProcessorStats& s = _stats[processor];
+    s.name = processor->reportName();
+    return s;
+  }
+
+  int StreamProfiler::threadId(){
+    pthread_t self = pthread_self();
+    for (size_t i=0; i<_threads.size(); i++)
+      if (pthread_equal(_threads[i], self))
+	return i;
+    _threads.push_back(self);
+    return _threads.size()-1;
+  }
+
+  void StreamProfiler::writeTraceEvent(ProfilingProcessor* processor, const std::string& messageClass,
+				       double start, double duration){
+    if (_traceFilename.empty() || _traceEvents>=_maxTraceEvents)
+      return;
+    if (! _traceOpen) {
+      // opened once, a failure is not retried at each event
+      _traceOpen = true;
+      _trace.open(_traceFilename.c_str());
+      if (! _trace)
+	cerr << "cannot open the trace file " << _traceFilename << endl;
+      else
+	_trace << "[";
+    }
+    if (! _trace.is_open())
+      return;
+    // a trace without the closing bracket is still read by the viewer
+    _trace << (_traceEvents ? ",\n" : "\n")
+	   << "{\"name\":\"" << jsonEscape(stats(processor).name) << "\",\"cat\":\"process\",\"ph\":\"X\""
+	   << fixed << setprecision(0)
+	   << ",\"ts\":" << (start-_startTime)*1e6 << ",\"dur\":" << duration*1e6
+	   << ",\"pid\":" << getpid() << ",\"tid\":" << threadId()
+	   << ",\"args\":{\"message\":\"" << jsonEscape(messageClass) << "\"}}";
+    _trace.unsetf(ios::floatfield);
+    _traceEvents++;
+  }
+
+  void StreamProfiler::addCall(ProfilingProcessor* processor, const std::string& messageClass, double start,
+			       double duration, double selfDuration, long memoryGrowth){
+    // read here, in the thread that runs the processors, and not by the summaries of other threads
+    int mapNodes = _manager ? (int)_manager->nodes().size() : -1;
+    int mapRelations = _manager ? (int)_manager->relations().size() : -1;
+    pthread_mutex_lock(&_mutex);
+    _mapNodes = mapNodes;
+    _mapRelations = mapRelations;
+    ProcessorStats& s = stats(processor);
+    s.calls++;
+    s.totalTime += duration;
+    s.selfTime += selfDuration;
+    if (duration>s.maxTime)
+      s.maxTime = duration;
+    s.memoryGrowth += memoryGrowth;
+    writeTraceEvent(processor, messageClass, start, duration);
+    double now = start+duration;
+    if (_summaryPeriod>0 && now-_lastSummaryTime>=_summaryPeriod) {
+      _lastSummaryTime = now;
+      writeSummary(cerr);
+      if (_trace.is_open())
+	_trace.flush();
+    }
+    pthread_mutex_unlock(&_mutex);
+  }
+
+  void StreamProfiler::addOutput(ProfilingProcessor* processor){
+    pthread_mutex_lock(&_mutex);
+    stats(processor).outputs++;
+    pthread_mutex_unlock(&_mutex);
+  }
+
+  void StreamProfiler::writeSummary(std::ostream& os){
+    double elapsed = Message::getCurrentTime()-_startTime;
+    long memory = residentMemory();
+    ios::fmtflags flags = os.flags();
+    os << fixed << setprecision(1);
+    os << endl << "PROFILE: " << elapsed << " s, resident memory " << memory/1048576.
+       << " MB (" << showpos << (memory-_startMemory)/1048576. << noshowpos << " MB)" << endl;
+    os << "  " << left << setw(24) << "processor" << right
+       << setw(9) << "calls" << setw(9) << "outputs" << setw(10) << "total_s" << setw(10) << "self_s"
+       << setw(10) << "mean_ms" << setw(10) << "max_ms" << setw(10) << "calls/s";
+    if (_measureMemory)
+      os << setw(10) << "mem_MB";
+    os << endl;
+    for (size_t i=0; i<_processors.size(); i++){
+      const ProcessorStats& s = _stats[_processors[i]];
+      os << "  " << left << setw(24) << s.name << right << setprecision(3)
+	 << setw(9) << s.calls << setw(9) << s.outputs << setw(10) << s.totalTime << setw(10) << s.selfTime
+	 << setw(10) << (s.calls ? 1e3*s.totalTime/s.calls : 0.) << setw(10) << 1e3*s.maxTime
+	 << setw(10) << (elapsed>0 ? s.calls/elapsed : 0.);
+      if (_measureMemory)
+	os << setw(10) << s.memoryGrowth/1048576.;
+      os << endl;
+    }
+    if (_pipeline) {
+      for (size_t i=0; i<_pipeline->objects.size(); i++){
+	StreamProcessor::AsyncPropagatorOutputHandler* handler =
+	  dynamic_cast<StreamProcessor::AsyncPropagatorOutputHandler*>(_pipeline->objects[i]);
+	if (! handler)
+	  continue;
+	StreamProcessor::AsyncPropagatorOutputHandler::QueueStats queue = handler->queueStats();
+	os << "  queue " << (handler->streamProcessor() ? handler->streamProcessor()->name() : "?")
+	   << " -> " << (handler->destinationProcessor() ? handler->destinationProcessor()->name() : "?")
+	   << ": size " << queue.queueSize << ", dequeued " << queue.dequeuedCount
+	   << ", latency mean " << (queue.dequeuedCount ? 1e3*queue.totalQueueLatency/queue.dequeuedCount : 0.)
+	   << " ms max " << 1e3*queue.maxQueueLatency << " ms, blocked puts " << queue.blockedPuts << endl;
+      }
+    }
+    if (_mapNodes>=0)
+      os << "  map at the last call: " << _mapNodes << " nodes, " << _mapRelations << " relations" << endl;
+    os.flags(flags);
+  }
+
+  void StreamProfiler::printSummary(std::ostream& os){
+    pthread_mutex_lock(&_mutex);
+    writeSummary(os);
+    pthread_mutex_unlock(&_mutex);
+  }
+
+  void StreamProfiler::close(){
+    pthread_mutex_lock(&_mutex);
+    writeSummary(cerr);
+    if (_trace.is_open()) {
+      _trace << "]" << endl;
+      _trace.close();
+    }
+    pthread_mutex_unlock(&_mutex);
+  }
+
+
+  ProfilingProcessor::CountingOutputHandler::CountingOutputHandler(StreamProcessor* processor_,
+								  ProfilingProcessor* profilingProcessor_):
+    OutputHandler(processor_){
+    _profilingProcessor = profilingProcessor_;
+  }
+
+  void ProfilingProcessor::CountingOutputHandler::put(boss::Serializable*){
+    if (_profilingProcessor->profiler())
+      _profilingProcessor->profiler()->addOutput(_profilingProcessor);
+  }
+
+  ProfilingProcessor::ProfilingProcessor(StreamProcessor* processor_, StreamProfiler* profiler_, int id, boss::IdContext* context):
+    StreamProcessor(id, context){
+    _processor = 0;
+    _profiler = profiler_;
+    _counter = 0;
+    _deserializedProcessor = 0;
+    setProcessor(processor_);
+  }
+
+  void ProfilingProcessor::serialize(ObjectData& data, IdContext& context){
+    StreamProcessor::serialize(data, context);
+    data.setPointer("processor", _processor);
+    data.setPointer("profiler", _profiler);
+  }
+
+  void ProfilingProcessor::deserialize(ObjectData& data, IdContext& context){
+    StreamProcessor::deserialize(data, context);
+    _deserializedProcessor = 0;
+    data.getReference("processor").bind(_deserializedProcessor);
+    data.getReference("profiler").bind(_profiler);
+  }
+
+  void ProfilingProcessor::deserializeComplete(){
+    setProcessor(_deserializedProcessor);
+  }
+
+  void ProfilingProcessor::setProcessor(StreamProcessor* processor_){
+    if (processor_ == _processor)
+      return;
+    _processor = processor_;
+    if (! _processor)
+      return;
+    if (_counter)
+      _counter->setStreamProcessor(_processor);
+    else
+      _counter = new CountingOutputHandler(_processor, this);
+  }
+
+  const std::string& ProfilingProcessor::reportName() const {
+    if (_name!="unknown" || ! _processor)
+      return _name;
+    return _processor->name();
+  }
+
+  void ProfilingProcessor::process(Serializable* s){
+    if (! _processor) {
+      put(s);
+      return;
+    }
+    if (! _profiler) {
+      _processor->process(s);
+      return;
+    }
+    // taken before the call, the processor may take the ownership of the message
+    string messageClass;
+    try {
+      messageClass = s->className();
+    } catch (const std::logic_error&) {
+      messageClass = typeid(*s).name();
+    }
+    ProfiledCall call;
+    call.nestedTime = 0;
+    ProfiledCall* outerCall = currentCall;
+    currentCall = &call;
+    long memory = _profiler->measureMemory() ? StreamProfiler::residentMemory() : 0;
+    double start = Message::getCurrentTime();
+    try {
+      _processor->process(s);
+    } catch (...) {
+      currentCall = outerCall;
+      throw;
+    }
+    double duration = Message::getCurrentTime()-start;
+    long memoryGrowth = _profiler->measureMemory() ? StreamProfiler::residentMemory()-memory : 0;
+    currentCall = outerCall;
+    if (outerCall)
+      outerCall->nestedTime += duration;
+    _profiler->addCall(this, messageClass, start, duration, duration-call.nestedTime, memoryGrowth);
+  }
+
+  BOSS_REGISTER_CLASS(StreamProfiler);
+  BOSS_REGISTER_CLASS(ProfilingProcessor);
+
+}
@@ -0,0 +1,151 @@
+#pragma once
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include "stream_processor.h"
+
+namespace boss_map {
+  class MapManager;
+  class StreamProcessorGroup;
+  class ProfilingProcessor;
+
+  /**
+     Collects the measurements of the ProfilingProcessors that point to it.
+     Every summaryPeriod seconds it prints to stderr, for each of them, the messages processed
+     and output, the wall time spent in the processor (total, without the nested profiled
+     processors, and the longest call) and the growth of the resident memory during the calls.
+     The self time subtracts only the nested calls made in the same thread: the time of the
+     processors behind an asynchronous handler stays in their own rows.
+     The summary also reports the queues of the asynchronous handlers of the pipeline, if given,
+     and the size of the map of the manager, if given. The map is not locked: its size is read
+     at the end of each profiled call, in the thread of the call, so the manager should be set
+     only if the profiled processors run in the thread that modifies the map.
+     If a traceFilename is set, each call is also written there as a complete event of the
+     Chrome trace format (chrome://tracing); the file is a valid trace also if close() is not called.
+     The measurements can come from many threads.
+   */
+  class StreamProfiler: public boss::Identifiable {
+  public:
+    StreamProfiler(int id=-1, boss::IdContext* context = 0);
+    virtual ~StreamProfiler();
+    virtual void serialize(boss::ObjectData& data, boss::IdContext& context);
+    virtual void deserialize(boss::ObjectData& data, boss::IdContext& context);
+
+    //! seconds between two summaries, 0 disables them
+    inline double summaryPeriod() const {return _summaryPeriod;}
+    inline void setSummaryPeriod(double summaryPeriod_) {_summaryPeriod = summaryPeriod_;}
+    //! the trace file, empty for none; set it before the first measurement
+    inline const std::string& traceFilename() const {return _traceFilename;}
+    inline void setTraceFilename(const std::string& traceFilename_) {_traceFilename = traceFilename_;}
+    //! events written in the trace at most, so that a long run does not fill the disk
+    inline int maxTraceEvents() const {return _maxTraceEvents;}
+    inline void setMaxTraceEvents(int maxTraceEvents_) {_maxTraceEvents = maxTraceEvents_;}
+    //! if true the resident memory is read before and after each call, a system call each
+    inline bool measureMemory() const {return _measureMemory;}
+    inline void setMeasureMemory(bool measureMemory_) {_measureMemory = measureMemory_;}
+    //! the pipeline whose asynchronous handlers are reported, can be 0
+    inline StreamProcessorGroup* pipeline() {return _pipeline;}
+    inline void setPipeline(StreamProcessorGroup* pipeline_) {_pipeline = pipeline_;}
+    //! the manager whose map is reported, can be 0; it is read by the threads calling addCall
+    inline MapManager* manager() {return _manager;}
+    inline void setManager(MapManager* manager_) {_manager = manager_;}
+
+    //! records a call of the processor on a message of class messageClass, from start lasting duration,
+    //! of which selfDuration not in the nested profiled processors; the times are in seconds.
+    //! Called in the thread of the processor, it also takes the size of the map
+    void addCall(ProfilingProcessor* processor, const std::string& messageClass, double start, double duration,
+		 double selfDuration, long memoryGrowth);
+    //! records a message output by the processor
+    void addOutput(ProfilingProcessor* processor);
+
+    //! prints the summary since the start
+    void printSummary(std::ostream& os);
+    //! prints the last summary and terminates the trace
+    void close();
+
+    //! resident memory of the process, in bytes
+    static long residentMemory();
+
+  protected:
+    struct ProcessorStats {
+      ProcessorStats();
+      std::string name;
+      int calls;
+      int outputs;
+      double totalTime;
+      double selfTime;
+      double maxTime;
+      long memoryGrowth;
+    };
+
+    ProcessorStats& stats(ProfilingProcessor* processor);
+    void writeSummary(std::ostream& os);
+    void writeTraceEvent(ProfilingProcessor* processor, const std::string& messageClass, double start, double duration);
+    //! small id of the calling thread for the trace
+    int threadId();
+
+    double _summaryPeriod;
+    std::string _traceFilename;
+    int _maxTraceEvents;
+    bool _measureMemory;
+    StreamProcessorGroup* _pipeline;
+    MapManager* _manager;
+
+    pthread_mutex_t _mutex;
+    std::map<ProfilingProcessor*, ProcessorStats> _stats;
+    std::vector<ProfilingProcessor*> _processors;
+    std::vector<pthread_t> _threads;
+    double _startTime;
+    double _lastSummaryTime;
+    long _startMemory;
+    //! size of the map at the last call, -1 before the first one
+    int _mapNodes;
+    int _mapRelations;
+    std::ofstream _trace;
+    bool _traceOpen;
+    int _traceEvents;
+  };
+
+  /**
+     Decorator of a processor, that measures its calls for a StreamProfiler.
+     It takes the place of the processor as sink of the upstream handlers (or as first node of
+     the pipeline) and forwards the messages to it; the outputs of the processor go on
+     to its handlers, and are counted.
+   */
+  class ProfilingProcessor: public StreamProcessor {
+  public:
+    ProfilingProcessor(StreamProcessor* processor_=0, StreamProfiler* profiler_=0, int id=-1, boss::IdContext* context = 0);
+    virtual void serialize(boss::ObjectData& data, boss::IdContext& context);
+    virtual void deserialize(boss::ObjectData& data, boss::IdContext& context);
+    virtual void deserializeComplete();
+
+    virtual void process(boss::Serializable* s);
+
+    //! the profiled processor
+    inline StreamProcessor* processor() {return _processor;}
+    void setProcessor(StreamProcessor* processor_);
+    inline StreamProfiler* profiler() {return _profiler;}
+    inline void setProfiler(StreamProfiler* profiler_) {_profiler = profiler_;}
+    //! the name in the reports, the one of the processor if this has none
+    const std::string& reportName() const;
+
+  protected:
+    //! counts the outputs of the profiled processor; as all the handlers, it is owned by the processor
+    class CountingOutputHandler: public OutputHandler {
+    public:
+      CountingOutputHandler(StreamProcessor* processor_, ProfilingProcessor* profilingProcessor_);
+      virtual void put(boss::Serializable* s);
+    protected:
+      ProfilingProcessor* _profilingProcessor;
+    };
+
+    StreamProcessor* _processor;
+    StreamProfiler* _profiler;
+    CountingOutputHandler* _counter;
+  private:
+    StreamProcessor* _deserializedProcessor;
+  };
+
+}
@@ -25,6 +25,7 @@ namespace boss_map_building {
   BaseTracker::BaseTracker(MapManager* manager_, RobotConfiguration* configuration_, int id, boss::IdContext* context): StreamProcessor(id,context){
     _manager = manager_;
     _robotConfiguration = configuration_;
+    _useOdometry = true;
     init();
   }
 
@@ -32,7 +33,24 @@ namespace boss_map_building {
     _pendingNode = 0;
     _currentNode = 0;
     _keyNode = 0;
-    _localT.setIdentity();
+    _predictor.clear();
+    _previousNodeTime = -1;
+    resetLocalT();
+  }
+
+  void BaseTracker::resetLocalT(const Eigen::Isometry3d& localT){
+    _localT = localT;
+    _motionPriorVariance.setZero();
+    _hasMotionPrior = false;
+    _motionPriorIMU = false;
+  }
+
+  // time of the sensor data of the node, negative if it has none
+  static double nodeTimestamp(MapNode* n){
+    BaseSensorDataNode* sn = dynamic_cast<BaseSensorDataNode*>(n);
+    if (! sn || ! sn->baseSensorData())
+      return -1;
+    return sn->baseSensorData()->timestamp();
   }
 
   Eigen::Isometry3d BaseTracker::computeInitialGuess(MapNode* n_){
@@ -40,17 +58,34 @@ namespace boss_map_building {
     t.setIdentity();
     dt.setIdentity();
     BaseSensorDataNode *sn = dynamic_cast<BaseSensorDataNode*>(n_);
+    double time = nodeTimestamp(n_);
+    bool imuIntegrated = false;
     
     if (_keyNode) {
-      if (sn && sn->odometry()) {
-	dt = sn->odometry()->transform();
+      Eigen::Isometry3d odometry;
+      const Eigen::Isometry3d* odometryPtr = 0;
+      if (_useOdometry && sn && sn->odometry()) {
+	odometry = sn->odometry()->transform();
+	odometryPtr = &odometry;
       }
+      // with an unknown time there is nothing to integrate or extrapolate
+      double previousTime = (time>=0 && _previousNodeTime>=0) ? _previousNodeTime : time;
+      Vector6d variance;
+      imuIntegrated = _predictor.predict(dt, variance, previousTime, time, odometryPtr);
       _localT = _localT*dt;
+      _motionPriorVariance += variance;
+      _hasMotionPrior = true;
+      _motionPriorIMU = _motionPriorIMU || imuIntegrated;
       t = _keyNode->transform()*_localT;
     }
+    if (time>=0) {
+      _previousNodeTime = time;
+      _predictor.discard(time);
+    }
     
+    // the absolute orientation only if the rotation was not integrated from the samples
     SyncSensorDataNode* ssn=dynamic_cast<SyncSensorDataNode*>(n_);
-    if (ssn && ssn->imu()){
+    if (! imuIntegrated && ssn && ssn->imu()){
       Eigen::Vector3d translation = t.translation();
       t.linear() = ssn->imu()->transform().linear();
       t.translation()= translation;
@@ -64,6 +99,14 @@ namespace boss_map_building {
 	 
   
   void BaseTracker::process(Serializable* s){
+    IMUData* imu = dynamic_cast<IMUData*>(s);
+    if (imu) {
+      // the angular velocity is measured in the frame of the imu
+      Eigen::Matrix3d sensorRotation = Eigen::Matrix3d::Identity();
+      if (_robotConfiguration && imu->sensor() && imu->sensor()->frame())
+	sensorRotation = _robotConfiguration->sensorOffset(imu->sensor()).linear();
+      _predictor.addIMU(imu, sensorRotation);
+    }
     MapNode* n = dynamic_cast<MapNode*>(s);
     if (n) {
       _currentNode = _pendingNode;
@@ -78,41 +121,60 @@ namespace boss_map_building {
     return true;
   }
 
+  void BaseTracker::reset(){
+    _keyNode = _currentNode;
+    resetLocalT();
+    _outputQueue.push_back(new NewKeyNodeMessage(_keyNode));
+  }
+
   void BaseTracker::doStuff(){
     if (! _currentNode)
       return;
     
     //cerr << "*************** NEW NODE " << cnt++ <<  " *************** " << endl;
    
-    Eigen::Isometry3d guess = computeInitialGuess(_currentNode);
-    //cerr << "globalT: " << t2v(_globalT).transpose() << endl;
-    _currentNode->setTransform(guess);
+    // the key node may be moved by the processors of other threads; the lock is
+    // taken around the uses of the map, and not while the queue is flushed
+    {
+      MapManager::ScopedLock lock(_manager);
+      Eigen::Isometry3d guess = computeInitialGuess(_currentNode);
+      //cerr << "globalT: " << t2v(_globalT).transpose() << endl;
+      _currentNode->setTransform(guess);
+    }
     //cerr << "guess" << t2v(guess).transpose() << endl;
     if (_keyNode){
-      MapNodeBinaryRelation* r = registerNodes(_keyNode, _currentNode, _localT);
+      MotionPrior prior;
+      if (_hasMotionPrior) {
+	prior.information.setZero();
+	for (int i=0; i<6; i++)
+	  prior.information(i,i) = 1./_motionPriorVariance(i);
+	prior.imuRotation = _motionPriorIMU;
+      }
+      MapNodeBinaryRelation* r = registerNodes(_keyNode, _currentNode, _localT, _hasMotionPrior ? &prior : 0);
       if (! r){ // matching failed
 	//cerr << "TRACK_INIT" << endl;
 	cerr << "X";
     	flushQueue();
-    	_keyNode = _currentNode;
-	_localT.setIdentity();
-	_outputQueue.push_back(new NewKeyNodeMessage(_keyNode));
+	reset();
       } else { // matching ok
 	//cerr << "rel: "  << t2v(r->transform()).transpose() << endl;
 	//cerr << "knt: " << t2v(_keyNode->transform()).transpose() << endl;
-	_localT = r->transform();
+	resetLocalT(r->transform());
 	Eigen::Matrix3d R = _localT.linear();
 	Eigen::Matrix3d E = R.transpose() * R;
 	E.diagonal().array() -= 1;
 	_localT.linear() -= 0.5 * R * E;
-	_currentNode->setTransform(_keyNode->transform()*r->transform());
+	{
+	  MapManager::ScopedLock lock(_manager);
+	  _currentNode->setTransform(_keyNode->transform()*r->transform());
+	}
     	if (shouldChangeKeyNode(r)){
 	  cerr << "K";
     	  //cerr << "KF_CHANGE" << endl;
     	  _outputQueue.push_back(r);
 	  flushQueue();
     	  _keyNode = _currentNode;
-	  _localT.setIdentity();
+	  resetLocalT();
 	  _outputQueue.push_back(new NewKeyNodeMessage(_keyNode));
    	  _manager->addRelation(r);
     	  //cerr << "knt: " << t2v(_keyNode->transform()).transpose() << endl;
@@ -126,9 +188,14 @@ namespace boss_map_building {
       //cerr << "KF_INIT" << endl;
       _keyNode = _currentNode;
       _outputQueue.push_back(new NewKeyNodeMessage(_keyNode));
-      _localT.setIdentity();
+      resetLocalT();
       //cerr << "knt: " << endl << _keyNode->transform().matrix() << endl;
     }
+    double time = nodeTimestamp(_currentNode);
+    if (time>=0) {
+      MapManager::ScopedLock lock(_manager);
+      _predictor.correct(time, _currentNode->transform());
+    }
   }
 
   void BaseTracker::flushQueue(){
@@ -142,15 +209,18 @@ namespace boss_map_building {
   void BaseTracker::serialize(ObjectData& data, IdContext& context) {
     StreamProcessor::serialize(data,context);
     data.setPointer("manager", _manager);
+    data.setBool("useOdometry", _useOdometry);
   }
   void BaseTracker::deserialize(ObjectData& data, IdContext& context) {
     StreamProcessor::deserialize(data,context);
     data.getReference("manager").bind(_manager);
+    data >> field("useOdometry", _useOdometry);
   }
 
   BaseTracker::~BaseTracker(){}
 
-  MapNodeBinaryRelation* BaseTracker::registerNodes(MapNode* keyNode, MapNode* otherNode, const Eigen::Isometry3d& guess) {
+  MapNodeBinaryRelation* BaseTracker::registerNodes(MapNode* keyNode, MapNode* otherNode, const Eigen::Isometry3d& guess,
+						    const MotionPrior*) {
     MapNodeBinaryRelation* rel = new MapNodeBinaryRelation(_manager);
     //cerr << "rel" << keyNode->seq() << " " << otherNode->seq() << endl;
     rel->nodes()[0]=keyNode;
@@ -12,6 +12,7 @@
 #include "g2o_frontend/boss_map/sensor_data_synchronizer.h"
 #include "g2o_frontend/boss_map/robot_configuration.h"
 #include "g2o_frontend/boss_map/map_manager.h"
+#include "motion_predictor.h"
 
 
 namespace boss_map_building {
@@ -30,6 +31,17 @@ namespace boss_map_building {
   class BaseTracker: public StreamProcessor {
   public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    //! the uncertainty of a guess predicted from the motion since the key node
+    struct MotionPrior {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+      //! the inverse of the variances of the predicted motions
+      Matrix6d information;
+      //! true if the rotation was integrated from the IMU samples, that
+      //! then are already in the prior and should not be used again
+      bool imuRotation;
+    };
+
     BaseTracker(MapManager* manager_=0, RobotConfiguration* configuration_=0, int id=-1, boss::IdContext* context=0);
     //! initializes the tracker
     virtual void init();
@@ -41,10 +53,15 @@ namespace boss_map_building {
     //! computes the initial guess of a node, by taking into account the
     //! - global transform
     //! - the relative displacement from the initial positions of the previous and the current nodes
-    //! the odometry (if available) and the imu (if available)
+    //! predicted from the odometry (if available and used) and the IMU samples received in between (if any),
+    //! or at constant velocity; without IMU samples, the absolute orientation of the imu (if available)
     //! @param n_: the node;
     //! @returns: the global position of the node
     virtual Eigen::Isometry3d computeInitialGuess(MapNode* n_);
+
+    //! if false the odometry of the nodes is ignored, and the motion is predicted from the IMU or at constant velocity
+    inline bool useOdometry() const {return _useOdometry;}
+    inline void setUseOdometry(bool useOdometry_) {_useOdometry = useOdometry_;}
 	 				
     //! processes a new incoming data
     //! if the data is not a node, it is just propagated as output
@@ -56,11 +73,17 @@ namespace boss_map_building {
 
     virtual bool shouldChangeKeyNode(MapNodeBinaryRelation* rel);
 
+    //! restarts the tracking from the current node, when it cannot be registered to the key node;
+    //! override to drop the state built on the previous key nodes
+    virtual void reset();
+
     //! alignment function you have to implement
-    //! @ paeam
+    //! @param guess: the initial guess of the transform from keyNode to otherNode
+    //! @param prior: the uncertainty of the guess if it is a prediction of the motion, 0 otherwise
     virtual MapNodeBinaryRelation* registerNodes(MapNode* keyNode, 
 						 MapNode* otherNode, 
-						 const Eigen::Isometry3d& guess = Eigen::Isometry3d::Identity());
+						 const Eigen::Isometry3d& guess = Eigen::Isometry3d::Identity(),
+						 const MotionPrior* prior = 0);
 
     virtual void serialize(ObjectData& data, IdContext& context);
     virtual void deserialize(ObjectData& data, IdContext& context);
@@ -68,6 +91,8 @@ namespace boss_map_building {
     virtual ~BaseTracker();
   protected:
     void doStuff();
+    //! resets the guess to the key node
+    void resetLocalT(const Eigen::Isometry3d& localT=Eigen::Isometry3d::Identity());
     //! the manager
     MapManager* _manager; 
     //! previousNode: the last node processed
@@ -76,6 +101,16 @@ namespace boss_map_building {
     MapNode* _pendingNode, *_keyNode, *_currentNode ;
     //! global position of the tracker
     Eigen::Isometry3d _localT;
+    //! predicts the motion between the nodes
+    MotionPredictor _predictor;
+    bool _useOdometry;
+    //! time of the last node whose guess was computed, negative if unknown
+    double _previousNodeTime;
+    //! sum of the variances of the motions accumulated in _localT
+    Vector6d _motionPriorVariance;
+    bool _hasMotionPrior;
+    //! true if the rotation of a motion accumulated in _localT was integrated from the IMU
+    bool _motionPriorIMU;
     //! queue where to put the output before closing a frame
     std::list<Serializable*> _outputQueue;
   };
@@ -1,5 +1,6 @@
 #include "map_closer.h"
 #include "base_tracker.h"
+#include "g2o/stuff/timeutil.h"
 
 
 namespace boss_map_building {
@@ -10,6 +11,8 @@ namespace boss_map_building {
     consensusCumInlier = 0;
     consensusCumOutlierTimes = 0;
     consensusTimeChecked = 0;
+    closureSerial = 0;
+    consensusLastSerial = 0;
   }
   ClosureInfo::~ClosureInfo(){}
 
@@ -35,7 +38,7 @@ namespace boss_map_building {
     data.setInt("currentPartitionIndex", currentPartitionIndex);
     for (size_t i = 0; i < partitions.size(); i++){
       ArrayData* pdata = new ArrayData;
-      for (std::set<MapNode*>::iterator it = partitions[i].begin(); it!=partitions[i].end(); it++)
+      for (MapNode* const* it = partitions.partitionBegin(i); it!=partitions.partitionEnd(i); it++)
 	pdata->add(new PointerData(*it));
       adata->add(pdata);
     }
@@ -46,12 +49,13 @@ namespace boss_map_building {
     partitions.clear();
     currentPartitionIndex = data.getInt("currentPartitionIndex");
     ArrayData& adata = data.getField("partitions")->getArray();
+    std::vector<MapNode*> pnodes;
     for (size_t i=0; i<adata.size(); i++){
-      std::set<MapNode*> pnodes;
+      pnodes.clear();
       ArrayData& pdata = adata[i].getArray();
       for (size_t k=0; k<pdata.size(); k++)
-	pnodes.insert(dynamic_cast<MapNode*>(pdata[k].getPointer()));
-      partitions.push_back(pnodes);
+	pnodes.push_back(dynamic_cast<MapNode*>(pdata[k].getPointer()));
+      partitions.addPartition(pnodes.empty() ? 0 : &pnodes[0], pnodes.empty() ? 0 : &pnodes[0]+pnodes.size());
     }
   }
 
@@ -64,11 +68,21 @@ namespace boss_map_building {
     _consensusInlierRotationalThreshold = 15.0f*M_PI/180.0f;
     _consensusMinTimesCheckedThreshold = 5;
     _debug = false;
-    _currentPartition = 0;
+    _currentPartitionIndex = -1;
     _pendingTrackerFrame = 0;
     _lastTrackerFrame = 0;
     _criterion = 0;
     _selector = 0;
+    _placeIndex = 0;
+    _pager = 0;
+    _maxCandidatesPerPartition = 0;
+    _closureTimeBudget = 0;
+    _maxClosureBacklog = 0;
+    _pendingValidationsPerRound = 0;
+    _closureSerial = 0;
+    _droppedCandidates = 0;
+    _scheduledCandidates = 0;
+    _processedCandidates = 0;
     autoProcess = true;
   }
 
@@ -81,6 +95,12 @@ namespace boss_map_building {
     data.setFloat("consensusInlierTranslationalThreshold", _consensusInlierTranslationalThreshold);
     data.setFloat("consensusInlierRotationalThreshold", _consensusInlierRotationalThreshold);
     data.setInt("consensusMinTimesCheckedThreshold", _consensusMinTimesCheckedThreshold);
+    data.setPointer("placeIndex", _placeIndex);
+    data.setInt("maxCandidatesPerPartition", _maxCandidatesPerPartition);
+    data.setFloat("closureTimeBudget", _closureTimeBudget);
+    data.setInt("maxClosureBacklog", _maxClosureBacklog);
+    data.setInt("pendingValidationsPerRound", _pendingValidationsPerRound);
+    data.setPointer("pager", _pager);
   }
 
   void MapCloser::deserialize(boss::ObjectData& data, boss::IdContext& context){
@@ -91,6 +111,18 @@ namespace boss_map_building {
     _consensusInlierTranslationalThreshold = data.getFloat("consensusInlierTranslationalThreshold");
     _consensusInlierRotationalThreshold = data.getFloat("consensusInlierRotationalThreshold");
     _consensusMinTimesCheckedThreshold = data.getInt("consensusMinTimesCheckedThreshold");
+    // optional, older configurations do not have a place index
+    _placeIndex = 0;
+    ValueData* placeIndexField = data.getField("placeIndex");
+    if (placeIndexField)
+      placeIndexField->getReference().bind(_placeIndex);
+    data >> field("maxCandidatesPerPartition", _maxCandidatesPerPartition);
+    data >> field("closureTimeBudget", _closureTimeBudget);
+    data >> field("maxClosureBacklog", _maxClosureBacklog);
+    data >> field("pendingValidationsPerRound", _pendingValidationsPerRound);
+    _pager = 0;
+    if (data.getField("pager"))
+      data.getReference("pager").bind(_pager);
   }
   
 
@@ -106,6 +138,30 @@ namespace boss_map_building {
     _keyNodes.insert(make_pair(f->seq(),f));
     _lastTrackerFrame = _pendingTrackerFrame;
     _pendingTrackerFrame = f;
+    indexKeyNode(f);
+  }
+
+  void MapCloser::indexKeyNode(MapNode*) {}
+
+  std::set<MapNode*>* MapCloser::selectCandidates(std::set<MapNode*>& pruned, 
+						  std::set<MapNode*>& partition, 
+						  MapNode* current){
+    if (! _placeIndex || _maxCandidatesPerPartition<=0 || 
+	(int)partition.size()<=_maxCandidatesPerPartition)
+      return &partition;
+    Eigen::VectorXf d;
+    if (! _placeIndex->descriptor(d, current))
+      return &partition;
+    PlaceDescriptorIndex::ScoredNodeVector ranked;
+    _placeIndex->query(ranked, d, partition, _maxCandidatesPerPartition);
+    for (size_t i=0; i<ranked.size(); i++)
+      pruned.insert(ranked[i].second);
+    // nodes without a descriptor cannot be ranked, keep them
+    for (std::set<MapNode*>::iterator it=partition.begin(); it!=partition.end(); it++){
+      if (! _placeIndex->contains(*it))
+	pruned.insert(*it);
+    }
+    return &pruned;
   }
   
   void MapCloser::addRelation(MapNodeRelation* r_){
@@ -144,6 +200,10 @@ namespace boss_map_building {
     std::set<MapNode*> selectedNodes;
     _criterion->setReferencePose(_pendingTrackerFrame->transform());
     selectNodes(selectedNodes,_criterion);
+    // the neighborhood is the active region, the payloads needed for the
+    // candidates are loaded again on demand
+    if (_pager)
+      _pager->pageOutExcept(selectedNodes);
     _partitions.clear();
     makePartitions(_partitions, selectedNodes, _selector);
     cerr << "node: " << _pendingTrackerFrame->seq() 
@@ -156,99 +216,245 @@ namespace boss_map_building {
       throw std::runtime_error("current frame is not accepted");
       
     }
-    _currentPartition = 0;
-    int cpi = -1;
-    for (size_t i=0; i<_partitions.size(); i++){
-      if (_partitions[i].count(_pendingTrackerFrame)){
-	_currentPartition=&(_partitions[i]); 
-	cpi = i;
-	break;
-      }
-    }
-    
-    if (! _currentPartition) {
+    _currentPartitionIndex = _partitions.partitionOf(_pendingTrackerFrame);
+    if (_currentPartitionIndex<0) {
       throw std::runtime_error("no current partition");
     }
     
     ClosureScannedMessage* msg = new ClosureScannedMessage;
     msg->partitions = _partitions;
-    msg->currentPartitionIndex = cpi;
+    msg->currentPartitionIndex = _currentPartitionIndex;
     _outputQueue.push_back(msg);
 
     for (size_t i=0; i<_partitions.size(); i++){
-      std::set<MapNode*>* otherPartition = &(_partitions[i]);
-      if (_currentPartition == otherPartition)
+      if ((int)i == _currentPartitionIndex)
 	continue;
-      cerr << "  " << i << "(" << otherPartition->size() << "): ";
+      cerr << "  " << i << "(" << _partitions.partitionSize(i) << "): ";
       std::list<MapNodeBinaryRelation*> newRelations;
-      processPartition(newRelations, *otherPartition, _pendingTrackerFrame);
-      // add all new relations to the pool
-      for(std::list<MapNodeBinaryRelation*>::iterator it = newRelations.begin(); 
-	  it!=newRelations.end(); it++){
-	_candidateRelations.push_back(*it);
-	_results.push_back(*it);
-	_manager->addRelation(*it);
-	_relations.insert(*it);
+      std::set<MapNode*> otherPartition(_partitions.partitionBegin(i), _partitions.partitionEnd(i));
+      std::set<MapNode*> prunedPartition;
+      std::set<MapNode*>* candidates = selectCandidates(prunedPartition, otherPartition, _pendingTrackerFrame);
+      if (_closureTimeBudget>0) {
+	scheduleCandidates(*candidates, _pendingTrackerFrame);
+	if (_debug)
+	  cerr << "scheduled " << candidates->size() << endl;
+	continue;
       }
-      validatePartitions(*otherPartition, *_currentPartition);
+      processPartition(newRelations, *candidates, _pendingTrackerFrame);
+      addCandidateRelations(newRelations);
+      validatePartitions(i, _currentPartitionIndex);
+    }
+
+    if (_closureTimeBudget>0) {
+      processScheduledCandidates();
+      // the relations found for earlier key nodes are validated when their
+      // partitions are in the neighborhood of the current one
+      for (size_t i=0; i<_partitions.size(); i++){
+	if ((int)i != _currentPartitionIndex)
+	  validatePartitions(i, _currentPartitionIndex);
+      }
+      validatePendingRelations();
+    }
+  }
+
+  void MapCloser::addCandidateRelations(std::list<MapNodeBinaryRelation*>& newRelations){
+    // add all new relations to the pool
+    for(std::list<MapNodeBinaryRelation*>::iterator it = newRelations.begin(); 
+	it!=newRelations.end(); it++){
+      _candidateRelations.push_back(*it);
+      _results.push_back(*it);
+      _manager->addRelation(*it);
+      _relations.insert(*it);
+      if (_closureTimeBudget>0 && _pendingValidationsPerRound>0)
+	_pendingRelations.push_back(*it);
+      ClosureInfo* c = dynamic_cast<ClosureInfo*>(*it);
+      if (c)
+	c->closureSerial = ++_closureSerial;
     }
   }
+
+  void MapCloser::validatePendingRelations(){
+    int budget = _pendingValidationsPerRound;
+    size_t n = _pendingRelations.size();
+    MapNodePartitions currentPartitions = _partitions;
+    for (size_t k=0; k<n && budget>0; k++){
+      MapNodeBinaryRelation* r = _pendingRelations.front();
+      _pendingRelations.pop_front();
+      ClosureInfo* c = dynamic_cast<ClosureInfo*>(r);
+      if (! c || c->accepted || ! _manager->contains(r))
+	continue;
+      // the ones touching the current partition have just been validated
+      if (_currentPartitionIndex>=0 && 
+	  (currentPartitions.contains(_currentPartitionIndex, r->nodes()[0]) ||
+	   currentPartitions.contains(_currentPartitionIndex, r->nodes()[1]))) {
+	_pendingRelations.push_back(r);
+	continue;
+      }
+      budget--;
+      std::set<MapNode*> selectedNodes;
+      _criterion->setReferencePose(r->nodes()[0]->transform());
+      selectNodes(selectedNodes, _criterion);
+      makePartitions(_partitions, selectedNodes, _selector);
+      int first = _partitions.partitionOf(r->nodes()[0]);
+      int second = _partitions.partitionOf(r->nodes()[1]);
+      if (first>=0 && second>=0 && first!=second) {
+	std::vector<MapNodeBinaryRelation*> rels;
+	collectClosureRelations(rels, second, first);
+	int newest = 0;
+	for (size_t i=0; i<rels.size(); i++){
+	  ClosureInfo* ci = dynamic_cast<ClosureInfo*>(rels[i]);
+	  if (ci && ci->closureSerial>newest)
+	    newest = ci->closureSerial;
+	}
+	// nothing new around it since its last check
+	if (newest>c->consensusLastSerial)
+	  validateRelations(rels, second, first);
+      }
+      if (! c->accepted && _manager->contains(r))
+	_pendingRelations.push_back(r);
+    }
+    _partitions = currentPartitions;
+  }
+
+  float MapCloser::closurePriority(MapNode* keyNode, MapNode* candidate, bool& appearance){
+    appearance = false;
+    if (_placeIndex) {
+      Eigen::VectorXf d1, d2;
+      if (_placeIndex->descriptor(d1, keyNode) && _placeIndex->descriptor(d2, candidate)) {
+	appearance = true;
+	return d1.dot(d2);
+      }
+    }
+    double distance = (keyNode->transform().translation()-candidate->transform().translation()).norm();
+    return -distance;
+  }
+
+  void MapCloser::scheduleCandidates(std::set<MapNode*>& candidates, MapNode* keyNode){
+    for (std::set<MapNode*>::iterator it=candidates.begin(); it!=candidates.end(); it++){
+      if (*it == keyNode)
+	continue;
+      ClosureTask task;
+      task.keyNode = keyNode;
+      task.candidate = *it;
+      bool appearance;
+      task.priority = closurePriority(keyNode, *it, appearance);
+      task.order = _scheduledCandidates++;
+      if (appearance)
+	_appearanceQueue.insert(task);
+      else
+	_proximityQueue.insert(task);
+    }
+    ClosureTaskQueue* queues[] = {&_appearanceQueue, &_proximityQueue};
+    for (int q=0; q<2; q++){
+      while (_maxClosureBacklog>0 && (int)queues[q]->size()>_maxClosureBacklog){
+	ClosureTaskQueue::iterator last = queues[q]->end();
+	last--;
+	queues[q]->erase(last);
+	_droppedCandidates++;
+      }
+    }
+  }
+
+  void MapCloser::processScheduledCandidates(){
+    double tStart = g2o::get_time();
+    int processed = 0;
+    // at least one candidate is processed per key node, so that the backlog always drains;
+    // the two queues are served in turn, a single one when the other is empty
+    while (closureBacklog() && 
+	   (! processed || (g2o::get_time()-tStart)*1e3 < _closureTimeBudget)) {
+      ClosureTaskQueue* queue = (processed%2 && ! _proximityQueue.empty()) || _appearanceQueue.empty() ?
+	&_proximityQueue : &_appearanceQueue;
+      ClosureTask task = *queue->begin();
+      queue->erase(queue->begin());
+      std::set<MapNode*> candidate;
+      candidate.insert(task.candidate);
+      std::list<MapNodeBinaryRelation*> newRelations;
+      processPartition(newRelations, candidate, task.keyNode);
+      addCandidateRelations(newRelations);
+      processed++;
+      _processedCandidates++;
+    }
+    if (_debug)
+      cerr << "  closures: processed " << processed 
+	   << " backlog " << closureBacklog() 
+	   << " dropped " << _droppedCandidates 
+	   << " time " << (g2o::get_time()-tStart)*1e3 << " ms" << endl;
+  }
   
 
   
 
-  void validateRelation(float* translationalErrors,
-			float* rotationalErrors ,
-			std::vector<MapNodeBinaryRelation*>& relations, 
-			MapNodeBinaryRelation* r, 
-			std::set<MapNode*>& current){
-    Eigen::Isometry3d tc, to, tr;
-    if (current.count(r->nodes()[0])) {
-      tc=r->nodes()[0]->transform();
-      to=r->nodes()[1]->transform();
-      tr=r->transform(); 
-    }
-    else if (current.count(r->nodes()[1])) {
-      to=r->nodes()[0]->transform();
-      tc=r->nodes()[1]->transform();
-      tr=r->transform().inverse();
-    } else {
+  // Consensus errors of the closure relations between the current partition and another one.
+  // Relation i proposes the fix F_i = T_o*T_r*T_c^-1 of the current partition, with T_c its node in
+  // current and T_o the other one; (j,i) holds the squared translation and the angle of the error
+  // T_e = (T_o*T_r)^-1*F_i*T_c of relation j under that fix.
+  // With T_p = T_o*T_r, the translation error is |F_i*t_c - t_p| and the cosine of the angle is
+  // (trace(R_F*R_c*R_p^T)-1)/2, so the terms of each relation are computed once and stored one
+  // array per component, and each column is a single pass over them.
+  static void computeConsensusErrors(Eigen::MatrixXf& translationalErrors,
+				     Eigen::MatrixXf& rotationalErrors,
+				     const std::vector<MapNodeBinaryRelation*>& relations,
+				     const MapNodePartitions& partitions,
+				     int current){
+    int n = relations.size();
+    // one column per relation: the rotation of its fix by rows, then the translation
+    Eigen::Matrix<double, 12, Eigen::Dynamic> fixes(12, n);
+    // one column per component: R_p*R_c^T by rows, t_c and t_p
+    Eigen::Matrix<double, Eigen::Dynamic, 9> rotations(n, 9);
+    Eigen::Matrix<double, Eigen::Dynamic, 3> currentTranslations(n, 3);
+    Eigen::Matrix<double, Eigen::Dynamic, 3> predictedTranslations(n, 3);
+    for (int k=0; k<n; k++){
+      MapNodeBinaryRelation* r = relations[k];
+      Eigen::Isometry3d tc, tp;
+      if (partitions.contains(current, r->nodes()[0])) {
+	tc=r->nodes()[0]->transform();
+	tp=r->nodes()[1]->transform()*r->transform();
+      } else if (partitions.contains(current, r->nodes()[1])) {
+	tc=r->nodes()[1]->transform();
+	tp=r->nodes()[0]->transform()*r->transform().inverse();
+      } else {
 	throw std::runtime_error("node in current partition missing");
+      }
+      Eigen::Isometry3d tfix = tp*tc.inverse();
+      Eigen::Matrix3d rpc = tp.linear()*tc.linear().transpose();
+      for (int a=0; a<3; a++){
+	for (int b=0; b<3; b++){
+	  fixes(3*a+b, k) = tfix.linear()(a,b);
+	  rotations(k, 3*a+b) = rpc(a,b);
+	}
+	fixes(9+a, k) = tfix.translation()(a);
+	currentTranslations(k, a) = tc.translation()(a);
+	predictedTranslations(k, a) = tp.translation()(a);
+      }
     }
- 
-
-    Eigen::Isometry3d tcInv = tc.inverse();
-    Eigen::Isometry3d tfix = to*tr*tcInv;
-    for (size_t i = 0; i<relations.size(); i++){
-      MapNodeBinaryRelation* r=relations[i];
-      MapNode* f0 = r->nodes()[0];
-      MapNode* f1 = r->nodes()[1];
-      Eigen::Isometry3d tc, to, tr;
-      if (current.count(f0)) {
-	tc=f0->transform();
-	to=f1->transform();
-	tr=r->transform(); 
-      } else if (current.count(f1)) {
-	tc=f1->transform();
-	to=f0->transform();
-	tr=r->transform().inverse();
-      } else{
- 	throw std::runtime_error("node in current partition missing");
+
+    translationalErrors.resize(n, n);
+    rotationalErrors.resize(n, n);
+    const double *cx = currentTranslations.col(0).data(), *cy = currentTranslations.col(1).data(),
+      *cz = currentTranslations.col(2).data();
+    const double *px = predictedTranslations.col(0).data(), *py = predictedTranslations.col(1).data(),
+      *pz = predictedTranslations.col(2).data();
+    const double* w[9];
+    for (int k=0; k<9; k++)
+      w[k] = rotations.col(k).data();
+#pragma omp parallel for
+    for (int i=0; i<n; i++){
+      const double* f = fixes.col(i).data();
+      float* te = translationalErrors.col(i).data();
+      float* re = rotationalErrors.col(i).data();
+      for (int j=0; j<n; j++){
+	double ex = f[0]*cx[j] + f[1]*cy[j] + f[2]*cz[j] + f[9] - px[j];
+	double ey = f[3]*cx[j] + f[4]*cy[j] + f[5]*cz[j] + f[10] - py[j];
+	double ez = f[6]*cx[j] + f[7]*cy[j] + f[8]*cz[j] + f[11] - pz[j];
+	double trace = 
+	  f[0]*w[0][j] + f[1]*w[1][j] + f[2]*w[2][j] +
+	  f[3]*w[3][j] + f[4]*w[4][j] + f[5]*w[5][j] +
+	  f[6]*w[6][j] + f[7]*w[7][j] + f[8]*w[8][j];
+	double cosine = 0.5*(trace-1);
+	cosine = cosine > 1 ? 1 : (cosine < -1 ? -1 : cosine);
+	te[j] = ex*ex + ey*ey + ez*ez;
+	re[j] = acos(cosine);
       }
-      // compute the position of the node in current
-      Eigen::Isometry3d tcp=tfix*tc;
-      // compute the predicted position of the node
-      Eigen::Isometry3d trp=to.inverse()*tcp;
-      
-      // compute the error
-      Eigen::Isometry3d te=tr.inverse()*trp;
-      
-      // extract rotational and translational part
-      float transErr=te.translation().squaredNorm();
-      Eigen::AngleAxisd aa(te.linear());
-      float rotErr=aa.angle();
-      translationalErrors[i]=transErr;
-      rotationalErrors[i]=rotErr;
     }
   }
 
@@ -261,114 +467,113 @@ namespace boss_map_building {
   }
 
   void MapCloser::process(Serializable*s){
-    _committedRelations.clear();
-    _candidateRelations.clear();
-    _outputQueue.push_back(s);
-    NewKeyNodeMessage* km = dynamic_cast<NewKeyNodeMessage*>(s);
-    if (km){
-      addKeyNode(km->keyNode);
-    }
-    MapNodeRelation* rel = dynamic_cast<MapNodeRelation*>(s);
-    if (rel){
-      addRelation(rel);
-    }
-    if(km && _lastTrackerFrame)
-      process();
-    if (_committedRelations.size()){
-      ClosureFoundMessage* closureFound = new ClosureFoundMessage;
-      closureFound->closureRelations = _committedRelations;
-      _outputQueue.push_back(closureFound);
+    {
+      // the tracker may run in another thread: the map is locked, but for the registrations
+      // of the candidates, and the outputs are put without the lock
+      MapManager::ScopedLock lock(_manager);
+      _committedRelations.clear();
+      _candidateRelations.clear();
+      _outputQueue.push_back(s);
+      NewKeyNodeMessage* km = dynamic_cast<NewKeyNodeMessage*>(s);
+      if (km){
+	addKeyNode(km->keyNode);
+      }
+      MapNodeRelation* rel = dynamic_cast<MapNodeRelation*>(s);
+      if (rel){
+	addRelation(rel);
+      }
+      if(km && _lastTrackerFrame)
+	process();
+      if (_committedRelations.size()){
+	ClosureFoundMessage* closureFound = new ClosureFoundMessage;
+	closureFound->closureRelations = _committedRelations;
+	_outputQueue.push_back(closureFound);
+      }
     }
-      
     flush();
   }
 
-  void MapCloser::validatePartitions(std::set<MapNode*>& other, 
-				     std::set<MapNode*>& current) {
+  void MapCloser::collectClosureRelations(std::vector<MapNodeBinaryRelation*>& rels, int other, int current) {
     // scan for the pwn closure relations connecting a node in current and a node in others
-    std::vector<MapNodeBinaryRelation*> rels;
-    for (std::set<MapNode*>::iterator it=other.begin(); it!=other.end(); it++){
+    rels.clear();
+    for (MapNode* const* it=_partitions.partitionBegin(other); it!=_partitions.partitionEnd(other); it++){
       MapNode* n=*it;
       if (!n)
 	continue;
-      std::set<MapNodeRelation*>& nrel=_manager->nodeRelations(n);
-      for (std::set<MapNodeRelation*>::iterator rit= nrel.begin(); rit!=nrel.end(); rit++){
+      MapNodeRelationView nrel=_manager->nodeRelations(n);
+      for (MapNodeRelationView::iterator rit= nrel.begin(); rit!=nrel.end(); rit++){
 	MapNodeBinaryRelation* r=dynamic_cast<MapNodeBinaryRelation*>(*rit);
 	if (! r)
 	  continue;
 	for (size_t i = 0; i<r->nodes().size(); i++){
-	  if (current.count(r->nodes()[i])){
+	  if (_partitions.contains(current, r->nodes()[i])){
 	    rels.push_back(r);
 	    break;
 	  }
 	}
       }
     }
+  }
+
+  void MapCloser::validatePartitions(int other, int current) {
+    std::vector<MapNodeBinaryRelation*> rels;
+    collectClosureRelations(rels, other, current);
+    validateRelations(rels, other, current);
+  }
+
+  void MapCloser::validateRelations(std::vector<MapNodeBinaryRelation*>& rels, int other, int current) {
     if (rels.size()){
       if (_debug) {
 	cerr << "   V( " << rels.size() << ")" << endl;
 	cerr << "      current: ";
-	for (std::set<MapNode*>::iterator it=current.begin(); it!=current.end(); it++){
+	for (MapNode* const* it=_partitions.partitionBegin(current); it!=_partitions.partitionEnd(current); it++){
 	  MapNode* n= *it;
 	  cerr << n->seq() << " ";
 	}
 	cerr<< endl;
 	cerr << "      other: ";
-	for (std::set<MapNode*>::iterator it=other.begin(); it!=other.end(); it++){
+	for (MapNode* const* it=_partitions.partitionBegin(other); it!=_partitions.partitionEnd(other); it++){
 	  MapNode* n= *it;
 	  cerr << n->seq() << " ";
 	}
 	cerr<< endl;
       }
-      Eigen::MatrixXf translationalErrors(rels.size(), rels.size());
-      Eigen::MatrixXf rotationalErrors(rels.size(), rels.size());
-
+      Eigen::MatrixXf translationalErrors, rotationalErrors;
+      computeConsensusErrors(translationalErrors, rotationalErrors, rels, _partitions, current);
+      std::vector<ClosureInfo*> infos(rels.size());
+      int newest = 0;
       for (size_t i=0; i<rels.size(); i++){
-      	validateRelation(translationalErrors.col(i).data(),
-		      rotationalErrors.col(i).data() ,
-		      rels, 
-		      rels[i], 
-		      current);
-	ClosureInfo* c = dynamic_cast<ClosureInfo*>(rels[i]);
-	c->consensusTimeChecked++;
+	infos[i] = dynamic_cast<ClosureInfo*>(rels[i]);
+	infos[i]->consensusTimeChecked++;
+	if (infos[i]->closureSerial>newest)
+	  newest = infos[i]->closureSerial;
       }
+      for (size_t i=0; i<rels.size(); i++)
+	infos[i]->consensusLastSerial = newest;
           
-      // now get the matrix of consensus.
-      // for each relation, count its consensus, add it to all inliers
-      std::vector<bool> relInliers(rels.size());
-      std::map<MapNodeBinaryRelation*, std::set<MapNodeBinaryRelation*> > relInliersMap;;
-      //for (size_t i=0; i<rels.size(); i++){
-      // 	rels[i]->outlierCount=0;
-      // 	rels[i]->inlierCount=0;
-      // }
+      // now get the matrix of consensus:
+      // (j,i) is set if relation j is an inlier of the fix of relation i
+      Eigen::Array<bool, Eigen::Dynamic, Eigen::Dynamic> inliers = 
+	(translationalErrors.array() < _consensusInlierTranslationalThreshold) &&
+	(rotationalErrors.array().abs() < _consensusInlierRotationalThreshold);
+      std::vector<int> inliersCount(rels.size());
       for (size_t i=0; i<rels.size(); i++){
-	//PwnCloserRelation* rOut=rels[i];
-	int inliersCount=0;
-	std::set<MapNodeBinaryRelation*> inlierRelations;
-	for (size_t j=0; j<rels.size(); j++){
-	  float te=translationalErrors(j,i);
-	  float re=fabs(rotationalErrors(j,i));
-	  bool isIn=(te<_consensusInlierTranslationalThreshold) && (re<_consensusInlierRotationalThreshold);
-	  relInliers[j]=isIn;
-	  inliersCount+=isIn;
-	  inlierRelations.insert(rels[j]);
-	}
-	relInliersMap.insert(make_pair(rels[i], inlierRelations));
-	if (! inliersCount ) {
+	inliersCount[i] = inliers.col(i).count();
+	if (! inliersCount[i] ) {
 	  cerr << "te: " << endl;
 	  cerr << translationalErrors << endl;
 	  cerr << "re: " << endl;
 	  cerr << rotationalErrors << endl;
 	  throw std::runtime_error("no inliers");
         }
-	for (size_t j=0; j<rels.size(); j++){
-	  if (relInliers[j]){
-	    ClosureInfo* c = dynamic_cast<ClosureInfo*>(rels[j]);
-	    c->consensusCumInlier+=inliersCount;
-	  } else {
-	    ClosureInfo* c = dynamic_cast<ClosureInfo*>(rels[j]);
-	    c->consensusCumOutlierTimes+=1;
-	  }
+      }
+      // each relation collects the inliers of the fixes it agrees with, and counts the others
+      for (size_t j=0; j<rels.size(); j++){
+	for (size_t i=0; i<rels.size(); i++){
+	  if (inliers(j,i))
+	    infos[j]->consensusCumInlier+=inliersCount[i];
+	  else
+	    infos[j]->consensusCumOutlierTimes+=1;
 	}
       }
 
@@ -394,18 +599,6 @@ namespace boss_map_building {
 	  if (_debug) 
 	    cerr << "accept" << endl;
 	  _committedRelations.push_back(r);
-	  /*
-	    std::set<MapNodeBinaryRelation*>& inlierRels = relInliersMap[r];
-	    for (std::set<MapNodeBinaryRelation*>::iterator it = inlierRels.begin(); it!=inlierRels.end(); it++) {
-	    MapNodeBinaryRelation* otherRel = *it;
-	    ClosureInfo* cOther = dynamic_cast<ClosureInfo*>(otherRel);
-	    if (! cOther->accepted){
-	      cOther->accepted = true;
-	      _committedRelations.push_back(otherRel);
-	      _outputQueue.push_back(otherRel);
-	    }
-	  }
-	  */
 	} else {
 	  _manager->removeRelation(r);
 	  _relations.erase(r);
@@ -450,6 +643,12 @@ namespace boss_map_building {
     return true;
   }
 
+  bool KeyNodeAcceptanceCriterion::queryCandidates(std::vector<MapNode*>& candidates, const MapNodeIndex& index){
+    if (_otherCriterion)
+      return _otherCriterion->queryCandidates(candidates, index);
+    return false;
+  }
+
 
   MapCloserActiveRelationSelector::MapCloserActiveRelationSelector(
 								   MapCloser* closer_, 
@@ -2,7 +2,9 @@
 
 #include "g2o_frontend/boss_map_building/map_g2o_reflector.h"
 #include "g2o_frontend/boss_map/map_utils.h"
+#include "g2o_frontend/boss_map/map_node_pager.h"
 #include "g2o_frontend/boss_map/stream_processor.h"
+#include "place_descriptor_index.h"
 
 namespace boss_map_building {
   using namespace boss;
@@ -16,8 +18,31 @@ namespace boss_map_building {
     int consensusCumInlier;
     int consensusCumOutlierTimes;
     int consensusTimeChecked;
+    //! order in which the closer added the relation, 0 if not added by a closer
+    int closureSerial;
+    //! the newest closureSerial among the relations of its last validation
+    int consensusLastSerial;
   };
   
+  //! a pending registration between a key node and a closure candidate
+  struct ClosureTask {
+    MapNode* keyNode;
+    MapNode* candidate;
+    float priority;
+    int order;
+  };
+
+  //! highest priority first, on ties the most recently scheduled
+  struct ClosureTaskComparator {
+    inline bool operator()(const ClosureTask& a, const ClosureTask& b) const {
+      if (a.priority != b.priority)
+	return a.priority > b.priority;
+      return a.order > b.order;
+    }
+  };
+
+  typedef std::multiset<ClosureTask, ClosureTaskComparator> ClosureTaskQueue;
+
   class ClosureFoundMessage: public Serializable {
   public:
     virtual void serialize(ObjectData& data, IdContext& context);
@@ -29,7 +54,7 @@ namespace boss_map_building {
   public:
     virtual void serialize(ObjectData& data, IdContext& context);
     virtual void deserialize(ObjectData& data, IdContext& context);
-    std::vector<std::set<MapNode*> > partitions;
+    MapNodePartitions partitions;
     int currentPartitionIndex;
   };
 
@@ -53,6 +78,44 @@ namespace boss_map_building {
 	_criterion->setManager(_manager);
     }
 
+    //! descriptor index used to rank the nodes of a partition before registering them
+    inline PlaceDescriptorIndex* placeIndex() {return _placeIndex;}
+    inline void setPlaceIndex(PlaceDescriptorIndex* placeIndex_) {_placeIndex = placeIndex_;}
+
+    //! max number of nodes of each partition that are registered against the current one.
+    //! 0 means all, otherwise the top ranked by the place index are used.
+    inline int maxCandidatesPerPartition() const {return _maxCandidatesPerPartition;}
+    inline void setMaxCandidatesPerPartition(int k) {_maxCandidatesPerPartition = k;}
+
+    //! milliseconds per key node spent in registering closure candidates.
+    //! If 0 all candidates are registered synchronously, otherwise the candidates are
+    //! queued by priority and the ones not processed within the budget are carried forward.
+    //! The candidates ranked by appearance and the ones ranked by distance are in two
+    //! queues, since their priorities are not comparable, served in turn.
+    inline float closureTimeBudget() const {return _closureTimeBudget;}
+    inline void setClosureTimeBudget(float ms) {_closureTimeBudget = ms;}
+
+    //! max number of candidates in each queue, the lowest priority ones beyond it are dropped (0 = unbounded)
+    inline int maxClosureBacklog() const {return _maxClosureBacklog;}
+    inline void setMaxClosureBacklog(int n) {_maxClosureBacklog = n;}
+
+    //! pending closure relations validated again in each round in their own neighborhood,
+    //! besides the ones near the current key node, so that their consensus does not stall
+    //! when the robot does not come back to them; used only with a closureTimeBudget.
+    //! A relation is validated again only if closures were added to its neighborhood since
+    //! its last check, a check on the same relations is not a new consensus
+    inline int pendingValidationsPerRound() const {return _pendingValidationsPerRound;}
+    inline void setPendingValidationsPerRound(int n) {_pendingValidationsPerRound = n;}
+
+    inline size_t closureBacklog() const {return _appearanceQueue.size()+_proximityQueue.size();}
+    inline int droppedCandidates() const {return _droppedCandidates;}
+    inline int scheduledCandidates() const {return _scheduledCandidates;}
+    inline int processedCandidates() const {return _processedCandidates;}
+
+    //! if set, the payloads of the nodes out of the neighborhood of each new key node are released
+    inline boss_map::MapNodePager* pager() {return _pager;}
+    inline void setPager(boss_map::MapNodePager* pager_) {_pager = pager_;}
+
     inline boss_map::MapRelationSelector* selector() {return _selector;}
     inline void setSelector(boss_map::MapRelationSelector* selector_) { 
       _selector= selector_;
@@ -67,8 +130,9 @@ namespace boss_map_building {
     std::map<int, MapNode*>& keyNodes() {return _keyNodes;}
     std::list<MapNodeBinaryRelation*>& committedRelations() {return _committedRelations;}
     std::list<MapNodeBinaryRelation*>& candidateRelations() {return _candidateRelations;}
-    std::vector<std::set<MapNode*> >& partitions() {return _partitions;}
-    std::set<MapNode*>* currentPartition() {return _currentPartition;}
+    MapNodePartitions& partitions() {return _partitions;}
+    //! index in partitions() of the one containing the current key node, -1 if none
+    int currentPartitionIndex() const {return _currentPartitionIndex;}
     virtual void process(Serializable* s);
     virtual void flush();
     virtual void setManager(MapManager* manager);
@@ -79,15 +143,47 @@ namespace boss_map_building {
     bool autoProcess;
     bool _debug;
   protected:
-    void validatePartitions(std::set<MapNode*>& other, 
-			    std::set<MapNode*>& current);
-    std::vector<std::set<MapNode*> > _partitions;
-    std::set<MapNode*>* _currentPartition;
+    //! called when a new key node arrives, override to add its descriptor to the place index
+    virtual void indexKeyNode(MapNode* keyNode);
+    //! returns the nodes of the partition that should be registered against current
+    //! (either the partition itself or the pruned set filled by the function)
+    std::set<MapNode*>* selectCandidates(std::set<MapNode*>& pruned, 
+					 std::set<MapNode*>& partition, 
+					 MapNode* current);
+    //! priority of registering candidate against keyNode, comparable only within its queue:
+    //! descriptor similarity if both are in the place index (and appearance is set),
+    //! otherwise decreasing with the distance
+    virtual float closurePriority(MapNode* keyNode, MapNode* candidate, bool& appearance);
+    void scheduleCandidates(std::set<MapNode*>& candidates, MapNode* keyNode);
+    void processScheduledCandidates();
+    void validatePendingRelations();
+    void addCandidateRelations(std::list<MapNodeBinaryRelation*>& newRelations);
+    //! the binary relations between a node of the other partition and one of the current
+    void collectClosureRelations(std::vector<MapNodeBinaryRelation*>& rels, int other, int current);
+    void validatePartitions(int other, int current);
+    //! updates the consensus of the relations collected between the two partitions
+    void validateRelations(std::vector<MapNodeBinaryRelation*>& rels, int other, int current);
+    MapNodePartitions _partitions;
+    int _currentPartitionIndex;
 
     MapNode* _pendingTrackerFrame, *_lastTrackerFrame;
     boss_map::MapManager* _manager;
     PoseAcceptanceCriterion* _criterion;
     MapRelationSelector* _selector;
+    PlaceDescriptorIndex* _placeIndex;
+    boss_map::MapNodePager* _pager;
+    int _maxCandidatesPerPartition;
+    float _closureTimeBudget;
+    int _maxClosureBacklog;
+    ClosureTaskQueue _appearanceQueue;
+    ClosureTaskQueue _proximityQueue;
+    int _pendingValidationsPerRound;
+    int _closureSerial;
+    //! closure relations not yet accepted or rejected, oldest validated first
+    std::list<MapNodeBinaryRelation*> _pendingRelations;
+    int _droppedCandidates;
+    int _scheduledCandidates;
+    int _processedCandidates;
     std::list<MapNodeBinaryRelation*> _results;
     std::list<MapNodeBinaryRelation*> _committedRelations;
     std::list<MapNodeBinaryRelation*> _candidateRelations;
@@ -106,6 +202,7 @@ namespace boss_map_building {
 			       int id = -1, boss::IdContext* context = 0);
     void setReferencePose(const Eigen::Isometry3d& pose_);
     virtual bool accept(MapNode* n);
+    virtual bool queryCandidates(std::vector<MapNode*>& candidates, const MapNodeIndex& index);
 
     MapCloser* closer() {return _closer;}
     void setCloser(MapCloser* closer_) {_closer = closer_;}
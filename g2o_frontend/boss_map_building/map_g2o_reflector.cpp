@@ -29,6 +29,9 @@ namespace boss_map_building {
     } else 
       _graph = graph_;
     _lastUsedId = 0;
+    _selector = 0;
+    _incremental = false;
+    _incrementalDepth = 3;
     init();
   }
 
@@ -37,21 +40,26 @@ namespace boss_map_building {
   void MapG2OReflector::serialize(ObjectData& data, IdContext& context){
     MapManagerActionHandler::serialize(data,context);
     data.setPointer("selector",_selector);
+    data.setBool("incremental", _incremental);
+    data.setInt("incrementalDepth", _incrementalDepth);
   }
 
   void MapG2OReflector::deserialize(ObjectData& data, IdContext& context){
     MapManagerActionHandler::deserialize(data,context);
     data.getReference("selector").bind(_selector);
+    data >> field("incremental", _incremental);
+    data >> field("incrementalDepth", _incrementalDepth);
   }
   
   void MapG2OReflector::init() {
     _graph->clear();
+    _touchedNodes.clear();
     if (!_manager)
       return;
-    for (std::set<MapNode*>::iterator it=_manager->nodes().begin(); it!=_manager->nodes().end(); it++){
+    for (MapNodeView::iterator it=_manager->nodes().begin(); it!=_manager->nodes().end(); it++){
       nodeAdded(*it);
     }
-    for (std::set<MapNodeRelation*>::iterator it=_manager->relations().begin(); it!=_manager->relations().end(); it++){
+    for (MapNodeRelationView::iterator it=_manager->relations().begin(); it!=_manager->relations().end(); it++){
       relationAdded(*it);
     }
   }
@@ -70,10 +78,34 @@ namespace boss_map_building {
 	 it!=_nm2g.end(); it++){
       MapNode* n = it->first;
       g2o::VertexSE3* v = it->second;
-      n->setTransform(v->estimate());
+      // the nodes not moved by the optimization are not notified
+      if (v->estimate().matrix()!=n->transform().matrix())
+	n->setTransform(v->estimate());
     }
   }
 
+  void MapG2OReflector::copyEstimatesToG2O(const std::vector<MapNode*>& nodes) {
+    for (size_t i=0; i<nodes.size(); i++){
+      g2o::VertexSE3* v = node(nodes[i]);
+      if (v)
+	v->setEstimate(nodes[i]->transform());
+    }
+  }
+
+  void MapG2OReflector::copyEstimatesFromG2O(const std::vector<MapNode*>& nodes) {
+    for (size_t i=0; i<nodes.size(); i++){
+      g2o::VertexSE3* v = node(nodes[i]);
+      if (v && v->estimate().matrix()!=nodes[i]->transform().matrix())
+	nodes[i]->setTransform(v->estimate());
+    }
+  }
+
+  void MapG2OReflector::touch(MapNodeRelation* r) {
+    for (size_t i=0; i<r->nodes().size(); i++)
+      if (r->nodes()[i])
+	_touchedNodes.insert(r->nodes()[i]);
+  }
+
   void MapG2OReflector::nodeAdded(MapNode* n) {
     g2o::VertexSE3 * gn = new g2o::VertexSE3;
     gn->setId(_lastUsedId++);
@@ -86,6 +118,7 @@ namespace boss_map_building {
     g2o::VertexSE3 * gn=_nm2g[n];
     _nm2g.erase(n);
     _ng2m.erase(gn);
+    _touchedNodes.erase(n);
     _graph->removeVertex(gn);
   }
 
@@ -103,6 +136,7 @@ namespace boss_map_building {
 	_rm2g.insert(make_pair(r,gr));
 	_rg2m.insert(make_pair(gr,r));
 	_graph->addEdge(gr);
+	touch(r);
 	return;
       }
     }
@@ -118,6 +152,7 @@ namespace boss_map_building {
 	_rm2g.insert(make_pair(r,gr));
 	_rg2m.insert(make_pair(gr,r));
 	_graph->addEdge(gr);
+	touch(r);
 	return;
       }
     }
@@ -131,6 +166,7 @@ namespace boss_map_building {
     _rm2g.erase(r);
     _rg2m.erase(gr);
     _graph->removeEdge(gr);
+    touch(r);
   }
 
   MapNode* MapG2OReflector::node(g2o::VertexSE3* n){
@@ -163,12 +199,20 @@ namespace boss_map_building {
 
 
   void MapG2OReflector::optimize(){
+    if (_incremental)
+      optimizeIncremental();
+    else
+      optimizeGlobal();
+  }
+
+  void MapG2OReflector::optimizeGlobal(){
+    _touchedNodes.clear();
     copyEstimatesToG2O();
     cerr << "optimizing" << endl;
     // scan for all edges that are of type PwnTrackerRelation that are not active and remove them from the optimization
     g2o::OptimizableGraph::EdgeSet eset;
     cerr << "total number of relations: " << _manager->relations().size() << endl;
-    for (std::set<MapNodeRelation*>::iterator it=_manager->relations().begin(); it!=_manager->relations().end(); it++){
+    for (MapNodeRelationView::iterator it=_manager->relations().begin(); it!=_manager->relations().end(); it++){
       g2o::OptimizableGraph::Edge* e=relation(*it);
       if (!e)
 	continue;
@@ -191,22 +235,169 @@ namespace boss_map_building {
     copyEstimatesFromG2O();
   }
 
+  void MapG2OReflector::optimizeIncremental(){
+    if (_touchedNodes.empty())
+      return;
+    // breadth first visit of the accepted relations from the touched nodes;
+    // the nodes at depth _incrementalDepth+1 are not expanded, and bound the region
+    std::map<MapNode*, int> depth;
+    std::vector<MapNode*> region;
+    for (std::set<MapNode*>::iterator it=_touchedNodes.begin(); it!=_touchedNodes.end(); it++){
+      if (node(*it) && depth.insert(make_pair(*it, 0)).second)
+	region.push_back(*it);
+    }
+    _touchedNodes.clear();
+    g2o::OptimizableGraph::EdgeSet eset;
+    for (size_t i=0; i<region.size(); i++){
+      MapNode* n = region[i];
+      int d = depth[n];
+      if (d>_incrementalDepth)
+	continue;
+      MapNodeRelationView relations = _manager->nodeRelations(n);
+      for (MapNodeRelationView::iterator it=relations.begin(); it!=relations.end(); it++){
+	MapNodeRelation* r = *it;
+	g2o::OptimizableGraph::Edge* e=relation(r);
+	if (!e || eset.count(e))
+	  continue;
+	if (_selector && ! _selector->accept(r))
+	  continue;
+	eset.insert(e);
+	for (size_t j=0; j<r->nodes().size(); j++){
+	  MapNode* m = r->nodes()[j];
+	  if (m && depth.insert(make_pair(m, d+1)).second)
+	    region.push_back(m);
+	}
+      }
+    }
+    if (eset.empty())
+      return;
+
+    copyEstimatesToG2O(region);
+    std::vector<g2o::VertexSE3*> fixed;
+    std::vector<MapNode*> updated;
+    g2o::VertexSE3* oldest = 0;
+    for (size_t i=0; i<region.size(); i++){
+      g2o::VertexSE3* v = node(region[i]);
+      if (depth[region[i]]>_incrementalDepth){
+	fixed.push_back(v);
+	continue;
+      }
+      updated.push_back(region[i]);
+      if (! oldest || v->id()<oldest->id())
+	oldest = v;
+    }
+    // nothing bounds the region when it holds its whole connected component,
+    // then the gauge is its oldest node
+    if (fixed.empty())
+      fixed.push_back(oldest);
+    for (size_t i=0; i<fixed.size(); i++)
+      fixed[i]->setFixed(true);
+
+    cerr << "INCREMENTAL OPT: " << updated.size() << " nodes, " << fixed.size() << " fixed, "
+	 << eset.size() << " relations" << endl;
+    _graph->initializeOptimization(eset);
+    _graph->optimize(10);
+    for (size_t i=0; i<fixed.size(); i++)
+      fixed[i]->setFixed(false);
+    copyEstimatesFromG2O(updated);
+  }
+
+
+  void MapG2OReflector::optimizeLoop(const std::list<MapNodeBinaryRelation*>& closures){
+    // the vertex ids follow the order in which the nodes were added
+    g2o::VertexSE3* first = 0;
+    std::vector<MapNode*> region;
+    std::set<MapNode*> visited;
+    for (std::list<MapNodeBinaryRelation*>::const_iterator it=closures.begin(); it!=closures.end(); it++){
+      for (size_t i=0; i<(*it)->nodes().size(); i++){
+	MapNode* n = (*it)->nodes()[i];
+	g2o::VertexSE3* v = node(n);
+	if (! v)
+	  continue;
+	if (visited.insert(n).second)
+	  region.push_back(n);
+	if (! first || v->id()<first->id())
+	  first = v;
+      }
+    }
+    if (! first)
+      return;
+
+    // breadth first visit of the accepted relations from the endpoints; the nodes
+    // older than the oldest endpoint are not expanded, and bound the loop
+    g2o::OptimizableGraph::EdgeSet eset;
+    std::vector<MapNode*> boundary;
+    for (size_t i=0; i<region.size(); i++){
+      MapNodeRelationView relations = _manager->nodeRelations(region[i]);
+      for (MapNodeRelationView::iterator it=relations.begin(); it!=relations.end(); it++){
+	MapNodeRelation* r = *it;
+	g2o::OptimizableGraph::Edge* e=relation(r);
+	if (!e || eset.count(e))
+	  continue;
+	if (_selector && ! _selector->accept(r))
+	  continue;
+	eset.insert(e);
+	for (size_t j=0; j<r->nodes().size(); j++){
+	  MapNode* m = r->nodes()[j];
+	  g2o::VertexSE3* v = node(m);
+	  if (! v || ! visited.insert(m).second)
+	    continue;
+	  if (v->id()<first->id())
+	    boundary.push_back(m);
+	  else
+	    region.push_back(m);
+	}
+      }
+    }
+    if (eset.empty())
+      return;
+
+    for (size_t i=0; i<region.size(); i++)
+      _touchedNodes.erase(region[i]);
+    copyEstimatesToG2O(region);
+    copyEstimatesToG2O(boundary);
+    std::vector<g2o::VertexSE3*> fixed;
+    for (size_t i=0; i<boundary.size(); i++)
+      fixed.push_back(node(boundary[i]));
+    // a loop starting at the first node of its component has no boundary,
+    // then the gauge is the oldest endpoint
+    if (fixed.empty())
+      fixed.push_back(first);
+    for (size_t i=0; i<fixed.size(); i++)
+      fixed[i]->setFixed(true);
+
+    cerr << "LOOP OPT: " << region.size() << " nodes, " << fixed.size() << " fixed, "
+	 << eset.size() << " relations" << endl;
+    _graph->initializeOptimization(eset);
+    _graph->optimize(10);
+    for (size_t i=0; i<fixed.size(); i++)
+      fixed[i]->setFixed(false);
+    copyEstimatesFromG2O(region);
+  }
 
   void MapG2OReflector::optimize(MapNode* gauge_, std::set<MapNodeRelation*>& relations){
-    copyEstimatesToG2O();
     g2o::VertexSE3* gauge = node(gauge_);
     if (! gauge)
       return;
 
     cerr << "optimizing" << endl;
     g2o::OptimizableGraph::EdgeSet eset;
+    std::set<MapNode*> nodeSet;
     cerr << "total number of relations: " << _manager->relations().size() << endl;
     for (std::set<MapNodeRelation*>::iterator it=relations.begin(); it!=relations.end(); it++){
       g2o::OptimizableGraph::Edge* e=relation(*it);
       if (!e)
 	continue;
       eset.insert(e);
+      for (size_t i=0; i<(*it)->nodes().size(); i++)
+	if ((*it)->nodes()[i])
+	  nodeSet.insert((*it)->nodes()[i]);
     }
+    // only the endpoints of the relations take part in the optimization
+    nodeSet.insert(gauge_);
+    std::vector<MapNode*> nodes(nodeSet.begin(), nodeSet.end());
+    copyEstimatesToG2O(nodes);
+    gauge->setFixed(true);
     
     _graph->initializeOptimization(eset);
     cerr << "LOCAL OPT: " << gauge->id() << endl;
@@ -214,7 +405,7 @@ namespace boss_map_building {
     cerr << "T0: " << t2v(vg->estimate()).transpose() << endl;
     _graph->optimize(10);
     gauge->setFixed(false);
-    copyEstimatesFromG2O();
+    copyEstimatesFromG2O(nodes);
   }
 
   g2o::SparseOptimizer * MapG2OReflector::g2oInit(){
@@ -263,16 +454,35 @@ namespace boss_map_building {
       _kfCount ++;
     }
 
+    // a closure moves the loop it closes, bounded by the nodes older than it;
+    // the periodic optimization is global, and corrects what the regions left behind;
+    // the odometry of the new key nodes is optimized incrementally, if the optimizer is so configured
     ClosureFoundMessage* msg = dynamic_cast<ClosureFoundMessage*>(s);
-    if (msg || _kfCount > _optimizeEachNKeyFrames){
-      _optimizer->optimize();
+    MapManager::ScopedLock lock(_manager);
+    if (_kfCount > _optimizeEachNKeyFrames){
+      _optimizer->optimizeGlobal();
       _kfCount = 0;
+    } else if (msg) {
+      _optimizer->optimizeLoop(msg->closureRelations);
+    } else if (km && _optimizer->incremental()) {
+      _optimizer->optimizeIncremental();
     }
   }
 
   LocalOptimizerProcessor::LocalOptimizerProcessor(int id, boss::IdContext* context):
     OptimizerProcessor(id,context){
     _previousNode  = 0;
+    _windowSize = 1;
+  }
+
+  void LocalOptimizerProcessor::serialize(boss::ObjectData& data, boss::IdContext& context){
+    OptimizerProcessor::serialize(data,context);
+    data.setInt("windowSize", _windowSize);
+  }
+
+  void LocalOptimizerProcessor::deserialize(boss::ObjectData& data, boss::IdContext& context){
+    OptimizerProcessor::deserialize(data,context);
+    data >> field("windowSize", _windowSize);
   }
 
   void LocalOptimizerProcessor::process(Serializable* s) {
@@ -284,7 +494,17 @@ namespace boss_map_building {
     NewKeyNodeMessage* km = dynamic_cast<NewKeyNodeMessage*>(s);
     if (km) {
       if (_previousNode) {
-	_optimizer->optimize(_previousNode, _lastRelations);
+	_windowNodes.push_back(_previousNode);
+	_windowRelations.push_back(_lastRelations);
+	while ((int)_windowNodes.size() > _windowSize) {
+	  _windowNodes.pop_front();
+	  _windowRelations.pop_front();
+	}
+	std::set<MapNodeRelation*> relations;
+	for (size_t i=0; i<_windowRelations.size(); i++)
+	  relations.insert(_windowRelations[i].begin(), _windowRelations[i].end());
+	MapManager::ScopedLock lock(_manager);
+	_optimizer->optimize(_windowNodes.front(), relations);
       }
       _kfCount ++;
       _previousNode  = km->keyNode;
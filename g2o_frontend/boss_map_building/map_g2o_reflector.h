@@ -1,5 +1,7 @@
 #pragma once
 
+#include <deque>
+#include <list>
 #include "g2o_frontend/boss_map/map_manager.h"
 #include "g2o_frontend/boss_map/stream_processor.h"
 #include "g2o_frontend/boss_map/map_utils.h"
@@ -20,11 +22,27 @@ namespace boss_map_building {
     void init();
     void copyEstimatesToG2O();
     void copyEstimatesFromG2O();
+    //! copies the estimates of the given nodes only; from g2o, only the ones that changed
+    void copyEstimatesToG2O(const std::vector<MapNode*>& nodes);
+    void copyEstimatesFromG2O(const std::vector<MapNode*>& nodes);
     virtual void serialize(ObjectData& data, IdContext& context);
     virtual void deserialize(ObjectData& data, IdContext& context);
    
-    g2o::SparseOptimizer * g2oInit();
+    //! a sparse optimizer with the solver and the parameters used by the reflector
+    static g2o::SparseOptimizer * g2oInit();
+    //! optimizeIncremental() if the reflector is incremental, optimizeGlobal() otherwise
     void optimize();
+    //! optimizes all the nodes over all the accepted relations
+    void optimizeGlobal();
+    //! optimizes the nodes within incrementalDepth accepted relations from the ones
+    //! touched by the relations added or removed since the last optimization;
+    //! the nodes one relation further are held fixed, the rest of the graph is not copied;
+    //! meant for the odometry, a loop closure needs optimizeLoop() to move the whole loop
+    void optimizeIncremental();
+    //! optimizes the loop closed by the relations: the nodes reachable from their endpoints
+    //! and added since the oldest endpoint; the older nodes next to them are held fixed
+    void optimizeLoop(const std::list<MapNodeBinaryRelation*>& closures);
+    //! optimizes the endpoints of the relations, holding the gauge fixed
     void optimize(MapNode* gauge, std::set<MapNodeRelation*>& relations);
     virtual void nodeAdded(MapNode* n);
     virtual void nodeRemoved(MapNode* n);
@@ -37,7 +55,16 @@ namespace boss_map_building {
 
     MapRelationSelector* selector() {return _selector;}
     void setSelector(MapRelationSelector* selector_) {_selector = selector_;}
+
+    inline bool incremental() const {return _incremental;}
+    inline void setIncremental(bool incremental_) {_incremental = incremental_;}
+    inline int incrementalDepth() const {return _incrementalDepth;}
+    inline void setIncrementalDepth(int incrementalDepth_) {_incrementalDepth = incrementalDepth_;}
+    //! nodes whose relations changed since the last global or incremental optimization
+    inline const std::set<MapNode*>& touchedNodes() const {return _touchedNodes;}
   protected:
+    void touch(MapNodeRelation* r);
+
     g2o::SparseOptimizer* _graph;
     std::map<g2o::VertexSE3*, MapNode*> _ng2m;
     std::map<MapNode*, g2o::VertexSE3*> _nm2g;
@@ -45,6 +72,9 @@ namespace boss_map_building {
     std::map<MapNodeRelation*, g2o::OptimizableGraph::Edge*> _rm2g;
     int _lastUsedId;
     MapRelationSelector* _selector;
+    bool _incremental;
+    int _incrementalDepth;
+    std::set<MapNode*> _touchedNodes;
   };
 
   class OptimizerProcessor: public StreamProcessor {
@@ -76,11 +106,22 @@ namespace boss_map_building {
   public:
     LocalOptimizerProcessor(int id=-1, boss::IdContext* context = 0);
 
+    //! number of key nodes whose relations are optimized together, the oldest key node is the gauge
+    inline int windowSize() const {return _windowSize;}
+    inline void setWindowSize(int windowSize_) {_windowSize = windowSize_;}
+
+    virtual void serialize(boss::ObjectData& data, boss::IdContext& context);
+
+    virtual void deserialize(boss::ObjectData& data, boss::IdContext& context);
+
     virtual void process(Serializable* s);
 
   protected:
     MapNode* _previousNode;
     std::set<MapNodeRelation*> _lastRelations;
+    int _windowSize;
+    std::deque<MapNode*> _windowNodes;
+    std::deque< std::set<MapNodeRelation*> > _windowRelations;
   };
 
 }
@@ -46,7 +46,7 @@ namespace boss_map {
     // scan for all edges that are of type PwnTrackerRelation that are not active and remove them from the optimization
     OptimizableGraph::EdgeSet eset;
     cerr << "total number of relations: " << manager->relations().size() << endl;
-    for (std::set<MapNodeRelation*>::iterator it=manager->relations().begin(); it!=manager->relations().end(); it++){
+    for (MapNodeRelationView::iterator it=manager->relations().begin(); it!=manager->relations().end(); it++){
       g2o::EdgeSE3* e=reflector->relation(*it);
       if (!e)
 	continue;
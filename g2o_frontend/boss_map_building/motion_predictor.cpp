@@ -0,0 +1,112 @@
+#include "motion_predictor.h"
+#include <algorithm>
+
+namespace boss_map_building {
+  using namespace std;
+  using namespace boss_map;
+
+  // variances of the translation and of the rotation of the motion, by source
+  static const double IMU_ROTATION_VARIANCE = 1e-4;
+  static const double ODOMETRY_TRANSLATION_VARIANCE = 1e-3;
+  static const double ODOMETRY_ROTATION_VARIANCE = 1e-3;
+  static const double CONSTANT_VELOCITY_TRANSLATION_VARIANCE = 1e-1;
+  static const double CONSTANT_VELOCITY_ROTATION_VARIANCE = 1e-1;
+
+  MotionPredictor::MotionPredictor(){
+    _maxIMUGap = 0.1;
+    clear();
+  }
+
+  void MotionPredictor::clear(){
+    _samples.clear();
+    _hasLastPose = false;
+    _lastTime = 0;
+    _lastPose.setIdentity();
+    _hasLastMotion = false;
+    _lastMotionDt = 0;
+    _lastMotion.setIdentity();
+  }
+
+  void MotionPredictor::addIMU(const IMUData* imu, const Eigen::Matrix3d& sensorRotation){
+    if (! imu)
+      return;
+    if (! _samples.empty() && imu->timestamp()<=_samples.back().timestamp)
+      return;
+    IMUSample sample;
+    sample.timestamp = imu->timestamp();
+    sample.angularVelocity = sensorRotation*imu->angularVelocity();
+    _samples.push_back(sample);
+  }
+
+  void MotionPredictor::discard(double t){
+    // the sample before t is kept, its velocity holds until the next one
+    while (_samples.size()>1 && _samples[1].timestamp<=t)
+      _samples.pop_front();
+  }
+
+  bool MotionPredictor::integrateIMU(Eigen::Matrix3d& R, double t0, double t1) const {
+    R.setIdentity();
+    if (_samples.empty() || t1<=t0)
+      return false;
+    if (_samples.front().timestamp>t0+_maxIMUGap || _samples.back().timestamp<t1-_maxIMUGap)
+      return false;
+    for (size_t i=0; i<_samples.size(); i++){
+      double next = i+1<_samples.size() ? _samples[i+1].timestamp : t1;
+      double a = std::max(_samples[i].timestamp, t0);
+      double b = std::min(next, t1);
+      if (b<=a)
+	continue;
+      if (next-_samples[i].timestamp>_maxIMUGap)
+	return false;
+      Eigen::Vector3d w = _samples[i].angularVelocity*(b-a);
+      double angle = w.norm();
+      if (angle>0)
+	R = R*Eigen::AngleAxisd(angle, w/angle).toRotationMatrix();
+    }
+    return true;
+  }
+
+  Eigen::Isometry3d MotionPredictor::extrapolate(double dt) const {
+    Eigen::Isometry3d motion = Eigen::Isometry3d::Identity();
+    if (! _hasLastMotion || dt<=0)
+      return motion;
+    double s = dt/_lastMotionDt;
+    Eigen::AngleAxisd aa(_lastMotion.linear());
+    motion.linear() = Eigen::AngleAxisd(aa.angle()*s, aa.axis()).toRotationMatrix();
+    motion.translation() = _lastMotion.translation()*s;
+    return motion;
+  }
+
+  bool MotionPredictor::predict(Eigen::Isometry3d& motion, Vector6d& variance,
+				double t0, double t1, const Eigen::Isometry3d* odometry) const {
+    if (odometry) {
+      motion = *odometry;
+      variance <<
+	ODOMETRY_TRANSLATION_VARIANCE, ODOMETRY_TRANSLATION_VARIANCE, ODOMETRY_TRANSLATION_VARIANCE,
+	ODOMETRY_ROTATION_VARIANCE, ODOMETRY_ROTATION_VARIANCE, ODOMETRY_ROTATION_VARIANCE;
+    } else {
+      motion = extrapolate(t1-t0);
+      variance <<
+	CONSTANT_VELOCITY_TRANSLATION_VARIANCE, CONSTANT_VELOCITY_TRANSLATION_VARIANCE, CONSTANT_VELOCITY_TRANSLATION_VARIANCE,
+	CONSTANT_VELOCITY_ROTATION_VARIANCE, CONSTANT_VELOCITY_ROTATION_VARIANCE, CONSTANT_VELOCITY_ROTATION_VARIANCE;
+    }
+    Eigen::Matrix3d R;
+    if (! integrateIMU(R, t0, t1))
+      return false;
+    motion.linear() = R;
+    variance.tail<3>().setConstant(IMU_ROTATION_VARIANCE);
+    return true;
+  }
+
+  void MotionPredictor::correct(double t, const Eigen::Isometry3d& pose){
+    if (_hasLastPose && t>_lastTime) {
+      _lastMotion = _lastPose.inverse()*pose;
+      _lastMotionDt = t-_lastTime;
+      _hasLastMotion = true;
+    }
+    _hasLastPose = true;
+    _lastTime = t;
+    _lastPose = pose;
+  }
+
+}
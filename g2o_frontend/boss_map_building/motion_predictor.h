@@ -0,0 +1,75 @@
+#pragma once
+
+#include <deque>
+#include "g2o_frontend/basemath/bm_defs.h"
+#include "g2o_frontend/boss_map/imu_sensor.h"
+#include <Eigen/Geometry>
+
+namespace boss_map_building {
+  using namespace boss_map;
+
+  /**
+     Predicts the motion of the robot between two instants, from the sources available:
+     - the rotation is integrated from the angular velocities of the IMU samples received in between,
+     - the translation (and the rotation, without IMU samples) is taken from the odometry,
+     - without any of them, the last motion is extrapolated at constant velocity.
+     Each prediction comes with the variances of its components, larger for the less reliable sources.
+     The angular velocities are brought from the frame of the IMU to the one of the robot when added.
+   */
+  class MotionPredictor {
+  public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    MotionPredictor();
+
+    //! clears the samples and the past motion
+    void clear();
+
+    //! buffers the angular velocity of an IMU sample, the samples have to come in time order
+    //! @param sensorRotation: the orientation of the IMU in the frame of the robot
+    void addIMU(const IMUData* imu, const Eigen::Matrix3d& sensorRotation = Eigen::Matrix3d::Identity());
+
+    //! drops the samples not needed to integrate from time t on
+    void discard(double t);
+
+    //! predicts the motion from t0 to t1
+    //! @param motion: the predicted motion, in the frame of the robot at t0
+    //! @param variance: the variances of the translation and of the rotation (as in t2v) of the motion
+    //! @param odometry: the odometry from t0 to t1, or 0 if not available
+    //! @returns true if the rotation was integrated from the IMU samples
+    bool predict(Eigen::Isometry3d& motion, Vector6d& variance,
+		 double t0, double t1, const Eigen::Isometry3d* odometry=0) const;
+
+    //! tells the pose of the robot at time t, once known; the motion since the previous one
+    //! is the one extrapolated at constant velocity
+    void correct(double t, const Eigen::Isometry3d& pose);
+
+    //! maximum time between the IMU samples, over which the integration is not trusted
+    inline double maxIMUGap() const {return _maxIMUGap;}
+    inline void setMaxIMUGap(double maxIMUGap_) {_maxIMUGap = maxIMUGap_;}
+
+    inline size_t numIMUSamples() const {return _samples.size();}
+
+  protected:
+    struct IMUSample {
+      double timestamp;
+      Eigen::Vector3d angularVelocity;
+    };
+
+    //! integrates the rotation from t0 to t1, fails if the samples do not cover the interval
+    bool integrateIMU(Eigen::Matrix3d& R, double t0, double t1) const;
+    //! the last motion, scaled to the interval dt
+    Eigen::Isometry3d extrapolate(double dt) const;
+
+    std::deque<IMUSample, Eigen::aligned_allocator<IMUSample> > _samples;
+    double _maxIMUGap;
+
+    bool _hasLastPose;
+    double _lastTime;
+    Eigen::Isometry3d _lastPose;
+    //! the motion between the last two corrected poses, in dt seconds
+    bool _hasLastMotion;
+    double _lastMotionDt;
+    Eigen::Isometry3d _lastMotion;
+  };
+
+}
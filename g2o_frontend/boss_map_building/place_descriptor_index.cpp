@@ -0,0 +1,128 @@
+#include "place_descriptor_index.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace boss_map_building {
+  using namespace std;
+
+  struct ScoredNodeGreater {
+    inline bool operator()(const PlaceDescriptorIndex::ScoredNode& a, const PlaceDescriptorIndex::ScoredNode& b) const {
+      return a.first > b.first;
+    }
+  };
+
+  static Eigen::VectorXf normalized(const Eigen::VectorXf& d){
+    float n = d.norm();
+    if (n>0)
+      return d/n;
+    return d;
+  }
+
+  PlaceDescriptorIndex::PlaceDescriptorIndex(MapManager* manager_, int dimension_, int id, boss::IdContext* context):
+    MapManagerActionHandler(manager_, id, context){
+    _dimension = dimension_;
+  }
+
+  void PlaceDescriptorIndex::serialize(ObjectData& data, IdContext& context){
+    MapManagerActionHandler::serialize(data,context);
+    data.setInt("dimension", _dimension);
+  }
+
+  void PlaceDescriptorIndex::deserialize(ObjectData& data, IdContext& context){
+    MapManagerActionHandler::deserialize(data,context);
+    _dimension = data.getInt("dimension");
+    _data.clear();
+    _nodes.clear();
+    _slots.clear();
+  }
+
+  void PlaceDescriptorIndex::nodeAdded(MapNode*) {}
+
+  void PlaceDescriptorIndex::nodeRemoved(MapNode* n){
+    remove(n);
+  }
+
+  void PlaceDescriptorIndex::relationAdded(MapNodeRelation*) {}
+
+  void PlaceDescriptorIndex::relationRemoved(MapNodeRelation*) {}
+
+  void PlaceDescriptorIndex::add(MapNode* n, const Eigen::VectorXf& descriptor){
+    if (! _dimension)
+      _dimension = descriptor.size();
+    if (descriptor.size()!=_dimension)
+      throw std::runtime_error("descriptor size does not match the index dimension");
+    size_t slot;
+    std::map<MapNode*, size_t>::iterator it = _slots.find(n);
+    if (it == _slots.end()) {
+      slot = _nodes.size();
+      _nodes.push_back(n);
+      _data.resize(_nodes.size()*_dimension);
+      _slots.insert(make_pair(n, slot));
+    } else
+      slot = it->second;
+    Eigen::Map<Eigen::VectorXf>(&_data[slot*_dimension], _dimension) = normalized(descriptor);
+  }
+
+  bool PlaceDescriptorIndex::remove(MapNode* n){
+    std::map<MapNode*, size_t>::iterator it = _slots.find(n);
+    if (it == _slots.end())
+      return false;
+    size_t slot = it->second;
+    size_t last = _nodes.size()-1;
+    if (slot != last) {
+      MapNode* moved = _nodes[last];
+      _nodes[slot] = moved;
+      std::copy(_data.begin()+last*_dimension, _data.begin()+(last+1)*_dimension, _data.begin()+slot*_dimension);
+      _slots[moved] = slot;
+    }
+    _nodes.pop_back();
+    _data.resize(_nodes.size()*_dimension);
+    _slots.erase(it);
+    return true;
+  }
+
+  bool PlaceDescriptorIndex::descriptor(Eigen::VectorXf& d, MapNode* n) const {
+    std::map<MapNode*, size_t>::const_iterator it = _slots.find(n);
+    if (it == _slots.end())
+      return false;
+    d = Eigen::Map<const Eigen::VectorXf>(&_data[it->second*_dimension], _dimension);
+    return true;
+  }
+
+  void PlaceDescriptorIndex::selectBest(ScoredNodeVector& results, size_t k) const {
+    if (results.size()>k) {
+      std::partial_sort(results.begin(), results.begin()+k, results.end(), ScoredNodeGreater());
+      results.resize(k);
+    } else
+      std::sort(results.begin(), results.end(), ScoredNodeGreater());
+  }
+
+  void PlaceDescriptorIndex::query(ScoredNodeVector& results, const Eigen::VectorXf& descriptor, size_t k) const {
+    results.clear();
+    if (descriptor.size()!=_dimension)
+      return;
+    Eigen::VectorXf d = normalized(descriptor);
+    results.resize(_nodes.size());
+    for (size_t i=0; i<_nodes.size(); i++)
+      results[i] = make_pair(score(d, i), _nodes[i]);
+    selectBest(results, k);
+  }
+
+  void PlaceDescriptorIndex::query(ScoredNodeVector& results, const Eigen::VectorXf& descriptor,
+				   const std::set<MapNode*>& candidates, size_t k) const {
+    results.clear();
+    if (descriptor.size()!=_dimension)
+      return;
+    Eigen::VectorXf d = normalized(descriptor);
+    results.reserve(candidates.size());
+    for (std::set<MapNode*>::const_iterator it=candidates.begin(); it!=candidates.end(); it++){
+      std::map<MapNode*, size_t>::const_iterator st = _slots.find(*it);
+      if (st == _slots.end())
+	continue;
+      results.push_back(make_pair(score(d, st->second), *it));
+    }
+    selectBest(results, k);
+  }
+
+  BOSS_REGISTER_CLASS(PlaceDescriptorIndex);
+}
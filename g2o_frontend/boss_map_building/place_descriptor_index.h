@@ -0,0 +1,64 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <vector>
+#include "g2o_frontend/boss_map/map_manager.h"
+
+namespace boss_map_building {
+  using namespace boss;
+  using namespace boss_map;
+
+  /**
+     In-memory index of compact global descriptors (one per key node), used to rank the
+     closure candidates by appearance before running the registration.
+     Descriptors are normalized when inserted, so the similarity is their dot product.
+     Storage is a flat array with one row per node, and removal swaps the last row in.
+     If it is given a manager, the descriptors of the nodes removed from the map are dropped.
+   */
+  class PlaceDescriptorIndex: public MapManagerActionHandler {
+  public:
+    typedef std::pair<float, MapNode*> ScoredNode;
+    typedef std::vector<ScoredNode> ScoredNodeVector;
+
+    PlaceDescriptorIndex(MapManager* manager_=0, int dimension_=0, int id=-1, boss::IdContext* context=0);
+    virtual void serialize(ObjectData& data, IdContext& context);
+    virtual void deserialize(ObjectData& data, IdContext& context);
+
+    virtual void nodeAdded(MapNode* n);
+    virtual void nodeRemoved(MapNode* n);
+    virtual void relationAdded(MapNodeRelation* r);
+    virtual void relationRemoved(MapNodeRelation* r);
+
+    //! length of the descriptors, if 0 it is set by the first add
+    inline int dimension() const {return _dimension;}
+    inline size_t size() const {return _nodes.size();}
+    inline bool contains(MapNode* n) const {return _slots.find(n)!=_slots.end();}
+
+    //! adds or replaces the descriptor of a node
+    void add(MapNode* n, const Eigen::VectorXf& descriptor);
+    //! removes the descriptor of a node, returns false if the node was not indexed
+    bool remove(MapNode* n);
+    //! retrieves the (normalized) descriptor of a node, returns false if the node was not indexed
+    bool descriptor(Eigen::VectorXf& d, MapNode* n) const;
+
+    //! the k indexed nodes most similar to the descriptor, sorted by decreasing similarity
+    void query(ScoredNodeVector& results, const Eigen::VectorXf& descriptor, size_t k) const;
+    //! the k nodes among the candidates most similar to the descriptor, sorted by decreasing similarity.
+    //! Candidates that are not indexed are ignored.
+    void query(ScoredNodeVector& results, const Eigen::VectorXf& descriptor,
+	       const std::set<MapNode*>& candidates, size_t k) const;
+
+  protected:
+    inline float score(const Eigen::VectorXf& d, size_t slot) const {
+      return d.dot(Eigen::Map<const Eigen::VectorXf>(&_data[slot*_dimension], _dimension));
+    }
+    void selectBest(ScoredNodeVector& results, size_t k) const;
+
+    int _dimension;
+    std::vector<float> _data;
+    std::vector<MapNode*> _nodes;
+    std::map<MapNode*, size_t> _slots;
+  };
+
+}
@@ -0,0 +1,317 @@
+#include "submap_optimizer.h"
+#include <algorithm>
+#include "map_g2o_reflector.h"
+#include "map_closer.h"
+#include "base_tracker.h"
+#include "g2o/types/slam3d/vertex_se3.h"
+#include "g2o/types/slam3d/edge_se3.h"
+
+namespace boss_map_building {
+  using namespace std;
+  using namespace boss;
+
+  // the information of a relation whose error e becomes A*e*A^-1, as when its measurement
+  // is taken through the offset A; the error is in the coordinates of g2o, the translation
+  // and the vector part of the quaternion, half the rotation vector
+  static Matrix6d informationThrough(const Matrix6d& information, const Eigen::Isometry3d& offset){
+    // the inverse of the adjoint of the offset, in those coordinates
+    Matrix6d J = Matrix6d::Zero();
+    Eigen::Matrix3d Rt = offset.linear().transpose();
+    Eigen::Matrix3d tx;
+    const Eigen::Vector3d& t = offset.translation();
+    tx <<
+      0, -t.z(), t.y(),
+      t.z(), 0, -t.x(),
+      -t.y(), t.x(), 0;
+    J.block<3,3>(0,0) = Rt;
+    J.block<3,3>(0,3) = -2*Rt*tx;
+    J.block<3,3>(3,3) = Rt;
+    return J.transpose()*information*J;
+  }
+
+  SubmapOptimizer::SubmapOptimizer(MapManager* manager_, int id, boss::IdContext* context):
+    StreamProcessor(id, context){
+    _manager = manager_;
+    _selector = 0;
+    _maxSubmapNodes = 20;
+    _maxSubmapDistance = 10;
+    _iterations = 10;
+    _kfCount = 0;
+    _optimizeEachNKeyFrames = 1000000;
+  }
+
+  void SubmapOptimizer::serialize(boss::ObjectData& data, boss::IdContext& context){
+    StreamProcessor::serialize(data,context);
+    data.setPointer("manager", _manager);
+    data.setPointer("selector", _selector);
+    data.setInt("maxSubmapNodes", _maxSubmapNodes);
+    data.setFloat("maxSubmapDistance", _maxSubmapDistance);
+    data.setInt("iterations", _iterations);
+    data.setInt("optimizeEachNKeyFrames", _optimizeEachNKeyFrames);
+  }
+
+  void SubmapOptimizer::deserialize(boss::ObjectData& data, boss::IdContext& context){
+    StreamProcessor::deserialize(data,context);
+    data.getReference("manager").bind(_manager);
+    data.getReference("selector").bind(_selector);
+    _maxSubmapNodes = data.getInt("maxSubmapNodes");
+    _maxSubmapDistance = data.getFloat("maxSubmapDistance");
+    _iterations = data.getInt("iterations");
+    _optimizeEachNKeyFrames = data.getInt("optimizeEachNKeyFrames");
+  }
+
+  MapNode* SubmapOptimizer::submapGauge(MapNode* n) const {
+    boost::unordered_map<MapNode*, int>::const_iterator it = _nodeSubmaps.find(n);
+    if (it==_nodeSubmaps.end()) {
+      it = _memberSubmaps.find(n);
+      if (it==_memberSubmaps.end())
+	return 0;
+    }
+    return _submaps[it->second].nodes[0];
+  }
+
+  void SubmapOptimizer::addKeyNode(MapNode* keyNode){
+    if (_nodeSubmaps.count(keyNode))
+      return;
+    // the node came as tracked from the previous key node
+    boost::unordered_map<MapNode*, int>::iterator member = _memberSubmaps.find(keyNode);
+    if (member!=_memberSubmaps.end()) {
+      std::vector< std::vector<MapNode*> >& members = _submaps[member->second].members;
+      for (size_t k=0; k<members.size(); k++){
+	std::vector<MapNode*>::iterator it = std::find(members[k].begin(), members[k].end(), keyNode);
+	if (it!=members[k].end())
+	  members[k].erase(it);
+      }
+      _memberSubmaps.erase(member);
+    }
+    bool startSubmap = _submaps.empty();
+    if (! startSubmap) {
+      const Submap& s = _submaps.back();
+      if (_maxSubmapNodes>0 && (int)s.nodes.size()>=_maxSubmapNodes)
+	startSubmap = true;
+      double distance = (keyNode->transform().translation()-s.nodes[0]->transform().translation()).norm();
+      if (_maxSubmapDistance>0 && distance>_maxSubmapDistance)
+	startSubmap = true;
+    }
+    if (startSubmap)
+      _submaps.push_back(Submap());
+    Submap& s = _submaps.back();
+    s.nodes.push_back(keyNode);
+    s.members.push_back(std::vector<MapNode*>());
+    s.dirty = true;
+    _nodeSubmaps[keyNode] = _submaps.size()-1;
+  }
+
+  void SubmapOptimizer::addNode(MapNode* node){
+    if (_submaps.empty() || _nodeSubmaps.count(node) || _memberSubmaps.count(node))
+      return;
+    _submaps.back().members.back().push_back(node);
+    _memberSubmaps[node] = _submaps.size()-1;
+  }
+
+  void SubmapOptimizer::touch(MapNodeRelation* r){
+    for (size_t i=0; i<r->nodes().size(); i++){
+      boost::unordered_map<MapNode*, int>::iterator it = _nodeSubmaps.find(r->nodes()[i]);
+      if (it!=_nodeSubmaps.end())
+	_submaps[it->second].dirty = true;
+    }
+  }
+
+  void SubmapOptimizer::optimize(){
+    if (! _manager || _submaps.empty())
+      return;
+    optimizeSubmaps();
+    optimizeGauges();
+  }
+
+  void SubmapOptimizer::optimizeSubmaps(){
+    // the internal relations of the changed submaps are collected here, since the
+    // manager and the selector are not meant to be used by many threads
+    std::vector<int> dirty;
+    std::vector< std::vector<MapNodeBinaryRelation*> > relations;
+    for (size_t i=0; i<_submaps.size(); i++){
+      Submap& s = _submaps[i];
+      if (! s.dirty)
+	continue;
+      s.dirty = false;
+      dirty.push_back(i);
+      relations.push_back(std::vector<MapNodeBinaryRelation*>());
+      std::vector<MapNodeBinaryRelation*>& internal = relations.back();
+      for (size_t k=0; k<s.nodes.size(); k++){
+	MapNodeRelationView nrel = _manager->nodeRelations(s.nodes[k]);
+	for (MapNodeRelationView::iterator it=nrel.begin(); it!=nrel.end(); it++){
+	  MapNodeBinaryRelation* r = dynamic_cast<MapNodeBinaryRelation*>(*it);
+	  // each relation once, from its first node
+	  if (! r || r->nodes()[0]!=s.nodes[k])
+	    continue;
+	  boost::unordered_map<MapNode*, int>::iterator other = _nodeSubmaps.find(r->nodes()[1]);
+	  if (other==_nodeSubmaps.end() || other->second!=(int)i)
+	    continue;
+	  if (_selector && ! _selector->accept(r))
+	    continue;
+	  internal.push_back(r);
+	}
+      }
+    }
+
+    // each submap in its own graph, with the gauge fixed
+    std::vector< std::vector<Eigen::Isometry3d, Eigen::aligned_allocator<Eigen::Isometry3d> > > poses(dirty.size());
+#pragma omp parallel for schedule(dynamic)
+    for (int k=0; k<(int)dirty.size(); k++){
+      const Submap& s = _submaps[dirty[k]];
+      if (relations[k].empty())
+	continue;
+      g2o::SparseOptimizer* graph = MapG2OReflector::g2oInit();
+      boost::unordered_map<MapNode*, g2o::VertexSE3*> vertices;
+      for (size_t i=0; i<s.nodes.size(); i++){
+	g2o::VertexSE3* v = new g2o::VertexSE3;
+	v->setId(i);
+	v->setEstimate(s.nodes[i]->transform());
+	v->setFixed(i==0);
+	graph->addVertex(v);
+	vertices[s.nodes[i]] = v;
+      }
+      g2o::OptimizableGraph::EdgeSet eset;
+      for (size_t i=0; i<relations[k].size(); i++){
+	MapNodeBinaryRelation* r = relations[k][i];
+	g2o::EdgeSE3* e = new g2o::EdgeSE3;
+	e->setVertex(0, vertices[r->nodes()[0]]);
+	e->setVertex(1, vertices[r->nodes()[1]]);
+	e->setMeasurement(r->transform());
+	e->setInformation(r->informationMatrix());
+	graph->addEdge(e);
+	eset.insert(e);
+      }
+      graph->initializeOptimization(eset);
+      graph->optimize(_iterations);
+      poses[k].resize(s.nodes.size());
+      for (size_t i=0; i<s.nodes.size(); i++)
+	poses[k][i] = vertices[s.nodes[i]]->estimate();
+      delete graph;
+    }
+
+    // the other nodes move with their key node
+    for (size_t k=0; k<dirty.size(); k++){
+      const Submap& s = _submaps[dirty[k]];
+      for (size_t i=1; i<poses[k].size(); i++){
+	Eigen::Isometry3d delta = poses[k][i]*s.nodes[i]->transform().inverse();
+	s.nodes[i]->setTransform(poses[k][i]);
+	const std::vector<MapNode*>& members = s.members[i];
+	for (size_t j=0; j<members.size(); j++)
+	  members[j]->setTransform(delta*members[j]->transform());
+      }
+    }
+  }
+
+  void SubmapOptimizer::optimizeGauges(){
+    // the condensed graph: a vertex for each gauge, and for each relation between the submaps
+    // S and T an edge between their gauges, measuring L_s*T_r*L_t^-1, with L the poses of
+    // the nodes in their submaps; its error is the one of the relation through L_t
+    g2o::SparseOptimizer* graph = MapG2OReflector::g2oInit();
+    std::vector<g2o::VertexSE3*> vertices(_submaps.size());
+    std::vector<Eigen::Isometry3d, Eigen::aligned_allocator<Eigen::Isometry3d> > inverseGauges(_submaps.size());
+    for (size_t i=0; i<_submaps.size(); i++){
+      const Eigen::Isometry3d& gauge = _submaps[i].nodes[0]->transform();
+      inverseGauges[i] = gauge.inverse();
+      vertices[i] = new g2o::VertexSE3;
+      vertices[i]->setId(i);
+      vertices[i]->setEstimate(gauge);
+      vertices[i]->setFixed(i==0);
+      graph->addVertex(vertices[i]);
+    }
+
+    g2o::OptimizableGraph::EdgeSet eset;
+    for (size_t i=0; i<_submaps.size(); i++){
+      const Submap& s = _submaps[i];
+      for (size_t k=0; k<s.nodes.size(); k++){
+	MapNode* n = s.nodes[k];
+	MapNodeRelationView nrel = _manager->nodeRelations(n);
+	for (MapNodeRelationView::iterator it=nrel.begin(); it!=nrel.end(); it++){
+	  MapNodeRelation* r = *it;
+	  MapNodeBinaryRelation* br = dynamic_cast<MapNodeBinaryRelation*>(r);
+	  MapNodeUnaryRelation* ur = dynamic_cast<MapNodeUnaryRelation*>(r);
+	  if (br) {
+	    if (br->nodes()[0]!=n)
+	      continue;
+	    boost::unordered_map<MapNode*, int>::iterator other = _nodeSubmaps.find(br->nodes()[1]);
+	    if (other==_nodeSubmaps.end() || other->second==(int)i)
+	      continue;
+	    if (_selector && ! _selector->accept(r))
+	      continue;
+	    int j = other->second;
+	    Eigen::Isometry3d ls = inverseGauges[i]*n->transform();
+	    Eigen::Isometry3d lt = inverseGauges[j]*br->nodes()[1]->transform();
+	    g2o::EdgeSE3* e = new g2o::EdgeSE3;
+	    e->setVertex(0, vertices[i]);
+	    e->setVertex(1, vertices[j]);
+	    e->setMeasurement(ls*br->transform()*lt.inverse());
+	    e->setInformation(informationThrough(br->informationMatrix(), lt));
+	    graph->addEdge(e);
+	    eset.insert(e);
+	  } else if (ur) {
+	    if (_selector && ! _selector->accept(r))
+	      continue;
+	    // a prior on the node is a prior on the gauge, through the pose in the submap
+	    Eigen::Isometry3d ls = inverseGauges[i]*n->transform();
+	    g2o::EdgeSE3Prior* e = new g2o::EdgeSE3Prior;
+	    e->setVertex(0, vertices[i]);
+	    e->setMeasurement(ur->transform()*ls.inverse());
+	    e->setInformation(informationThrough(ur->informationMatrix(), ls));
+	    e->setParameterId(0,0);
+	    graph->addEdge(e);
+	    eset.insert(e);
+	  }
+	}
+      }
+    }
+
+    if (! eset.empty()) {
+      cerr << "SUBMAP OPT: " << _submaps.size() << " gauges, " << eset.size() << " relations" << endl;
+      graph->initializeOptimization(eset);
+      graph->optimize(_iterations);
+      // the nodes move with their gauge
+      for (size_t i=1; i<_submaps.size(); i++){
+	Eigen::Isometry3d delta = vertices[i]->estimate()*inverseGauges[i];
+	const Submap& s = _submaps[i];
+	for (size_t k=0; k<s.nodes.size(); k++){
+	  s.nodes[k]->setTransform(delta*s.nodes[k]->transform());
+	  for (size_t j=0; j<s.members[k].size(); j++)
+	    s.members[k][j]->setTransform(delta*s.members[k][j]->transform());
+	}
+      }
+    }
+    delete graph;
+  }
+
+  void SubmapOptimizer::process(Serializable* s){
+    put(s);
+    MapNode* node = dynamic_cast<MapNode*>(s);
+    if (node)
+      addNode(node);
+    bool submapClosed = false;
+    NewKeyNodeMessage* km = dynamic_cast<NewKeyNodeMessage*>(s);
+    if (km) {
+      size_t submaps = _submaps.size();
+      addKeyNode(km->keyNode);
+      submapClosed = submaps && _submaps.size()>submaps;
+      _kfCount ++;
+    }
+    MapNodeRelation* rel = dynamic_cast<MapNodeRelation*>(s);
+    if (rel)
+      touch(rel);
+
+    ClosureFoundMessage* msg = dynamic_cast<ClosureFoundMessage*>(s);
+    if (msg) {
+      for (std::list<MapNodeBinaryRelation*>::iterator it=msg->closureRelations.begin();
+	   it!=msg->closureRelations.end(); it++)
+	touch(*it);
+    }
+    if (msg || submapClosed || _kfCount > _optimizeEachNKeyFrames){
+      optimize();
+      _kfCount = 0;
+    }
+  }
+
+  BOSS_REGISTER_CLASS(SubmapOptimizer);
+
+}
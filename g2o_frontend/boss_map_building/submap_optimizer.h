@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+#include <boost/unordered_map.hpp>
+#include "g2o_frontend/boss_map/map_manager.h"
+#include "g2o_frontend/boss_map/map_utils.h"
+#include "g2o_frontend/boss_map/stream_processor.h"
+
+namespace boss_map_building {
+  using namespace boss;
+  using namespace boss_map;
+
+  /**
+     Hierarchical optimizer that groups the key nodes into submaps (local maps).
+     A submap is started by a key node, its gauge, and collects the following key nodes
+     until it holds maxSubmapNodes of them or one is further than maxSubmapDistance from the gauge.
+     The other nodes of the stream belong to the submap of the key node they are tracked from.
+     On optimization
+     - each submap touched by new relations is optimized alone, over its internal relations
+       and with its gauge fixed; the submaps are independent and are optimized in parallel;
+     - the gauges are optimized over a condensed graph, where each relation between two submaps
+       becomes a relation between their gauges, through the local poses of its nodes;
+     - every node is moved with its gauge, keeping its pose in the submap;
+       the nodes that are not key nodes follow their key node also in the first step.
+     The cost of an update is bounded by the size of the submaps and by the number of gauges.
+   */
+  class SubmapOptimizer: public StreamProcessor {
+  public:
+    SubmapOptimizer(MapManager* manager_=0, int id=-1, boss::IdContext* context=0);
+
+    inline MapManager* manager() { return  _manager; }
+    inline void setManager(MapManager* manager_) { _manager = manager_; }
+    //! relations used in the optimization, all if not set
+    inline MapRelationSelector* selector() {return _selector;}
+    inline void setSelector(MapRelationSelector* selector_) {_selector = selector_;}
+
+    //! key nodes after which a submap is closed, unbounded if not positive
+    inline int maxSubmapNodes() const {return _maxSubmapNodes;}
+    inline void setMaxSubmapNodes(int maxSubmapNodes_) {_maxSubmapNodes = maxSubmapNodes_;}
+    //! distance from the gauge beyond which a key node starts a new submap, unbounded if not positive
+    inline float maxSubmapDistance() const {return _maxSubmapDistance;}
+    inline void setMaxSubmapDistance(float maxSubmapDistance_) {_maxSubmapDistance = maxSubmapDistance_;}
+
+    inline int submapCount() const {return _submaps.size();}
+    //! gauge of the submap of the node, key node or not, 0 if the node is not in a submap
+    MapNode* submapGauge(MapNode* n) const;
+
+    //! adds a key node to the current submap, or starts a new one with it
+    void addKeyNode(MapNode* keyNode);
+    //! adds a node tracked from the last key node to the submap of that key node
+    void addNode(MapNode* node);
+    //! optimizes the changed submaps, then the gauges
+    void optimize();
+
+    virtual void serialize(boss::ObjectData& data, boss::IdContext& context);
+    virtual void deserialize(boss::ObjectData& data, boss::IdContext& context);
+    virtual void process(Serializable* s);
+
+  protected:
+    struct Submap {
+      Submap(): dirty(false) {}
+      //! key nodes, the gauge first
+      std::vector<MapNode*> nodes;
+      //! for each key node, the other nodes tracked from it
+      std::vector< std::vector<MapNode*> > members;
+      //! set when the relations of its nodes changed since the last optimization
+      bool dirty;
+    };
+
+    void touch(MapNodeRelation* r);
+    void optimizeSubmaps();
+    void optimizeGauges();
+
+    MapManager* _manager;
+    MapRelationSelector* _selector;
+    int _maxSubmapNodes;
+    float _maxSubmapDistance;
+    int _iterations;
+    int _kfCount;
+    int _optimizeEachNKeyFrames;
+    std::vector<Submap> _submaps;
+    //! submap of each key node
+    boost::unordered_map<MapNode*, int> _nodeSubmaps;
+    //! submap of each node that is not a key node
+    boost::unordered_map<MapNode*, int> _memberSubmaps;
+  };
+
+}
@@ -20,6 +20,12 @@ namespace pwn_boss {
     save(os, Eigen::Isometry3f::Identity(), 1, true);
   }
 
+  BLOB* Cloud::clone() const {
+    Cloud* copy = new Cloud;
+    static_cast<pwn::Cloud&>(*copy) = *this;
+    return copy;
+  }
+
   
   BOSS_REGISTER_BLOB(Cloud);
 
@@ -17,6 +17,7 @@ namespace pwn_boss {
     virtual const std::string &extension();
     virtual bool read(std::istream &is);
     virtual void write(std::ostream &os);
+    virtual boss::BLOB* clone() const;
   };
 
   typedef boss::BLOBReference<Cloud> CloudBLOBReference;
@@ -61,7 +61,7 @@ namespace pwn_tracker{
 
   PwnCacheHandler::~PwnCacheHandler() {}
   void PwnCacheHandler::init(){
-    for (std::set<MapNode*>::iterator it = _manager->nodes().begin(); it!=_manager->nodes().end(); it++){
+    for (MapNodeView::iterator it = _manager->nodes().begin(); it!=_manager->nodes().end(); it++){
       nodeAdded(*it);
     }
   }
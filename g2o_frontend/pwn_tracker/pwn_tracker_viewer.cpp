@@ -99,7 +99,7 @@ namespace pwn_tracker  {
 
   void VisState::draw(){
     // draw the trajectory
-    for(std::set<MapNodeRelation*>::iterator it=manager->relations().begin(); it!=manager->relations().end(); it++){
+    for(MapNodeRelationView::iterator it=manager->relations().begin(); it!=manager->relations().end(); it++){
       PwnCloserRelation* cRel=dynamic_cast<PwnCloserRelation*>(*it);
       PwnTrackerRelation* tRel=dynamic_cast<PwnTrackerRelation*>(*it);
       if (tRel || (cRel && cRel->accepted) ) {
@@ -112,13 +112,12 @@ namespace pwn_tracker  {
     }
     if (! final){
       for (int i=0; i<(int)partitions.size(); i++){
-	std::set<MapNode*>& p=partitions[i];
 	if (i==currentPartitionIndex){
 	  glColor3f(1,0,0);
 	} else {
 	  glColor3f(0,0,1);
 	}
-	for (std::set<MapNode*>::iterator it=p.begin(); it!=p.end();it++){
+	for (MapNode* const* it=partitions.partitionBegin(i); it!=partitions.partitionEnd(i);it++){
 	  PwnTrackerFrame* f = dynamic_cast<PwnTrackerFrame*>(*it);
 	  if (f) {
 	    drawFrame(f);
@@ -127,7 +126,7 @@ namespace pwn_tracker  {
       }
     } else {
       glColor3f(1,0,0);
-      for (std::set<MapNode*>::iterator it=manager->nodes().begin(); it!=manager->nodes().end();it++){
+      for (MapNodeView::iterator it=manager->nodes().begin(); it!=manager->nodes().end();it++){
 	PwnTrackerFrame* f = dynamic_cast<PwnTrackerFrame*>(*it);
 	if (f) {
 	  drawFrame(f);
@@ -166,11 +165,7 @@ namespace pwn_tracker  {
     int nr=_closer->candidateRelations().size();
     //_visState->candidateRelations=_closer->candidateRelations();
     _visState->partitions = _closer->partitions();
-    for (size_t i =0; i<_closer->partitions().size(); i++){
-      if (&_closer->partitions()[i]==_closer->currentPartition()){
-	_visState->currentPartitionIndex = i;
-      }
-    }
+    _visState->currentPartitionIndex = _closer->currentPartitionIndex();
     if (nr) {
       cerr << "CANDIDATE RELATIONS: " << nr << endl;
     }
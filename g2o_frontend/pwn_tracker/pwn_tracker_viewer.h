@@ -22,7 +22,7 @@ namespace pwn_tracker {
     VisState(MapManager* manager);
 
     std::map<PwnTrackerFrame*,VisCloud*> cloudMap;
-    std::vector<std::set <MapNode*> > partitions;
+    MapNodePartitions partitions;
     int currentPartitionIndex;
     std::list<PwnCloserRelation*>  candidateRelations;
     bool final;
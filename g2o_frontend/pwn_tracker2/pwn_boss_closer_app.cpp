@@ -143,7 +143,7 @@ int main(int argc, char** argv) {
   }
   /*
   std::list<MapNodeRelation*> outliers;
-  for(std::set<MapNodeRelation*>::iterator it=manager->relations().begin(); it!=manager->relations().end(); it++){
+  for(MapNodeRelationView::iterator it=manager->relations().begin(); it!=manager->relations().end(); it++){
     ClosureInfo* info = dynamic_cast<ClosureInfo*>(*it);
     if (info && !info->accepted)
       outliers.push_back(*it);
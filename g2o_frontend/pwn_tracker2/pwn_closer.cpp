@@ -80,6 +80,60 @@ namespace pwn_tracker {
       put(s);
   }
 
+  void PwnCloser::indexKeyNode(MapNode* keyNode_){
+    SyncSensorDataNode* keyNode = dynamic_cast<SyncSensorDataNode*>(keyNode_);
+    if (! _placeIndex || ! keyNode || ! _enabled)
+      return;
+    PwnCloudCache::HandleType handle=_cache->get(keyNode);
+    Eigen::VectorXf descriptor;
+    computeDescriptor(descriptor, handle.get());
+    _placeIndex->add(keyNode, descriptor);
+  }
+
+  void PwnCloser::computeDescriptor(Eigen::VectorXf& descriptor, CloudWithImageSize* cloud){
+    const int azimuthBins = 8;
+    const int elevationBins = 4;
+    const int rangeBins = 8;
+    const float maxRange = 6.0f;
+    const int frequencies = azimuthBins/2+1;
+    const int normalBins = frequencies*elevationBins;
+    Eigen::MatrixXf normalHistogram = Eigen::MatrixXf::Zero(azimuthBins, elevationBins);
+    descriptor.setZero(normalBins+rangeBins);
+    for (size_t i=0; i<cloud->points().size(); i++){
+      const Normal& n = cloud->normals()[i];
+      if (n.squaredNorm()<1e-6)
+	continue;
+      float azimuth = atan2(n.y(), n.x());
+      float elevation = asin(std::max(-1.0f, std::min(1.0f, n.z())));
+      int a = std::min(azimuthBins-1, (int)((azimuth+M_PI)*azimuthBins/(2*M_PI)));
+      int e = std::min(elevationBins-1, (int)((elevation+M_PI/2)*elevationBins/M_PI));
+      normalHistogram(a, e) += 1.0f;
+      float range = cloud->points()[i].head<3>().norm();
+      int r = std::min(rangeBins-1, (int)(range*rangeBins/maxRange));
+      descriptor(normalBins+r) += 1.0f;
+    }
+    // a change of heading shifts the azimuth bins circularly: the magnitudes of their
+    // DFT do not change, so a place revisited with another heading keeps its descriptor
+    for (int e=0; e<elevationBins; e++){
+      for (int k=0; k<frequencies; k++){
+	float re = 0, im = 0;
+	for (int a=0; a<azimuthBins; a++){
+	  float phase = 2*M_PI*k*a/azimuthBins;
+	  re += normalHistogram(a, e)*cos(phase);
+	  im -= normalHistogram(a, e)*sin(phase);
+	}
+	descriptor(e*frequencies+k) = sqrt(re*re+im*im);
+      }
+    }
+    // give the same weight to the two histograms
+    float nn = descriptor.head(normalBins).norm();
+    float rn = descriptor.tail(rangeBins).norm();
+    if (nn>0)
+      descriptor.head(normalBins) /= nn;
+    if (rn>0)
+      descriptor.tail(rangeBins) /= rn;
+  }
+
   void PwnCloser::processPartition(std::list<MapNodeBinaryRelation*>& newRelations, 
 				   std::set<MapNode*>& otherPartition, 
 				   MapNode* current_){
@@ -155,11 +209,15 @@ namespace pwn_tracker {
     }
 
     PwnMatcherBase::MatcherResult result;
-    _matcher->matchClouds(result, 
-			  keyCloud, otherCloud, 
-			  keyOffset, otherOffset,
-			  otherCameraMatrix, otherCloud->imageRows, otherCloud->imageCols, 
-			  ig);
+    {
+      // the clouds are held by the handles, the tracker can use the map meanwhile
+      MapManager::ScopedUnlock unlock(_manager);
+      _matcher->matchClouds(result, 
+			    keyCloud, otherCloud, 
+			    keyOffset, otherOffset,
+			    otherCameraMatrix, otherCloud->imageRows, otherCloud->imageCols, 
+			    ig);
+    }
 
     if(result.image_nonZeros < _frameMinNonZeroThreshold ||
        result.image_outliers > _frameMaxOutliersThreshold || 
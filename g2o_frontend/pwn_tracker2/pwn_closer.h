@@ -61,6 +61,11 @@ namespace pwn_tracker {
 
     inline void setRobotConfiguration(RobotConfiguration* conf) {_robotConfiguration = conf; if (_cache) _cache->_robotConfiguration = conf;} 
   protected:
+    virtual void indexKeyNode(MapNode* keyNode);
+    //! place descriptor of a cloud: for each elevation of the normals, the DFT magnitudes of
+    //! the histogram of their azimuths, followed by a histogram of the point ranges, both in
+    //! the robot frame; it does not change with the heading of the robot
+    void computeDescriptor(Eigen::VectorXf& descriptor, CloudWithImageSize* cloud);
     virtual void processPartition(std::list<MapNodeBinaryRelation*>& newRelations, std::set<MapNode*> & otherPartition, MapNode* current_);
     PwnCloserRelation* registerNodes(SyncSensorDataNode* keyNode, SyncSensorDataNode* otherNode, const Eigen::Isometry3d& initialGuess);
 						
@@ -27,6 +27,7 @@ namespace pwn_tracker{
     cumTime = 0;
     _topic = topic_;
     _robotConfiguration = robotConfiguration_;
+    _pager = 0;
   }
 
   void PwnCloudCache::serialize(boss::ObjectData& data, boss::IdContext& context){
@@ -39,6 +40,7 @@ namespace pwn_tracker{
     data.setString("topic", _topic);
     data.setInt("minSlots", _minSlots);
     data.setInt("maxSlots", _maxSlots);
+    data.setPointer("pager", _pager);
   }
   
   void PwnCloudCache::deserialize(boss::ObjectData& data, boss::IdContext& context){
@@ -51,6 +53,9 @@ namespace pwn_tracker{
     _topic = data.getString("topic");
     _minSlots = data.getInt("minSlots");
     _maxSlots = data.getInt("maxSlots");
+    _pager = 0;
+    if (data.getField("pager"))
+      data.getReference("pager").bind(_pager);
   }
 
   void PwnCloudCache::deserializeComplete() {
@@ -58,6 +63,8 @@ namespace pwn_tracker{
   }
   
   CloudWithImageSize* PwnCloudCache::loadCloud(SyncSensorDataNode* trackerNode){
+    if (_pager)
+      _pager->pageIn(trackerNode);
     PinholeImageData* imdata = trackerNode->sensorData()->sensorData<PinholeImageData>(_topic);
     if (! imdata) {
       for(size_t i =0; i<trackerNode->sensorData()->sensorDatas.size(); i++){
@@ -94,7 +101,9 @@ namespace pwn_tracker{
     _converter->compute(*cloud, scaledDepth, offset);
     double t1 = g2o::get_time();
 
-    imdata->imageBlob().set(0);
+    // the cloud is all what is needed of the image: released if it can be read again, dropped otherwise
+    if (! imdata->imageBlob().release())
+      imdata->imageBlob().set(0);
     //delete depthBLOB;
     numCalls ++;
     cumTime += (t1-t0);
@@ -114,7 +123,7 @@ namespace pwn_tracker{
   PwnCloudCacheHandler::~PwnCloudCacheHandler() {}
   void PwnCloudCacheHandler::init(){
     cerr << "Manager: " << _manager << endl;
-    for (std::set<MapNode*>::iterator it = _manager->nodes().begin(); it!=_manager->nodes().end(); it++){
+    for (MapNodeView::iterator it = _manager->nodes().begin(); it!=_manager->nodes().end(); it++){
       nodeAdded(*it);
     }
   }
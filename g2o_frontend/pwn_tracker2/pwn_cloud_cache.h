@@ -8,6 +8,7 @@
 #include "g2o_frontend/pwn_core/depthimageconverter.h"
 #include "g2o_frontend/pwn_boss/depthimageconverter.h"
 #include "g2o_frontend/boss_map/sensor_data_node.h"
+#include "g2o_frontend/boss_map/map_node_pager.h"
 #include "g2o_frontend/boss_map_building/cache.h"
 
 namespace pwn_tracker {
@@ -46,6 +47,11 @@ namespace pwn_tracker {
     inline int scale() const {return _scale;}
     inline void setScale(int scale_)  {_scale=scale_;}
 
+    //! if set, the sensor data of the nodes are paged in through it; either way
+    //! the depth image is dropped once its cloud is computed
+    inline MapNodePager* pager() {return _pager;}
+    inline void setPager(MapNodePager* pager_) {_pager = pager_;}
+
     virtual void serialize(boss::ObjectData& data, boss::IdContext& context);
     virtual void deserialize(boss::ObjectData& data, boss::IdContext& context);
     virtual void deserializeComplete();
@@ -60,6 +66,7 @@ namespace pwn_tracker {
     DepthImageConverter* _converter;
     int _scale;
     std::string _topic;
+    MapNodePager* _pager;
     pwn_boss::DepthImageConverter* _tempConverter;
   };
 
@@ -11,6 +11,7 @@
 #include "g2o_frontend/boss_map/robot_configuration.h"
 #include "g2o_frontend/boss_map/map_manager.h"
 #include "g2o_frontend/boss_map/sensor_data_node.h"
+#include "g2o_frontend/boss_map/stream_profiler.h"
 #include "g2o_frontend/boss_map_building/map_g2o_reflector.h"
 #include "pwn_tracker.h"
 #include "pwn_cloud_cache.h"
@@ -119,6 +120,14 @@ int main(int argc, char** argv) {
       app->processEvents();
     }
   }
+  // wait for the stages running in their own threads to complete
+  group->flush();
+
+  // if the pipeline is profiled, print the final summary and complete the trace
+  pos = 0;
+  StreamProfiler* profiler = group->byType<StreamProfiler>(pos);
+  if (profiler)
+    profiler->close();
 
   // write out all what the system has done
   Serializer ser;
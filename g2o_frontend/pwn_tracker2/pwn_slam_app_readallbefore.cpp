@@ -92,11 +92,10 @@ int main(int argc, char** argv) {
     return -1;
   }
   
-  std::list<Serializable*> otherObjects;
-  while ( (o=des.readObject()) ){
-    otherObjects.push_back(o);
-    cerr << ".";
-  }
+  std::vector<Serializable*> readObjects;
+  des.readAllObjects(readObjects);
+  std::list<Serializable*> otherObjects(readObjects.begin(), readObjects.end());
+  cerr << "read " << otherObjects.size() << " objects" << endl;
 
   group->setRobotConfiguration(conf);
   QApplication* app = 0;
@@ -134,6 +133,8 @@ int main(int argc, char** argv) {
       app->processEvents();
     }
   }
+  // wait for the stages running in their own threads to complete
+  group->flush();
 
   // if we have the gui provide with a nice show
   if (! visProc)
@@ -1,5 +1,6 @@
 #include "pwn_tracker.h"
 #include "g2o_frontend/boss_map/sensor_data_node.h"
+#include "g2o/stuff/timeutil.h"
 namespace pwn_tracker{
   using namespace boss_map_building;
   using namespace boss_map;
@@ -11,6 +12,9 @@ namespace pwn_tracker{
     image_outliers = 0;
     image_inliers = 0;
     image_reprojectionDistance = 0;
+    scale = 0;
+    scaleLevels = 0;
+    matchingTime = 0;
   }
   
   void PwnTrackerRelation::serialize(ObjectData& data, IdContext& context){
@@ -20,6 +24,9 @@ namespace pwn_tracker{
     data.setInt("image_nonZeros", image_nonZeros);
     data.setInt("image_outliers", image_outliers);
     data.setFloat("image_reprojectionDistance", image_reprojectionDistance);
+    data.setInt("scale", scale);
+    data.setInt("scaleLevels", scaleLevels);
+    data.setFloat("matchingTime", matchingTime);
   }
   
   void PwnTrackerRelation::deserialize(ObjectData& data, IdContext& context){
@@ -29,6 +36,9 @@ namespace pwn_tracker{
     image_outliers = data.getInt("image_outliers");
     image_inliers = data.getInt("image_inliers");
     image_reprojectionDistance = data.getFloat("image_reprojectionDistance");
+    data >> field("scale", scale);
+    data >> field("scaleLevels", scaleLevels);
+    data >> field("matchingTime", matchingTime);
   }
 
   void PwnTrackerRelation::fromResult(PwnMatcherBase::MatcherResult& result){
@@ -60,6 +70,13 @@ namespace pwn_tracker{
     _frameMaxOutliersThreshold = 2000;
     _frameMinInliersThreshold = 500; // was 1000
     _enabled = true;
+    _localModelSize = 0;
+    _localModelKeyNode = 0;
+    _localModel = 0;
+    _minScale = 0;
+    _maxScale = 0;
+    _targetLatency = 33;
+    _scaleRefinementMargin = 0.2;
     cerr << "tracker constructed" << endl;
   }
 
@@ -74,6 +91,11 @@ namespace pwn_tracker{
     data.setInt("frameMaxOutliersThreshold", _frameMaxOutliersThreshold);
     data.setInt("frameMinInliersThreshold", _frameMinInliersThreshold);
     data.setString("topic", _topic);
+    data.setInt("localModelSize", _localModelSize);
+    data.setInt("minScale", _minScale);
+    data.setInt("maxScale", _maxScale);
+    data.setFloat("targetLatency", _targetLatency);
+    data.setFloat("scaleRefinementMargin", _scaleRefinementMargin);
   }
     
   
@@ -90,6 +112,11 @@ namespace pwn_tracker{
     _frameMaxOutliersThreshold = data.getInt("frameMaxOutliersThreshold");
     _frameMinInliersThreshold = data.getInt("frameMinInliersThreshold");
     _topic = data.getString("topic");
+    data >> field("localModelSize", _localModelSize);
+    data >> field("minScale", _minScale);
+    data >> field("maxScale", _maxScale);
+    data >> field("targetLatency", _targetLatency);
+    data >> field("scaleRefinementMargin", _scaleRefinementMargin);
     cerr << "deserialized" << endl;
    }
 
@@ -104,8 +131,55 @@ namespace pwn_tracker{
     //setScale(_matcher->scale());
   }
 
-  PwnTracker::~PwnTracker(){}
+  PwnTracker::~PwnTracker(){
+    if (_localModel)
+      delete _localModel;
+  }
+
+  void PwnTracker::reset(){
+    _localModelNodes.clear();
+    _localModelKeyNode = 0;
+    if (_localModel)
+      _localModel->clear();
+    BaseTracker::reset();
+  }
+
+  void PwnTracker::updateLocalModel(SyncSensorDataNode* keyNode){
+    if (keyNode == _localModelKeyNode)
+      return;
+    _localModelKeyNode = keyNode;
+    _localModelNodes.push_back(keyNode);
+    while ((int)_localModelNodes.size() > _localModelSize)
+      _localModelNodes.pop_front();
+    if (! _localModel)
+      _localModel = new CloudWithImageSize;
+    _localModel->clear();
+    // the model is rebuilt from the current estimates of the key nodes, 
+    // so that it follows the corrections done by the optimizer
+    Eigen::Isometry3d invKeyTransform = keyNode->transform().inverse();
+    for (std::list<SyncSensorDataNode*>::iterator it = _localModelNodes.begin(); it!=_localModelNodes.end(); it++){
+      SyncSensorDataNode* n = *it;
+      PwnCloudCache::HandleType h = _cache->get(n);
+      CloudWithImageSize* cloud = h.get();
+      Eigen::Isometry3f dt;
+      convertScalar(dt, invKeyTransform*n->transform());
+      dt.matrix().row(3) << 0,0,0,1;
+      _localModel->add(*cloud, dt);
+      if (n == keyNode) {
+	_localModel->imageRows = cloud->imageRows;
+	_localModel->imageCols = cloud->imageCols;
+      }
+    }
+  }
+
 
+  bool PwnTracker::isAcceptable(const PwnMatcherBase::MatcherResult& result, float f, float margin) const {
+    float fmin = f*(1+margin), fmax = f*(1-margin);
+    return ! (result.cloud_inliers < _minCloudInliers*fmin ||
+	      result.image_nonZeros < _frameMinNonZeroThreshold*fmin ||
+	      result.image_inliers  < _frameMinInliersThreshold*fmin ||
+	      result.image_outliers > _frameMaxOutliersThreshold*fmax );
+  }
 
   bool PwnTracker::shouldChangeKeyNode(MapNodeBinaryRelation* r_){
     PwnTrackerRelation* r=dynamic_cast<PwnTrackerRelation*>(r_);
@@ -114,18 +188,34 @@ namespace pwn_tracker{
     return true;
   }
 
-  MapNodeBinaryRelation* PwnTracker::registerNodes(MapNode* keyNode_, MapNode* otherNode_, const Eigen::Isometry3d&  initialGuess_) {
+  // restores the scale of the matcher when leaving the scope, also on exceptions
+  struct MatcherScaleGuard {
+    MatcherScaleGuard(PwnMatcherBase* matcher_): matcher(matcher_), scale(matcher_->scale()) {}
+    ~MatcherScaleGuard() {matcher->setScale(scale);}
+    PwnMatcherBase* matcher;
+    int scale;
+  };
+
+  MapNodeBinaryRelation* PwnTracker::registerNodes(MapNode* keyNode_, MapNode* otherNode_, const Eigen::Isometry3d&  initialGuess_,
+						   const MotionPrior* prior) {
     SyncSensorDataNode * keyNode = dynamic_cast<SyncSensorDataNode*>(keyNode_);
     SyncSensorDataNode * otherNode = dynamic_cast<SyncSensorDataNode*>(otherNode_);
     if (! (keyNode && otherNode))
       return 0;
     
+    // the map, the transforms of the nodes and the cache are used under the lock of the manager,
+    // the matching runs without it
+    MapManager::ScopedLock lock(_manager);
+
     // fetch the clouds from the cache
     PwnCloudCache::HandleType _keyCloudHandler = _cache->get(keyNode);
     CloudWithImageSize* keyCloud = _keyCloudHandler.get();
+    if (_localModelSize>1) {
+      updateLocalModel(keyNode);
+      keyCloud = _localModel;
+    }
     PwnCloudCache::HandleType _otherCloudHandler = _cache->get(otherNode); 
     CloudWithImageSize* otherCloud = _otherCloudHandler.get();
-    _scaledImageSize = otherCloud->imageRows*otherCloud->imageCols/(_matcher->scale()*_matcher->scale());
     Eigen::Isometry3d keyOffset_, otherOffset_;
     Eigen::Matrix3d   otherCameraMatrix_;
     Eigen::Isometry3d odomGuess;
@@ -148,13 +238,16 @@ namespace pwn_tracker{
     }
     
     _matcher->clearPriors();
-    if (keyNode->imu() && otherNode->imu()){
+    // the absolute orientation only if the imu is not already in the rotation of the prior
+    if (keyNode->imu() && otherNode->imu() && ! (prior && prior->imuRotation)){
       MapNodeUnaryRelation* imuData=otherNode->imu();
       Matrix6d info = imuData->informationMatrix()*1000;
       _matcher->addAbsolutePrior(keyNode->transform(), imuData->transform(), info);
     }
-    bool useOdom=true;
-    if (useOdom){
+    if (prior){
+      // the guess is the predicted motion, with its own uncertainty
+      _matcher->addRelativePrior(initialGuess_, prior->information);
+    } else if (_useOdometry){
       Matrix6d info = Matrix6d::Identity()*1000;
       _matcher->addRelativePrior(odomGuess, info);
     }
@@ -170,11 +263,52 @@ namespace pwn_tracker{
       return 0;
 
     PwnMatcherBase::MatcherResult result;
-    _matcher->matchClouds(result, 
-			  keyCloud, otherCloud, 
-			  keyOffset, otherOffset,
-			  otherCameraMatrix, otherCloud->imageRows, otherCloud->imageCols, 
-			  initialGuess_);
+    int referenceScale = _matcher->scale();
+    int scale = referenceScale;
+    int levels = 0;
+    double tStart = g2o::get_time();
+    bool accepted;
+    // from here on the map is not used
+    MapManager::ScopedUnlock unlock(_manager);
+    if (_maxScale > 0) {
+      // coarse to fine: the next finer level is tried if the result fails or is borderline,
+      // and the cost of the next level (4 times the pixels) still fits in the latency budget.
+      // A borderline result seeds the finer level, a failure is retried from the initial guess;
+      // the frame is rejected only if the finest level tried fails
+      MatcherScaleGuard scaleGuard(_matcher);
+      scale = _maxScale;
+      Eigen::Isometry3d guess = initialGuess_;
+      while (1) {
+	double tLevel = g2o::get_time();
+	_matcher->setScale(scale);
+	_matcher->matchClouds(result, 
+			      keyCloud, otherCloud, 
+			      keyOffset, otherOffset,
+			      otherCameraMatrix, otherCloud->imageRows, otherCloud->imageCols, 
+			      guess);
+	levels++;
+	double now = g2o::get_time();
+	float f = (float)(referenceScale*referenceScale)/(scale*scale);
+	int nextScale = scale/2;
+	bool acceptable = isAcceptable(result, f);
+	if ((acceptable && isAcceptable(result, f, _scaleRefinementMargin)) ||
+	    nextScale < 1 || nextScale < _minScale || 
+	    (now-tStart + 4*(now-tLevel))*1e3 > _targetLatency)
+	  break;
+	guess = acceptable ? result.transform : initialGuess_;
+	scale = nextScale;
+      }
+      accepted = isAcceptable(result, (float)(referenceScale*referenceScale)/(scale*scale));
+    } else {
+      _matcher->matchClouds(result, 
+			    keyCloud, otherCloud, 
+			    keyOffset, otherOffset,
+			    otherCameraMatrix, otherCloud->imageRows, otherCloud->imageCols, 
+			    initialGuess_);
+      levels = 1;
+      accepted = isAcceptable(result, 1.0f);
+    }
+    _scaledImageSize = otherCloud->imageRows*otherCloud->imageCols/(scale*scale);
     //cerr << " key:" << keyNode->seq() << " other: " << otherNode->seq();
     //cerr << " cloud inliers: " << result.cloud_inliers;
     //cerr << " image_inliers: " << result.image_inliers;
@@ -182,18 +316,16 @@ namespace pwn_tracker{
 
     //cerr << endl;
 
-
-
-    if(result.cloud_inliers < _minCloudInliers ||
-       result.image_nonZeros < _frameMinNonZeroThreshold ||
-       result.image_inliers  < _frameMinInliersThreshold ||
-       result.image_outliers > _frameMaxOutliersThreshold )
+    if (! accepted)
       return 0;
 
     PwnTrackerRelation* r=new PwnTrackerRelation(_manager);
     r->nodes()[0]=keyNode;
     r->nodes()[1]=otherNode;
     r->fromResult(result);
+    r->scale = scale;
+    r->scaleLevels = levels;
+    r->matchingTime = (g2o::get_time()-tStart)*1e3;
     Matrix6d info = Matrix6d::Identity();
     info.block<3,3>(0,0) = Eigen::Matrix3d::Identity()*10;
     info.block<3,3>(3,3) = Eigen::Matrix3d::Identity()*100;
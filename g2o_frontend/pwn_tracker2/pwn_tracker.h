@@ -24,7 +24,12 @@ namespace pwn_tracker{
     int image_outliers;
     int image_inliers;
     float image_reprojectionDistance;
-    
+    //! scale of the image used by the matcher, and number of scales tried
+    int scale;
+    int scaleLevels;
+    //! time spent in matching, in ms
+    float matchingTime;
+
   };
 
   class PwnTracker: public BaseTracker {
@@ -61,6 +66,25 @@ namespace pwn_tracker{
     inline void  setFrameMinInliersThreshold( int t)  { _frameMinInliersThreshold = t; }
      
 
+    //! number of key clouds fused in the model the frames are aligned against.
+    //! With 0 or 1 the frames are aligned against the current key cloud only
+    inline int localModelSize() const { return _localModelSize; }
+    inline void setLocalModelSize(int s) { _localModelSize = s; }
+
+    //! range of the image scales used by the matcher. If maxScale is 0 the scale of the matcher is used,
+    //! otherwise the matching starts at maxScale and the scale is halved down to minScale while
+    //! the result fails or is borderline and the time spent stays within the target latency
+    inline int minScale() const { return _minScale; }
+    inline void setMinScale(int s) { _minScale = s; }
+    inline int maxScale() const { return _maxScale; }
+    inline void setMaxScale(int s) { _maxScale = s; }
+    //! target time for matching a frame, in ms
+    inline float targetLatency() const { return _targetLatency; }
+    inline void setTargetLatency(float t) { _targetLatency = t; }
+    //! a result is borderline if it would fail the checks with the thresholds increased by this fraction
+    inline float scaleRefinementMargin() const { return _scaleRefinementMargin; }
+    inline void setScaleRefinementMargin(float m) { _scaleRefinementMargin = m; }
+
     inline bool enabled() const { return _enabled; };
     inline void setEnabled(bool e) { _enabled = e; }
 
@@ -73,15 +97,25 @@ namespace pwn_tracker{
     //virtual void init();
 
     virtual bool shouldChangeKeyNode(MapNodeBinaryRelation* r);
+    //! also drops the key clouds of the local model, not registered to the new key node
+    virtual void reset();
     virtual MapNodeBinaryRelation* registerNodes(MapNode* keyNode, 
 						 MapNode* otherNode, 
-						 const Eigen::Isometry3d& guess = Eigen::Isometry3d::Identity());
+						 const Eigen::Isometry3d& guess = Eigen::Isometry3d::Identity(),
+						 const MotionPrior* prior = 0);
 
 
     inline void setRobotConfiguration(RobotConfiguration* conf) {_robotConfiguration = conf; _cache->_robotConfiguration = conf;} 
     inline RobotConfiguration* robotConfiguration() const { return _robotConfiguration; }
     virtual ~PwnTracker();
   protected:
+    //! checks the matcher result against the thresholds, scaled by f to match the image size used.
+    //! A positive margin makes the checks stricter
+    bool isAcceptable(const PwnMatcherBase::MatcherResult& result, float f, float margin=0) const;
+    //! if keyNode is a new key node, adds it to the local model, drops the oldest key cloud
+    //! and re-expresses the model in the frame of keyNode
+    void updateLocalModel(SyncSensorDataNode* keyNode);
+
     RobotConfiguration* _robotConfiguration;
     std::string _topic;
     PwnCloudCache* _cache;
@@ -93,6 +127,14 @@ namespace pwn_tracker{
     int _frameMinInliersThreshold;
     bool _enabled;
     mutable int _scaledImageSize;
+    int _localModelSize;
+    std::list<SyncSensorDataNode*> _localModelNodes;
+    SyncSensorDataNode* _localModelKeyNode;
+    CloudWithImageSize* _localModel;
+    int _minScale;
+    int _maxScale;
+    float _targetLatency;
+    float _scaleRefinementMargin;
  };
 
 }
@@ -103,7 +103,7 @@ namespace pwn_tracker  {
 
   void VisState::draw(){
     // draw the trajectory
-    for(std::set<MapNodeRelation*>::iterator it=manager->relations().begin(); it!=manager->relations().end(); it++){
+    for(MapNodeRelationView::iterator it=manager->relations().begin(); it!=manager->relations().end(); it++){
       if (relationSelector && ! relationSelector->accept(*it))
 	  continue;
       PwnCloserRelation* cRel=dynamic_cast<PwnCloserRelation*>(*it);
@@ -124,19 +124,18 @@ namespace pwn_tracker  {
     }
     if (! final){
       for (int i=0; i<(int)partitions.size(); i++){
-	std::set<MapNode*>& p=partitions[i];
 	if (i==currentPartitionIndex){
 	  glColor3f(1,0,0);
 	} else {
 	  glColor3f(0,0,1);
 	}
-	for (std::set<MapNode*>::iterator it=p.begin(); it!=p.end();it++){
+	for (MapNode* const* it=partitions.partitionBegin(i); it!=partitions.partitionEnd(i);it++){
 	  drawFrame(*it);
 	}
       }
     } else {
       glColor3f(1,0,0);
-      for (std::set<MapNode*>::iterator it=manager->nodes().begin(); it!=manager->nodes().end();it++){
+      for (MapNodeView::iterator it=manager->nodes().begin(); it!=manager->nodes().end();it++){
 	drawFrame(*it);
       }
     }
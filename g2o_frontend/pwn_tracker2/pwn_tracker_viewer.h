@@ -24,7 +24,7 @@ namespace pwn_tracker {
     VisState(MapManager* manager);
 
     std::map<MapNode*,VisCloud*> cloudMap;
-    std::vector<std::set <MapNode*> > partitions;
+    MapNodePartitions partitions;
     int currentPartitionIndex;
     std::list<MapNodeBinaryRelation*>  candidateRelations;
     bool final;